@@ -115,6 +115,17 @@ namespace dsn
             int reply_hash = 0
             );
 
+        // sent to all members of the group, and the callback is invoked once quorum 
+        // members reply successfully (all when quorum <= 0), see dsn_rpc_call_group
+        task_ptr call_group(
+            ::dsn::rpc_address group,
+            dsn_message_t request,
+            clientlet* svc,
+            rpc_reply_handler callback,
+            int quorum = 0,
+            int reply_hash = 0
+            );
+
         //
         // for TRequest/TResponse, we assume that the following routines are defined:
         //    marshall(binary_writer& writer, const T& val); 
@@ -86,6 +86,10 @@ public:
 
     bool is_master_connected( ::dsn::rpc_address node) const;
 
+    // the master never declares this node dead before the returned time (ms) as
+    // grace > lease, so it is safe to act as a lease holder until then; 0 if not connected
+    uint64_t get_master_lease_expire_ms( ::dsn::rpc_address node) const;
+
     // ATTENTION: be very careful to set is_connected to false as
     // workers are always considered *connected* initially which is ok even when workers think master is disconnected
     // Considering workers *disconnected* initially is *dangerous* coz it may violate the invariance when workers think they are online 
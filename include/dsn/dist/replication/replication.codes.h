@@ -81,20 +81,27 @@ MAKE_EVENT_CODE(RPC_REPLICATION_WRITE_EMPTY, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_PER_REPLICA_CHECK_TIMER, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_MUTATION_PENDING_TIMER, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE(LPC_GROUP_CHECK, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_DOWNGRADE_AFTER_DRAIN, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_LEARN_STREAM_CONTINUE, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_CM_DISCONNECTED_SCATTER, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE(LPC_QUERY_NODE_CONFIGURATION_SCATTER, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE(LPC_LEARN_REMOTE_DELTA_FILES_COMPLETED, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE(LPC_CHECKPOINT_REPLICA_COMPLETED, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE(LPC_APPLY_MUTATIONS_FAILED, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE(LPC_SIM_UPDATE_PARTITION_CONFIGURATION_REPLY, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_AIO(LPC_WRITE_REPLICATION_LOG, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_AIO(LPC_LERARN_REMOTE_DISK_STATE, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE_AIO(LPC_LEARN_CHUNK_READ, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE_AIO(LPC_LEARN_CHUNK_WRITE, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE(LPC_QUERY_CONFIGURATION_ALL, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_REPLICATION_CLIENT_WRITE, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_CONFIG_PROPOSAL, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_QUERY_PN_DECREE, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_PREPARE, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE_RPC(RPC_PREPARE_STREAM, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_GROUP_CHECK, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_LEARN, TASK_PRIORITY_HIGH)
+MAKE_EVENT_CODE_RPC(RPC_LEARN_CHUNK, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_LEARN_COMPLETION_NOTIFY, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_LEARN_ADD_LEARNER, TASK_PRIORITY_HIGH)
 MAKE_EVENT_CODE_RPC(RPC_REMOVE_REPLICA, TASK_PRIORITY_COMMON)
@@ -103,6 +110,7 @@ MAKE_EVENT_CODE_RPC(RPC_REMOVE_REPLICA, TASK_PRIORITY_COMMON)
 // THREAD_POOL_LOCAL_APP
 #define CURRENT_THREAD_POOL THREAD_POOL_LOCAL_APP
 MAKE_EVENT_CODE(LPC_WRITE, TASK_PRIORITY_COMMON)
+MAKE_EVENT_CODE(LPC_APPLY_MUTATIONS, TASK_PRIORITY_COMMON)
 MAKE_EVENT_CODE_RPC(RPC_REPLICATION_CLIENT_READ, TASK_PRIORITY_COMMON)
 #undef CURRENT_THREAD_POOL
 
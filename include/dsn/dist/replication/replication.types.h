@@ -247,6 +247,36 @@ namespace dsn { namespace replication {
         ::dsn::unmarshall_rpc_args<learn_response>(&proto, val, &learn_response::read);
     };
 
+    // ---------- learn_chunk_request -------------
+    inline void marshall(::dsn::binary_writer& writer, const learn_chunk_request& val)
+    {
+        boost::shared_ptr<::dsn::binary_writer_transport> transport(new ::dsn::binary_writer_transport(writer));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::marshall_rpc_args<learn_chunk_request>(&proto, val, &learn_chunk_request::write);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ learn_chunk_request& val)
+    {
+        boost::shared_ptr<::dsn::binary_reader_transport> transport(new ::dsn::binary_reader_transport(reader));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::unmarshall_rpc_args<learn_chunk_request>(&proto, val, &learn_chunk_request::read);
+    };
+
+    // ---------- learn_chunk_response -------------
+    inline void marshall(::dsn::binary_writer& writer, const learn_chunk_response& val)
+    {
+        boost::shared_ptr<::dsn::binary_writer_transport> transport(new ::dsn::binary_writer_transport(writer));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::marshall_rpc_args<learn_chunk_response>(&proto, val, &learn_chunk_response::write);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ learn_chunk_response& val)
+    {
+        boost::shared_ptr<::dsn::binary_reader_transport> transport(new ::dsn::binary_reader_transport(reader));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::unmarshall_rpc_args<learn_chunk_response>(&proto, val, &learn_chunk_response::read);
+    };
+
     // ---------- group_check_request -------------
     inline void marshall(::dsn::binary_writer& writer, const group_check_request& val)
     {
@@ -352,6 +382,21 @@ namespace dsn { namespace replication {
         ::dsn::unmarshall_rpc_args<configuration_proposal_request>(&proto, val, &configuration_proposal_request::read);
     };
 
+    // ---------- partition_load -------------
+    inline void marshall(::dsn::binary_writer& writer, const partition_load& val)
+    {
+        boost::shared_ptr<::dsn::binary_writer_transport> transport(new ::dsn::binary_writer_transport(writer));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::marshall_rpc_args<partition_load>(&proto, val, &partition_load::write);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ partition_load& val)
+    {
+        boost::shared_ptr<::dsn::binary_reader_transport> transport(new ::dsn::binary_reader_transport(reader));
+        ::apache::thrift::protocol::TBinaryProtocol proto(transport);
+        ::dsn::unmarshall_rpc_args<partition_load>(&proto, val, &partition_load::read);
+    };
+
     // ---------- configuration_query_by_node_request -------------
     inline void marshall(::dsn::binary_writer& writer, const configuration_query_by_node_request& val)
     {
@@ -467,6 +512,7 @@ namespace dsn { namespace replication {
         ReadLastUpdate = 0,
         ReadOutdated = 1,
         ReadSnapshot = 2,
+        ReadBoundedStaleness = 3,
     };
 
     DEFINE_POD_SERIALIZATION(read_semantic_t);
@@ -818,6 +864,68 @@ namespace dsn { namespace replication {
         unmarshall(reader, val.base_local_dir);
     };
 
+    // ---------- learn_chunk_request -------------
+    struct learn_chunk_request
+    {
+        global_partition_id gpid;
+        ::dsn::rpc_address learner;
+        int64_t signature;
+        std::string base_local_dir;
+        std::string file;
+        int64_t offset;
+        int32_t size;
+    };
+
+    inline void marshall(::dsn::binary_writer& writer, const learn_chunk_request& val)
+    {
+        marshall(writer, val.gpid);
+        marshall(writer, val.learner);
+        marshall(writer, val.signature);
+        marshall(writer, val.base_local_dir);
+        marshall(writer, val.file);
+        marshall(writer, val.offset);
+        marshall(writer, val.size);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ learn_chunk_request& val)
+    {
+        unmarshall(reader, val.gpid);
+        unmarshall(reader, val.learner);
+        unmarshall(reader, val.signature);
+        unmarshall(reader, val.base_local_dir);
+        unmarshall(reader, val.file);
+        unmarshall(reader, val.offset);
+        unmarshall(reader, val.size);
+    };
+
+    // ---------- learn_chunk_response -------------
+    struct learn_chunk_response
+    {
+        ::dsn::error_code err;
+        int64_t file_size;
+        ::dsn::blob data;
+        int64_t file_mtime;
+        bool append_only;
+    };
+
+    inline void marshall(::dsn::binary_writer& writer, const learn_chunk_response& val)
+    {
+        marshall(writer, val.err);
+        marshall(writer, val.file_size);
+        marshall(writer, val.data);
+        marshall(writer, val.file_mtime);
+        marshall(writer, val.append_only);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ learn_chunk_response& val)
+    {
+        unmarshall(reader, val.err);
+        unmarshall(reader, val.file_size);
+        unmarshall(reader, val.data);
+        unmarshall(reader, val.file_mtime);
+        unmarshall(reader, val.append_only);
+    };
+
     // ---------- group_check_request -------------
     struct group_check_request
     {
@@ -984,20 +1092,59 @@ namespace dsn { namespace replication {
         unmarshall(reader, val.is_upgrade);
     };
 
+    // ---------- partition_load -------------
+    struct partition_load
+    {
+        global_partition_id gpid;
+        partition_status status;
+        double qps;
+        double write_bytes_per_second;
+        int64_t log_backlog;
+        int64_t p99_latency_us;
+    };
+
+    inline void marshall(::dsn::binary_writer& writer, const partition_load& val)
+    {
+        marshall(writer, val.gpid);
+        marshall(writer, val.status);
+        marshall(writer, val.qps);
+        marshall(writer, val.write_bytes_per_second);
+        marshall(writer, val.log_backlog);
+        marshall(writer, val.p99_latency_us);
+    };
+
+    inline void unmarshall(::dsn::binary_reader& reader, /*out*/ partition_load& val)
+    {
+        unmarshall(reader, val.gpid);
+        unmarshall(reader, val.status);
+        unmarshall(reader, val.qps);
+        unmarshall(reader, val.write_bytes_per_second);
+        unmarshall(reader, val.log_backlog);
+        unmarshall(reader, val.p99_latency_us);
+    };
+
     // ---------- configuration_query_by_node_request -------------
     struct configuration_query_by_node_request
     {
         ::dsn::rpc_address node;
+        std::vector< partition_load> loads;
     };
 
+    // loads is optional and trails the request: it is only written when not empty,
+    // and only read when present, so the format without it is kept
     inline void marshall(::dsn::binary_writer& writer, const configuration_query_by_node_request& val)
     {
         marshall(writer, val.node);
+        if (val.loads.size() > 0)
+            marshall(writer, val.loads);
     };
 
     inline void unmarshall(::dsn::binary_reader& reader, /*out*/ configuration_query_by_node_request& val)
     {
         unmarshall(reader, val.node);
+        val.loads.clear();
+        if (!reader.is_eof())
+            unmarshall(reader, val.loads);
     };
 
     // ---------- configuration_query_by_node_response -------------
@@ -48,6 +48,7 @@
 namespace dsn { namespace replication {
 
 class mutation;
+class replication_app_base_tester;
 
 class replica_log_info
 {
@@ -109,6 +110,12 @@ public:
     // Postconditions:
     // * if `wait' is true, then last_committed_decree() == last_durable_decree()
     //
+    // If the app declares async checkpoint support, flush(false) must not block
+    // reads and writes: the app captures a consistent snapshot of the state
+    // (e.g., copy-on-write, or the keys changed since last_durable_decree()),
+    // writes it in the background, and only then advances last_durable_decree().
+    // The replication framework then checkpoints without pausing the replica.
+    //
     virtual int  flush(bool wait) = 0;
     
     //
@@ -116,6 +123,18 @@ public:
     //
     virtual void on_empty_write() { _last_committed_decree++; }
 
+    //
+    // The client writes in one mutation (one or more when batched) are
+    // dispatched one by one between these two calls. The write handlers must
+    // not touch the decree: the framework advances last_committed_decree()
+    // once for the whole mutation right before on_batched_write_end().
+    // Apps which snapshot the state concurrently with the writes (e.g., for
+    // async checkpoints) should make the batch atomic to the snapshot, e.g.,
+    // by holding the state lock in between.
+    //
+    virtual void on_batched_write_begin() {}
+    virtual void on_batched_write_end() {}
+
     //
     // Helper routines to accelerate learning.
     // 
@@ -153,14 +172,25 @@ public:
     const std::string& data_dir() const { return _dir_data; }
     const std::string& learn_dir() const { return _dir_learn; }
     bool is_delta_state_learning_supported() const { return _is_delta_state_learning_supported; }
+    bool is_async_checkpoint_supported() const { return _is_async_checkpoint_supported; }
 
     //
     // set physical error (e.g., disk error) so that the app is dropped by replication later
     //
     void set_physical_error(int err) { _physical_error = err; }
     void set_delta_state_learning_supported() { _is_delta_state_learning_supported = true; }
+    void set_async_checkpoint_supported() { _is_async_checkpoint_supported = true; }
 
 protected:
+    //
+    // Write handlers registered here only change the app state and reply;
+    // the decree is owned by the framework, which advances
+    // _last_committed_decree once per mutation after all its writes are
+    // dispatched (see on_batched_write_begin). A handler advancing the decree
+    // itself triggers an assertion in write_internal. _last_committed_decree
+    // is only to be set by the app in open(), checkpoint loading and
+    // apply_learn_state().
+    //
     template<typename T, typename TRequest, typename TResponse> 
     void register_async_rpc_handler(
         dsn_task_code_t code,
@@ -182,6 +212,7 @@ private:
     // routines for replica internal usage
     friend class replica;
     friend class replica_stub;
+    friend class replication_app_base_tester;
     error_code open_internal(replica* r, bool create_new);
     error_code write_internal(mutation_ptr& mu);
     void       dispatch_rpc_call(int code, binary_reader& reader, dsn_message_t response);
@@ -195,6 +226,7 @@ private:
     std::unordered_map<int, std::function<void(binary_reader&, dsn_message_t)> > _handlers;
     int         _physical_error; // physical error (e.g., io error) indicates the app needs to be dropped
     bool        _is_delta_state_learning_supported;
+    bool        _is_async_checkpoint_supported;
     replica_log_info _info;
 
 protected:
@@ -43,10 +43,13 @@
 # include <dsn/dist/replication/replication.types.h>
 # include <dsn/dist/replication/replication_other_types.h>
 # include <dsn/dist/replication/replication.codes.h>
+# include <atomic>
 
 namespace dsn { namespace replication {
 
     DEFINE_ERR_CODE(ERR_REPLICATION_FAILURE)
+
+    class replication_app_client_tester;
     
 #pragma pack(push, 4)
     class replication_app_client_base : public virtual clientlet
@@ -204,7 +207,7 @@ namespace dsn { namespace replication {
             int timeout_milliseconds = 0,            
             int reply_hash = 0,
             read_semantic_t read_semantic = ReadOutdated,
-            decree snapshot_decree = invalid_decree // only used when ReadSnapshot
+            decree snapshot_decree = invalid_decree // only used when ReadSnapshot, or min decree for ReadBoundedStaleness
             )
         {
             
@@ -238,7 +241,7 @@ namespace dsn { namespace replication {
             int timeout_milliseconds = 0,
             int reply_hash = 0,
             read_semantic_t read_semantic = ReadOutdated,
-            decree snapshot_decree = invalid_decree // only used when ReadSnapshot
+            decree snapshot_decree = invalid_decree // only used when ReadSnapshot, or min decree for ReadBoundedStaleness
             )
         {
             
@@ -253,7 +256,7 @@ namespace dsn { namespace replication {
                 );
 
             auto rc = create_read_context(partition_index, code, msg, task, read_semantic, snapshot_decree, reply_hash);
-            ::marshall(msg *req);
+            ::marshall(msg, *req);
             call(rc);
             return std::move(task);
         }
@@ -273,7 +276,7 @@ namespace dsn { namespace replication {
             int timeout_milliseconds = 0,
             int reply_hash = 0,
             read_semantic_t read_semantic = ReadOutdated,
-            decree snapshot_decree = invalid_decree // only used when ReadSnapshot
+            decree snapshot_decree = invalid_decree // only used when ReadSnapshot, or min decree for ReadBoundedStaleness
             )
         {
             
@@ -308,7 +311,7 @@ namespace dsn { namespace replication {
             int timeout_milliseconds = 0,
             int reply_hash = 0,
             read_semantic_t read_semantic = ReadOutdated,
-            decree snapshot_decree = invalid_decree // only used when ReadSnapshot
+            decree snapshot_decree = invalid_decree // only used when ReadSnapshot, or min decree for ReadBoundedStaleness
             )
         {
             
@@ -327,7 +330,55 @@ namespace dsn { namespace replication {
             return std::move(task);
         }
 
-        // get read address policy
+        // batch calls with partition scatter-gather: the keys are grouped by
+        // get_partition_index, each group is sent to its partition as one
+        // std::vector<TKey> request and all groups go in parallel; the callback
+        // is invoked once after all groups complete, with the error code of
+        // each key (i.e., that of its group) and the values in key order.
+        // the returned tasks (one per group) can be waited on for sync calls
+        template<typename TKey, typename TValue>
+        std::vector<::dsn::task_ptr> multi_write(
+            dsn_task_code_t code,
+            const std::vector<TKey>& keys,
+            std::function<int(const TKey&)> get_partition_index,
+
+            // callback
+            std::function<void(error_code, const std::vector<error_code>&, std::vector<TValue>&)> callback,
+
+            // other specific parameters   
+            int timeout_milliseconds = 0,
+            int reply_hash = 0
+            )
+        {
+            return multi_call<TKey, TValue>(
+                false, code, keys, get_partition_index, callback,
+                timeout_milliseconds, reply_hash, ReadOutdated, invalid_decree
+                );
+        }
+
+        template<typename TKey, typename TValue>
+        std::vector<::dsn::task_ptr> multi_read(
+            dsn_task_code_t code,
+            const std::vector<TKey>& keys,
+            std::function<int(const TKey&)> get_partition_index,
+
+            // callback
+            std::function<void(error_code, const std::vector<error_code>&, std::vector<TValue>&)> callback,
+
+            // other specific parameters   
+            int timeout_milliseconds = 0,
+            int reply_hash = 0,
+            read_semantic_t read_semantic = ReadOutdated,
+            decree snapshot_decree = invalid_decree // only used when ReadSnapshot, or min decree for ReadBoundedStaleness
+            )
+        {
+            return multi_call<TKey, TValue>(
+                true, code, keys, get_partition_index, callback,
+                timeout_milliseconds, reply_hash, read_semantic, snapshot_decree
+                );
+        }
+
+        // get read address policy, by default the one with lower observed latency of two random replicas
         virtual ::dsn::rpc_address get_read_address(read_semantic_t semantic, const partition_configuration& config);
         
     public:
@@ -342,6 +393,9 @@ namespace dsn { namespace replication {
             int                   timeout_ms; // init timeout
             uint64_t              timeout_ts_us; // timeout at this timing point
             dsn_message_t         request;
+            ::dsn::rpc_address    target; // replica of the last try, for latency tracking
+            uint64_t              send_ts_us;
+            bool                  read_from_primary; // replica is too stale, fall back to primary
 
             ::dsn::service::zlock lock; // [
             dsn::task_ptr         timeout_timer; // when partition config is unknown at the first place            
@@ -363,6 +417,120 @@ namespace dsn { namespace replication {
         mutable ::dsn::service::zlock  _requests_lock;
         pending_requests               _pending_requests;
 
+    private:
+        template<typename TValue>
+        struct multi_call_context
+        {
+            std::vector<error_code> errors;
+            std::vector<TValue>     values;
+            std::atomic<int>        pending_calls;
+            std::function<void(error_code, const std::vector<error_code>&, std::vector<TValue>&)> callback;
+        };
+
+        template<typename TKey, typename TValue>
+        std::vector<::dsn::task_ptr> multi_call(
+            bool is_read,
+            dsn_task_code_t code,
+            const std::vector<TKey>& keys,
+            std::function<int(const TKey&)>& get_partition_index,
+            std::function<void(error_code, const std::vector<error_code>&, std::vector<TValue>&)>& callback,
+            int timeout_milliseconds,
+            int reply_hash,
+            read_semantic_t read_semantic,
+            decree snapshot_decree
+            )
+        {
+            typedef std::vector<TKey> request_type;
+            typedef std::vector<TValue> response_type;
+
+            // partition index => positions of its keys in the batch
+            std::map<int, std::vector<int> > groups;
+            for (int i = 0; i < static_cast<int>(keys.size()); i++)
+            {
+                groups[get_partition_index(keys[i])].push_back(i);
+            }
+
+            std::shared_ptr<multi_call_context<TValue> > mc(new multi_call_context<TValue>());
+            mc->errors.resize(keys.size(), ERR_OK);
+            mc->values.resize(keys.size());
+            mc->pending_calls = static_cast<int>(groups.size());
+            mc->callback = callback;
+
+            std::vector<::dsn::task_ptr> tasks;
+            if (groups.empty())
+            {
+                if (callback != nullptr)
+                    callback(ERR_OK, mc->errors, mc->values);
+                return tasks;
+            }
+
+            for (auto& g : groups)
+            {
+                std::shared_ptr<request_type> req(new request_type());
+                req->reserve(g.second.size());
+                for (auto& pos : g.second)
+                {
+                    req->push_back(keys[pos]);
+                }
+
+                std::vector<int> positions;
+                positions.swap(g.second);
+
+                // groups complete on different threads, but each of them only
+                // touches its own positions before the final decrement
+                std::function<void(error_code, std::shared_ptr<request_type>&, std::shared_ptr<response_type>&)> cb =
+                    [mc, positions](error_code err, std::shared_ptr<request_type>&, std::shared_ptr<response_type>& resp)
+                {
+                    if (err == ERR_OK && resp->size() != positions.size())
+                    {
+                        err = ERR_INVALID_DATA;
+                    }
+
+                    for (size_t i = 0; i < positions.size(); i++)
+                    {
+                        mc->errors[positions[i]] = err;
+                        if (err == ERR_OK)
+                        {
+                            mc->values[positions[i]] = std::move((*resp)[i]);
+                        }
+                    }
+
+                    if (--mc->pending_calls == 0 && mc->callback != nullptr)
+                    {
+                        error_code first_err = ERR_OK;
+                        for (auto& e : mc->errors)
+                        {
+                            if (e != ERR_OK)
+                            {
+                                first_err = e;
+                                break;
+                            }
+                        }
+                        mc->callback(first_err, mc->errors, mc->values);
+                    }
+                };
+
+                dsn_message_t msg = dsn_msg_create_request(
+                    is_read ? RPC_REPLICATION_CLIENT_READ : RPC_REPLICATION_CLIENT_WRITE,
+                    timeout_milliseconds, 0);
+
+                auto task = ::dsn::rpc::internal_use_only::create_rpc_call<request_type, response_type>(
+                    msg,
+                    req,
+                    cb,
+                    reply_hash
+                    );
+
+                auto rc = is_read ?
+                    create_read_context(g.first, code, msg, task, read_semantic, snapshot_decree, reply_hash) :
+                    create_write_context(g.first, code, msg, task, reply_hash);
+                ::marshall(msg, *req);
+                call(rc);
+                tasks.push_back(task);
+            }
+            return tasks;
+        }
+
     private:
         request_context* create_write_context(
             int partition_index,
@@ -391,6 +559,9 @@ namespace dsn { namespace replication {
         int                                     _app_id;
         int                                     _app_partition_count;
 
+        mutable ::dsn::service::zlock           _read_latency_lock;
+        std::unordered_map< ::dsn::rpc_address, double> _read_latency_us; // moving average per replica
+
     private:
         void call(request_context_ptr request, bool no_delay = true);
         error_code get_address(int pidx, bool is_write, /*out*/ ::dsn::rpc_address& addr, /*out*/ int& app_id, read_semantic_t semantic = read_semantic_t::ReadLastUpdate);
@@ -398,7 +569,12 @@ namespace dsn { namespace replication {
         void replica_rw_reply(error_code err, dsn_message_t request, dsn_message_t response, request_context_ptr& rc);
         void end_request(request_context_ptr& request, error_code err, dsn_message_t resp);
         void on_user_request_timeout(request_context_ptr& rc);
+        double get_read_latency_us(::dsn::rpc_address addr) const;
+        void update_read_latency_us(::dsn::rpc_address addr, uint64_t latency_us);
         void clear_all_pending_tasks();
+
+    private:
+        friend class replication_app_client_tester;
     };
 #pragma pack(pop)
 
@@ -64,6 +64,10 @@ public:
     virtual void         aio(aio_task* aio) = 0;
     virtual disk_aio*    prepare_aio_context(aio_task*) = 0;
 
+    // buffer for merging the batched writes of aio, which must stay valid until
+    // the write is completed; nullptr to use the default transient memory
+    virtual char*        prepare_write_buffer(disk_aio* aio, uint32_t size) { return nullptr; }
+
     virtual void start(io_modifer& ctx) = 0;
 
 protected:
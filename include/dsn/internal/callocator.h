@@ -95,4 +95,14 @@ namespace dsn {
         callocator(const callocator<T, a, d> &ac) throw() : std::allocator<T>(ac) { }
         ~callocator() throw() { }
     };
+
+    //
+    // allocation from the memory provider for rDSN itself and the tools
+    // (see tools_memory_factory_name in [core]), e.g., for the hot objects 
+    // such as tasks and messages
+    //
+    extern void* tools_memory_allocate(size_t sz);
+    extern void  tools_memory_deallocate(void* ptr);
+
+    typedef callocator_object<tools_memory_allocate, tools_memory_deallocate> tools_memory_object;
 }
@@ -55,7 +55,8 @@ namespace dsn
         void* read_buffer_ptr(int read_next);
         int read_buffer_capacity() const;
 
-        // afer read, see if we can compose a message
+        // afer read, see if we can compose a message; read_next is negative when
+        // the received data is malformed, and the session should be closed then
         virtual message_ex* get_message_on_receive(int read_length, /*out*/ int& read_next) = 0;
 
         // before send, prepare buffer
@@ -84,10 +85,31 @@ namespace dsn
         void create_new_buffer(int sz);
         void mark_read(int read_length);
 
+        //
+        // scatter receive mode: a large message which cannot be held by the
+        // current block is received into its own buffer, so that the remaining
+        // of the body lands in its final place directly, while the current block
+        // is still used for the following messages
+        //
+        // the part received before the message size is known is copied
+        //
+        void begin_scatter(int msg_size);
+        void end_scatter();
+        bool is_scattering() const { return _scatter_buffer.length() > 0; }
+
+        // the whole size of the message starting at data, with size bytes of it
+        // received, and -1 when it is unknown yet
+        virtual int peek_message_size(const char* data, int size, /*out*/ int& header_size) const { return -1; }
+
     protected:        
         blob            _read_buffer;
         int             _read_buffer_occupied;
         int             _buffer_block_size;
+
+        // message size >= threshold to enable scatter mode, 0 for disabled
+        int             _scatter_threshold;
+        blob            _scatter_buffer;
+        int             _scatter_buffer_occupied;
     };
 
     class dsn_message_parser : public message_parser
@@ -100,5 +122,51 @@ namespace dsn
         virtual int prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers) override;
 
         virtual int get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length) override;
+
+    protected:
+        virtual int peek_message_size(const char* data, int size, /*out*/ int& header_size) const override;
+    };
+
+    //
+    // compact header format (NET_HDR_DSN_COMPACT), with a variable length header of
+    // about 24 bytes instead of the fixed message_header.
+    //
+    // rpc names are negotiated per session: the first message of each rpc code carries
+    // the name together with the sender's numeric code, and the following ones carry
+    // the code only. the receiver resolves the name to its own local code once, so that
+    // the rpc engine dispatches received requests with an array lookup.
+    //
+    // both the send and the receive state are per session, which is fine as the
+    // messages of a session are sent and received in order.
+    //
+    class dsn_compact_message_parser : public message_parser
+    {
+    public:
+        dsn_compact_message_parser(int buffer_block_size);
+
+        virtual message_ex* get_message_on_receive(int read_length, /*out*/ int& read_next) override;
+
+        virtual int prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers) override;
+
+        virtual int get_send_buffers_count_and_total_length(message_ex* msg, /*out*/ int* total_length) override;
+
+    private:
+        // returns the header length, and only marks the name as sent when commit is true
+        int encode_header(message_ex* msg, /*out*/ char* buffer, bool commit);
+
+        // returns nullptr when the header is malformed
+        message_ex* decode_message(const blob& data, int header_length);
+
+    private:
+        // send: whether the name of the local code is sent on this session
+        std::vector<bool> _sent_names;
+
+        // receive: remote code => (local code, name)
+        struct remote_code
+        {
+            dsn_task_code_t local_code;
+            std::string     name;
+        };
+        std::vector<remote_code> _remote_codes;
     };
 }
@@ -148,10 +148,15 @@ namespace dsn {
         // to be defined
         virtual rpc_session_ptr create_client_session(::dsn::rpc_address server_addr) = 0;
 
+    private:
+        int select_client_session(const std::vector<rpc_session_ptr>& sessions, int hash) const;
+
     protected:
-        typedef std::unordered_map<::dsn::rpc_address, rpc_session_ptr> client_sessions;
+        // up to _client_session_count sessions for each server, see send_message
+        typedef std::unordered_map<::dsn::rpc_address, std::vector<rpc_session_ptr> > client_sessions;
         client_sessions               _clients;
         utils::rw_lock_nr             _clients_lock;
+        int                           _client_session_count;
 
         typedef std::unordered_map<::dsn::rpc_address, rpc_session_ptr> server_sessions;
         server_sessions               _servers;
@@ -179,6 +184,7 @@ namespace dsn {
         connection_oriented_network& net() const { return _net; }
         void send_message(message_ex* msg);
         bool cancel(message_ex* request);
+        int  pending_message_count() const { return _pending_message_count.load(); } // queued or being sent
 
     // for client session
     public:
@@ -209,9 +215,15 @@ namespace dsn {
         bool is_connected() const { return _connect_state == SS_CONNECTED; }        
         void on_send_completed(uint64_t signature = 0); // default value for nothing is sent
 
+        // append the messages queued after send(signature) is issued to the
+        // sending batch, only valid before any of the batch is written out;
+        // return whether there are new messages gathered
+        bool gather_messages_for_send();
+
     private:
-        // return whether there are messages for sending        
-        bool unlink_message_for_send();
+        // return whether there are messages for sending, and the sending
+        // batch must be empty unless more messages are being gathered
+        bool unlink_message_for_send(bool gathering = false);
         void clear(bool resend_msgs);
 
     protected:
@@ -228,6 +240,7 @@ namespace dsn {
 
     private:
         std::atomic<int>                   _reconnect_count_after_last_success;
+        std::atomic<int>                   _pending_message_count;
         rpc_client_matcher                 *_matcher; // client used only
 
         enum session_state
@@ -42,6 +42,7 @@
 # include <dsn/cpp/auto_codes.h>
 # include <dsn/cpp/address.h>
 # include <dsn/internal/link.h>
+# include <dsn/internal/callocator.h>
 
 namespace dsn 
 {
@@ -84,7 +85,8 @@ namespace dsn
             
     class message_ex : 
         public ref_counter, 
-        public extensible_object<message_ex, 4>
+        public extensible_object<message_ex, 4>,
+        public tools_memory_object
     {
     public:
         message_header         *header;
@@ -122,9 +124,14 @@ namespace dsn
         // routines for create messages
         //
         static message_ex* create_receive_message(const blob& data);
+        // the header is decoded into its own buffer by parsers with other header formats
+        static message_ex* create_receive_message(const blob& header, const blob& body);
         static message_ex* create_request(dsn_task_code_t rpc_code, int timeout_milliseconds = 0, int hash = 0);
         message_ex* create_response();
         message_ex* copy();
+        // a request sharing the sealed body buffers of this one, with a header
+        // of its own (and a new id) so that it is sent and matched separately
+        message_ex* copy_for_send(bool crc_required);
 
         //
         // routines for buffer management
@@ -144,6 +151,9 @@ namespace dsn
     private:        
         static std::atomic<uint64_t> _id;
 
+    private:
+        blob                   _header_buffer; // standalone header of a received message, if any
+
     private:
         // by msg read & write
         int                    _rw_index;
@@ -41,6 +41,7 @@
 # include <dsn/internal/task_spec.h>
 # include <dsn/internal/rpc_message.h>
 # include <dsn/internal/link.h>
+# include <dsn/internal/callocator.h>
 # include <dsn/cpp/auto_codes.h>
 # include <dsn/cpp/utils.h>
 
@@ -62,6 +63,7 @@ class service_node;
 class task_engine;
 class task_queue;
 class rpc_engine;
+class rpc_group_call;
 class disk_engine;
 class env_provider;
 class nfs_node;
@@ -96,7 +98,8 @@ extern __thread struct __tls_dsn__ tls_dsn;
 
 class task :
     public ref_counter, 
-    public extensible_object<task, 4>
+    public extensible_object<task, 4>,
+    public tools_memory_object
 {
 public:
     task(dsn_task_code_t code, int hash = 0, service_node* node = nullptr);
@@ -267,10 +270,11 @@ public:
     rpc_response_task(message_ex* request, dsn_rpc_response_handler_t cb, void* param, int hash = 0, service_node* node = nullptr);
     ~rpc_response_task();
 
-    void             enqueue(error_code err, message_ex* reply);
+    virtual void     enqueue(error_code err, message_ex* reply);
     virtual void     enqueue(); // re-enqueue after above enqueue, e.g., after delay
     message_ex*      get_request() { return _request; }
     message_ex*      get_response() { return _response; }
+    rpc_group_call*  get_group_call() { return _group_call; } // per-member results for group calls
 
     virtual void  exec()
     {
@@ -290,6 +294,7 @@ private:
     task_worker_pool *         _caller_pool;
     dsn_rpc_response_handler_t _cb;
     void*                      _param;
+    rpc_group_call*            _group_call;
 
     friend class rpc_engine;    
 };
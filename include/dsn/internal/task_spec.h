@@ -138,6 +138,7 @@ ENUM_END(grpc_mode_t)
 // define network header format for RPC
 DEFINE_CUSTOMIZED_ID_TYPE(network_header_format);
 DEFINE_CUSTOMIZED_ID(network_header_format, NET_HDR_DSN);
+DEFINE_CUSTOMIZED_ID(network_header_format, NET_HDR_DSN_COMPACT);
 
 // define network channel types for RPC
 DEFINE_CUSTOMIZED_ID_TYPE(rpc_channel)
@@ -185,9 +186,11 @@ public:
     dsn_threadpool_code_t  pool_code;
     bool                   allow_inline; // allow task executed in other thread pools or tasks
     bool                   fast_execution_in_network_thread;
+    bool                   allow_stealing; // allow task executed by other workers in a partitioned pool
     network_header_format  rpc_call_header_format;
     rpc_channel            rpc_call_channel;
     int32_t                rpc_timeout_milliseconds;
+    int32_t                rpc_call_hedge_percentile; // 0 for no hedged requests
     // ]
 
     task_rejection_handler rejection_handler;
@@ -233,9 +236,11 @@ CONFIG_BEGIN(task_spec)
     CONFIG_FLD_ID(threadpool_code2, pool_code, THREAD_POOL_DEFAULT, true, "thread pool to execute the task")
     CONFIG_FLD(bool, bool, allow_inline, false, "whether the task can be executed inlined with the caller task")
     CONFIG_FLD(bool, bool, fast_execution_in_network_thread, false, "whether the rpc task can be executed in network threads directly")
+    CONFIG_FLD(bool, bool, allow_stealing, false, "whether the task can be stolen by other workers of a partitioned pool using work stealing queues, when the ordering of tasks with the same hash does not matter")
     CONFIG_FLD_ID(network_header_format, rpc_call_header_format, NET_HDR_DSN, false, "what kind of header format for this kind of rpc calls")
     CONFIG_FLD_ID(rpc_channel, rpc_call_channel, RPC_CHANNEL_TCP, false, "what kind of network channel for this kind of rpc calls")
     CONFIG_FLD(int32_t, uint64, rpc_timeout_milliseconds, 5000, "what is the default timeout (ms) for this kind of rpc calls")    
+    CONFIG_FLD(int32_t, uint64, rpc_call_hedge_percentile, 0, "for GRPC_TO_ANY calls, resend the request to another member when there is no reply after this percentile of the recent rtts of the first member, 0 for disabled, and only for idempotent rpcs such as reads")
 CONFIG_END
 
 struct threadpool_spec
@@ -66,6 +66,7 @@ public:
     int native_tid() const { return _native_tid; }
     task_worker_pool* pool() const { return _owner_pool; }
     task_queue* queue() const { return _input_queue; }
+    bool is_running() const { return _is_running; }
     const threadpool_spec& pool_spec() const;
     static task_worker* current();
 
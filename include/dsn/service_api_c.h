@@ -235,6 +235,14 @@ typedef enum dsn_host_type_t
     HOST_TYPE_COUNT = 4    
 } dsn_host_type_t;
 
+typedef enum dsn_perf_counter_type_t
+{
+    PERF_COUNTER_TYPE_NUMBER,             // incremented or added values
+    PERF_COUNTER_TYPE_RATE,               // events per second
+    PERF_COUNTER_TYPE_NUMBER_PERCENTILES, // percentiles of the sampled values
+    PERF_COUNTER_TYPE_INVALID
+} dsn_perf_counter_type_t;
+
 typedef struct dsn_address_t
 {
     union u_t {
@@ -420,6 +428,20 @@ extern DSN_API uint32_t              dsn_crc32_concatenate(
                                         size_t   y_size
                                         );
 
+//
+// perf counters for upper apps, which are registered in the same registry
+// as rDSN's own counters and therefore visible through the same cli commands;
+// the returned handle is valid till the process exits
+//
+extern DSN_API dsn_handle_t          dsn_perf_counter_create(
+                                        const char* section, 
+                                        const char* name, 
+                                        dsn_perf_counter_type_t type
+                                        );
+extern DSN_API void                  dsn_perf_counter_increment(dsn_handle_t counter);
+extern DSN_API void                  dsn_perf_counter_add(dsn_handle_t counter, uint64_t val);
+extern DSN_API void                  dsn_perf_counter_set(dsn_handle_t counter, uint64_t val);
+
 //------------------------------------------------------------------------------
 //
 // tasking - asynchronous tasks and timers tasks executed in target thread pools
@@ -705,9 +727,32 @@ extern DSN_API void          dsn_rpc_call_one_way(
                                 dsn_message_t request
                                 );
 
+// send the request to all members of the group (see dsn_group_build), and 
+// rpc_call completes once quorum members reply successfully (all when quorum <= 0), 
+// with one of the successful replies as its response, or with the first member error
+// when the quorum cannot be reached any more; the request is serialized only once.
+// [task.%rpc_code%] grpc_mode = GRPC_TO_ALL makes dsn_rpc_call do the same with all members
+extern DSN_API void          dsn_rpc_call_group(
+                                dsn_address_t group,
+                                dsn_task_t rpc_call, 
+                                int quorum,
+                                dsn_task_tracker_t tracker DEFAULT(nullptr)
+                                );
+
 // WARNING: returned msg must be explicitly msg_release_ref
 extern DSN_API dsn_message_t dsn_rpc_get_response(dsn_task_t rpc_call);
 
+// per-member results of a group call, where the member count is 0 for other calls,
+// and ERR_IO_PENDING is returned for members which have not responded yet
+// WARNING: returned *response must be explicitly msg_release_ref when not null
+extern DSN_API int           dsn_rpc_get_group_response_count(dsn_task_t rpc_call);
+extern DSN_API dsn_error_t   dsn_rpc_get_group_response(
+                                dsn_task_t rpc_call,
+                                int index,
+                                /*out*/ dsn_address_t* member,
+                                /*out*/ dsn_message_t* response
+                                );
+
 // this is to mimic a response is received when no real rpc is called
 extern DSN_API void          dsn_rpc_enqueue_response(
                                 dsn_task_t rpc_call, 
@@ -134,6 +134,8 @@ replication_app_client_base::request_context* replication_app_client_base::creat
     rc->timeout_ms = timeout_milliseconds;
     rc->timeout_ts_us = now_us() + timeout_milliseconds * 1000;
     rc->completed = false;
+    rc->send_ts_us = 0;
+    rc->read_from_primary = false;
 
     size_t offset = dsn_msg_body_size(request);
     ::marshall(request, rc->write_header);
@@ -178,6 +180,8 @@ replication_app_client_base::request_context* replication_app_client_base::creat
     rc->timeout_ms = timeout_milliseconds;
     rc->timeout_ts_us = now_us() + timeout_milliseconds * 1000;
     rc->completed = false;
+    rc->send_ts_us = 0;
+    rc->read_from_primary = false;
 
     size_t offset = dsn_msg_body_size(request);
     ::marshall(request, rc->read_header);
@@ -249,7 +253,7 @@ void replication_app_client_base::call(request_context_ptr request, bool no_dela
         !request->is_read,
         addr,
         app_id,
-        request->read_header.semantic
+        request->read_from_primary ? read_semantic_t::ReadLastUpdate : request->read_header.semantic
         );
 
     // target node in cache
@@ -287,6 +291,8 @@ void replication_app_client_base::call(request_context_ptr request, bool no_dela
 
         {
             zauto_lock l(request->lock);
+            request->target = addr;
+            request->send_ts_us = nts;
             rpc::call(
                 addr,
                 msg,
@@ -380,6 +386,12 @@ void replication_app_client_base::replica_rw_reply(
     request_context_ptr& rc
     )
 {
+    if (rc->is_read)
+    {
+        // failed replicas are penalized with the full timeout so they are avoided for a while
+        update_read_latency_us(rc->target, err == ERR_OK ? now_us() - rc->send_ts_us : rc->timeout_ms * 1000ULL);
+    }
+
     if (err != ERR_OK)
     {
         goto Retry;
@@ -389,8 +401,19 @@ void replication_app_client_base::replica_rw_reply(
     
     if (err != ERR_OK && err != ERR_HANDLER_NOT_FOUND)
     {
+        if (rc->is_read && err == ERR_INVALID_STATE
+            && rc->read_header.semantic == read_semantic_t::ReadBoundedStaleness)
+        {
+            rc->read_from_primary = true;
+        }
         goto Retry;
     }
+    else if (err != ERR_OK)
+    {
+        // no app response is carried with the error
+        dsn_message_t nil(nullptr);
+        end_request(rc, err, nil);
+    }
     else
     {
         end_request(rc, err, response);
@@ -512,7 +535,8 @@ void replication_app_client_base::query_partition_configuration_reply(error_code
     if (semantic == read_semantic_t::ReadLastUpdate)
         return config.primary;
 
-    // readsnapshot or readoutdated, using random
+    // readsnapshot, readoutdated or readboundedstaleness, 
+    // pick the faster one of two random replicas
     else
     {
         bool has_primary = false;
@@ -525,12 +549,37 @@ void replication_app_client_base::query_partition_configuration_reply(error_code
 
         if (0 == N) return config.primary;
 
-        int r = random32(0, 1000) % N;
-        if (has_primary && r == N - 1)
-            return config.primary;
-        else
-            return config.secondaries[r];
+        auto pick = [&](int r) { return (has_primary && r == N - 1) ? config.primary : config.secondaries[r]; };
+        int r1 = random32(0, 1000) % N;
+        if (1 == N) 
+            return pick(r1);
+
+        int r2 = (r1 + 1 + random32(0, 1000) % (N - 1)) % N;
+        auto a1 = pick(r1), a2 = pick(r2);
+        return get_read_latency_us(a2) < get_read_latency_us(a1) ? a2 : a1;
     }
 }
 
+double replication_app_client_base::get_read_latency_us(::dsn::rpc_address addr) const
+{
+    zauto_lock l(_read_latency_lock);
+    auto it = _read_latency_us.find(addr);
+
+    // unknown replicas are preferred so that they are explored
+    return it != _read_latency_us.end() ? it->second : 0.0;
+}
+
+void replication_app_client_base::update_read_latency_us(::dsn::rpc_address addr, uint64_t latency_us)
+{
+    if (addr.is_invalid())
+        return;
+
+    zauto_lock l(_read_latency_lock);
+    auto it = _read_latency_us.find(addr);
+    if (it == _read_latency_us.end())
+        _read_latency_us[addr] = static_cast<double>(latency_us);
+    else
+        it->second = 0.8 * it->second + 0.2 * static_cast<double>(latency_us);
+}
+
 }} // end namespace
@@ -53,6 +53,25 @@ replication_options::replication_options()
     
     mutation_2pc_min_replica_count = 1;    
 
+    request_batch_disabled = false;
+    mutation_max_batch_count = 32;
+    mutation_max_size_mb = 15;
+    mutation_max_pending_time_ms = 20;
+
+    prepare_stream_disabled = false;
+    prepare_stream_window = 4;
+
+    apply_async_enabled = false;
+
+    lease_read_disabled = false;
+    read_max_staleness_ms = 10000;
+
+    learn_stream_disabled = false;
+    learn_stream_chunk_kb = 1024;
+    learn_stream_window = 4;
+    learn_stream_max_mb_per_second = 100;
+    learn_stream_max_retries = 5;
+
     group_check_internal_ms = 100000;
     group_check_disabled = false;
 
@@ -76,11 +95,30 @@ replication_options::replication_options()
     log_buffer_size_mb_private = 1;
     log_pending_max_ms_private = 100;
     log_file_size_mb_private = 32;
+    log_batch_write = false;
+    log_max_concurrent_writes = 2;
+    log_replay_prefetch_files = 0;
 
     log_enable_private_prepare = true;
+
+    checkpoint_interval_seconds = 300;
+    checkpoint_min_decree_gap = 10000;
     
     config_sync_interval_ms = 30000;
     config_sync_disabled = false;
+
+    lb_load_aware = true;
+    lb_weight_qps = 1.0;
+    lb_weight_write_bytes = 1.0;
+    lb_weight_log_backlog = 0.5;
+    lb_weight_latency = 0.5;
+    lb_weight_partition_count = 1.0;
+    lb_hysteresis_percentage = 20;
+    lb_migration_cooldown_ms = 60000;
+    lb_max_migrations_per_round = 1;
+    lb_primary_balance_disabled = false;
+    lb_primary_balance_max_concurrent_switches = 2;
+    lb_primary_switch_timeout_ms = 30000;
 }
 
 replication_options::~replication_options()
@@ -147,6 +185,96 @@ void replication_options::initialize()
         "minimum number of alive replicas under which write is allowed"
         );
 
+    request_batch_disabled =
+        dsn_config_get_value_bool("replication",
+        "request_batch_disabled",
+        request_batch_disabled,
+        "whether to disable batching client write requests into one mutation on primary"
+        );
+    mutation_max_batch_count =
+        (int)dsn_config_get_value_uint64("replication",
+        "mutation_max_batch_count",
+        mutation_max_batch_count,
+        "maximum number of client write requests batched into one mutation"
+        );
+    mutation_max_size_mb =
+        (int)dsn_config_get_value_uint64("replication",
+        "mutation_max_size_mb",
+        mutation_max_size_mb,
+        "a batched mutation is sent once its size (MB) reaches this"
+        );
+    mutation_max_pending_time_ms =
+        (int)dsn_config_get_value_uint64("replication",
+        "mutation_max_pending_time_ms",
+        mutation_max_pending_time_ms,
+        "maximum duration (ms) a batched mutation waits for in-flight two phase commit"
+        );
+
+    prepare_stream_disabled =
+        dsn_config_get_value_bool("replication",
+        "prepare_stream_disabled",
+        prepare_stream_disabled,
+        "whether to send one prepare rpc per mutation to secondaries instead of the prepare stream"
+        );
+    prepare_stream_window =
+        (int)dsn_config_get_value_uint64("replication",
+        "prepare_stream_window",
+        prepare_stream_window,
+        "maximum in-flight prepare stream messages to each secondary"
+        );
+
+    apply_async_enabled =
+        dsn_config_get_value_bool("replication",
+        "apply_async_enabled",
+        apply_async_enabled,
+        "whether committed mutations are applied to the app on the app pool, "
+        "so that a slow app does not block the replication protocol"
+        );
+
+    lease_read_disabled =
+        dsn_config_get_value_bool("replication",
+        "lease_read_disabled",
+        lease_read_disabled,
+        "whether to serve ReadLastUpdate on primary without checking the lease from meta server"
+        );
+    read_max_staleness_ms =
+        (int)dsn_config_get_value_uint64("replication",
+        "read_max_staleness_ms",
+        read_max_staleness_ms,
+        "secondaries serve ReadBoundedStaleness only when they have heard from primary in this period(ms)"
+        );
+
+    learn_stream_disabled =
+        dsn_config_get_value_bool("replication",
+        "learn_stream_disabled",
+        learn_stream_disabled,
+        "whether to copy learned files with nfs as a whole instead of streaming them in chunks"
+        );
+    learn_stream_chunk_kb =
+        (int)dsn_config_get_value_uint64("replication",
+        "learn_stream_chunk_kb",
+        learn_stream_chunk_kb,
+        "chunk size (KB) of each learn stream request"
+        );
+    learn_stream_window =
+        (int)dsn_config_get_value_uint64("replication",
+        "learn_stream_window",
+        learn_stream_window,
+        "maximum chunks being transferred or waiting to be written for each learner"
+        );
+    learn_stream_max_mb_per_second =
+        (int)dsn_config_get_value_uint64("replication",
+        "learn_stream_max_mb_per_second",
+        learn_stream_max_mb_per_second,
+        "bandwidth cap (MB/s) of each learner, 0 for unlimited"
+        );
+    learn_stream_max_retries =
+        (int)dsn_config_get_value_uint64("replication",
+        "learn_stream_max_retries",
+        learn_stream_max_retries,
+        "consecutive chunk transfer failures before the learning round fails"
+        );
+
     group_check_internal_ms =
         (int)dsn_config_get_value_uint64("replication",
         "group_check_internal_ms", 
@@ -253,6 +381,27 @@ void replication_options::initialize()
         log_pending_max_ms_private,
         "maximum duration (ms) the log entries reside in the buffer for batching for private log"
         );
+    log_batch_write =
+        dsn_config_get_value_bool("replication",
+        "log_batch_write",
+        log_batch_write,
+        "whether to group commit log entries adaptively, i.e., batching them "
+        "while there are in-flight log writes"
+        );
+    log_max_concurrent_writes =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_max_concurrent_writes",
+        log_max_concurrent_writes,
+        "maximum in-flight log writes per log when log_batch_write is true"
+        );
+    log_replay_prefetch_files =
+        (int)dsn_config_get_value_uint64("replication",
+        "log_replay_prefetch_files",
+        log_replay_prefetch_files,
+        "how many log files are read and decoded in parallel ahead of "
+        "the one being replayed, 0 for sequential replay; keep it 0 when "
+        "the replay runs in the pool of LPC_AIO_IMMEDIATE_CALLBACK"
+        );
 
     log_enable_private_prepare =
         dsn_config_get_value_bool("replication",
@@ -262,6 +411,21 @@ void replication_options::initialize()
         "which is used for easier learning"
         );
 
+    checkpoint_interval_seconds =
+        (int)dsn_config_get_value_uint64("replication",
+        "checkpoint_interval_seconds",
+        checkpoint_interval_seconds,
+        "every this period(seconds) the replica checks whether to checkpoint the app state"
+        );
+
+    checkpoint_min_decree_gap =
+        (int64_t)dsn_config_get_value_uint64("replication",
+        "checkpoint_min_decree_gap",
+        checkpoint_min_decree_gap,
+        "a checkpoint is taken only when the committed decree is ahead of "
+        "the durable decree by at least this many mutations"
+        );
+
     config_sync_disabled =
         dsn_config_get_value_bool("replication", 
         "config_sync_disabled",
@@ -275,6 +439,80 @@ void replication_options::initialize()
         config_sync_interval_ms,
         "every this period(ms) the replica syncs replica configuration with the meta server"
         );
+
+    lb_load_aware =
+        dsn_config_get_value_bool("replication",
+        "lb_load_aware",
+        lb_load_aware,
+        "whether the meta server balances with the replica loads reported on config sync, "
+        "or only with the partition counts"
+        );
+    lb_weight_qps =
+        dsn_config_get_value_double("replication",
+        "lb_weight_qps",
+        lb_weight_qps,
+        "weight of the qps in the node load score"
+        );
+    lb_weight_write_bytes =
+        dsn_config_get_value_double("replication",
+        "lb_weight_write_bytes",
+        lb_weight_write_bytes,
+        "weight of the written bytes per second in the node load score"
+        );
+    lb_weight_log_backlog =
+        dsn_config_get_value_double("replication",
+        "lb_weight_log_backlog",
+        lb_weight_log_backlog,
+        "weight of the committed but not durable decrees in the node load score"
+        );
+    lb_weight_latency =
+        dsn_config_get_value_double("replication",
+        "lb_weight_latency",
+        lb_weight_latency,
+        "weight of the p99 request latency in the node load score"
+        );
+    lb_weight_partition_count =
+        dsn_config_get_value_double("replication",
+        "lb_weight_partition_count",
+        lb_weight_partition_count,
+        "weight of the replica count in the node load score"
+        );
+    lb_hysteresis_percentage =
+        (int)dsn_config_get_value_uint64("replication",
+        "lb_hysteresis_percentage",
+        lb_hysteresis_percentage,
+        "a primary is migrated only when its node load exceeds the average by this percentage"
+        );
+    lb_migration_cooldown_ms =
+        (int)dsn_config_get_value_uint64("replication",
+        "lb_migration_cooldown_ms",
+        lb_migration_cooldown_ms,
+        "a partition is not migrated again within this period(ms)"
+        );
+    lb_max_migrations_per_round =
+        (int)dsn_config_get_value_uint64("replication",
+        "lb_max_migrations_per_round",
+        lb_max_migrations_per_round,
+        "maximum primary migrations issued by one load balance round"
+        );
+    lb_primary_balance_disabled =
+        dsn_config_get_value_bool("replication",
+        "lb_primary_balance_disabled",
+        lb_primary_balance_disabled,
+        "whether to disable balancing the primary count of each node on the load balance timer"
+        );
+    lb_primary_balance_max_concurrent_switches =
+        (int)dsn_config_get_value_uint64("replication",
+        "lb_primary_balance_max_concurrent_switches",
+        lb_primary_balance_max_concurrent_switches,
+        "maximum in-flight planned primary switches in the cluster for primary balancing"
+        );
+    lb_primary_switch_timeout_ms =
+        (int)dsn_config_get_value_uint64("replication",
+        "lb_primary_switch_timeout_ms",
+        lb_primary_switch_timeout_ms,
+        "a planned primary switch is given up if the downgrade is not done in this period(ms)"
+        );
         
     read_meta_servers();
 
@@ -73,6 +73,25 @@ public:
     int32_t staleness_for_commit;
     int32_t max_mutation_count_in_prepare_list;
     int32_t mutation_2pc_min_replica_count;
+
+    bool    request_batch_disabled;
+    int32_t mutation_max_batch_count;
+    int32_t mutation_max_size_mb;
+    int32_t mutation_max_pending_time_ms;
+
+    bool    prepare_stream_disabled;
+    int32_t prepare_stream_window;
+
+    bool    apply_async_enabled;
+
+    bool    lease_read_disabled;
+    int32_t read_max_staleness_ms;
+
+    bool    learn_stream_disabled;
+    int32_t learn_stream_chunk_kb;
+    int32_t learn_stream_window;
+    int32_t learn_stream_max_mb_per_second;
+    int32_t learn_stream_max_retries;
     
     bool    group_check_disabled;
     int32_t group_check_internal_ms;
@@ -90,16 +109,35 @@ public:
 
     bool    log_enable_private_prepare;
 
+    int32_t checkpoint_interval_seconds;
+    int64_t checkpoint_min_decree_gap;
+
     int32_t log_file_size_mb;
     int32_t log_batch_buffer_MB;
     int32_t log_pending_max_ms;
     int32_t log_file_size_mb_private;
     int32_t log_buffer_size_mb_private;
     int32_t log_pending_max_ms_private;
+    bool    log_batch_write;
+    int32_t log_max_concurrent_writes;
+    int32_t log_replay_prefetch_files;
 
     int32_t config_sync_interval_ms;
     bool    config_sync_disabled;
 
+    bool    lb_load_aware;
+    double  lb_weight_qps;
+    double  lb_weight_write_bytes;
+    double  lb_weight_log_backlog;
+    double  lb_weight_latency;
+    double  lb_weight_partition_count;
+    int32_t lb_hysteresis_percentage;
+    int32_t lb_migration_cooldown_ms;
+    int32_t lb_max_migrations_per_round;
+    bool    lb_primary_balance_disabled;
+    int32_t lb_primary_balance_max_concurrent_switches;
+    int32_t lb_primary_switch_timeout_ms;
+
 public:
     replication_options();
     void initialize();
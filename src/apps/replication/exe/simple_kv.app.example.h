@@ -109,6 +109,37 @@ public:
                 }
             }
         }
+
+        {
+            std::vector< ::dsn::replication::application::kv_pair> prs(3);
+            std::vector< std::string> keys;
+            for (size_t i = 0; i < prs.size(); i++)
+            {
+                prs[i].key = "multi.key." + std::to_string(i);
+                prs[i].value = value + "." + std::to_string(i);
+                keys.push_back(prs[i].key);
+            }
+
+            std::vector< int32_t> resp;
+            std::vector< ::dsn::error_code> errors;
+            auto err = _simple_kv_client->multi_write(prs, resp, errors);
+            std::cout << "call RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE end, multiwrite " << prs.size() << " keys, err = " << err.to_string() << std::endl;
+
+            std::vector< std::string> vs;
+            auto err2 = _simple_kv_client->multi_read(keys, vs, errors);
+            std::cout << "call RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ end, multiread " << keys.size() << " keys, err = " << err2.to_string() << std::endl;
+
+            if (err == ERR_OK && err2 == ERR_OK)
+            {
+                if (1 == SKV_PARTITION_COUNT)
+                {
+                    for (size_t i = 0; i < prs.size(); i++)
+                    {
+                        dassert(vs[i] == prs[i].value, "data is inconsistent!");
+                    }
+                }
+            }
+        }
     }
 
 private:
@@ -324,6 +324,136 @@ public:
         }
     }
     
+
+    // ---------- call RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ ------------
+    // - synchronous 
+    ::dsn::error_code multi_read(
+        const std::vector< std::string>& keys, 
+        /*out*/ std::vector< std::string>& resp, 
+        /*out*/ std::vector< ::dsn::error_code>& errors, 
+        int timeout_milliseconds = 0
+        )
+    {
+        ::dsn::error_code err;
+        auto tasks = ::dsn::replication::replication_app_client_base::multi_read<std::string, std::string>(
+            RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ,
+            keys,
+            [this](const std::string& key) { return get_partition_index(key); },
+            [&](::dsn::error_code e, const std::vector< ::dsn::error_code>& errs, std::vector< std::string>& values)
+            {
+                err = e;
+                errors = errs;
+                resp.swap(values);
+            },
+            timeout_milliseconds,
+            0,
+            read_semantic_t::ReadLastUpdate
+            );
+        for (auto& t : tasks)
+        {
+            t->wait();
+        }
+        return err;
+    }
+    
+    // - asynchronous with on-stack std::vector< std::string> and std::vector< std::string> 
+    std::vector< ::dsn::task_ptr> begin_multi_read(
+        const std::vector< std::string>& keys,         
+        void* context = nullptr,
+        int timeout_milliseconds = 0, 
+        int reply_hash = 0
+        )
+    {
+        return ::dsn::replication::replication_app_client_base::multi_read<std::string, std::string>(
+            RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ, 
+            keys,
+            [this](const std::string& key) { return get_partition_index(key); },
+            [this, context](::dsn::error_code err, const std::vector< ::dsn::error_code>& errors, std::vector< std::string>& resp)
+            {
+                end_multi_read(err, errors, resp, context);
+            },
+            timeout_milliseconds,
+            reply_hash
+            );
+    }
+
+    virtual void end_multi_read(
+        ::dsn::error_code err, 
+        const std::vector< ::dsn::error_code>& errors,
+        const std::vector< std::string>& resp,
+        void* context)
+    {
+        if (err != ::dsn::ERR_OK) std::cout << "reply RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ err : " << err.to_string() << std::endl;
+        else
+        {
+            std::cout << "reply RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ ok" << std::endl;
+        }
+    }
+    
+
+    // ---------- call RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE ------------
+    // - synchronous 
+    ::dsn::error_code multi_write(
+        const std::vector< ::dsn::replication::application::kv_pair>& prs, 
+        /*out*/ std::vector< int32_t>& resp, 
+        /*out*/ std::vector< ::dsn::error_code>& errors, 
+        int timeout_milliseconds = 0
+        )
+    {
+        ::dsn::error_code err;
+        auto tasks = ::dsn::replication::replication_app_client_base::multi_write< ::dsn::replication::application::kv_pair, int32_t>(
+            RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE,
+            prs,
+            [this](const ::dsn::replication::application::kv_pair& pr) { return get_partition_index(pr); },
+            [&](::dsn::error_code e, const std::vector< ::dsn::error_code>& errs, std::vector< int32_t>& values)
+            {
+                err = e;
+                errors = errs;
+                resp.swap(values);
+            },
+            timeout_milliseconds
+            );
+        for (auto& t : tasks)
+        {
+            t->wait();
+        }
+        return err;
+    }
+    
+    // - asynchronous with on-stack std::vector< ::dsn::replication::application::kv_pair> and std::vector< int32_t> 
+    std::vector< ::dsn::task_ptr> begin_multi_write(
+        const std::vector< ::dsn::replication::application::kv_pair>& prs,         
+        void* context = nullptr,
+        int timeout_milliseconds = 0, 
+        int reply_hash = 0
+        )
+    {
+        return ::dsn::replication::replication_app_client_base::multi_write< ::dsn::replication::application::kv_pair, int32_t>(
+            RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE, 
+            prs,
+            [this](const ::dsn::replication::application::kv_pair& pr) { return get_partition_index(pr); },
+            [this, context](::dsn::error_code err, const std::vector< ::dsn::error_code>& errors, std::vector< int32_t>& resp)
+            {
+                end_multi_write(err, errors, resp, context);
+            },
+            timeout_milliseconds,
+            reply_hash
+            );
+    }
+
+    virtual void end_multi_write(
+        ::dsn::error_code err, 
+        const std::vector< ::dsn::error_code>& errors,
+        const std::vector< int32_t>& resp,
+        void* context)
+    {
+        if (err != ::dsn::ERR_OK) std::cout << "reply RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE err : " << err.to_string() << std::endl;
+        else
+        {
+            std::cout << "reply RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE ok" << std::endl;
+        }
+    }
+    
 };
 
 } } } 
\ No newline at end of file
@@ -50,6 +50,16 @@ namespace dsn {
                     const char* app_name)
                     : simple_kv_client(meta_servers, app_name)
                 {
+                    _key_space = dsn_config_get_value_uint64("apps.client.perf.test",
+                        "perf_test_key_space",
+                        10000000,
+                        "keys used by the perf test are key.[0, perf_test_key_space), which is kept small for reads to hit"
+                        );
+                    _read_percentage = (int)dsn_config_get_value_uint64("apps.client.perf.test",
+                        "perf_test_read_percentage",
+                        90,
+                        "percentage of reads in the mixed read/write test"
+                        );
                 }
 
                 void start_test()
@@ -78,6 +88,15 @@ namespace dsn {
                     load_suite_config(s);
                     suits.push_back(s);
 
+                    // reads and writes on the same partitions at the same time, where
+                    // the reads are served by the app pool in parallel with the writes
+                    s.name = "simple_kv.read_write";
+                    s.config_section = "task.RPC_SIMPLE_KV_SIMPLE_KV_READ";
+                    s.send_one = [this](int payload_bytes){this->send_one_read_write(payload_bytes); };
+                    s.cases.clear();
+                    load_suite_config(s);
+                    suits.push_back(s);
+
                     start(suits);
                 }
 
@@ -94,7 +113,7 @@ namespace dsn {
                 void send_one_read(int payload_bytes)
                 {
                     void* ctx = prepare_send_one();
-                    auto rs = random64(0, 10000000);
+                    auto rs = random64(0, _key_space - 1);
                     std::stringstream ss;
                     ss << "key." << rs;
 
@@ -113,7 +132,7 @@ namespace dsn {
                 void send_one_write(int payload_bytes)
                 {
                     void* ctx = prepare_send_one();
-                    auto rs = random64(0, 10000000);
+                    auto rs = random64(0, _key_space - 1);
                     std::stringstream ss;
                     ss << "key." << rs;
 
@@ -132,10 +151,18 @@ namespace dsn {
                     end_send_one(context, err);
                 }
 
+                void send_one_read_write(int payload_bytes)
+                {
+                    if ((int)dsn_random32(0, 99) < _read_percentage)
+                        send_one_read(payload_bytes);
+                    else
+                        send_one_write(payload_bytes);
+                }
+
                 void send_one_append(int payload_bytes)
                 {
                     void* ctx = prepare_send_one();
-                    auto rs = random64(0, 10000000);
+                    auto rs = random64(0, _key_space - 1);
                     std::stringstream ss;
                     ss << "key." << rs;
 
@@ -153,6 +180,10 @@ namespace dsn {
                 {
                     end_send_one(context, err);
                 }
+
+            private:
+                uint64_t _key_space;
+                int      _read_percentage;
             };
         }
     }
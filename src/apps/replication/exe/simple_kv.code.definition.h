@@ -42,6 +42,8 @@ namespace dsn { namespace replication { namespace application {
     DEFINE_TASK_CODE_RPC(RPC_SIMPLE_KV_SIMPLE_KV_READ, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
     DEFINE_TASK_CODE_RPC(RPC_SIMPLE_KV_SIMPLE_KV_WRITE, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
     DEFINE_TASK_CODE_RPC(RPC_SIMPLE_KV_SIMPLE_KV_APPEND, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
+    DEFINE_TASK_CODE_RPC(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
+    DEFINE_TASK_CODE_RPC(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
     // test timer task code
     DEFINE_TASK_CODE(LPC_SIMPLE_KV_TEST_TIMER, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
 } } } 
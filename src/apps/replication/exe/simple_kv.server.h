@@ -77,6 +77,20 @@ protected:
         int32_t resp;
         reply(resp);
     }
+    // RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ 
+    virtual void on_multi_read(const std::vector< std::string>& keys, ::dsn::rpc_replier<std::vector< std::string>>& reply)
+    {
+        std::cout << "... exec RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ ... (not implemented) " << std::endl;
+        std::vector< std::string> resp;
+        reply(resp);
+    }
+    // RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE 
+    virtual void on_multi_write(const std::vector< ::dsn::replication::application::kv_pair>& prs, ::dsn::rpc_replier<std::vector< int32_t>>& reply)
+    {
+        std::cout << "... exec RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE ... (not implemented) " << std::endl;
+        std::vector< int32_t> resp;
+        reply(resp);
+    }
     
 public:
     void open_service()
@@ -84,6 +98,8 @@ public:
         this->register_async_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_READ, "read", &simple_kv_service::on_read);
         this->register_async_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_WRITE, "write", &simple_kv_service::on_write);
         this->register_async_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_APPEND, "append", &simple_kv_service::on_append);
+        this->register_async_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ, "multi_read", &simple_kv_service::on_multi_read);
+        this->register_async_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE, "multi_write", &simple_kv_service::on_multi_write);
     }
 
     void close_service()
@@ -91,6 +107,8 @@ public:
         this->unregister_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_READ);
         this->unregister_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_WRITE);
         this->unregister_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_APPEND);
+        this->unregister_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_READ);
+        this->unregister_rpc_handler(RPC_SIMPLE_KV_SIMPLE_KV_MULTI_WRITE);
     }
 };
 
@@ -47,39 +47,91 @@ using namespace ::dsn::service;
 namespace dsn {
     namespace replication {
         namespace application {
+
+            DEFINE_TASK_CODE(LPC_SIMPLE_KV_CHECKPOINT, TASK_PRIORITY_COMMON, THREAD_POOL_REPLICATION_LONG)
+
+            // delta checkpoints are compacted into a full one when there are too many
+            // of them, or when they are larger in total than the full checkpoint
+            static const size_t max_delta_checkpoint_count = 10;
             
             simple_kv_service_impl::simple_kv_service_impl(replica* replica)
-                : simple_kv_service(replica), _lock(true)
+                : simple_kv_service(replica), _lock(true), _checkpoint_lock(true)
             {
                 _test_file_learning = false;
+                _checkpointing = false;
+                reset_checkpoint_state();
                 //set_delta_state_learning_supported();
+                set_async_checkpoint_supported();
+            }
+
+            simple_kv_service_impl::store_shard& simple_kv_service_impl::get_shard(const std::string& key)
+            {
+                return _shards[std::hash<std::string>()(key) % store_shard_count];
+            }
+
+            void simple_kv_service_impl::reset_store(/*inout*/ simple_kv& kvs)
+            {
+                for (auto& shard : _shards)
+                {
+                    zauto_write_lock l(shard.lock);
+                    shard.kvs.clear();
+                    shard.changed_keys.clear();
+                }
+
+                for (auto& kv : kvs)
+                {
+                    auto& shard = get_shard(kv.first);
+                    zauto_write_lock l(shard.lock);
+                    shard.kvs[kv.first].swap(kv.second);
+                }
+                kvs.clear();
+            }
+
+            uint64_t simple_kv_service_impl::store_size() const
+            {
+                uint64_t count = 0;
+                for (auto& shard : _shards)
+                {
+                    count += static_cast<uint64_t>(shard.kvs.size());
+                }
+                return count;
             }
 
             // RPC_SIMPLE_KV_READ
             void simple_kv_service_impl::on_read(const std::string& key, ::dsn::rpc_replier<std::string>& reply)
             {
-                zauto_lock l(_lock);
-                
-                auto it = _store.find(key);
-                if (it == _store.end())
+                auto& shard = get_shard(key);
+                std::string value;
+                bool found = false;
                 {
-                    reply("");
+                    zauto_read_lock l(shard.lock);
+                    auto it = shard.kvs.find(key);
+                    if (it != shard.kvs.end())
+                    {
+                        value = it->second;
+                        found = true;
+                    }
                 }
-                else
+
+                if (found)
                 {
-                    dinfo("read %s, decree = %lld\n", it->second.c_str(), last_committed_decree());
-                    reply(it->second);
+                    dinfo("read %s, decree = %lld\n", value.c_str(), last_committed_decree());
                 }
+                reply(value);
             }
 
             // RPC_SIMPLE_KV_WRITE
             void simple_kv_service_impl::on_write(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply)
             {
                 zauto_lock l(_lock);
-                _store[pr.key] = pr.value;
-                ++_last_committed_decree;
+                {
+                    auto& shard = get_shard(pr.key);
+                    zauto_write_lock sl(shard.lock);
+                    shard.kvs[pr.key] = pr.value;
+                    shard.changed_keys.insert(pr.key);
+                }
 
-                dinfo("write %s, decree = %lld\n", pr.key.c_str(), last_committed_decree());
+                dinfo("write %s, decree = %lld\n", pr.key.c_str(), last_committed_decree() + 1);
                 reply(0);
             }
 
@@ -87,20 +139,61 @@ namespace dsn {
             void simple_kv_service_impl::on_append(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply)
             {
                 zauto_lock l(_lock);
-                auto it = _store.find(pr.key);
-                if (it != _store.end())
-                    it->second.append(pr.value);
-                else
-                    _store[pr.key] = pr.value;
-                ++_last_committed_decree;
+                {
+                    auto& shard = get_shard(pr.key);
+                    zauto_write_lock sl(shard.lock);
+                    auto it = shard.kvs.find(pr.key);
+                    if (it != shard.kvs.end())
+                        it->second.append(pr.value);
+                    else
+                        shard.kvs[pr.key] = pr.value;
+                    shard.changed_keys.insert(pr.key);
+                }
 
-                dinfo("append %s, decree = %lld\n", pr.key.c_str(), last_committed_decree());
+                dinfo("append %s, decree = %lld\n", pr.key.c_str(), last_committed_decree() + 1);
                 reply(0);
             }
+
+            // RPC_SIMPLE_KV_MULTI_READ
+            void simple_kv_service_impl::on_multi_read(const std::vector<std::string>& keys, ::dsn::rpc_replier<std::vector<std::string>>& reply)
+            {
+                std::vector<std::string> values(keys.size());
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    auto& shard = get_shard(keys[i]);
+                    zauto_read_lock l(shard.lock);
+                    auto it = shard.kvs.find(keys[i]);
+                    if (it != shard.kvs.end())
+                    {
+                        values[i] = it->second;
+                    }
+                }
+
+                dinfo("multi read %d keys, decree = %lld\n", static_cast<int>(keys.size()), last_committed_decree());
+                reply(values);
+            }
+
+            // RPC_SIMPLE_KV_MULTI_WRITE
+            void simple_kv_service_impl::on_multi_write(const std::vector<kv_pair>& prs, ::dsn::rpc_replier<std::vector<int32_t>>& reply)
+            {
+                // all pairs are applied as a single decree
+                zauto_lock l(_lock);
+                for (auto& pr : prs)
+                {
+                    auto& shard = get_shard(pr.key);
+                    zauto_write_lock sl(shard.lock);
+                    shard.kvs[pr.key] = pr.value;
+                    shard.changed_keys.insert(pr.key);
+                }
+
+                dinfo("multi write %d keys, decree = %lld\n", static_cast<int>(prs.size()), last_committed_decree() + 1);
+                reply(std::vector<int32_t>(prs.size(), 0));
+            }
             
             int simple_kv_service_impl::open(bool create_new)
             {
                 zauto_lock l(_lock);
+                reset_checkpoint_state();
                 if (create_new)
                 {
 					auto& dir = data_dir();
@@ -116,7 +209,15 @@ namespace dsn {
 
             int simple_kv_service_impl::close(bool clear_state)
             {
+                if (_checkpoint_task != nullptr)
+                {
+                    _checkpoint_task->cancel(true);
+                    _checkpoint_task = nullptr;
+                }
+
+                zauto_lock cl(_checkpoint_lock);
                 zauto_lock l(_lock);
+                _checkpointing = false;
                 if (clear_state)
                 {
 					if (!dsn::utils::filesystem::remove_path(data_dir()))
@@ -127,16 +228,34 @@ namespace dsn {
                 return 0;
             }
 
+            void simple_kv_service_impl::reset_checkpoint_state()
+            {
+                for (auto& shard : _shards)
+                {
+                    zauto_write_lock l(shard.lock);
+                    shard.changed_keys.clear();
+                }
+                _full_checkpoint_required = false;
+                _full_checkpoint_decree = 0;
+                _full_checkpoint_bytes = 0;
+                _delta_checkpoints.clear();
+                _delta_checkpoint_bytes = 0;
+            }
+
             // checkpoint related
             void simple_kv_service_impl::recover()
             {
                 zauto_lock l(_lock);
 
-                _store.clear();
+                reset_checkpoint_state();
 
                 decree maxVersion = 0;
                 std::string name;
 
+                // base decree => (decree, path)
+                std::map<decree, std::pair<decree, std::string> > deltas;
+                std::vector<std::string> obsoletes;
+
 				std::vector<std::string> sub_list;
 				auto& path = data_dir();
 				if (!dsn::utils::filesystem::get_subfiles(path, sub_list, false))
@@ -146,6 +265,35 @@ namespace dsn {
 				for (auto& fpath : sub_list)
                 {
 					auto&& s = dsn::utils::filesystem::get_file_name(fpath);
+
+                    // interrupted checkpoint writes
+                    if (s.substr(0, strlen("tmp.")) == std::string("tmp."))
+                    {
+                        obsoletes.push_back(data_dir() + "/" + s);
+                        continue;
+                    }
+
+                    if (s.substr(0, strlen("delta.")) == std::string("delta."))
+                    {
+                        long long base, version;
+                        if (2 == sscanf(s.c_str(), "delta.%lld.%lld", &base, &version))
+                        {
+                            auto& d = deltas[static_cast<decree>(base)];
+                            if (static_cast<decree>(version) > d.first)
+                            {
+                                if (d.first > 0)
+                                    obsoletes.push_back(d.second);
+                                d.first = static_cast<decree>(version);
+                                d.second = data_dir() + "/" + s;
+                            }
+                            else
+                            {
+                                obsoletes.push_back(data_dir() + "/" + s);
+                            }
+                        }
+                        continue;
+                    }
+
                     if (s.substr(0, strlen("checkpoint.")) != std::string("checkpoint."))
                         continue;
 
@@ -158,27 +306,66 @@ namespace dsn {
                 }
 				sub_list.clear();
 
+                simple_kv kvs;
                 if (maxVersion > 0)
                 {
-                    recover(name, maxVersion);
+                    if (!read_checkpoint(name, kvs))
+                    {
+                        dassert(false, "invalid checkpoint %s", name.c_str());
+                    }
+
+                    int64_t sz = 0;
+                    dsn::utils::filesystem::file_size(name, sz);
+                    _full_checkpoint_decree = maxVersion;
+                    _full_checkpoint_bytes = static_cast<uint64_t>(sz);
+                }
+
+                // replay the delta chain on top of the full checkpoint
+                decree durable = maxVersion;
+                for (auto it = deltas.find(durable); it != deltas.end(); it = deltas.find(durable))
+                {
+                    if (!read_checkpoint(it->second.second, kvs))
+                    {
+                        dassert(false, "invalid checkpoint %s", it->second.second.c_str());
+                    }
+
+                    int64_t sz = 0;
+                    dsn::utils::filesystem::file_size(it->second.second, sz);
+                    _delta_checkpoints.push_back(it->second.second);
+                    _delta_checkpoint_bytes += static_cast<uint64_t>(sz);
+
+                    durable = it->second.first;
+                    deltas.erase(it);
+                }
+
+                reset_store(kvs);
+                _last_durable_decree = _last_committed_decree = durable;
+
+                // deltas off the chain, e.g., those based on a state which is
+                // replaced later by learning, are of no use any more
+                for (auto& d : deltas)
+                {
+                    obsoletes.push_back(d.second.second);
+                }
+
+                for (auto& o : obsoletes)
+                {
+                    ddebug("%s: remove obsolete checkpoint file %s", replica_name(), o.c_str());
+                    dsn::utils::filesystem::remove_path(o);
                 }
             }
 
-            void simple_kv_service_impl::recover(const std::string& name, decree version)
+            bool simple_kv_service_impl::read_checkpoint(const std::string& name, /*inout*/ simple_kv& kvs)
             {
-                zauto_lock l(_lock);
-
                 std::ifstream is(name.c_str(), std::ios::binary);
                 if (!is.is_open())
-                    return;
-                
-                _store.clear();
+                    return false;
 
                 uint64_t count;
                 int magic;
-                
+
                 is.read((char*)&count, sizeof(count));
-                is.read((char*)&magic, sizeof(magic)); 
+                is.read((char*)&magic, sizeof(magic));
                 dassert(magic == 0xdeadbeef, "invalid checkpoint");
 
                 for (uint64_t i = 0; i < count; i++)
@@ -197,34 +384,29 @@ namespace dsn {
 
                     is.read((char*)&value[0], sz);
 
-                    _store[key] = value;
+                    kvs[key] = value;
                 }
 
-                _last_durable_decree = _last_committed_decree = version;
+                return !is.fail();
             }
 
-            int simple_kv_service_impl::flush(bool force)
+            bool simple_kv_service_impl::write_checkpoint(const std::string& name, const simple_kv& kvs, /*out*/ uint64_t& bytes)
             {
-                zauto_lock l(_lock);
-
-                if (last_committed_decree() == last_durable_decree())
-                {
-                    return 0;
-                }
-
-                // TODO: should use async write instead
-                char name[256];
-                sprintf(name, "%s/checkpoint.%lld", data_dir().c_str(), 
-                        static_cast<long long int>(last_committed_decree()));
-                std::ofstream os(name, std::ios::binary);
-
-                uint64_t count = (uint64_t)_store.size();
+                // written to a temp file first so that a partial checkpoint
+                // is never picked up by recover()
+                std::string tmp = data_dir() + "/tmp." + dsn::utils::filesystem::get_file_name(name);
+                std::ofstream os(tmp.c_str(), std::ios::binary);
+                if (!os.is_open())
+                    return false;
+
+                uint64_t count = (uint64_t)kvs.size();
                 int magic = 0xdeadbeef;
-                
+
                 os.write((const char*)&count, (uint32_t)sizeof(count));
                 os.write((const char*)&magic, (uint32_t)sizeof(magic));
+                bytes = sizeof(count) + sizeof(magic);
 
-                for (auto it = _store.begin(); it != _store.end(); it++)
+                for (auto it = kvs.begin(); it != kvs.end(); it++)
                 {
                     const std::string& k = it->first;
                     uint32_t sz = (uint32_t)k.length();
@@ -237,9 +419,233 @@ namespace dsn {
 
                     os.write((const char*)&sz, (uint32_t)sizeof(sz));
                     os.write((const char*)&v[0], sz);
+
+                    bytes += sizeof(sz) * 2 + k.length() + v.length();
+                }
+
+                os.close();
+                if (os.fail())
+                {
+                    dsn::utils::filesystem::remove_path(tmp);
+                    return false;
                 }
 
-                _last_durable_decree = last_committed_decree();
+                return dsn::utils::filesystem::rename_path(tmp, name, true);
+            }
+
+            void simple_kv_service_impl::gc_checkpoints(decree full_decree)
+            {
+                char full_name[256];
+                sprintf(full_name, "checkpoint.%lld", static_cast<long long int>(full_decree));
+
+                std::vector<std::string> sub_list;
+                if (!dsn::utils::filesystem::get_subfiles(data_dir(), sub_list, false))
+                {
+                    derror("%s: fail to get subfiles in %s", replica_name(), data_dir().c_str());
+                    return;
+                }
+
+                for (auto& fpath : sub_list)
+                {
+                    auto&& s = dsn::utils::filesystem::get_file_name(fpath);
+                    if (s == full_name)
+                        continue;
+
+                    if (s.substr(0, strlen("checkpoint.")) == std::string("checkpoint.")
+                        || s.substr(0, strlen("delta.")) == std::string("delta."))
+                    {
+                        dsn::utils::filesystem::remove_path(data_dir() + "/" + s);
+                    }
+                }
+            }
+
+            int simple_kv_service_impl::flush(bool force)
+            {
+                if (force)
+                {
+                    return checkpoint();
+                }
+
+                // at most one background checkpoint at a time
+                bool expected = false;
+                if (!_checkpointing.compare_exchange_strong(expected, true))
+                {
+                    return 0;
+                }
+
+                _checkpoint_task = tasking::enqueue(
+                    LPC_SIMPLE_KV_CHECKPOINT,
+                    nullptr,
+                    [this]()
+                    {
+                        int err = checkpoint();
+                        if (err != 0)
+                        {
+                            set_physical_error(err);
+                        }
+                        _checkpointing = false;
+                    }
+                    );
+                return 0;
+            }
+
+            int simple_kv_service_impl::checkpoint()
+            {
+                zauto_lock cl(_checkpoint_lock);
+
+                decree base, version;
+                bool full;
+                simple_kv snapshot;
+
+                // snapshot the whole store for a full checkpoint, or only the keys
+                // changed since the last checkpoint for a delta one; the file is
+                // written without _lock so that reads and writes go on meanwhile;
+                // the shards need no lock here as only reads may run concurrently
+                {
+                    zauto_lock l(_lock);
+
+                    base = last_durable_decree();
+                    version = last_committed_decree();
+                    full = _full_checkpoint_required;
+
+                    if (!full && version == base)
+                    {
+                        return 0;
+                    }
+
+                    for (auto& shard : _shards)
+                    {
+                        if (full)
+                        {
+                            snapshot.insert(shard.kvs.begin(), shard.kvs.end());
+                        }
+                        else
+                        {
+                            for (auto& k : shard.changed_keys)
+                            {
+                                auto it = shard.kvs.find(k);
+                                dassert(it != shard.kvs.end(), "changed key %s must be in the store", k.c_str());
+                                snapshot[k] = it->second;
+                            }
+                        }
+                        shard.changed_keys.clear();
+                    }
+                    _full_checkpoint_required = false;
+                }
+
+                char name[256];
+                if (full)
+                {
+                    sprintf(name, "%s/checkpoint.%lld", data_dir().c_str(),
+                        static_cast<long long int>(version));
+                }
+                else
+                {
+                    sprintf(name, "%s/delta.%lld.%lld", data_dir().c_str(),
+                        static_cast<long long int>(base), static_cast<long long int>(version));
+                }
+
+                uint64_t bytes = 0;
+                if (!write_checkpoint(name, snapshot, bytes))
+                {
+                    derror("%s: write checkpoint %s failed", replica_name(), name);
+
+                    // so that the next checkpoint covers them again
+                    zauto_lock l(_lock);
+                    if (full)
+                    {
+                        _full_checkpoint_required = true;
+                    }
+                    else
+                    {
+                        for (auto& kv : snapshot)
+                            get_shard(kv.first).changed_keys.insert(kv.first);
+                    }
+                    return ERR_FILE_OPERATION_FAILED.get();
+                }
+
+                {
+                    zauto_lock l(_lock);
+
+                    // the store is replaced by learning meanwhile
+                    if (_full_checkpoint_required)
+                    {
+                        dsn::utils::filesystem::remove_path(name);
+                        return 0;
+                    }
+
+                    _last_durable_decree = version;
+                }
+
+                ddebug("%s: %s checkpoint %s written, %llu bytes",
+                    replica_name(), full ? "full" : "delta", name, static_cast<unsigned long long>(bytes));
+
+                if (full)
+                {
+                    _full_checkpoint_decree = version;
+                    _full_checkpoint_bytes = bytes;
+                    _delta_checkpoints.clear();
+                    _delta_checkpoint_bytes = 0;
+                    gc_checkpoints(version);
+                    return 0;
+                }
+
+                _delta_checkpoints.push_back(name);
+                _delta_checkpoint_bytes += bytes;
+
+                if (_delta_checkpoints.size() > max_delta_checkpoint_count
+                    || _delta_checkpoint_bytes > _full_checkpoint_bytes)
+                {
+                    return compact_checkpoints(version);
+                }
+                return 0;
+            }
+
+            int simple_kv_service_impl::compact_checkpoints(decree version)
+            {
+                // merged from the files instead of the store, so no lock is needed
+                simple_kv kvs;
+                if (_full_checkpoint_decree > 0)
+                {
+                    char full_name[256];
+                    sprintf(full_name, "%s/checkpoint.%lld", data_dir().c_str(),
+                        static_cast<long long int>(_full_checkpoint_decree));
+                    if (!read_checkpoint(full_name, kvs))
+                    {
+                        derror("%s: read checkpoint %s failed", replica_name(), full_name);
+                        return ERR_FILE_OPERATION_FAILED.get();
+                    }
+                }
+
+                for (auto& d : _delta_checkpoints)
+                {
+                    if (!read_checkpoint(d, kvs))
+                    {
+                        derror("%s: read checkpoint %s failed", replica_name(), d.c_str());
+                        return ERR_FILE_OPERATION_FAILED.get();
+                    }
+                }
+
+                char name[256];
+                sprintf(name, "%s/checkpoint.%lld", data_dir().c_str(),
+                    static_cast<long long int>(version));
+
+                uint64_t bytes = 0;
+                if (!write_checkpoint(name, kvs, bytes))
+                {
+                    derror("%s: write checkpoint %s failed", replica_name(), name);
+                    return ERR_FILE_OPERATION_FAILED.get();
+                }
+
+                ddebug("%s: %d delta checkpoints compacted into %s, %llu bytes",
+                    replica_name(), static_cast<int>(_delta_checkpoints.size()),
+                    name, static_cast<unsigned long long>(bytes));
+
+                _full_checkpoint_decree = version;
+                _full_checkpoint_bytes = bytes;
+                _delta_checkpoints.clear();
+                _delta_checkpoint_bytes = 0;
+                gc_checkpoints(version);
                 return 0;
             }
 
@@ -257,13 +663,16 @@ namespace dsn {
 
                 dassert(_last_committed_decree >= 0, "");
 
-                uint64_t count = static_cast<uint64_t>(_store.size());
+                uint64_t count = store_size();
                 writer.write(count);
 
-                for (auto it = _store.begin(); it != _store.end(); it++)
+                for (auto& shard : _shards)
                 {
-                    writer.write(it->first);
-                    writer.write(it->second);
+                    for (auto it = shard.kvs.begin(); it != shard.kvs.end(); it++)
+                    {
+                        writer.write(it->first);
+                        writer.write(it->second);
+                    }
                 }
 
                 auto bb = writer.get_buffer();
@@ -294,10 +703,6 @@ namespace dsn {
 
                 binary_reader reader(bb);
 
-                zauto_lock l(_lock);
-
-                _store.clear();
-
                 int magic;
                 reader.read(magic);
 
@@ -311,17 +716,26 @@ namespace dsn {
                 uint64_t count;
                 reader.read(count);
 
+                simple_kv kvs;
                 for (uint64_t i = 0; i < count; i++)
                 {
                     std::string key, value;
                     reader.read(key);
                     reader.read(value);
-                    _store[key] = value;
+                    kvs[key] = value;
                 }
 
+                _lock.lock();
+
+                reset_store(kvs);
                 _last_committed_decree = decree;
                 _last_durable_decree = 0;
 
+                // the learned state is not derived from the local checkpoints
+                _full_checkpoint_required = true;
+                _lock.unlock();
+
+                // _lock must be released before flush as it takes _checkpoint_lock
                 flush(true);
 
                 bool ret = true;
@@ -36,6 +36,8 @@
 #pragma once
 
 #include "simple_kv.server.h"
+#include <set>
+#include <atomic>
 
 namespace dsn {
     namespace replication {
@@ -51,24 +53,74 @@ namespace dsn {
                 virtual void on_write(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply);
                 // RPC_SIMPLE_KV_APPEND
                 virtual void on_append(const kv_pair& pr, ::dsn::rpc_replier<int32_t>& reply);
+                // RPC_SIMPLE_KV_MULTI_READ
+                virtual void on_multi_read(const std::vector<std::string>& keys, ::dsn::rpc_replier<std::vector<std::string>>& reply);
+                // RPC_SIMPLE_KV_MULTI_WRITE
+                virtual void on_multi_write(const std::vector<kv_pair>& prs, ::dsn::rpc_replier<std::vector<int32_t>>& reply);
 
                 virtual int  open(bool create_new);
                 virtual int  close(bool clear_state);
                 virtual int  flush(bool force);
 
+                virtual void on_batched_write_begin() { _lock.lock(); }
+                virtual void on_batched_write_end() { _lock.unlock(); }
+
                 // helper routines to accelerate learning
                 virtual int get_learn_state(decree start, const blob& learn_req, /*out*/ learn_state& state);
                 virtual int apply_learn_state(learn_state& state);
 
             private:
+                typedef std::map<std::string, std::string> simple_kv;
+
+                // the store is split into shards by key hash, each with its own
+                // rw lock, so that reads from the app pool go on in parallel
+                // with each other and with the writes applied by the replica
+                struct store_shard
+                {
+                    simple_kv kvs;
+                    // keys written since the last checkpoint
+                    std::set<std::string> changed_keys;
+                    ::dsn::service::zrwlock_nr lock;
+                };
+
+                static const int store_shard_count = 16;
+
+                store_shard& get_shard(const std::string& key);
+                void reset_store(/*inout*/ simple_kv& kvs);
+                uint64_t store_size() const;
+
                 void recover();
-                void recover(const std::string& name, decree version);
+                void reset_checkpoint_state();
+
+                // checkpoints are either full ("checkpoint.<decree>"), or delta
+                // ("delta.<base decree>.<decree>") with the keys changed since
+                // the base decree, which are chained on the previous checkpoint
+                int  checkpoint();
+                int  compact_checkpoints(decree version);
+                bool write_checkpoint(const std::string& name, const simple_kv& kvs, /*out*/ uint64_t& bytes);
+                bool read_checkpoint(const std::string& name, /*inout*/ simple_kv& kvs);
+                void gc_checkpoints(decree full_decree);
 
             private:
-                typedef std::map<std::string, std::string> simple_kv;
-                simple_kv _store;
+                store_shard _shards[store_shard_count];
+                // serializes state updates, i.e., writes, learning and the
+                // checkpoint snapshot, while reads only take the shard lock
                 ::dsn::service::zlock _lock;
                 bool      _test_file_learning;
+
+                // the next checkpoint must be a full one as the store is not
+                // derived from the checkpoints on disk (e.g., after learning)
+                bool      _full_checkpoint_required;
+
+                // at most one checkpoint is written at any time; lock order
+                // is _checkpoint_lock first and then _lock
+                ::dsn::service::zlock _checkpoint_lock;
+                std::atomic<bool> _checkpointing;
+                task_ptr  _checkpoint_task;
+                decree    _full_checkpoint_decree;
+                uint64_t  _full_checkpoint_bytes;
+                std::vector<std::string> _delta_checkpoints;
+                uint64_t  _delta_checkpoint_bytes;
             };
 
         }
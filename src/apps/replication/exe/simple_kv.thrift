@@ -11,4 +11,6 @@ service simple_kv
 	string read(1:string key);
 	i32    write(2:kv_pair pr);
 	i32    append(2:kv_pair pr);
+	list<string> multi_read(1:list<string> keys);
+	list<i32>    multi_write(2:list<kv_pair> prs);
 }
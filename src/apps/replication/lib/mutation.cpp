@@ -44,15 +44,16 @@ mutation::mutation()
     _private0 = 0; 
     _not_logged = 1;
     _prepare_ts_ms = 0;
-    _client_request = nullptr;
+    _create_ts_ns = dsn_now_ns();
+    _appro_data_bytes = 0;
     _prepare_request = nullptr;
 }
 
 mutation::~mutation()
 {
-    if (_client_request != nullptr)
+    for (auto& r : _client_requests)
     {
-        dsn_msg_release_ref(_client_request);
+        dsn_msg_release_ref(r);
     }
 
     if (_prepare_request != nullptr)
@@ -65,16 +66,18 @@ void mutation::copy_from(mutation_ptr& old)
 {
     data.updates = old->data.updates;
     rpc_code = old->rpc_code;
+    _create_ts_ns = old->_create_ts_ns;
+    _appro_data_bytes = old->_appro_data_bytes;
     if (old->is_logged())
     {
         set_logged();
         data.header.log_offset = old->data.header.log_offset;
     }
         
-    _client_request = old->client_msg();
-    if (_client_request)
+    _client_requests = old->client_requests();
+    for (auto& r : _client_requests)
     {
-        dsn_msg_add_ref(_client_request);
+        dsn_msg_add_ref(r);
     }
 
     _prepare_request = old->prepare_msg();
@@ -84,14 +87,16 @@ void mutation::copy_from(mutation_ptr& old)
     }
 }
 
-void mutation::set_client_request(dsn_task_code_t code, dsn_message_t request)
+void mutation::add_client_request(dsn_task_code_t code, dsn_message_t request)
 {
-    dassert(_client_request == nullptr, "batch is not supported now");
+    // all requests in a batch share the same rpc code
+    dassert(data.updates.size() == 0 || rpc_code == code, 
+        "batched requests must be of the same rpc code");
     rpc_code = code;
 
     if (request != nullptr)
     {
-        _client_request = request;
+        _client_requests.push_back(request);
         dsn_msg_add_ref(request); // released on dctor
 
         void* ptr;
@@ -102,6 +107,7 @@ void mutation::set_client_request(dsn_task_code_t code, dsn_message_t request)
 
         blob buffer((char*)ptr, 0, (int)size);
         data.updates.push_back(buffer);
+        _appro_data_bytes += (int)size;
     }    
 }
 
@@ -112,8 +118,8 @@ void mutation::set_client_request(dsn_task_code_t code, dsn_message_t request)
     unmarshall(reader, mu->rpc_code);
 
     // it is possible this is an emtpy mutation due to new primaries inserts empty mutations for holes
-    dassert(mu->data.updates.size() == 1 || mu->rpc_code == RPC_REPLICATION_WRITE_EMPTY,
-        "batch is not supported now");
+    dassert(mu->data.updates.size() >= 1 || mu->rpc_code == RPC_REPLICATION_WRITE_EMPTY,
+        "a non-empty mutation must have at least one update");
 
     if (nullptr != from)
     {
@@ -43,6 +43,17 @@
 
 namespace dsn { namespace replication {
 
+//
+// the mutations received in one prepare stream message on a secondary,
+// which is acked once when all of them are acked
+//
+struct prepare_stream_context
+{
+    int        pending_count;
+    error_code err;
+    decree     last_decree;
+};
+
 class mutation : public ref_counter
 {
 public:
@@ -54,7 +65,8 @@ public:
     bool is_logged() const { return _not_logged == 0; }
     bool is_ready_for_commit() const { return _private0 == 0; }
     dsn_message_t prepare_msg() { return _prepare_request; }
-    dsn_message_t client_msg() { return _client_request; }
+    const std::vector<dsn_message_t>& client_requests() const { return _client_requests; }
+    int  appro_data_bytes() const { return _appro_data_bytes; }
     unsigned int left_secondary_ack_count() const { return _left_secondary_ack_count; }
     unsigned int left_potential_secondary_ack_count() const { return _left_potential_secondary_ack_count; }
     ::dsn::task_ptr& log_task() { return _log_task; }
@@ -63,7 +75,7 @@ public:
 
     // state change
     void set_id(ballot b, decree c);
-    void set_client_request(dsn_task_code_t code, dsn_message_t request);
+    void add_client_request(dsn_task_code_t code, dsn_message_t request);
     void copy_from(mutation_ptr& old);
     void set_logged() { dassert (!is_logged(), ""); _not_logged = 0; }
     unsigned int decrease_left_secondary_ack_count() { return --_left_secondary_ack_count; }
@@ -73,6 +85,8 @@ public:
     int  clear_prepare_or_commit_tasks();
     int  clear_log_task();
     void set_prepare_ts() { _prepare_ts_ms = dsn_now_ms(); }
+    uint64_t create_ts_ns() const { return _create_ts_ns; }
+    std::shared_ptr<prepare_stream_context>& prepare_stream() { return _prepare_stream; }
     
     // reader & writer
     static mutation_ptr read_from(binary_reader& readeer, dsn_message_t from);
@@ -95,10 +109,13 @@ private:
     };
 
     uint64_t        _prepare_ts_ms;
+    uint64_t        _create_ts_ns; // for client latency on primary
     ::dsn::task_ptr _log_task;
     node_tasks      _prepare_or_commit_tasks;
     dsn_message_t   _prepare_request;
-    dsn_message_t   _client_request;
+    std::shared_ptr<prepare_stream_context> _prepare_stream; // on secondary only
+    std::vector<dsn_message_t> _client_requests; // one per update when batched on primary
+    int             _appro_data_bytes;
     char            _name[40]; // ballot.decree
 };
 
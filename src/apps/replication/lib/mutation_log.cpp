@@ -35,6 +35,7 @@
 
 
 #include "mutation_log.h"
+#include <atomic>
 #ifdef _WIN32
 #include <io.h>
 #endif
@@ -52,14 +53,29 @@ mutation_log::mutation_log(
     const std::string& dir,
     bool is_private,
     uint32_t batch_buffer_size_mb,
-    uint32_t max_log_file_mb
+    uint32_t max_log_file_mb,
+    bool batch_write,
+    uint32_t pending_max_ms,
+    uint32_t max_concurrent_writes
     )
 {
     _dir = dir;
     _max_log_file_size_in_bytes = ((int64_t)max_log_file_mb) * 1024L * 1024L;
     _batch_buffer_bytes = batch_buffer_size_mb * 1024 * 1024;
+    _batch_write = batch_write;
+    _pending_max_ms = pending_max_ms;
+    _max_concurrent_writes = max_concurrent_writes > 0 ? max_concurrent_writes : 1;
+    _replay_prefetch_files = 0;
     _is_private = is_private;
 
+    const char* prefix = is_private ? "private.log" : "shared.log";
+    _counter_batch_bytes = dsn_perf_counter_create("replication",
+        (std::string(prefix) + ".batch.size(bytes)").c_str(), PERF_COUNTER_TYPE_NUMBER_PERCENTILES);
+    _counter_batch_mutations = dsn_perf_counter_create("replication",
+        (std::string(prefix) + ".batch.size(#)").c_str(), PERF_COUNTER_TYPE_NUMBER_PERCENTILES);
+    _counter_write_latency = dsn_perf_counter_create("replication",
+        (std::string(prefix) + ".write.latency(ns)").c_str(), PERF_COUNTER_TYPE_NUMBER_PERCENTILES);
+
     init_states();
 }
 
@@ -77,7 +93,13 @@ void mutation_log::init_states()
 
     // buffering and replica states
     _pending_write = nullptr;
+    _pending_write_offset = 0;
     _pending_write_callbacks = nullptr;
+    _pending_mutation_count = 0;
+    _pending_timer = nullptr;
+    _issued_write_seq = 0;
+    _completed_write_seq = 0;
+    _out_of_order_completions.clear();
     _private_gpid.app_id = 0;
     _private_gpid.pidx = 0;
     _private_max_decree = 0;
@@ -136,6 +158,9 @@ error_code mutation_log::open(replay_callback callback)
 
 	for (auto& fpath : file_list)
 	{
+        if (log_file::is_index_file(fpath))
+            continue;
+
 		log_file_ptr log = log_file::open_read(fpath.c_str(), err);
 		if (log == nullptr)
 		{
@@ -154,6 +179,14 @@ error_code mutation_log::open(replay_callback callback)
 		_log_files[log->index()] = log;
 	}
 	file_list.clear();
+
+    // files without a persisted index get theirs rebuilt during replay
+    std::vector<log_file_ptr> unindexed_files;
+    for (auto& kv : _log_files)
+    {
+        if (!kv.second->has_partition_index())
+            unindexed_files.push_back(kv.second);
+    }
         
     // replay with the found files    
     int64_t offset = 0;
@@ -174,7 +207,8 @@ error_code mutation_log::open(replay_callback callback)
             }
             return ret;
         },
-        offset
+        offset,
+        _replay_prefetch_files
         );
 
     if (ERR_OK == err)
@@ -182,6 +216,13 @@ error_code mutation_log::open(replay_callback callback)
         _global_start_offset = _log_files.size() > 0 ? _log_files.begin()->second->start_offset() : 0;
         _global_end_offset = offset;
         _last_file_number = _log_files.size() > 0 ? _log_files.rbegin()->first : 0;
+
+        // all existing files are sealed as new mutations go to a new file
+        for (auto& log : unindexed_files)
+        {
+            if (log->has_partition_index())
+                log->seal_partition_index(this);
+        }
     }
     
     _is_opened = (err == ERR_OK);
@@ -218,11 +259,22 @@ void mutation_log::close(bool clear_all)
         zauto_lock l(_lock);
         _is_opened = false;
 
+        if (_pending_timer)
+        {
+            _pending_timer->cancel(false);
+            _pending_timer = nullptr;
+        }
+
         if (_pending_write)
         {
             write_pending_mutations(false);
             _pending_write = nullptr;
         }
+
+        if (_current_log_file != nullptr)
+        {
+            _current_log_file->seal_partition_index(this);
+        }
     }
 
     // make sure all issued aios are completed
@@ -257,6 +309,7 @@ error_code mutation_log::create_new_log_file()
     if (_current_log_file != nullptr)
     {
         dassert (_current_log_file->end_offset() == _global_end_offset, "");
+        _current_log_file->seal_partition_index(this);
     }
 
     log_file_ptr logf = log_file::create_write(
@@ -316,6 +369,8 @@ void mutation_log::create_new_pending_buffer()
 
     _pending_write_callbacks.reset(new std::list<::dsn::task_ptr>);
     _pending_write = _current_log_file->prepare_log_entry();
+    _pending_write_offset = _global_end_offset;
+    _pending_mutation_count = 0;
     _global_end_offset += _pending_write->total_size();
 }
 
@@ -332,7 +387,11 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
         && (_global_end_offset - _current_log_file->start_offset()
         >= _max_log_file_size_in_bytes)
         ;
-    
+
+    dsn_perf_counter_set(_counter_batch_bytes, bb.length());
+    dsn_perf_counter_set(_counter_batch_mutations, _pending_mutation_count);
+
+    uint64_t seq = ++_issued_write_seq;
     auto aio = _current_log_file->commit_log_entry(
         bb,
         offset, 
@@ -340,16 +399,17 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
         this,
         std::bind(
             &mutation_log::internal_write_callback, 
+            this,
             std::placeholders::_1, 
             std::placeholders::_2, 
-            _pending_write_callbacks, bb),        
+            seq, _pending_write_callbacks, bb, dsn_now_ns()),
         -1
         );    
     
     if (aio == nullptr)
     {
-        internal_write_callback(ERR_FILE_OPERATION_FAILED, 
-            0, _pending_write_callbacks, bb);
+        // already under _lock
+        on_write_completed(ERR_FILE_OPERATION_FAILED, 0, seq, _pending_write_callbacks);
     }
     else
     {
@@ -358,6 +418,7 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
 
     _pending_write = nullptr;
     _pending_write_callbacks = nullptr;
+    _pending_mutation_count = 0;
 
     dassert(nullptr != aio, "");
 
@@ -374,11 +435,80 @@ error_code mutation_log::write_pending_mutations(bool create_new_log_when_necess
     return ERR_OK;
 }
 
+//
+// adaptive group commit (when batch_write is on), called under _lock:
+// - no in-flight write: flush right away as there is nothing to group with
+// - max concurrent writes reached: wait, the next completion flushes
+// - otherwise: flush when the batch reaches the batch buffer size,
+//   or when it has waited for pending_max_ms
+//
+void mutation_log::check_pending_mutations()
+{
+    if (_pending_write == nullptr || _pending_mutation_count == 0)
+        return;
+
+    int inflight = inflight_write_count();
+    if (inflight >= static_cast<int>(_max_concurrent_writes))
+        return;
+
+    if (inflight == 0
+        || static_cast<uint32_t>(_pending_write->total_size()) >= _batch_buffer_bytes
+        || _pending_max_ms == 0)
+    {
+        if (_pending_timer)
+        {
+            _pending_timer->cancel(false);
+            _pending_timer = nullptr;
+        }
+
+        auto err = write_pending_mutations();
+        dassert(
+            err == ERR_OK,
+            "write pending mutation failed, err = %s",
+            err.to_string()
+            );
+    }
+    else if (_pending_timer == nullptr)
+    {
+        _pending_timer = tasking::enqueue(
+            LPC_MUTATION_LOG_PENDING_TIMER,
+            this,
+            &mutation_log::on_pending_timer,
+            0,
+            static_cast<int>(_pending_max_ms)
+            );
+    }
+}
+
+void mutation_log::on_pending_timer()
+{
+    zauto_lock l(_lock);
+    _pending_timer = nullptr;
+
+    if (!_is_opened || _pending_write == nullptr || _pending_mutation_count == 0)
+        return;
+
+    // the batch has waited long enough, flush it unless
+    // all write slots are busy, in which case the next
+    // completion flushes it
+    if (inflight_write_count() < static_cast<int>(_max_concurrent_writes))
+    {
+        auto err = write_pending_mutations();
+        dassert(
+            err == ERR_OK,
+            "write pending mutation failed, err = %s",
+            err.to_string()
+            );
+    }
+}
+
 void mutation_log::internal_write_callback(
     error_code err, 
     size_t size, 
+    uint64_t seq,
     mutation_log::pending_callbacks_ptr callbacks,
-    blob data
+    blob data,
+    uint64_t issue_ts_ns
     )
 {
     auto hdr = (log_block_header*)data.data();
@@ -393,10 +523,58 @@ void mutation_log::internal_write_callback(
             );
     }
 
+    dsn_perf_counter_set(_counter_write_latency, dsn_now_ns() - issue_ts_ns);
+
+    zauto_lock l(_lock);
+    on_write_completed(err, size, seq, callbacks);
+
+    if (_batch_write && _is_opened)
+    {
+        check_pending_mutations();
+    }
+}
+
+void mutation_log::on_write_completed(
+    error_code err,
+    size_t size,
+    uint64_t seq,
+    mutation_log::pending_callbacks_ptr callbacks
+    )
+{
+    dassert(seq > _completed_write_seq && seq <= _issued_write_seq,
+        "invalid log write sequence %llu, completed = %llu, issued = %llu",
+        seq, _completed_write_seq, _issued_write_seq
+        );
+
+    if (seq != _completed_write_seq + 1)
+    {
+        // earlier writes are still in flight
+        auto& c = _out_of_order_completions[seq];
+        c.err = err;
+        c.size = size;
+        c.callbacks = callbacks;
+        return;
+    }
+
+    // callbacks are enqueued under _lock so that they are
+    // dispatched in log order
     for (auto& cb : *callbacks)
     {
         cb->enqueue_aio(err, size);
     }
+    _completed_write_seq = seq;
+
+    auto it = _out_of_order_completions.begin();
+    while (it != _out_of_order_completions.end() 
+        && it->first == _completed_write_seq + 1)
+    {
+        for (auto& cb : *it->second.callbacks)
+        {
+            cb->enqueue_aio(it->second.err, it->second.size);
+        }
+        _completed_write_seq = it->first;
+        it = _out_of_order_completions.erase(it);
+    }
 }
 
 /*static*/ error_code mutation_log::replay(
@@ -412,6 +590,9 @@ void mutation_log::internal_write_callback(
         log->end_offset()
         );
 
+    bool build_index = !log->has_partition_index();
+    int64_t block_offset = offset;
+
     ::dsn::blob bb;    
     error_code err = log->read_next_log_entry(0, bb);
     if (err != ERR_OK)
@@ -442,11 +623,17 @@ void mutation_log::internal_write_callback(
                 break;
             }
 
+            if (build_index)
+            {
+                log->update_partition_index(mu->data.header.gpid, mu->data.header.decree, block_offset);
+            }
+
             callback(mu);
 
             offset += old_size - reader->get_remaining_size();
         }
         
+        block_offset = offset;
         err = log->read_next_log_entry(offset - log->start_offset(), bb);
         if (err != ERR_OK)
         {
@@ -457,18 +644,27 @@ void mutation_log::internal_write_callback(
         offset += sizeof(log_block_header);
     }
 
+    if (build_index && (err == ERR_HANDLE_EOF || err == ERR_INCOMPLETE_DATA))
+    {
+        log->set_partition_index_valid();
+    }
+
     return err;
 }
 
 /*static*/ error_code mutation_log::replay(
     std::vector<std::string>& log_files,
     replay_callback callback,
-    /*out*/ int64_t& offset
+    /*out*/ int64_t& offset,
+    int prefetch_files
     )
 {
     std::map<int, log_file_ptr> logs;
     for (auto& fpath : log_files)
     {
+        if (log_file::is_index_file(fpath))
+            continue;
+
         error_code err;
         log_file_ptr log = log_file::open_read(fpath.c_str(), err);
         if (log == nullptr)
@@ -488,14 +684,216 @@ void mutation_log::internal_write_callback(
         logs[log->index()] = log;
     }
 
-    return replay(logs, callback, offset);
+    return replay(logs, callback, offset, prefetch_files);
+}
+
+//
+// parallel replay: each log file is read in whole with sequential reads of
+// bounded chunks, and its blocks are crc-checked and decoded on the aio callback
+// thread of the last finished chunk, so that several files are decoded
+// concurrently while the replay thread only delivers the decoded mutations in
+// log order
+//
+static const int64_t s_replay_read_chunk_bytes = 64 * 1024 * 1024;
+
+struct log_file_replay_context
+{
+    log_file_ptr                 log;
+    std::shared_ptr<char>        buffer;
+    std::vector<::dsn::task_ptr> read_tasks;
+
+    // reading results of each chunk
+    std::vector<error_code>      read_errs;
+    std::vector<size_t>          read_counts;
+    std::atomic<int>             pending_reads;
+
+    // decoding results
+    std::vector<mutation_ptr> mutations;
+    int64_t                   end_offset; // offset after the last good mutation
+    error_code                err;
+};
+
+typedef std::shared_ptr<log_file_replay_context> log_file_replay_context_ptr;
+
+static void decode_log_file(log_file_replay_context* ctx, error_code read_err, size_t read_count)
+{
+    auto& log = ctx->log;
+    int64_t offset = log->start_offset();
+    ctx->end_offset = offset;
+
+    if (read_err != ERR_OK && read_err != ERR_HANDLE_EOF)
+    {
+        derror("read log file %s failed, err = %s", log->path().c_str(), read_err.to_string());
+        ctx->err = read_err;
+        return;
+    }
+
+    const char* data = ctx->buffer.get();
+    size_t local_offset = 0;
+    error_code err = ERR_OK;
+    bool build_index = !log->has_partition_index();
+
+    while (err == ERR_OK)
+    {
+        // same error codes as log_file::read_next_log_entry
+        if (local_offset == read_count)
+        {
+            err = ERR_HANDLE_EOF;
+            break;
+        }
+
+        if (read_count - local_offset < sizeof(log_block_header))
+        {
+            err = ERR_INCOMPLETE_DATA;
+            break;
+        }
+
+        auto hdr = (const log_block_header*)(data + local_offset);
+        if (hdr->magic != 0xdeadbeef)
+        {
+            derror("invalid data header magic: 0x%x", hdr->magic);
+            err = ERR_INVALID_DATA;
+            break;
+        }
+
+        if (read_count - local_offset - sizeof(log_block_header) < (size_t)hdr->length)
+        {
+            derror("read data block body failed, size = %d vs %d, local_offset = %lld",
+                (int)(read_count - local_offset - sizeof(log_block_header)), 
+                (int)hdr->length, 
+                static_cast<long long int>(local_offset));
+            err = ERR_INCOMPLETE_DATA;
+            break;
+        }
+
+        // copy the block out so that the replayed mutations only hold
+        // their own block (as sequential replay does) instead of the file
+        std::shared_ptr<char> block(new char[hdr->length]);
+        memcpy(block.get(), data + local_offset + sizeof(log_block_header), hdr->length);
+
+        auto crc = dsn_crc32_compute((const void*)block.get(), (size_t)hdr->length, 0);
+        if (crc != (uint32_t)hdr->body_crc)
+        {
+            derror("crc checking failed");
+            err = ERR_INVALID_DATA;
+            break;
+        }
+
+        blob bb(block, 0, hdr->length);
+        binary_reader reader(bb);
+        offset += sizeof(log_block_header);
+
+        if (local_offset == 0)
+        {
+            offset += log->read_header(reader);
+            if (!log->is_right_header())
+            {
+                err = ERR_INVALID_DATA;
+                break;
+            }
+        }
+
+        while (!reader.is_eof())
+        {
+            auto old_size = reader.get_remaining_size();
+            mutation_ptr mu = mutation::read_from(reader, nullptr);
+            dassert(nullptr != mu, "");
+            mu->set_logged();
+
+            if (mu->data.header.log_offset != offset)
+            {
+                derror("offset mismatch in log entry and mutation %lld vs %lld",
+                    offset, mu->data.header.log_offset);
+                err = ERR_INVALID_DATA;
+                break;
+            }
+
+            if (build_index)
+            {
+                log->update_partition_index(mu->data.header.gpid, mu->data.header.decree,
+                    log->start_offset() + (int64_t)local_offset);
+            }
+
+            ctx->mutations.push_back(mu);
+            offset += old_size - reader.get_remaining_size();
+        }
+
+        ctx->end_offset = offset;
+        local_offset += sizeof(log_block_header) + hdr->length;
+    }
+
+    if (build_index && (err == ERR_HANDLE_EOF || err == ERR_INCOMPLETE_DATA))
+    {
+        log->set_partition_index_valid();
+    }
+
+    ctx->err = err;
+}
+
+static void on_log_file_chunk_read(log_file_replay_context* ctx, int chunk, error_code err, size_t sz)
+{
+    ctx->read_errs[chunk] = err;
+    ctx->read_counts[chunk] = sz;
+    if (--ctx->pending_reads > 0)
+        return;
+
+    // the file content is valid up to the first failed or short chunk
+    error_code read_err = ERR_OK;
+    size_t read_count = 0;
+    for (size_t i = 0; i < ctx->read_counts.size(); i++)
+    {
+        read_count += ctx->read_counts[i];
+        if (ctx->read_errs[i] != ERR_OK)
+        {
+            read_err = ctx->read_errs[i];
+            break;
+        }
+
+        int64_t chunk_size = std::min(s_replay_read_chunk_bytes,
+            ctx->log->end_offset() - ctx->log->start_offset() - (int64_t)i * s_replay_read_chunk_bytes);
+        if ((int64_t)ctx->read_counts[i] < chunk_size)
+            break;
+    }
+
+    decode_log_file(ctx, read_err, read_count);
+}
+
+static void prefetch_log_file(log_file_replay_context_ptr& ctx)
+{
+    int64_t size = ctx->log->end_offset() - ctx->log->start_offset();
+    ctx->buffer.reset(new char[size > 0 ? (size_t)size : 1], std::default_delete<char[]>());
+
+    int chunks = size > 0 ? (int)((size + s_replay_read_chunk_bytes - 1) / s_replay_read_chunk_bytes) : 1;
+    ctx->read_errs.resize(chunks, ERR_OK);
+    ctx->read_counts.resize(chunks, 0);
+    ctx->pending_reads = chunks;
+
+    // all tasks are issued before any callback may decode the file
+    auto pctx = ctx;
+    for (int i = 0; i < chunks; i++)
+    {
+        int64_t offset = (int64_t)i * s_replay_read_chunk_bytes;
+        int chunk_size = (int)std::min(s_replay_read_chunk_bytes, size - offset);
+        ctx->read_tasks.push_back(ctx->log->read_file(
+            ctx->buffer.get() + offset,
+            chunk_size,
+            offset,
+            LPC_AIO_IMMEDIATE_CALLBACK,
+            [pctx, i](error_code err, size_t sz)
+            {
+                on_log_file_chunk_read(pctx.get(), i, err, sz);
+            },
+            ctx->log->index()
+            ));
+    }
 }
 
 
 /*static*/ error_code mutation_log::replay(
     std::map<int, log_file_ptr>& logs,
     replay_callback callback,
-    /*out*/ int64_t& offset
+    /*out*/ int64_t& offset,
+    int prefetch_files
     )
 {
     int64_t g_start_offset = 0, g_end_offset = 0;
@@ -522,6 +920,18 @@ void mutation_log::internal_write_callback(
         
     offset = g_start_offset;
 
+    std::vector<log_file_replay_context_ptr> prefetches;
+    size_t prefetch_issued = 0, file_pos = 0;
+    if (prefetch_files > 0)
+    {
+        for (auto& kv : logs)
+        {
+            log_file_replay_context_ptr ctx(new log_file_replay_context());
+            ctx->log = kv.second;
+            prefetches.push_back(ctx);
+        }
+    }
+
     for (auto& kv : logs)
     {
         log_file_ptr& log = kv.second;
@@ -530,11 +940,45 @@ void mutation_log::internal_write_callback(
         {
             derror("offset mismatch in log file offset and global offset %lld vs %lld",
                 log->start_offset(), offset);
-            return ERR_INVALID_DATA;
+            err = ERR_INVALID_DATA;
+            break;
         }
 
         last = log;
-        err = mutation_log::replay(log, callback, offset);
+        if (prefetch_files > 0)
+        {
+            while (prefetch_issued < prefetches.size()
+                && prefetch_issued <= file_pos + (size_t)prefetch_files)
+            {
+                prefetch_log_file(prefetches[prefetch_issued++]);
+            }
+
+            dinfo("replay mutation log %s (prefetched): offset = [%lld, %lld)",
+                log->path().c_str(),
+                log->start_offset(),
+                log->end_offset()
+                );
+
+            auto ctx = prefetches[file_pos];
+            for (auto& t : ctx->read_tasks)
+            {
+                t->wait();
+            }
+            for (auto& mu : ctx->mutations)
+            {
+                callback(mu);
+            }
+            offset = ctx->end_offset;
+            err = ctx->err;
+
+            // release the file buffer and decoded mutations early
+            prefetches[file_pos] = nullptr;
+        }
+        else
+        {
+            err = mutation_log::replay(log, callback, offset);
+        }
+        file_pos++;
 
         log->close();
 
@@ -553,6 +997,15 @@ void mutation_log::internal_write_callback(
         }
     }
 
+    // make sure no prefetching read is still on the files
+    for (size_t i = file_pos; i < prefetch_issued; i++)
+    {
+        for (auto& t : prefetches[i]->read_tasks)
+        {
+            t->wait();
+        }
+    }
+
     if (err == ERR_OK)
     {
         dassert(g_end_offset == offset,
@@ -627,6 +1080,28 @@ void mutation_log::check_log_start_offset(global_partition_id gpid, int64_t vali
     }
 }
 
+bool mutation_log::get_partition_blocks(
+    global_partition_id gpid,
+    decree start,
+    /*out*/ std::vector<std::pair<std::string, int64_t>>& blocks
+    ) const
+{
+    zauto_lock l(_lock);
+    for (auto& kv : _log_files)
+    {
+        auto& log = kv.second;
+        if (!log->has_partition_index())
+            return false;
+
+        auto it = log->partition_index().find(gpid);
+        if (it != log->partition_index().end() && it->second.max_decree >= start)
+        {
+            blocks.push_back(std::make_pair(log->path(), it->second.first_block_offset));
+        }
+    }
+    return true;
+}
+
 decree mutation_log::max_gced_decree(global_partition_id gpid, int64_t valid_start_offset) const
 {
     check_log_start_offset(gpid, valid_start_offset);
@@ -734,6 +1209,8 @@ void mutation_log::update_max_decrees(global_partition_id gpid, decree d)
     mu->data.header.log_offset = _global_end_offset;
     mu->write_to(*_pending_write);
     _global_end_offset += _pending_write->total_size() - old_size;
+    _pending_mutation_count++;
+    _current_log_file->update_partition_index(mu->data.header.gpid, d, _pending_write_offset);
 
     task_ptr tsk = nullptr;
     if (callback)
@@ -749,32 +1226,19 @@ void mutation_log::update_max_decrees(global_partition_id gpid, decree d)
     //
     // start to write
     //
-    err = write_pending_mutations();
-    //
-    //// not batching
-    //if (_batch_buffer_bytes == 0)
-    //{
-    //    err = write_pending_mutations();
-    //}
-
-    //// batching
-    //else
-    //{
-    //    if ((uint32_t)_pending_write->total_size() >= _batch_buffer_bytes)
-    //    {
-    //        err = write_pending_mutations();
-    //    }
-    //    else
-    //    {
-    //        // waiting for batch write later
-    //    }
-    //}   
-
-    dassert(
-        err == ERR_OK,
-        "write pending mutation failed, err = %s",
-        err.to_string()
-        );
+    if (_batch_write)
+    {
+        check_pending_mutations();
+    }
+    else
+    {
+        err = write_pending_mutations();
+        dassert(
+            err == ERR_OK,
+            "write pending mutation failed, err = %s",
+            err.to_string()
+            );
+    }
 
     return tsk;
 }
@@ -857,6 +1321,32 @@ void mutation_log::get_learn_state(
     // flush last file so learning can learn the on-disk state
     if (nullptr != cfile) cfile->flush();
 
+    // with partition indexes, start from the first file having decrees >= start
+    // (all later files are needed as well as replay requires continuous files)
+    std::vector<std::pair<std::string, int64_t>> blocks;
+    if (get_partition_blocks(gpid, start, blocks))
+    {
+        if (blocks.size() == 0)
+            return;
+
+        zauto_lock l(_lock);
+        bool found = false;
+        for (auto& kv : files)
+        {
+            log_file_ptr& log = kv.second;
+            found = found || log->path() == blocks[0].first;
+            if (!found || log->end_offset() <= _private_valid_start_offset)
+                continue;
+
+            if (log->end_offset() > log->start_offset())
+                state.files.push_back(log->path());
+        }
+
+        // otherwise the file list is changed meanwhile, fall back to the file headers below
+        if (found)
+            return;
+    }
+
     // find all applicable files
     bool skip_next = false;
     std::list<std::string> learn_files;
@@ -973,6 +1463,13 @@ int mutation_log::garbage_collection(
 
         ddebug("gc: log segment %s is removed", fpath.c_str());
         count++;
+
+        auto ipath = itr->second->index_path();
+        if (dsn::utils::filesystem::file_exists(ipath)
+            && !dsn::utils::filesystem::remove_path(ipath))
+        {
+            dwarn("gc: fail to remove index %s", ipath.c_str());
+        }
         {
             zauto_lock l(_lock);
             _log_files.erase(itr->first);
@@ -1112,6 +1609,13 @@ int mutation_log::garbage_collection(multi_partition_decrees_ex& durable_decrees
 
         ddebug("gc: log segment %s is removed", fpath.c_str());
         count++;
+
+        auto ipath = itr->second->index_path();
+        if (dsn::utils::filesystem::file_exists(ipath)
+            && !dsn::utils::filesystem::remove_path(ipath))
+        {
+            dwarn("gc: fail to remove index %s", ipath.c_str());
+        }
         {
             zauto_lock l(_lock);
             _log_files.erase(itr->first);
@@ -1178,6 +1682,9 @@ int mutation_log::garbage_collection(multi_partition_decrees_ex& durable_decrees
     binary_reader reader(hdr_blob);
     lf->read_header(reader);
 
+    // missing or stale index is rebuilt during replay
+    lf->load_partition_index();
+
     return lf;
 }
 
@@ -1217,6 +1724,9 @@ log_file::log_file(
     _index = index; 
     memset(&_header, 0, sizeof(_header));
 
+    // a new log file starts with an empty index
+    _index_valid = !is_read;
+
     if (is_read)
     {
 		int64_t sz;
@@ -1305,6 +1815,20 @@ error_code log_file::read_next_log_entry(int64_t local_offset, /*out*/::dsn::blo
     return ERR_OK;
 }
 
+::dsn::task_ptr log_file::read_file(
+    char* buffer, 
+    int size, 
+    int64_t local_offset,
+    dsn_task_code_t evt, 
+    aio_handler callback, 
+    int hash
+    )
+{
+    dassert (_is_read, "log file must be of read mode");
+
+    return file::read(_handle, buffer, size, local_offset, evt, nullptr, callback, hash);
+}
+
 std::shared_ptr<binary_writer> log_file::prepare_log_entry()
 {
     log_block_header hdr;
@@ -1429,4 +1953,163 @@ int log_file::write_header(
     return get_file_header_size();
 }
 
+//
+// partition index sidecar file format:
+//   magic, version, log end offset, count, count * (gpid, log_partition_index), crc32
+//
+# define LOG_INDEX_MAGIC    0x58444e49
+# define LOG_INDEX_VERSION  0x1
+
+/*static*/ bool log_file::is_index_file(const std::string& path)
+{
+    const char* suffix = ".index";
+    return path.length() > strlen(suffix)
+        && path.substr(path.length() - strlen(suffix)) == std::string(suffix);
+}
+
+void log_file::update_partition_index(global_partition_id gpid, decree d, int64_t block_offset)
+{
+    auto it = _partition_index.find(gpid);
+    if (it == _partition_index.end())
+    {
+        log_partition_index& idx = _partition_index[gpid];
+        idx.min_decree = d;
+        idx.max_decree = d;
+        idx.first_block_offset = block_offset;
+        idx.last_block_offset = block_offset;
+    }
+    else
+    {
+        log_partition_index& idx = it->second;
+        if (d < idx.min_decree)
+            idx.min_decree = d;
+        if (d > idx.max_decree)
+            idx.max_decree = d;
+        idx.last_block_offset = block_offset;
+    }
+}
+
+error_code log_file::load_partition_index()
+{
+    dassert (_is_read, "log file must be of read mode");
+
+    auto ipath = index_path();
+    int64_t sz;
+    if (!dsn::utils::filesystem::file_exists(ipath)
+        || !dsn::utils::filesystem::file_size(ipath, sz)
+        || sz < (int64_t)(sizeof(int32_t) * 3 + sizeof(int64_t) + sizeof(uint32_t)))
+    {
+        return ERR_OBJECT_NOT_FOUND;
+    }
+
+    dsn_handle_t hfile = dsn_file_open(ipath.c_str(), O_RDONLY | O_BINARY, 0);
+    if (hfile == 0)
+    {
+        dwarn("open log index %s failed", ipath.c_str());
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    std::shared_ptr<char> data(new char[sz]);
+    auto tsk = file::read(hfile, data.get(), (int)sz, 0, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr);
+    tsk->wait();
+    auto err = tsk->error();
+    auto read_count = tsk->io_size();
+    dsn_file_close(hfile);
+
+    if (err != ERR_OK || read_count != (size_t)sz)
+    {
+        dwarn("read log index %s failed, err = %s", ipath.c_str(), err.to_string());
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    uint32_t crc = *(uint32_t*)(data.get() + sz - sizeof(uint32_t));
+    if (crc != dsn_crc32_compute(data.get(), (size_t)(sz - sizeof(uint32_t)), 0))
+    {
+        dwarn("log index %s is corrupted, crc checking failed", ipath.c_str());
+        return ERR_INVALID_DATA;
+    }
+
+    blob bb(data, 0, (int)(sz - sizeof(uint32_t)));
+    binary_reader reader(bb);
+    int32_t magic, version, count;
+    int64_t end_offset;
+    reader.read(magic);
+    reader.read(version);
+    reader.read(end_offset);
+    reader.read(count);
+
+    // the index is written before the last blocks of the log file are
+    // durable, so a log file truncated by a crash must have its index rebuilt
+    if (magic != LOG_INDEX_MAGIC || version != LOG_INDEX_VERSION || end_offset != _end_offset
+        || reader.get_remaining_size() != count * (int)(sizeof(global_partition_id) + sizeof(log_partition_index)))
+    {
+        dwarn("log index %s is stale or invalid, rebuild it later", ipath.c_str());
+        return ERR_INVALID_DATA;
+    }
+
+    _partition_index.clear();
+    for (int32_t i = 0; i < count; i++)
+    {
+        global_partition_id gpid;
+        log_partition_index idx;
+        reader.read_pod(gpid);
+        reader.read_pod(idx);
+        _partition_index[gpid] = idx;
+    }
+
+    _index_valid = true;
+    return ERR_OK;
+}
+
+void log_file::seal_partition_index(clientlet* callback_host)
+{
+    if (!_index_valid)
+        return;
+
+    binary_writer writer;
+    writer.write((int32_t)LOG_INDEX_MAGIC);
+    writer.write((int32_t)LOG_INDEX_VERSION);
+    writer.write((int64_t)_end_offset);
+    writer.write((int32_t)_partition_index.size());
+    for (auto& kv : _partition_index)
+    {
+        writer.write_pod(kv.first);
+        writer.write_pod(kv.second);
+    }
+
+    auto body = writer.get_buffer();
+    uint32_t crc = dsn_crc32_compute(body.data(), (size_t)body.length(), 0);
+    std::shared_ptr<char> data(new char[body.length() + sizeof(crc)]);
+    memcpy(data.get(), body.data(), body.length());
+    memcpy(data.get() + body.length(), &crc, sizeof(crc));
+    blob bb(data, 0, body.length() + (int)sizeof(crc));
+
+    auto ipath = index_path();
+    dsn_handle_t hfile = dsn_file_open(ipath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_BINARY, 0666);
+    if (hfile == 0)
+    {
+        dwarn("create log index %s failed", ipath.c_str());
+        return;
+    }
+
+    file::write(
+        hfile,
+        bb.data(),
+        bb.length(),
+        0,
+        LPC_AIO_IMMEDIATE_CALLBACK,
+        callback_host,
+        [hfile, bb, ipath](error_code err, size_t sz)
+        {
+            if (err != ERR_OK)
+            {
+                // a missing index is rebuilt on next open
+                dwarn("write log index %s failed, err = %s", ipath.c_str(), err.to_string());
+            }
+            dsn_file_close(hfile);
+        },
+        0
+        );
+}
+
 }} // end namespace
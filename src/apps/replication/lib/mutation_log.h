@@ -69,6 +69,22 @@ typedef std::unordered_map<global_partition_id, decree>
 typedef std::unordered_map<global_partition_id, log_replica_info>
     multi_partition_decrees_ex;
 
+//
+// per-partition summary of the mutations in one log file, which is
+// maintained on append and persisted as a sidecar file (<log file>.index)
+// when the log file is sealed, so that learning and gc can find the
+// relevant files and blocks of a partition without reading the log
+//
+struct log_partition_index
+{
+    decree  min_decree;
+    decree  max_decree;
+    int64_t first_block_offset; // global offset of the first block with this partition's mutations
+    int64_t last_block_offset;  // global offset of the last block with this partition's mutations
+};
+
+typedef std::unordered_map<global_partition_id, log_partition_index> log_file_index;
+
 struct log_block_header
 {
     int32_t magic;
@@ -101,7 +117,10 @@ public:
         const std::string& dir,
         bool is_private,
         uint32_t log_batch_buffer_MB,
-        uint32_t max_log_file_mb        
+        uint32_t max_log_file_mb,
+        bool     batch_write = false,       // adaptive group commit, see append
+        uint32_t pending_max_ms = 0,        // max delay of a batch when there are in-flight writes
+        uint32_t max_concurrent_writes = 1  // max in-flight log writes when batch_write is on
         );
     virtual ~mutation_log();
     
@@ -110,6 +129,9 @@ public:
     //
     void set_valid_log_offset_before_open(global_partition_id gpid, int64_t valid_start_offset);
 
+    // replay log files in parallel on open, see replay below
+    void set_replay_prefetch_files_before_open(int count) { _replay_prefetch_files = count; }
+
     // for shared
     error_code open(replay_callback callback);
 
@@ -122,10 +144,18 @@ public:
     //
     // replay
     //
+    // when prefetch_files > 0, up to prefetch_files log files ahead of the
+    // one being replayed are read in whole and decoded in parallel
+    // on the callback threads of LPC_AIO_IMMEDIATE_CALLBACK, while 
+    // the callback is still invoked in log order on the calling thread;
+    // the calling thread waits for those reads, so it must not be one
+    // of the THREAD_POOL_DEFAULT threads they complete on
+    //
     static error_code replay(
         std::vector<std::string>& log_files,
         replay_callback callback,
-        /*out*/ int64_t& end_offset
+        /*out*/ int64_t& end_offset,
+        int prefetch_files = 0
         );
            
     //
@@ -178,6 +208,15 @@ public:
 
     void check_log_start_offset(global_partition_id gpid, int64_t valid_start_offset) const;
 
+    // get the blocks of the given partition with decrees >= start, 
+    // as [log file path, first block global offset] in log order; 
+    // return false when some log files have no index
+    bool get_partition_blocks(
+        global_partition_id gpid, 
+        decree start, 
+        /*out*/ std::vector<std::pair<std::string, int64_t>>& blocks
+        ) const;
+
 private:
     //
     //  internal helpers
@@ -191,20 +230,29 @@ private:
     static error_code replay(
         std::map<int, log_file_ptr>& log_files,
         replay_callback callback,
-        /*out*/ int64_t& end_offset
+        /*out*/ int64_t& end_offset,
+        int prefetch_files = 0
         );
 
     typedef std::shared_ptr<std::list<::dsn::task_ptr>> pending_callbacks_ptr;
     void init_states();    
     error_code create_new_log_file();    
     void create_new_pending_buffer();    
-    static void internal_write_callback(error_code err, size_t size, pending_callbacks_ptr callbacks, blob data);
+    void internal_write_callback(error_code err, size_t size, uint64_t seq, pending_callbacks_ptr callbacks, blob data, uint64_t issue_ts_ns);
+    void on_write_completed(error_code err, size_t size, uint64_t seq, pending_callbacks_ptr callbacks);
     error_code write_pending_mutations(bool create_new_log_when_necessary = true);
+    void check_pending_mutations();
+    void on_pending_timer();
+    int  inflight_write_count() const { return static_cast<int>(_issued_write_seq - _completed_write_seq); }
     
 private:
     // options
     int64_t                   _max_log_file_size_in_bytes;    
     uint32_t                  _batch_buffer_bytes;
+    bool                      _batch_write;
+    uint32_t                  _pending_max_ms;
+    uint32_t                  _max_concurrent_writes;
+    int                       _replay_prefetch_files;
 
     // memory states
     std::string               _dir;
@@ -220,7 +268,28 @@ private:
     
     // bufferring    
     std::shared_ptr<binary_writer> _pending_write;
+    int64_t                        _pending_write_offset; // global offset of the pending block
     pending_callbacks_ptr          _pending_write_callbacks;
+    int                            _pending_mutation_count;
+    ::dsn::task_ptr                _pending_timer;
+
+    // log writes are issued with increasing sequence numbers, and
+    // their completions are delivered in the same order even when
+    // several aios are in flight and complete out of order
+    struct write_completion
+    {
+        error_code            err;
+        size_t                size;
+        pending_callbacks_ptr callbacks;
+    };
+    uint64_t                                 _issued_write_seq;
+    uint64_t                                 _completed_write_seq;
+    std::map<uint64_t, write_completion>     _out_of_order_completions;
+
+    // perf counters
+    dsn_handle_t                   _counter_batch_bytes;
+    dsn_handle_t                   _counter_batch_mutations;
+    dsn_handle_t                   _counter_write_latency;
 
     // replica states
     bool                           _is_private;
@@ -251,6 +320,9 @@ public:
     //
     error_code read_next_log_entry(int64_t local_offset, /*out*/::dsn::blob& bb);
 
+    // read size bytes at local_offset with one sequential read, used by parallel replay
+    ::dsn::task_ptr read_file(char* buffer, int size, int64_t local_offset, dsn_task_code_t evt, aio_handler callback, int hash);
+
     //
     // write routines
     //
@@ -279,6 +351,19 @@ public:
     bool is_right_header() const;
     void flush();
     int get_file_header_size() const;
+
+    //
+    // partition index, see log_partition_index
+    //
+    static bool is_index_file(const std::string& path);
+    std::string index_path() const { return _path + ".index"; }
+    bool has_partition_index() const { return _index_valid; }
+    const log_file_index& partition_index() const { return _partition_index; }
+    void update_partition_index(global_partition_id gpid, decree d, int64_t block_offset);
+    void set_partition_index_valid() { _index_valid = true; }
+    error_code load_partition_index();
+    // persist the index asynchronously, the aio is tracked by callback_host
+    void seal_partition_index(clientlet* callback_host);
     
 private:
     log_file(const char* path, dsn_handle_t handle, int index, int64_t start_offset, bool isRead);
@@ -294,6 +379,10 @@ private:
     // for gc
     multi_partition_decrees_ex _previous_log_max_decrees;    
     log_file_header            _header;
+
+    // for learning and gc
+    log_file_index             _partition_index;
+    bool                       _index_valid;
 };
 
 }} // namespace
@@ -120,8 +120,24 @@ void replica::on_client_read(const read_request_header& meta, dsn_message_t requ
 
     if (meta.semantic == read_semantic_t::ReadLastUpdate)
     {
+        // linearizable without contacting others as long as the lease from
+        // meta server is held, before which no other primary can be assigned
         if (status() != PS_PRIMARY || 
-            last_committed_decree() < _primary_states.last_prepare_decree_on_new_primary)
+            _app->last_committed_decree() < _primary_states.last_prepare_decree_on_new_primary ||
+            (!_options->lease_read_disabled && !_stub->is_lease_valid()))
+        {
+            response_client_message(request, ERR_INVALID_STATE);
+            return;
+        }
+    }
+    else if (meta.semantic == read_semantic_t::ReadBoundedStaleness)
+    {
+        // secondaries serve when they have the required decree and have heard
+        // from primary recently, otherwise the client falls back to primary
+        if (status() != PS_PRIMARY &&
+            (status() != PS_SECONDARY ||
+             _app->last_committed_decree() < meta.version_decree ||
+             now_ms() > _secondary_states.last_primary_contact_ms + _options->read_max_staleness_ms))
         {
             response_client_message(request, ERR_INVALID_STATE);
             return;
@@ -130,9 +146,11 @@ void replica::on_client_read(const read_request_header& meta, dsn_message_t requ
 
     dassert (_app != nullptr, "");
 
+    uint64_t start_ns = dsn_now_ns();
     rpc_read_stream reader(request);
     _app->dispatch_rpc_call(dsn_task_code_from_string(meta.code.c_str(), TASK_CODE_INVALID),
                             reader, dsn_msg_create_response(request));
+    _load.on_request(dsn_now_ns() - start_ns);
 }
 
 void replica::response_client_message(dsn_message_t request, error_code error, decree d/* = invalid_decree*/)
@@ -232,8 +250,11 @@ void replica::execute_mutation(mutation_ptr& mu)
     case PS_PRIMARY:
         {
             check_state_completeness();
-            dassert(_app->last_committed_decree() + 1 == d, "");
-            err = _app->write_internal(mu);
+            dassert(last_applying_decree() + 1 == d, "");
+            if (_options->apply_async_enabled)
+                apply_mutation_async(mu);
+            else
+                err = _app->write_internal(mu);
         }
         break;
 
@@ -241,8 +262,11 @@ void replica::execute_mutation(mutation_ptr& mu)
         if (_secondary_states.checkpoint_task == nullptr)
         {
             check_state_completeness();
-            dassert (_app->last_committed_decree() + 1 == d, "");
-            err = _app->write_internal(mu);
+            dassert (last_applying_decree() + 1 == d, "");
+            if (_options->apply_async_enabled)
+                apply_mutation_async(mu);
+            else
+                err = _app->write_internal(mu);
         }
         else
         {
@@ -285,12 +309,126 @@ void replica::execute_mutation(mutation_ptr& mu)
     
     ddebug("TwoPhaseCommit, %s: mutation %s committed, err = %s", name(), mu->name(), err.to_string());
 
+    if (err == ERR_OK)
+    {
+        uint64_t bytes = 0;
+        for (auto& bb : mu->data.updates)
+            bytes += bb.length();
+        _load.on_write(bytes);
+        _load.set_log_backlog(last_committed_decree() - last_durable_decree());
+        
+        if (status() == PS_PRIMARY && !mu->client_requests().empty())
+        {
+            auto latency = dsn_now_ns() - mu->create_ts_ns();
+            for (size_t i = 0; i < mu->client_requests().size(); i++)
+                _load.on_request(latency);
+        }
+    }
+
     if (err != ERR_OK)
     {
         handle_local_failure(err);
     }
 }
 
+decree replica::last_applying_decree() const
+{
+    return _apply.last_queued_decree != 0 ? _apply.last_queued_decree : _app->last_committed_decree();
+}
+
+void replica::apply_mutation_async(mutation_ptr& mu)
+{
+    check_hashed_access();
+
+    _apply.last_queued_decree = mu->data.header.decree;
+
+    zauto_lock l(_apply.queue_lock);
+    if (_apply.is_failed)
+        return;
+
+    _apply.queue.push_back(mu);
+    if (!_apply.is_running)
+    {
+        _apply.is_running = true;
+        _apply.apply_task = tasking::enqueue(
+            LPC_APPLY_MUTATIONS,
+            this,
+            &replica::apply_mutations
+            );
+    }
+}
+
+void replica::apply_mutations()
+{
+    auto err = apply_queued_mutations();
+    if (err != ERR_OK)
+    {
+        tasking::enqueue(
+            LPC_APPLY_MUTATIONS_FAILED,
+            this,
+            [this, err]() { this->handle_local_failure(err); },
+            gpid_to_hash(get_gpid())
+            );
+    }
+}
+
+error_code replica::apply_queued_mutations()
+{
+    zauto_lock al(_apply.apply_lock);
+
+    while (true)
+    {
+        mutation_ptr mu;
+        {
+            zauto_lock l(_apply.queue_lock);
+            if (_apply.queue.empty())
+            {
+                _apply.is_running = false;
+                return ERR_OK;
+            }
+
+            mu = _apply.queue.front();
+            _apply.queue.pop_front();
+        }
+
+        dassert(_app->last_committed_decree() + 1 == mu->data.header.decree, "");
+        auto err = _app->write_internal(mu);
+
+        ddebug("%s: mutation %s applied, err = %s", name(), mu->name(), err.to_string());
+
+        if (err != ERR_OK)
+        {
+            // the replica is going to be dropped, and the rest are not applied
+            zauto_lock l(_apply.queue_lock);
+            _apply.is_failed = true;
+            _apply.is_running = false;
+            _apply.queue.clear();
+            return err;
+        }
+    }
+}
+
+void replica::drain_apply_queue()
+{
+    // nothing queued since the last drain
+    if (_apply.last_queued_decree == 0)
+        return;
+
+    // wait for the in-flight mutations, and apply the rest right here
+    auto err = apply_queued_mutations();
+    _apply.last_queued_decree = 0;
+
+    if (err != ERR_OK)
+    {
+        tasking::enqueue(
+            LPC_APPLY_MUTATIONS_FAILED,
+            this,
+            [this, err]() { this->handle_local_failure(err); },
+            gpid_to_hash(get_gpid())
+            );
+    }
+}
+
 mutation_ptr replica::new_mutation(decree decree)
 {
     mutation_ptr mu(new mutation());
@@ -312,6 +450,13 @@ bool replica::group_configuration(/*out*/ partition_configuration& config) const
 
 decree replica::last_durable_decree() const { return _app->last_durable_decree(); }
 
+void replica::collect_load(/*out*/ partition_load& load)
+{
+    load.gpid = get_gpid();
+    load.status = status();
+    _load.collect(load);
+}
+
 decree replica::last_prepared_decree() const
 {
     ballot lastBallot = 0;
@@ -339,6 +484,13 @@ void replica::close()
         _check_timer = nullptr;
     }
 
+    if (nullptr != _apply.apply_task)
+    {
+        _apply.apply_task->cancel(true);
+        _apply.apply_task = nullptr;
+    }
+    drain_apply_queue();
+
     if (status() != PS_INACTIVE && status() != PS_ERROR)
     {
         update_local_configuration_with_no_ballot_change(PS_INACTIVE);
@@ -53,6 +53,7 @@ namespace dsn { namespace replication {
 class replication_app_base;
 class mutation_log;
 class replica_stub;
+class replica_tester;
 
 using namespace ::dsn::service;
 
@@ -92,7 +93,9 @@ public:
     //    messages from peers (primary or secondary)
     //
     void on_prepare(dsn_message_t request);    
+    void on_prepare_stream(dsn_message_t request);
     void on_learn(dsn_message_t msg, const learn_request& request);
+    void on_learn_chunk(dsn_message_t msg, const learn_chunk_request& request);
     void on_learn_completion_notification(const group_check_response& report);
     void on_add_learner(const group_check_request& request);
     void on_remove(const replica_configuration& request);
@@ -124,12 +127,18 @@ public:
     uint64_t last_config_change_time_milliseconds() const { return _last_config_change_time_ms; }
     const char* name() const { return _name; }
     mutation_log_ptr private_log() const { return _private_log; }
+    void collect_load(/*out*/ partition_load& load);
         
 private:
     // common helpers
     void init_state();
     void response_client_message(dsn_message_t request, error_code error, decree decree = -1);    
     void execute_mutation(mutation_ptr& mu);
+    void apply_mutation_async(mutation_ptr& mu);
+    void apply_mutations();
+    error_code apply_queued_mutations();
+    void drain_apply_queue();
+    decree last_applying_decree() const;
     mutation_ptr new_mutation(decree decree);    
         
     // initialization
@@ -142,9 +151,15 @@ private:
     /////////////////////////////////////////////////////////////////
     // 2pc
     void init_prepare(mutation_ptr& mu);
+    void init_prepare_pending_mutation();
+    void on_mutation_pending_timeout();
     void send_prepare_message(::dsn::rpc_address addr, partition_status status, mutation_ptr& mu, int timeout_milliseconds);
     void on_append_log_completed(mutation_ptr& mu, error_code err, size_t size);
     void on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, error_code err, dsn_message_t request, dsn_message_t reply);
+    void send_prepare_stream(::dsn::rpc_address addr);
+    void send_prepare_stream_message(::dsn::rpc_address addr, decree first, decree last);
+    void on_prepare_stream_reply(ballot b, decree first, decree last, error_code err, dsn_message_t request, dsn_message_t reply);
+    void prepare_on_secondary(const replica_configuration& rconfig, mutation_ptr& mu);
     void do_possible_commit_on_primary(mutation_ptr& mu);    
     void ack_prepare_message(error_code err, mutation_ptr& mu);
     void cleanup_preparing_mutations(bool is_primary);
@@ -159,6 +174,11 @@ private:
     void handle_learning_succeeded_on_primary(::dsn::rpc_address node, uint64_t learn_signature);
     void notify_learn_completion();
     error_code apply_learned_state_from_private_log(learn_state& state);
+    void start_learn_stream(std::shared_ptr<learn_response>& resp);
+    void continue_learn_stream(learn_stream_context_ptr stream);
+    void on_learn_chunk_reply(learn_stream_context_ptr stream, int file_index, int64_t offset, error_code err, dsn_message_t request, dsn_message_t reply);
+    void write_learn_stream(learn_stream_context_ptr stream);
+    void on_learn_chunk_written(learn_stream_context_ptr stream, ::dsn::blob data, error_code err, size_t size);
         
     /////////////////////////////////////////////////////////////////
     // failure handling    
@@ -171,6 +191,7 @@ private:
     void add_potential_secondary(configuration_update_request& proposal);
     void upgrade_to_secondary_on_primary(::dsn::rpc_address node);
     void downgrade_to_secondary_on_primary(configuration_update_request& proposal);
+    void downgrade_to_secondary_after_drain(bool timeout);
     void downgrade_to_inactive_on_primary(configuration_update_request& proposal);
     void remove(configuration_update_request& proposal);
     void update_configuration_on_meta_server(config_type type, ::dsn::rpc_address node, partition_configuration& newConfig);
@@ -199,6 +220,7 @@ private:
     
 private:
     friend class ::dsn::replication::replication_checker;
+    friend class ::dsn::replication::replica_tester;
 
     // replica configuration, updated by update_local_configuration ONLY    
     replica_configuration   _config;
@@ -227,5 +249,11 @@ private:
     secondary_context           _secondary_states;
     potential_secondary_context _potential_secondary_states;
     bool                        _inactive_is_transient; // upgrade to P/S is allowed only iff true
+
+    // asynchronous apply of committed mutations
+    apply_context               _apply;
+
+    // load reported to meta server
+    load_context                _load;
 };
 }} // namespace
@@ -50,15 +50,77 @@ void replica::on_client_write(int code, dsn_message_t request)
 {
     check_hashed_access();
 
-    if (PS_PRIMARY != status())
+    // new writes are rejected during planned downgrade,
+    // and the clients retry on the new primary
+    if (PS_PRIMARY != status() || _primary_states.downgrade_proposal != nullptr)
     {
         response_client_message(request, ERR_INVALID_STATE);
         return;
     }
 
-    mutation_ptr mu = new_mutation(_prepare_list->max_decree() + 1);
-    mu->set_client_request(code, request);
-    init_prepare(mu);
+    if (_options->request_batch_disabled)
+    {
+        mutation_ptr mu = new_mutation(_prepare_list->max_decree() + 1);
+        mu->add_client_request(code, request);
+        init_prepare(mu);
+        return;
+    }
+
+    // requests of different codes are not batched together
+    auto& mu = _primary_states.pending_mutation;
+    if (mu != nullptr && mu->rpc_code != code)
+    {
+        init_prepare_pending_mutation();
+    }
+
+    if (mu == nullptr)
+    {
+        mu = new_mutation(invalid_decree);
+    }
+    mu->add_client_request(code, request);
+
+    // adaptive batching: the batch is sent at once when there is no in-flight 2pc,
+    // otherwise it waits until full, the 2pc is drained, or mutation_max_pending_time_ms
+    if (static_cast<int>(mu->client_requests().size()) >= _options->mutation_max_batch_count
+        || mu->appro_data_bytes() >= _options->mutation_max_size_mb * 1024 * 1024
+        || last_committed_decree() == max_prepared_decree())
+    {
+        init_prepare_pending_mutation();
+    }
+    else if (_primary_states.pending_mutation_task == nullptr)
+    {
+        _primary_states.pending_mutation_task = tasking::enqueue(
+            LPC_MUTATION_PENDING_TIMER,
+            this,
+            &replica::on_mutation_pending_timeout,
+            gpid_to_hash(get_gpid()),
+            _options->mutation_max_pending_time_ms
+            );
+    }
+}
+
+void replica::init_prepare_pending_mutation()
+{
+    _primary_states.do_cleanup_pending_mutations(false);
+
+    mutation_ptr mu = _primary_states.pending_mutation;
+    _primary_states.pending_mutation = nullptr;
+    if (mu != nullptr)
+    {
+        init_prepare(mu);
+    }
+}
+
+void replica::on_mutation_pending_timeout()
+{
+    check_hashed_access();
+
+    // the task is done, so it must not be cancelled in init_prepare_pending_mutation
+    _primary_states.pending_mutation_task = nullptr;
+    if (PS_PRIMARY == status())
+    {
+        init_prepare_pending_mutation();
+    }
 }
 
 void replica::init_prepare(mutation_ptr& mu)
@@ -107,7 +169,29 @@ void replica::init_prepare(mutation_ptr& mu)
     mu->set_left_secondary_ack_count((unsigned int)_primary_states.membership.secondaries.size());
     for (auto it = _primary_states.membership.secondaries.begin(); it != _primary_states.membership.secondaries.end(); it++)
     {
-        send_prepare_message(*it, PS_SECONDARY, mu, _options->prepare_timeout_ms_for_secondaries);
+        if (_options->prepare_stream_disabled)
+        {
+            send_prepare_message(*it, PS_SECONDARY, mu, _options->prepare_timeout_ms_for_secondaries);
+            continue;
+        }
+
+        auto sit = _primary_states.prepare_streams.find(*it);
+        if (sit == _primary_states.prepare_streams.end() || sit->second.ballot != get_ballot())
+        {
+            primary_context::prepare_stream stream;
+            stream.ballot = get_ballot();
+            stream.prepared_decree = mu->data.header.decree - 1;
+            stream.sent_decree = mu->data.header.decree - 1;
+            stream.inflight_count = 0;
+            _primary_states.prepare_streams[*it] = stream;
+            sit = _primary_states.prepare_streams.find(*it);
+        }
+
+        if (mu->data.header.decree > sit->second.prepared_decree)
+        {
+            sit->second.prepared_decree = mu->data.header.decree;
+        }
+        send_prepare_stream(*it);
     }
 
     count = 0;
@@ -144,7 +228,10 @@ void replica::init_prepare(mutation_ptr& mu)
     return;
 
 ErrOut:
-    response_client_message(mu->client_msg(), err);
+    for (auto& r : mu->client_requests())
+    {
+        response_client_message(r, err);
+    }
     return;
 }
 
@@ -180,6 +267,154 @@ void replica::send_prepare_message(::dsn::rpc_address addr, partition_status sta
         );
 }
 
+void replica::send_prepare_stream(::dsn::rpc_address addr)
+{
+    auto& stream = _primary_states.prepare_streams[addr];
+    if (stream.sent_decree < stream.prepared_decree
+        && stream.inflight_count < _options->prepare_stream_window)
+    {
+        send_prepare_stream_message(addr, stream.sent_decree + 1, stream.prepared_decree);
+    }
+}
+
+void replica::send_prepare_stream_message(::dsn::rpc_address addr, decree first, decree last)
+{
+    dsn_message_t msg = dsn_msg_create_request(RPC_PREPARE_STREAM, _options->prepare_timeout_ms_for_secondaries, gpid_to_hash(get_gpid()));
+    replica_configuration rconfig;
+    _primary_states.get_replica_config(PS_SECONDARY, rconfig);
+
+    std::vector<mutation_ptr> mus;
+    for (decree d = first; d <= last; d++)
+    {
+        mutation_ptr mu = _prepare_list->get_mutation_by_decree(d);
+        dassert(mu != nullptr && mu->data.header.ballot == get_ballot(), 
+            "mutation %lld must be prepared before sent in the prepare stream", static_cast<long long int>(d));
+        mus.push_back(mu);
+    }
+
+    {
+        rpc_write_stream writer(msg);
+        marshall(writer, get_gpid());
+        marshall(writer, rconfig);
+        marshall(writer, static_cast<int>(mus.size()));
+        for (auto& mu : mus)
+        {
+            mu->write_to(writer);
+        }
+    }
+
+    // one rpc (and timeout task) for all the mutations in the message
+    ::dsn::task_ptr task = rpc::call(addr, msg,
+        this,
+        std::bind(&replica::on_prepare_stream_reply,
+            this,
+            get_ballot(),
+            first,
+            last,
+            std::placeholders::_1,
+            std::placeholders::_2,
+            std::placeholders::_3),
+        gpid_to_hash(get_gpid())
+        );
+
+    for (auto& mu : mus)
+    {
+        mu->remote_tasks()[addr] = task;
+    }
+
+    auto& stream = _primary_states.prepare_streams[addr];
+    stream.inflight_count++;
+    if (last > stream.sent_decree)
+    {
+        stream.sent_decree = last;
+    }
+
+    ddebug(
+        "%s: mutations [%lld, %lld] send_prepare_stream_message to %s",
+        name(),
+        static_cast<long long int>(first),
+        static_cast<long long int>(last),
+        addr.to_string()
+        );
+}
+
+void replica::on_prepare_stream_reply(ballot b, decree first, decree last, error_code err, dsn_message_t request, dsn_message_t reply)
+{
+    check_hashed_access();
+
+    // skip callback for old streams
+    if (b < get_ballot() || PS_PRIMARY != status())
+        return;
+
+    ::dsn::rpc_address node = dsn_msg_to_address(request);
+    auto sit = _primary_states.prepare_streams.find(node);
+    if (sit == _primary_states.prepare_streams.end() || sit->second.ballot != b)
+        return;
+
+    sit->second.inflight_count--;
+
+    prepare_ack resp;
+    if (err != ERR_OK)
+    {
+        resp.err = err;
+    }
+    else
+    {
+        ::unmarshall(reply, resp);
+    }
+
+    ddebug(
+        "%s: mutations [%lld, %lld] on_prepare_stream_reply from %s, err = %s",
+        name(),
+        static_cast<long long int>(first),
+        static_cast<long long int>(last),
+        node.to_string(),
+        resp.err.to_string()
+        );
+
+    if (resp.err == ERR_OK)
+    {
+        dassert (resp.ballot == get_ballot(), "");
+        dassert (resp.decree == last, "");
+
+        if (_primary_states.check_exist(node, PS_SECONDARY))
+        {
+            for (decree d = first; d <= last; d++)
+            {
+                mutation_ptr mu = _prepare_list->get_mutation_by_decree(d);
+                dassert (mu != nullptr && mu->data.header.ballot == get_ballot(), "");
+                dassert (mu->left_secondary_ack_count() > 0, "");
+                mu->decrease_left_secondary_ack_count();
+            }
+
+            // commit once for all the acked mutations
+            mutation_ptr next = _prepare_list->get_mutation_by_decree(last_committed_decree() + 1);
+            if (next != nullptr && next->data.header.ballot == get_ballot())
+            {
+                do_possible_commit_on_primary(next);
+            }
+        }
+
+        if (PS_PRIMARY == status() && b == get_ballot())
+        {
+            send_prepare_stream(node);
+        }
+        return;
+    }
+
+    // retry when there are still time
+    mutation_ptr mu = _prepare_list->get_mutation_by_decree(first);
+    if ((resp.err == ERR_INACTIVE_STATE || resp.err == ERR_BUSY)
+        && mu != nullptr
+        && !mu->is_prepare_close_to_timeout(2, _options->prepare_timeout_ms_for_secondaries))
+    {
+        send_prepare_stream_message(node, first, last);
+        return;
+    }
+
+    handle_remote_failure(_primary_states.get_node_status(node), node, resp.err);
+}
+
 void replica::do_possible_commit_on_primary(mutation_ptr& mu)
 {
     dassert (_config.ballot == mu->data.header.ballot, "");
@@ -188,6 +423,27 @@ void replica::do_possible_commit_on_primary(mutation_ptr& mu)
     if (mu->is_ready_for_commit())
     {
         _prepare_list->commit(mu->data.header.decree, COMMIT_ALL_READY);
+
+        // the batch held for in-flight 2pc can go now
+        if (_primary_states.pending_mutation != nullptr
+            && PS_PRIMARY == status()
+            && last_committed_decree() == max_prepared_decree())
+        {
+            init_prepare_pending_mutation();
+        }
+
+        // 2pc is drained for the planned downgrade, which is done in 
+        // another task as the caller still works as a primary
+        if (_primary_states.downgrade_proposal != nullptr
+            && last_committed_decree() == max_prepared_decree())
+        {
+            tasking::enqueue(
+                LPC_DOWNGRADE_AFTER_DRAIN,
+                this,
+                std::bind(&replica::downgrade_to_secondary_after_drain, this, false),
+                gpid_to_hash(get_gpid())
+                );
+        }
     }
 }
 
@@ -204,6 +460,44 @@ void replica::on_prepare(dsn_message_t request)
         mu = mutation::read_from(reader, request);
     }
 
+    prepare_on_secondary(rconfig, mu);
+}
+
+void replica::on_prepare_stream(dsn_message_t request)
+{
+    check_hashed_access();
+
+    replica_configuration rconfig;
+    std::vector<mutation_ptr> mus;
+
+    {
+        rpc_read_stream reader(request);
+        unmarshall(reader, rconfig);
+
+        int count;
+        unmarshall(reader, count);
+        for (int i = 0; i < count; i++)
+        {
+            mus.push_back(mutation::read_from(reader, request));
+        }
+    }
+
+    dassert(mus.size() > 0, "prepare stream message must not be empty");
+
+    std::shared_ptr<prepare_stream_context> stream(new prepare_stream_context());
+    stream->pending_count = static_cast<int>(mus.size());
+    stream->err = ERR_OK;
+    stream->last_decree = mus.back()->data.header.decree;
+
+    for (auto& mu : mus)
+    {
+        mu->prepare_stream() = stream;
+        prepare_on_secondary(rconfig, mu);
+    }
+}
+
+void replica::prepare_on_secondary(const replica_configuration& rconfig, mutation_ptr& mu)
+{
     decree decree = mu->data.header.decree;
 
     ddebug( "%s: mutation %s on_prepare", name(), mu->name());
@@ -279,12 +573,23 @@ void replica::on_prepare(dsn_message_t request)
         {
             ack_prepare_message(ERR_OK, mu);
         }
+
+        // the stream message cannot be acked until mu2 is logged, so let primary retry
+        else if (mu->prepare_stream() != nullptr)
+        {
+            ack_prepare_message(ERR_BUSY, mu);
+        }
         return;
     }
 
     error_code err = _prepare_list->prepare(mu, status());
     dassert (err == ERR_OK, "");
 
+    if (PS_SECONDARY == status())
+    {
+        _secondary_states.last_primary_contact_ms = now_ms();
+    }
+
     if (PS_POTENTIAL_SECONDARY == status())
     {
         dassert (mu->data.header.decree <= last_committed_decree() + _options->max_mutation_count_in_prepare_list, "");
@@ -471,11 +776,27 @@ void replica::on_prepare_reply(std::pair<mutation_ptr, partition_status> pr, err
 
 void replica::ack_prepare_message(error_code err, mutation_ptr& mu)
 {
+    // cumulative ack for the whole stream message
+    auto& stream = mu->prepare_stream();
+    if (stream != nullptr)
+    {
+        if (err != ERR_OK && stream->err == ERR_OK)
+        {
+            stream->err = err;
+        }
+
+        dassert(stream->pending_count > 0, "");
+        if (--stream->pending_count > 0)
+            return;
+
+        err = stream->err;
+    }
+
     prepare_ack resp;
     resp.gpid = get_gpid();
     resp.err = err;
     resp.ballot = get_ballot();
-    resp.decree = mu->data.header.decree;
+    resp.decree = (stream != nullptr ? stream->last_decree : mu->data.header.decree);
 
     // for PS_POTENTIAL_SECONDARY ONLY
     resp.last_committed_decree_in_app = _app->last_committed_decree(); 
@@ -509,6 +830,12 @@ void replica::cleanup_preparing_mutations(bool is_primary)
             mu->clear_log_task();
         }
     }
+
+    // the stream rpcs are cancelled above, and the mutations are prepared again if necessary
+    if (is_primary)
+    {
+        _primary_states.prepare_streams.clear();
+    }
 }
 
 }} // namespace
@@ -150,6 +150,7 @@ void replica::on_group_check(const group_check_request& request, /*out*/ group_c
         {
             _prepare_list->commit(request.last_committed_decree, COMMIT_TO_DECREE_HARD);
         }
+        _secondary_states.last_primary_contact_ms = now_ms();
         break;
     case PS_POTENTIAL_SECONDARY:
         init_learn(request.learner_signature);
@@ -212,9 +212,68 @@ void replica::downgrade_to_secondary_on_primary(configuration_update_request& pr
     proposal.config.primary.set_invalid();
     proposal.config.secondaries.push_back(proposal.node);
 
+    // the batched requests are drained together with the in-flight ones
+    init_prepare_pending_mutation();
+
+    // the downgrade is planned by meta server for primary balancing, so
+    // in-flight mutations are committed first instead of being failed
+    if (last_committed_decree() < max_prepared_decree())
+    {
+        ddebug(
+            "%s: downgrade to secondary after the in-flight mutations are committed, %lld vs %lld",
+            name(),
+            last_committed_decree(),
+            max_prepared_decree()
+            );
+
+        if (_primary_states.downgrade_timeout_task == nullptr)
+        {
+            _primary_states.downgrade_timeout_task = tasking::enqueue(
+                LPC_DOWNGRADE_AFTER_DRAIN,
+                this,
+                std::bind(&replica::downgrade_to_secondary_after_drain, this, true),
+                gpid_to_hash(get_gpid()),
+                _options->prepare_timeout_ms_for_secondaries
+                );
+        }
+        _primary_states.downgrade_proposal.reset(new configuration_update_request(proposal));
+        return;
+    }
+
     update_configuration_on_meta_server(CT_DOWNGRADE_TO_SECONDARY, proposal.node, proposal.config);
 }
 
+void replica::downgrade_to_secondary_after_drain(bool timeout)
+{
+    check_hashed_access();
+
+    auto proposal = _primary_states.downgrade_proposal;
+    if (proposal == nullptr)
+        return;
+
+    if (!timeout && last_committed_decree() < max_prepared_decree())
+        return;
+
+    _primary_states.downgrade_proposal = nullptr;
+    if (_primary_states.downgrade_timeout_task != nullptr)
+    {
+        _primary_states.downgrade_timeout_task->cancel(false);
+        _primary_states.downgrade_timeout_task = nullptr;
+    }
+
+    // configuration may be changed during draining
+    if (proposal->config.ballot != get_ballot() || status() != PS_PRIMARY)
+    {
+        dwarn(
+            "%s: planned downgrade is dropped as configuration changes during draining",
+            name()
+            );
+        return;
+    }
+
+    update_configuration_on_meta_server(CT_DOWNGRADE_TO_SECONDARY, proposal->node, proposal->config);
+}
+
 
 void replica::downgrade_to_inactive_on_primary(configuration_update_request& proposal)
 {
@@ -544,6 +603,10 @@ bool replica::update_local_configuration(const replica_configuration& config, bo
         break;
     }
 
+    // the app catches up with the committed mutations before the status
+    // change, as the status specific states rely on the app state
+    drain_apply_queue();
+
     uint64_t oldTs = _last_config_change_time_ms;
     _config = config;
     _last_config_change_time_ms =now_ms();
@@ -624,6 +687,9 @@ bool replica::update_local_configuration(const replica_configuration& config, bo
             _inactive_is_transient = false;
             init_group_check();
             replay_prepare_list();
+
+            // the batch kept during the transient inactive status
+            init_prepare_pending_mutation();
             break;
         case PS_SECONDARY:            
             _inactive_is_transient = false;
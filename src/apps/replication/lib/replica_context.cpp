@@ -34,12 +34,14 @@
  */
 
 #include "replica_context.h"
+#include <algorithm>
 
 namespace dsn { namespace replication {
 
 void primary_context::cleanup(bool clean_pending_mutations)
 {
     do_cleanup_pending_mutations(clean_pending_mutations);
+    prepare_streams.clear();
 
     // clean up group check
     if (nullptr != group_check_task)
@@ -60,6 +62,13 @@ void primary_context::cleanup(bool clean_pending_mutations)
         reconfiguration_task->cancel(true);
         reconfiguration_task = nullptr;
     }
+
+    if (nullptr != downgrade_timeout_task)
+    {
+        downgrade_timeout_task->cancel(true);
+        downgrade_timeout_task = nullptr;
+    }
+    downgrade_proposal = nullptr;
 }
 
 void primary_context::do_cleanup_pending_mutations(bool clean_pending_mutations)
@@ -154,6 +163,8 @@ void secondary_context::cleanup()
         checkpoint_task->cancel(true);
         checkpoint_task = nullptr;
     }
+
+    last_primary_contact_ms = 0;
 }
 
 bool potential_secondary_context::cleanup(bool force)
@@ -182,10 +193,102 @@ bool potential_secondary_context::cleanup(bool force)
         learn_remote_files_completed_task->cancel(true);
     }
 
+    if (learn_stream != nullptr)
+    {
+        // in-flight chunk transfers and writes hold the context and
+        // are dropped on completion as the stream is no longer current
+        if (learn_stream->continue_task != nullptr)
+            learn_stream->continue_task->cancel(true);
+        learn_stream = nullptr;
+    }
+
     learning_signature = 0;
     learning_round_is_running = false;
     learning_start_prepare_decree = invalid_decree;
     return true;
 }
 
+learn_stream_context::learn_stream_context(std::shared_ptr<learn_response>& r)
+    : resp(r),
+    request_file(0), request_offset(0), inflight_count(0), failure_count(0),
+    start_ms(dsn_now_ms()), requested_bytes(0),
+    write_file(0), write_offset(0), write_handle(nullptr), is_writing(false), written_bytes(0)
+{
+}
+
+learn_stream_context::~learn_stream_context()
+{
+    if (write_handle != nullptr)
+    {
+        dsn_file_close(write_handle);
+    }
+}
+
+load_context::load_context()
+    : _request_count(0), _write_bytes(0), _log_backlog(0), _latency_pos(0)
+{
+    for (auto& l : _latency_us)
+        l.store(0, std::memory_order_relaxed);
+
+    _last_collect_ms = dsn_now_ms();
+    _last_request_count = 0;
+    _last_write_bytes = 0;
+}
+
+void load_context::on_request(uint64_t latency_ns)
+{
+    _request_count.fetch_add(1, std::memory_order_relaxed);
+    if (latency_ns > 0)
+    {
+        uint32_t pos = _latency_pos.fetch_add(1, std::memory_order_relaxed);
+        _latency_us[pos % LATENCY_SAMPLE_COUNT].store(
+            static_cast<uint32_t>(std::min<uint64_t>(latency_ns / 1000, UINT32_MAX)),
+            std::memory_order_relaxed
+            );
+    }
+}
+
+void load_context::collect(/*out*/ partition_load& load)
+{
+    zauto_lock l(_collect_lock);
+
+    uint64_t now = dsn_now_ms();
+    uint64_t requests = _request_count.load(std::memory_order_relaxed);
+    uint64_t bytes = _write_bytes.load(std::memory_order_relaxed);
+    double seconds = (double)(now - _last_collect_ms) / 1000.0;
+    
+    if (seconds > 0)
+    {
+        load.qps = (double)(requests - _last_request_count) / seconds;
+        load.write_bytes_per_second = (double)(bytes - _last_write_bytes) / seconds;
+    }
+    else
+    {
+        load.qps = 0;
+        load.write_bytes_per_second = 0;
+    }
+    load.log_backlog = _log_backlog.load(std::memory_order_relaxed);
+
+    // p99 over the recent samples
+    uint32_t count = std::min<uint32_t>(_latency_pos.load(std::memory_order_relaxed), LATENCY_SAMPLE_COUNT);
+    if (count > 0)
+    {
+        std::vector<uint32_t> samples(count);
+        for (uint32_t i = 0; i < count; i++)
+            samples[i] = _latency_us[i].load(std::memory_order_relaxed);
+        
+        auto p99 = samples.begin() + (count * 99 / 100);
+        std::nth_element(samples.begin(), p99, samples.end());
+        load.p99_latency_us = *p99;
+    }
+    else
+    {
+        load.p99_latency_us = 0;
+    }
+
+    _last_collect_ms = now;
+    _last_request_count = requests;
+    _last_write_bytes = bytes;
+}
+
 }} // end namespace
@@ -36,6 +36,7 @@
 #pragma once
 
 #include "mutation.h"
+#include <deque>
 
 namespace dsn { namespace replication {
 
@@ -71,6 +72,17 @@ public:
     mutation_ptr      pending_mutation;
     dsn::task_ptr     pending_mutation_task;
 
+    // prepare stream to each secondary, where consecutive mutations are sent 
+    // in one message when prepare_stream_window messages are in flight
+    struct prepare_stream
+    {
+        int64_t ballot;
+        decree  prepared_decree; // max decree to be sent
+        decree  sent_decree;
+        int     inflight_count;
+    };
+    std::unordered_map<::dsn::rpc_address, prepare_stream> prepare_streams;
+
     // group check
     dsn::task_ptr     group_check_task;
     node_tasks        group_check_pending_replies;
@@ -78,6 +90,11 @@ public:
     // reconfig
     dsn::task_ptr     reconfiguration_task;
 
+    // planned downgrade to secondary, which is held until in-flight 2pc
+    // is completed (or timeout), and new writes are rejected meanwhile
+    std::shared_ptr<configuration_update_request> downgrade_proposal;
+    dsn::task_ptr     downgrade_timeout_task;
+
     // when read lastest update, all prepared decrees must be firstly committed
     // (possibly true on old primary) before opening read service
     decree       last_prepare_decree_on_new_primary; 
@@ -86,12 +103,59 @@ public:
 class secondary_context
 {
 public:
+    secondary_context() : last_primary_contact_ms(0) {}
     void cleanup();
 
 public:
     ::dsn::task_ptr checkpoint_task;
+
+    // last time a prepare or group check from primary arrives, for bounded-staleness reads
+    uint64_t        last_primary_contact_ms;
+};
+
+//
+// streaming transfer of the learned files from the learnee, chunk by chunk;
+// chunks are requested ahead within a window and written to learn dir
+// strictly in order, so that the size of a local file is always what has
+// been received, from which a later learning round may resume
+//
+class learn_stream_context
+{
+public:
+    learn_stream_context(std::shared_ptr<learn_response>& r);
+    ~learn_stream_context();
+
+public:
+    std::shared_ptr<learn_response> resp;
+    std::string          source_path;    // learn.stream.source, see start_learn_stream
+    std::string          source;
+    std::vector<int64_t> resume_offsets; // local size when the stream starts
+    std::vector<std::string> identities; // remote identity of the local content, "" when unknown
+    std::vector<int64_t> file_sizes;     // -1 when not known yet
+
+    // [ requesting
+    int             request_file;
+    int64_t         request_offset;
+    std::deque<std::pair<int, int64_t>> retry_chunks;
+    int             inflight_count;
+    int             failure_count;
+    uint64_t        start_ms;
+    uint64_t        requested_bytes; // for bandwidth cap
+    ::dsn::task_ptr continue_task;
+    // ]
+
+    // [ writing
+    std::map<std::pair<int, int64_t>, ::dsn::blob> received_chunks;
+    int             write_file;
+    int64_t         write_offset;
+    dsn_handle_t    write_handle;
+    bool            is_writing;
+    uint64_t        written_bytes;
+    // ]
 };
 
+typedef std::shared_ptr<learn_stream_context> learn_stream_context_ptr;
+
 class potential_secondary_context 
 {
 public:
@@ -112,8 +176,66 @@ public:
     ::dsn::task_ptr       learning_task;
     ::dsn::task_ptr       learn_remote_files_task;
     ::dsn::task_ptr       learn_remote_files_completed_task;
+    learn_stream_context_ptr learn_stream;
+
+};
+
+//
+// committed mutations which are applied to the app on the app pool in order
+// when apply_async_enabled is set, see replica::execute_mutation
+//
+class apply_context
+{
+public:
+    apply_context() : queue_lock(false), is_running(false), is_failed(false), apply_lock(false), last_queued_decree(0) {}
+
+public:
+    // protects queue, is_running and is_failed
+    ::dsn::service::zlock    queue_lock;
+    std::deque<mutation_ptr> queue;
+    bool                     is_running;    // an apply task is enqueued or running
+    bool                     is_failed;     // the app fails to apply, and the rest are dropped
+    ::dsn::task_ptr          apply_task;
+
+    // held while applying, so that the replica thread may wait for the
+    // in-flight mutations to be applied
+    ::dsn::service::zlock    apply_lock;
+
+    // replica thread only, 0 when everything queued is applied
+    decree                   last_queued_decree;
+};
+
+//
+// load of the replica, which is reported to meta server on config sync for
+// load balancing; it is updated on the replica thread and collected on the
+// config sync thread, so all states are atomic
+//
+class load_context
+{
+public:
+    load_context();
+
+    // one client request is served, with its latency (0 for unknown)
+    void on_request(uint64_t latency_ns);
+    void on_write(uint64_t bytes) { _write_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+    void set_log_backlog(int64_t backlog) { _log_backlog.store(backlog, std::memory_order_relaxed); }
+
+    // rates are computed over the period since last collect
+    void collect(/*out*/ partition_load& load);
+
+private:
+    enum { LATENCY_SAMPLE_COUNT = 256 };
 
+    std::atomic<uint64_t> _request_count;
+    std::atomic<uint64_t> _write_bytes;
+    std::atomic<int64_t>  _log_backlog;
+    std::atomic<uint32_t> _latency_pos;
+    std::atomic<uint32_t> _latency_us[LATENCY_SAMPLE_COUNT]; // ring of recent samples
 
+    ::dsn::service::zlock _collect_lock;
+    uint64_t              _last_collect_ms;
+    uint64_t              _last_request_count;
+    uint64_t              _last_write_bytes;
 };
 
 //---------------inline impl----------------------------------------------------------------
@@ -178,8 +178,12 @@ error_code replica::init_app_and_prepare_list(const char* app_type, bool create_
                 log_dir,
                 true,
                 _options->log_batch_buffer_MB,
-                _options->log_file_size_mb
+                _options->log_file_size_mb,
+                _options->log_batch_write,
+                _options->log_pending_max_ms_private,
+                _options->log_max_concurrent_writes
                 );
+            _private_log->set_replay_prefetch_files_before_open(_options->log_replay_prefetch_files);
         }
 
         // sync vaid start log offset between app and logs
@@ -249,7 +253,7 @@ error_code replica::init_app_and_prepare_list(const char* app_type, bool create_
                 &replica::on_check_timer,
                 gpid_to_hash(get_gpid()),
                 0,
-                5 * 60 * 1000 // check every five mins
+                _options->checkpoint_interval_seconds * 1000
                 );
         }
     }
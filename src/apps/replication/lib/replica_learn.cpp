@@ -37,6 +37,8 @@
 #include "mutation.h"
 #include "mutation_log.h"
 #include "replica_stub.h"
+#include <fstream>
+#include <sstream>
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -216,6 +218,9 @@ void replica::on_learn(dsn_message_t msg, const learn_request& request)
         local_committed_decree = last_committed_decree();
     }
 
+    // the app state to be learned must cover all the committed mutations
+    drain_apply_queue();
+
     decree learn_start_decree = request.last_committed_decree_in_app + 1;
     bool delayed_replay_prepare_list = false;
 
@@ -470,6 +475,11 @@ void replica::on_learn_reply(
             );
     }
    
+    else if (resp->state.files.size() > 0 && !_options->learn_stream_disabled)
+    {
+        start_learn_stream(resp);
+    }
+
     else if (resp->state.files.size() > 0)
     {
         utils::filesystem::remove_path(_app->learn_dir());
@@ -728,6 +738,540 @@ void replica::on_add_learner(const group_check_request& request)
     }
 }
 
+void replica::on_learn_chunk(dsn_message_t msg, const learn_chunk_request& request)
+{
+    check_hashed_access();
+
+    learn_chunk_response response;
+    response.err = ERR_OK;
+    response.file_size = 0;
+    response.file_mtime = 0;
+    response.append_only = false;
+
+    if (PS_PRIMARY != status())
+    {
+        response.err = ERR_INVALID_STATE;
+        reply(msg, response);
+        return;
+    }
+
+    auto it = _primary_states.learners.find(request.learner);
+    if (it == _primary_states.learners.end() || it->second.signature != static_cast<uint64_t>(request.signature))
+    {
+        response.err = ERR_OBJECT_NOT_FOUND;
+        reply(msg, response);
+        return;
+    }
+
+    // only the files under the dirs given out by on_learn are served
+    if ((request.base_local_dir != _app->data_dir()
+            && (_private_log == nullptr || request.base_local_dir != _private_log->dir()))
+        || request.file.find("..") != std::string::npos
+        || request.offset < 0
+        || request.size <= 0)
+    {
+        response.err = ERR_INVALID_PARAMETERS;
+        reply(msg, response);
+        return;
+    }
+
+    std::string path = utils::filesystem::path_combine(request.base_local_dir, request.file);
+    if (!utils::filesystem::file_size(path, response.file_size))
+    {
+        derror("%s: on_learn_chunk %s, get size of %s failed", name(), request.learner.to_string(), path.c_str());
+        response.err = ERR_FILE_OPERATION_FAILED;
+        reply(msg, response);
+        return;
+    }
+
+    // so that the learner resumes only from a prefix of the same content
+    time_t mtime = 0;
+    if (!utils::filesystem::last_write_time(path, mtime))
+    {
+        derror("%s: on_learn_chunk %s, get last write time of %s failed", name(), request.learner.to_string(), path.c_str());
+        response.err = ERR_FILE_OPERATION_FAILED;
+        reply(msg, response);
+        return;
+    }
+    response.file_mtime = static_cast<int64_t>(mtime);
+    response.append_only = (_private_log != nullptr && request.base_local_dir == _private_log->dir());
+
+    // beyond the end, reply with the file size only
+    if (request.offset >= response.file_size)
+    {
+        reply(msg, response);
+        return;
+    }
+
+    dsn_handle_t hfile = dsn_file_open(path.c_str(), O_RDONLY | O_BINARY, 0);
+    if (nullptr == hfile)
+    {
+        derror("%s: on_learn_chunk %s, open %s failed", name(), request.learner.to_string(), path.c_str());
+        response.err = ERR_FILE_OPERATION_FAILED;
+        reply(msg, response);
+        return;
+    }
+
+    int size = std::min(request.size, _options->learn_stream_chunk_kb * 1024);
+    if (static_cast<int64_t>(size) > response.file_size - request.offset)
+        size = static_cast<int>(response.file_size - request.offset);
+
+    std::shared_ptr<char> buffer(new char[size], std::default_delete<char[]>());
+    rpc_replier<learn_chunk_response> replier(dsn_msg_create_response(msg));
+    
+    file::read(hfile, buffer.get(), size, request.offset, LPC_LEARN_CHUNK_READ, this,
+        [hfile, buffer, response, replier](error_code err, size_t sz) mutable
+        {
+            dsn_file_close(hfile);
+            if (err == ERR_OK && sz > 0)
+                response.data = blob(buffer, static_cast<int>(sz));
+            else
+                response.err = ERR_FILE_OPERATION_FAILED;
+            replier(response);
+        },
+        gpid_to_hash(get_gpid())
+        );
+}
+
+//
+// learn.stream.source in learn dir records where the local files are learned
+// from, as the learnee address and dir in the first line, followed by one line
+// for each file as "<remote mtime> <remote size> <file>", i.e., the identity of
+// the remote file when its local prefix is started
+//
+static void load_learn_stream_source(
+    const std::string& path,
+    /*out*/ std::string& source,
+    /*out*/ std::map<std::string, std::string>& identities
+    )
+{
+    std::ifstream is(path.c_str());
+    if (!is.is_open())
+        return;
+
+    std::getline(is, source);
+
+    std::string line;
+    while (std::getline(is, line))
+    {
+        auto pos = line.find(' ');
+        pos = (pos == std::string::npos ? pos : line.find(' ', pos + 1));
+        if (pos != std::string::npos)
+            identities[line.substr(pos + 1)] = line.substr(0, pos);
+    }
+}
+
+static void save_learn_stream_source(learn_stream_context_ptr& stream)
+{
+    std::ofstream os(stream->source_path.c_str());
+    os << stream->source << std::endl;
+    for (size_t i = 0; i < stream->identities.size(); i++)
+    {
+        if (stream->identities[i].length() > 0)
+            os << stream->identities[i] << " " << stream->resp->state.files[i] << std::endl;
+    }
+}
+
+void replica::start_learn_stream(std::shared_ptr<learn_response>& resp)
+{
+    learn_stream_context_ptr stream(new learn_stream_context(resp));
+    
+    // files received in previous rounds are kept and resumed only when 
+    // they are from the same source, and when the remote files are not
+    // changed since (see on_learn_chunk_reply)
+    stream->source = std::string(resp->config.primary.to_string()) + " " + resp->base_local_dir;
+    stream->source_path = utils::filesystem::path_combine(_app->learn_dir(), "learn.stream.source");
+
+    std::string last_source;
+    std::map<std::string, std::string> identities;
+    load_learn_stream_source(stream->source_path, last_source, identities);
+
+    if (last_source != stream->source)
+    {
+        utils::filesystem::remove_path(_app->learn_dir());
+        utils::filesystem::create_directory(_app->learn_dir());
+        identities.clear();
+    }
+
+    uint64_t resumed_bytes = 0;
+    for (auto& f : resp->state.files)
+    {
+        int64_t sz = 0;
+        std::string path = utils::filesystem::path_combine(_app->learn_dir(), f);
+        if (!utils::filesystem::file_exists(path) || !utils::filesystem::file_size(path, sz))
+            sz = 0;
+
+        auto it = identities.find(f);
+        std::string identity = (it != identities.end() ? it->second : std::string());
+
+        // a local prefix of unknown origin is of no use
+        if (sz > 0 && identity.length() == 0)
+        {
+            utils::filesystem::remove_path(path);
+            sz = 0;
+        }
+
+        stream->resume_offsets.push_back(sz);
+        stream->identities.push_back(identity);
+        stream->file_sizes.push_back(-1);
+        resumed_bytes += sz;
+    }
+    save_learn_stream_source(stream);
+
+    stream->request_offset = stream->resume_offsets[0];
+    stream->write_offset = stream->resume_offsets[0];
+    _potential_secondary_states.learn_stream = stream;
+
+    ddebug(
+        "%s: start_learn_stream %d files from %s, with %llu bytes resumed",
+        name(),
+        static_cast<int>(resp->state.files.size()),
+        resp->config.primary.to_string(),
+        static_cast<unsigned long long>(resumed_bytes)
+        );
+
+    continue_learn_stream(stream);
+}
+
+void replica::continue_learn_stream(learn_stream_context_ptr stream)
+{
+    check_hashed_access();
+
+    if (stream != _potential_secondary_states.learn_stream)
+        return;
+
+    auto& files = stream->resp->state.files;
+    int chunk_bytes = _options->learn_stream_chunk_kb * 1024;
+
+    // flow control, as received chunks are also counted before they are written
+    while (stream->inflight_count + static_cast<int>(stream->received_chunks.size()) < _options->learn_stream_window)
+    {
+        int f;
+        int64_t offset;
+
+        if (!stream->retry_chunks.empty())
+        {
+            f = stream->retry_chunks.front().first;
+            offset = stream->retry_chunks.front().second;
+            stream->retry_chunks.pop_front();
+        }
+        else
+        {
+            if (stream->request_file >= static_cast<int>(files.size()))
+                break;
+
+            int64_t size = stream->file_sizes[stream->request_file];
+
+            // wait for the file size from the reply of the first chunk
+            if (size == -1 && stream->request_offset > stream->resume_offsets[stream->request_file])
+                break;
+
+            if (size != -1 && stream->request_offset >= size)
+            {
+                if (++stream->request_file < static_cast<int>(files.size()))
+                    stream->request_offset = stream->resume_offsets[stream->request_file];
+                continue;
+            }
+
+            f = stream->request_file;
+            offset = stream->request_offset;
+            stream->request_offset += chunk_bytes;
+        }
+
+        // bandwidth cap
+        if (_options->learn_stream_max_mb_per_second > 0)
+        {
+            uint64_t due_ms = stream->start_ms + stream->requested_bytes * 1000ULL 
+                / (static_cast<uint64_t>(_options->learn_stream_max_mb_per_second) * 1024 * 1024);
+            uint64_t nts = now_ms();
+            if (due_ms > nts)
+            {
+                stream->retry_chunks.push_front(std::make_pair(f, offset));
+                if (stream->continue_task == nullptr)
+                {
+                    stream->continue_task = tasking::enqueue(
+                        LPC_LEARN_STREAM_CONTINUE,
+                        this,
+                        [this, stream]() 
+                        {
+                            stream->continue_task = nullptr;
+                            continue_learn_stream(stream);
+                        },
+                        gpid_to_hash(get_gpid()),
+                        static_cast<int>(due_ms - nts)
+                        );
+                }
+                break;
+            }
+        }
+
+        learn_chunk_request request;
+        request.gpid = get_gpid();
+        request.learner = primary_address();
+        request.signature = _potential_secondary_states.learning_signature;
+        request.base_local_dir = stream->resp->base_local_dir;
+        request.file = files[f];
+        request.offset = offset;
+        request.size = chunk_bytes;
+
+        dsn_message_t msg = dsn_msg_create_request(RPC_LEARN_CHUNK, 0, gpid_to_hash(get_gpid()));
+        ::marshall(msg, request);
+
+        rpc::call(stream->resp->config.primary, msg,
+            this,
+            std::bind(&replica::on_learn_chunk_reply,
+                this,
+                stream,
+                f,
+                offset,
+                std::placeholders::_1,
+                std::placeholders::_2,
+                std::placeholders::_3),
+            gpid_to_hash(get_gpid())
+            );
+
+        stream->inflight_count++;
+        stream->requested_bytes += chunk_bytes;
+    }
+}
+
+void replica::on_learn_chunk_reply(
+    learn_stream_context_ptr stream, 
+    int file_index, 
+    int64_t offset, 
+    error_code err, 
+    dsn_message_t request, 
+    dsn_message_t reply
+    )
+{
+    check_hashed_access();
+
+    if (stream != _potential_secondary_states.learn_stream)
+        return;
+
+    stream->inflight_count--;
+
+    // transfer failure (e.g., timeout or disconnection), resume from the failed chunk later
+    if (err != ERR_OK)
+    {
+        if (++stream->failure_count > _options->learn_stream_max_retries)
+        {
+            derror("%s: learn stream chunk %s@%lld failed with err = %s, too many failures",
+                name(), stream->resp->state.files[file_index].c_str(), static_cast<long long int>(offset), err.to_string());
+            handle_learning_error(err);
+            return;
+        }
+
+        dwarn("%s: learn stream chunk %s@%lld failed with err = %s, retry later",
+            name(), stream->resp->state.files[file_index].c_str(), static_cast<long long int>(offset), err.to_string());
+
+        stream->retry_chunks.push_back(std::make_pair(file_index, offset));
+        if (stream->continue_task == nullptr)
+        {
+            stream->continue_task = tasking::enqueue(
+                LPC_LEARN_STREAM_CONTINUE,
+                this,
+                [this, stream]()
+                {
+                    stream->continue_task = nullptr;
+                    continue_learn_stream(stream);
+                },
+                gpid_to_hash(get_gpid()),
+                1000
+                );
+        }
+        return;
+    }
+
+    learn_chunk_response response;
+    ::unmarshall(reply, response);
+
+    if (response.err != ERR_OK)
+    {
+        derror("%s: learn stream chunk %s@%lld failed with remote err = %s",
+            name(), stream->resp->state.files[file_index].c_str(), static_cast<long long int>(offset), response.err.to_string());
+        handle_learning_error(response.err);
+        return;
+    }
+
+    stream->failure_count = 0;
+
+    // the first reply of a file, which is the only one in flight for the file
+    if (stream->file_sizes[file_index] == -1)
+    {
+        auto& file = stream->resp->state.files[file_index];
+        std::ostringstream identity;
+        identity << response.file_mtime << " " << response.file_size;
+
+        // the local prefix is kept when the remote file is not changed since
+        // it is started, or is appended only; otherwise the file is learned
+        // from scratch, as the new content must not be appended to a stale prefix
+        int64_t resumed = stream->resume_offsets[file_index];
+        if (resumed > 0
+            && (response.append_only ? response.file_size < resumed : identity.str() != stream->identities[file_index]))
+        {
+            dwarn("%s: learn stream file %s is changed on remote (%s vs %s), with %lld bytes received, learn it from scratch",
+                name(),
+                file.c_str(),
+                identity.str().c_str(),
+                stream->identities[file_index].c_str(),
+                static_cast<long long int>(resumed)
+                );
+
+            utils::filesystem::remove_path(utils::filesystem::path_combine(_app->learn_dir(), file));
+            stream->resume_offsets[file_index] = 0;
+            if (stream->request_file == file_index)
+                stream->request_offset = 0;
+            if (stream->write_file == file_index)
+                stream->write_offset = 0;
+
+            stream->identities[file_index] = identity.str();
+            save_learn_stream_source(stream);
+            stream->file_sizes[file_index] = response.file_size;
+
+            // the data of this reply is requested again with the rest
+            continue_learn_stream(stream);
+            return;
+        }
+
+        if (resumed == 0 || response.append_only)
+        {
+            stream->identities[file_index] = identity.str();
+            save_learn_stream_source(stream);
+        }
+
+        // files like private logs may grow during learning, 
+        // only the part seen by the first reply is learned
+        stream->file_sizes[file_index] = response.file_size;
+    }
+
+    int64_t size = stream->file_sizes[file_index];
+    if (offset >= size)
+        response.data = blob();
+    else if (response.data.length() == 0)
+    {
+        derror("%s: learn stream file %s is truncated on remote during learning",
+            name(), stream->resp->state.files[file_index].c_str());
+        handle_learning_error(ERR_LEARN_FILE_FALED);
+        return;
+    }
+    else if (offset + response.data.length() > size)
+        response.data = response.data.range(0, static_cast<int>(size - offset));
+
+    stream->received_chunks[std::make_pair(file_index, offset)] = response.data;
+
+    write_learn_stream(stream);
+    continue_learn_stream(stream);
+}
+
+void replica::write_learn_stream(learn_stream_context_ptr stream)
+{
+    if (stream->is_writing)
+        return;
+
+    auto& files = stream->resp->state.files;
+    while (stream->write_file < static_cast<int>(files.size()))
+    {
+        int64_t size = stream->file_sizes[stream->write_file];
+
+        // current file is done, drop the empty chunks beyond its end
+        if (size != -1 && stream->write_offset >= size)
+        {
+            if (stream->write_handle != nullptr)
+            {
+                dsn_file_close(stream->write_handle);
+                stream->write_handle = nullptr;
+            }
+
+            stream->received_chunks.erase(
+                stream->received_chunks.lower_bound(std::make_pair(stream->write_file, static_cast<int64_t>(0))),
+                stream->received_chunks.lower_bound(std::make_pair(stream->write_file + 1, static_cast<int64_t>(0)))
+                );
+
+            if (++stream->write_file < static_cast<int>(files.size()))
+                stream->write_offset = stream->resume_offsets[stream->write_file];
+            continue;
+        }
+
+        auto it = stream->received_chunks.find(std::make_pair(stream->write_file, stream->write_offset));
+        if (it == stream->received_chunks.end())
+            return;
+
+        if (stream->write_handle == nullptr)
+        {
+            std::string path = utils::filesystem::path_combine(_app->learn_dir(), files[stream->write_file]);
+            utils::filesystem::create_directory(utils::filesystem::remove_file_name(path));
+
+            stream->write_handle = dsn_file_open(path.c_str(), O_RDWR | O_CREAT | O_BINARY, 0666);
+            if (nullptr == stream->write_handle)
+            {
+                derror("%s: learn stream open %s failed", name(), path.c_str());
+                handle_learning_error(ERR_FILE_OPERATION_FAILED);
+                return;
+            }
+        }
+
+        stream->is_writing = true;
+        blob data = it->second;
+        file::write(
+            stream->write_handle,
+            data.data(),
+            data.length(),
+            stream->write_offset,
+            LPC_LEARN_CHUNK_WRITE,
+            this,
+            std::bind(&replica::on_learn_chunk_written,
+                this,
+                stream,
+                data,
+                std::placeholders::_1,
+                std::placeholders::_2),
+            gpid_to_hash(get_gpid())
+            );
+        return;
+    }
+
+    // all files are received
+    ddebug(
+        "%s: learn stream completed, %llu bytes received in %llu ms",
+        name(),
+        static_cast<unsigned long long>(stream->written_bytes),
+        static_cast<unsigned long long>(now_ms() - stream->start_ms)
+        );
+
+    _potential_secondary_states.learn_stream = nullptr;
+    _potential_secondary_states.learn_remote_files_task = tasking::enqueue(
+        LPC_LEARN_REMOTE_DELTA_FILES,
+        this,
+        std::bind(&replica::on_copy_remote_state_completed, this, ERR_OK, static_cast<size_t>(stream->written_bytes), stream->resp)
+        );
+}
+
+void replica::on_learn_chunk_written(learn_stream_context_ptr stream, ::dsn::blob data, error_code err, size_t size)
+{
+    check_hashed_access();
+
+    stream->is_writing = false;
+    if (stream != _potential_secondary_states.learn_stream)
+        return;
+
+    auto& file = stream->resp->state.files[stream->write_file];
+    if (err != ERR_OK || size != static_cast<size_t>(data.length()))
+    {
+        derror("%s: learn stream write %s@%lld failed, err = %s",
+            name(), file.c_str(), static_cast<long long int>(stream->write_offset), err.to_string());
+        handle_learning_error(ERR_FILE_OPERATION_FAILED);
+        return;
+    }
+
+    stream->received_chunks.erase(std::make_pair(stream->write_file, stream->write_offset));
+    stream->write_offset += size;
+    stream->written_bytes += size;
+
+    write_learn_stream(stream);
+    continue_learn_stream(stream);
+}
+
 error_code replica::apply_learned_state_from_private_log(learn_state& state)
 {
     int64_t offset;
@@ -758,7 +1302,8 @@ error_code replica::apply_learned_state_from_private_log(learn_state& state)
             plist.prepare(mu, PS_SECONDARY);
             return true;
         },
-        offset
+        offset,
+        _options->log_replay_prefetch_files
         );
 
     // apply in-buffer private logs
@@ -108,8 +108,12 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
         log_dir,
         false,
         opts.log_batch_buffer_MB,
-        opts.log_file_size_mb
+        opts.log_file_size_mb,
+        opts.log_batch_write,
+        opts.log_pending_max_ms,
+        opts.log_max_concurrent_writes
         );
+    _log->set_replay_prefetch_files_before_open(opts.log_replay_prefetch_files);
 
     // init rps
     replicas rps;
@@ -258,7 +262,7 @@ void replica_stub::initialize(const replication_options& opts, bool clear/* = fa
         _config_sync_timer_task = tasking::enqueue(
             LPC_QUERY_CONFIGURATION_ALL,
             this,
-            &replica_stub::query_configuration_by_node,
+            &replica_stub::on_config_sync_timer,
             0, 
             0,
             _options.config_sync_interval_ms
@@ -424,6 +428,24 @@ void replica_stub::on_prepare(dsn_message_t request)
     }
 }
 
+void replica_stub::on_prepare_stream(dsn_message_t request)
+{
+    global_partition_id gpid;
+    ::unmarshall(request, gpid);
+    replica_ptr rep = get_replica(gpid);
+    if (rep != nullptr)
+    {
+        rep->on_prepare_stream(request);
+    }
+    else
+    {
+        prepare_ack resp;
+        resp.gpid = gpid;
+        resp.err = ERR_OBJECT_NOT_FOUND;
+        reply(request, resp);
+    }
+}
+
 void replica_stub::on_group_check(const group_check_request& request, /*out*/ group_check_response& response)
 {
     if (!is_connected()) return;
@@ -469,6 +491,25 @@ void replica_stub::on_learn(dsn_message_t msg)
     }
 }
 
+void replica_stub::on_learn_chunk(dsn_message_t msg)
+{
+    learn_chunk_request request;
+    ::unmarshall(msg, request);
+
+    replica_ptr rep = get_replica(request.gpid);
+    if (rep != nullptr)
+    {
+        rep->on_learn_chunk(msg, request);
+    }
+    else
+    {
+        learn_chunk_response response;
+        response.err = ERR_OBJECT_NOT_FOUND;
+        response.file_size = 0;
+        reply(msg, response);
+    }
+}
+
 void replica_stub::on_learn_completion_notification(const group_check_response& report)
 {
     replica_ptr rep = get_replica(report.gpid);
@@ -506,6 +547,13 @@ void replica_stub::on_remove(const replica_configuration& request)
     }
 }
 
+void replica_stub::on_config_sync_timer()
+{
+    zauto_lock l(_replicas_lock);
+    query_configuration_by_node();
+}
+
+// _replicas_lock is held by the caller
 void replica_stub::query_configuration_by_node()
 {
     if (_state == NS_Disconnected)
@@ -522,6 +570,17 @@ void replica_stub::query_configuration_by_node()
 
     configuration_query_by_node_request req;
     req.node = primary_address();
+    
+    // piggyback the loads of all replicas for load balancing on meta server
+    for (auto& r : _replicas)
+    {
+        partition_load load;
+        r.second->collect_load(load);
+        req.loads.push_back(load);
+    }
+# ifdef DSN_NOT_USE_DEFAULT_SERIALIZATION
+    req.__isset.loads = (req.loads.size() > 0);
+# endif
     ::marshall(msg, req);
 
     rpc_address target(_failure_detector->get_servers());
@@ -921,6 +980,18 @@ void replica_stub::open_replica(const std::string app_type, global_partition_id
     }
 }
 
+bool replica_stub::is_lease_valid() const
+{
+    if (!is_connected())
+        return false;
+
+    // no lease when failure detection is disabled
+    if (nullptr == _failure_detector)
+        return true;
+
+    return dsn_now_ms() < _failure_detector->get_master_lease_expire_ms(_failure_detector->current_server_contact());
+}
+
 ::dsn::task_ptr replica_stub::begin_close_replica(replica_ptr r)
 {
     zauto_lock l(_replicas_lock);
@@ -1003,7 +1074,9 @@ void replica_stub::open_service()
     register_rpc_handler(RPC_CONFIG_PROPOSAL, "ProposeConfig", &replica_stub::on_config_proposal);
 
     register_rpc_handler(RPC_PREPARE, "prepare", &replica_stub::on_prepare);
+    register_rpc_handler(RPC_PREPARE_STREAM, "PrepareStream", &replica_stub::on_prepare_stream);
     register_rpc_handler(RPC_LEARN, "Learn", &replica_stub::on_learn);
+    register_rpc_handler(RPC_LEARN_CHUNK, "LearnChunk", &replica_stub::on_learn_chunk);
     register_rpc_handler(RPC_LEARN_COMPLETION_NOTIFY, "LearnNotify", &replica_stub::on_learn_completion_notification);
     register_rpc_handler(RPC_LEARN_ADD_LEARNER, "LearnAdd", &replica_stub::on_add_learner);
     register_rpc_handler(RPC_REMOVE_REPLICA, "remove", &replica_stub::on_remove);
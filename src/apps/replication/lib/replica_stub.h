@@ -47,6 +47,7 @@ namespace dsn { namespace replication {
 
 class mutation_log;
 class replication_failure_detector;
+class replica_tester;
 typedef std::unordered_map<global_partition_id, replica_ptr> replicas;
 // from, new replica config, isClosing
 typedef std::function<void (::dsn::rpc_address, const replica_configuration&, bool)> replica_state_subscriber;
@@ -85,7 +86,9 @@ public:
     //        - learn
     //
     void on_prepare(dsn_message_t request);    
+    void on_prepare_stream(dsn_message_t request);
     void on_learn(dsn_message_t msg);
+    void on_learn_chunk(dsn_message_t msg);
     void on_learn_completion_notification(const group_check_response& report);
     void on_add_learner(const group_check_request& request);
     void on_remove(const replica_configuration& request);
@@ -113,6 +116,7 @@ public:
     replica_ptr get_replica(int32_t app_id, int32_t partition_index);
     replication_options& options() { return _options; }
     bool is_connected() const { return NS_Connected == _state; }
+    bool is_lease_valid() const;
     
 private:    
     enum replica_node_state
@@ -123,6 +127,7 @@ private:
     };
 
     void query_configuration_by_node();
+    void on_config_sync_timer();
     void on_meta_server_disconnected_scatter(replica_stub_ptr this_, global_partition_id gpid);
     void on_node_query_reply(error_code err, dsn_message_t request, dsn_message_t response);
     void on_node_query_reply_scatter(replica_stub_ptr this_, const partition_configuration& config);
@@ -139,6 +144,7 @@ private:
 
 private:
     friend class ::dsn::replication::replication_checker;    
+    friend class ::dsn::replication::replica_tester;
     typedef std::unordered_map<global_partition_id, ::dsn::task_ptr> opening_replicas;
     typedef std::unordered_map<global_partition_id, std::pair<::dsn::task_ptr, replica_ptr>> closing_replicas; // <close, replica>
 
@@ -83,9 +83,25 @@ namespace dsn {
             dassert(nullptr != _private_log, "log_enable_private_prepare must be true for checkpointing");
 
             // TODO: when NOT to checkpoint, but use private log replay to build the state
-            if (last_committed_decree() - last_durable_decree() < 10000)
+            if (last_committed_decree() - last_durable_decree() < _options->checkpoint_min_decree_gap)
                 return;
 
+            // the app snapshots its state and writes it in the background,
+            // so there is no need to freeze the replica
+            if (_app->is_async_checkpoint_supported())
+            {
+                auto lerr = _app->flush(false);
+                if (lerr != 0)
+                {
+                    derror("%s: async checkpoint failed, err = %d", name(), lerr);
+                    handle_local_failure(ERR_LOCAL_APP_FAILURE);
+                }
+                return;
+            }
+
+            // the checkpoint must cover all the committed mutations
+            drain_apply_queue();
+
             // primary is downgraded to secondary for checkpointing as no write can be seen
             // during checkpointing (i.e., state is freezed)
             if (PS_PRIMARY == status())
@@ -125,6 +125,7 @@ replication_app_base::replication_app_base(replica* replica)
     _dir_data = replica->dir() + "/data";
     _dir_learn = replica->dir() + "/learn";
     _is_delta_state_learning_supported = false;
+    _is_async_checkpoint_supported = false;
 
     _replica = replica;
     _last_committed_decree = _last_durable_decree = 0;
@@ -165,9 +166,26 @@ error_code replication_app_base::write_internal(mutation_ptr& mu)
 
     if (mu->rpc_code != RPC_REPLICATION_WRITE_EMPTY)
     {
-        binary_reader reader(mu->data.updates[0]);
-        dsn_message_t resp = (mu->client_msg() ? dsn_msg_create_response(mu->client_msg()) : nullptr);
-        dispatch_rpc_call(mu->rpc_code, reader, resp);
+        // batched requests are applied in order, and only the primary
+        // has the client requests to reply; the write handlers do not
+        // touch the decree, which is advanced once after the whole batch
+        // so that no reader observes a half-applied decree
+        auto& requests = mu->client_requests();
+        on_batched_write_begin();
+
+        for (size_t i = 0; i < mu->data.updates.size(); i++)
+        {
+            binary_reader reader(mu->data.updates[i]);
+            dsn_message_t resp = (i < requests.size() ? dsn_msg_create_response(requests[i]) : nullptr);
+            dispatch_rpc_call(mu->rpc_code, reader, resp);
+        }
+
+        dassert(mu->data.header.decree == last_committed_decree() + 1,
+            "write handlers must not advance the decree, app decree %lld vs mutation decree %lld",
+            last_committed_decree(), mu->data.header.decree);
+        _last_committed_decree = mu->data.header.decree;
+
+        on_batched_write_end();
     }
     else
     {
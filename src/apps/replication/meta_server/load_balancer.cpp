@@ -41,8 +41,8 @@
 # endif
 # define __TITLE__ "load.balancer"
 
-load_balancer::load_balancer(server_state* state)
-: _state(state), serverlet<load_balancer>("load_balancer")
+load_balancer::load_balancer(server_state* state, const replication_options& opts)
+: _state(state), _opts(opts), serverlet<load_balancer>("load_balancer")
 {
 }
 
@@ -53,6 +53,9 @@ load_balancer::~load_balancer()
 void load_balancer::run()
 {
     zauto_read_lock l(_state->_lock);
+    zauto_lock l2(_balance_lock);
+
+    compute_node_loads();
 
     for (size_t i = 0; i < _state->_apps.size(); i++)
     {
@@ -64,30 +67,157 @@ void load_balancer::run()
             run_lb(pc);
         }
     }
+
+    migrate_primaries();
 }
 
 void load_balancer::run(global_partition_id gpid)
 {
     zauto_read_lock l(_state->_lock);
+    zauto_lock l2(_balance_lock);
+
+    compute_node_loads();
+
     partition_configuration& pc = _state->_apps[gpid.app_id - 1].partitions[gpid.pidx];
     run_lb(pc);
 }
 
-::dsn::rpc_address load_balancer::find_minimal_load_machine(bool primaryOnly)
+void load_balancer::compute_node_loads()
 {
-    std::vector<std::pair<::dsn::rpc_address, int>> stats;
+    std::unordered_map<::dsn::rpc_address, std::pair<node_metrics, node_metrics>> metrics;
+    node_metrics sum, sum_primary;
 
-    for (auto it = _state->_nodes.begin(); it != _state->_nodes.end(); it++)
+    for (auto& kv : _state->_nodes)
     {
-        if (it->second.is_alive)
+        auto& ns = kv.second;
+        if (!ns.is_alive)
+            continue;
+
+        node_metrics all, pri;
+        all.count = static_cast<double>(ns.partitions.size());
+        pri.count = static_cast<double>(ns.primaries.size());
+
+        if (_opts.lb_load_aware)
+        {
+            for (auto& ld : ns.loads)
+            {
+                // the report may be out-dated against the current configuration
+                if (ns.partitions.find(ld.first) == ns.partitions.end())
+                    continue;
+
+                bool is_primary = (ns.primaries.find(ld.first) != ns.primaries.end());
+                for (auto m : { &all, &pri })
+                {
+                    if (m == &pri && !is_primary)
+                        continue;
+
+                    m->qps += ld.second.qps;
+                    m->write_bytes += ld.second.write_bytes_per_second;
+                    m->log_backlog += static_cast<double>(ld.second.log_backlog);
+                    m->latency = std::max(m->latency, static_cast<double>(ld.second.p99_latency_us));
+                }
+            }
+        }
+
+        for (auto t : { std::make_pair(&sum, &all), std::make_pair(&sum_primary, &pri) })
         {
-            stats.push_back(std::make_pair(it->first, static_cast<int>(primaryOnly ? it->second.primaries.size()
-                : it->second.partitions.size())));
+            t.first->qps += t.second->qps;
+            t.first->write_bytes += t.second->write_bytes;
+            t.first->log_backlog += t.second->log_backlog;
+            t.first->latency += t.second->latency;
+            t.first->count += t.second->count;
         }
+
+        metrics[kv.first] = std::make_pair(all, pri);
+    }
+
+    _node_loads.clear();
+    if (metrics.empty())
+        return;
+
+    double n = static_cast<double>(metrics.size());
+    for (auto t : { std::make_pair(&_avg, &sum), std::make_pair(&_avg_primary, &sum_primary) })
+    {
+        t.first->qps = t.second->qps / n;
+        t.first->write_bytes = t.second->write_bytes / n;
+        t.first->log_backlog = t.second->log_backlog / n;
+        t.first->latency = t.second->latency / n;
+        t.first->count = t.second->count / n;
+    }
+
+    for (auto& kv : metrics)
+    {
+        node_load& ld = _node_loads[kv.first];
+        ld.score = score(kv.second.first, _avg);
+        ld.primary_score = score(kv.second.second, _avg_primary);
+        ld.report_count = _state->_nodes[kv.first].load_report_count;
+    }
+}
+
+double load_balancer::score(const node_metrics& m, const node_metrics& avg) const
+{
+    // metrics are normalized by the cluster average, and a zero average means 
+    // the metric is not available at all
+    double s = _opts.lb_weight_partition_count * m.count / (avg.count > 0 ? avg.count : 1.0);
+    if (avg.qps > 0)
+        s += _opts.lb_weight_qps * m.qps / avg.qps;
+    if (avg.write_bytes > 0)
+        s += _opts.lb_weight_write_bytes * m.write_bytes / avg.write_bytes;
+    if (avg.log_backlog > 0)
+        s += _opts.lb_weight_log_backlog * m.log_backlog / avg.log_backlog;
+    if (avg.latency > 0)
+        s += _opts.lb_weight_latency * m.latency / avg.latency;
+    return s;
+}
+
+double load_balancer::replica_score(const partition_load* load, bool primary) const
+{
+    // latency is not additive, so it is left for the next report
+    node_metrics m;
+    m.count = 1;
+    if (load != nullptr && _opts.lb_load_aware)
+    {
+        m.qps = load->qps;
+        m.write_bytes = load->write_bytes_per_second;
+        m.log_backlog = static_cast<double>(load->log_backlog);
     }
+    
+    node_metrics avg = primary ? _avg_primary : _avg;
+    avg.latency = 0;
+    return score(m, avg);
+}
 
+const partition_load* load_balancer::get_primary_load(const partition_configuration& pc) const
+{
+    if (pc.primary.is_invalid())
+        return nullptr;
+
+    auto it = _state->_nodes.find(pc.primary);
+    if (it == _state->_nodes.end())
+        return nullptr;
+
+    auto it2 = it->second.loads.find(pc.gpid);
+    if (it2 == it->second.loads.end() || it2->second.status != PS_PRIMARY)
+        return nullptr;
     
-    std::sort(stats.begin(), stats.end(), [](const std::pair<::dsn::rpc_address, int>& l, const std::pair<::dsn::rpc_address, int>& r)
+    return &it2->second;
+}
+
+::dsn::rpc_address load_balancer::find_minimal_load_machine(bool primaryOnly, const partition_configuration* exclude)
+{
+    std::vector<std::pair<::dsn::rpc_address, double>> stats;
+
+    for (auto& kv : _node_loads)
+    {
+        if (exclude != nullptr && 
+            (exclude->primary == kv.first || 
+            std::find(exclude->secondaries.begin(), exclude->secondaries.end(), kv.first) != exclude->secondaries.end()))
+            continue;
+
+        stats.push_back(std::make_pair(kv.first, primaryOnly ? kv.second.primary_score : kv.second.score));
+    }
+
+    std::sort(stats.begin(), stats.end(), [](const std::pair<::dsn::rpc_address, double>& l, const std::pair<::dsn::rpc_address, double>& r)
     {
         return l.second < r.second;
     });
@@ -98,16 +228,319 @@ void load_balancer::run(global_partition_id gpid)
     }
 
     int candidate_count = 1;
-    int val = stats[0].second;
+    double val = stats[0].second;
 
     for (size_t i = 1; i < stats.size(); i++)
     {
-        if (stats[i].second > val)
+        if (stats[i].second > val + 1e-6)
             break;
         candidate_count++;
     }
 
-    return stats[dsn_random32(0, candidate_count - 1)].first;
+    auto node = stats[dsn_random32(0, candidate_count - 1)].first;
+
+    // so that following placements in the same round see this one
+    auto& ld = _node_loads[node];
+    ld.score += replica_score(nullptr, false);
+    if (primaryOnly)
+        ld.primary_score += replica_score(nullptr, true);
+    return node;
+}
+
+::dsn::rpc_address load_balancer::find_primary_candidate(const partition_configuration& pc)
+{
+    // planned by migrate_primaries or balance_primaries
+    auto it = _primary_plans.find(pc.gpid);
+    if (it != _primary_plans.end())
+    {
+        auto target = it->second.target;
+        bool valid = (pc.ballot == it->second.ballot + 1 &&
+            std::find(pc.secondaries.begin(), pc.secondaries.end(), target) != pc.secondaries.end() &&
+            _node_loads.find(target) != _node_loads.end());
+        _primary_plans.erase(it);
+
+        if (valid)
+            return target;
+    }
+
+    // the least loaded alive secondary
+    ::dsn::rpc_address node;
+    double min_score = 0;
+    for (auto& s : pc.secondaries)
+    {
+        auto it2 = _node_loads.find(s);
+        if (it2 != _node_loads.end() && (node.is_invalid() || it2->second.primary_score < min_score))
+        {
+            node = s;
+            min_score = it2->second.primary_score;
+        }
+    }
+
+    if (node.is_invalid())
+    {
+        node = pc.secondaries[dsn_random32(0, static_cast<int>(pc.secondaries.size()) - 1)];
+    }
+    return node;
+}
+
+void load_balancer::migrate_primaries()
+{
+    if (!_opts.lb_load_aware || _opts.lb_max_migrations_per_round <= 0 || _node_loads.size() < 2)
+        return;
+
+    double avg = 0;
+    for (auto& kv : _node_loads)
+        avg += kv.second.primary_score;
+    avg /= static_cast<double>(_node_loads.size());
+
+    // hysteresis: only nodes above (1 + h) * avg are drained, and a primary
+    // is moved only when the target stays below the source by h * avg afterwards,
+    // so that the reverse move is never qualified
+    double margin = avg * _opts.lb_hysteresis_percentage / 100.0;
+    uint64_t now = dsn_now_ms();
+    int migrations = 0;
+
+    // a node is not touched again until its loads after the last migration are reported
+    auto is_fresh = [this](const ::dsn::rpc_address& node, const node_load& ld)
+    {
+        auto it = _migration_report_counts.find(node);
+        return it == _migration_report_counts.end() || ld.report_count > it->second;
+    };
+
+    std::vector<std::pair<::dsn::rpc_address, double>> hot_nodes;
+    for (auto& kv : _node_loads)
+    {
+        if (kv.second.primary_score > avg + margin && is_fresh(kv.first, kv.second))
+            hot_nodes.push_back(std::make_pair(kv.first, kv.second.primary_score));
+    }
+
+    std::sort(hot_nodes.begin(), hot_nodes.end(), [](const std::pair<::dsn::rpc_address, double>& l, const std::pair<::dsn::rpc_address, double>& r)
+    {
+        return l.second > r.second;
+    });
+
+    for (auto& hn : hot_nodes)
+    {
+        node_load& hot = _node_loads[hn.first];
+
+        // hottest primaries first
+        std::vector<std::pair<double, partition_configuration*>> candidates;
+        for (auto& gpid : _state->_nodes[hn.first].primaries)
+        {
+            partition_configuration& pc = _state->_apps[gpid.app_id - 1].partitions[gpid.pidx];
+            if (pc.primary != hn.first || static_cast<int>(pc.secondaries.size()) + 1 < pc.max_replica_count)
+                continue;
+
+            auto it = _last_migration_ms.find(gpid);
+            if (it != _last_migration_ms.end() && now < it->second + _opts.lb_migration_cooldown_ms)
+                continue;
+
+            candidates.push_back(std::make_pair(replica_score(get_primary_load(pc), true), &pc));
+        }
+
+        std::sort(candidates.begin(), candidates.end(), 
+            [](const std::pair<double, partition_configuration*>& l, const std::pair<double, partition_configuration*>& r)
+        {
+            return l.first > r.first;
+        });
+
+        for (auto& c : candidates)
+        {
+            partition_configuration& pc = *c.second;
+
+            ::dsn::rpc_address target;
+            node_load* target_load = nullptr;
+            for (auto& s : pc.secondaries)
+            {
+                auto it = _node_loads.find(s);
+                if (it != _node_loads.end() && is_fresh(s, it->second) &&
+                    (target_load == nullptr || it->second.primary_score < target_load->primary_score))
+                {
+                    target = s;
+                    target_load = &it->second;
+                }
+            }
+
+            if (target_load == nullptr || target_load->primary_score + c.first > hot.primary_score - margin)
+                continue;
+
+            ddebug("%s.%d.%d: migrate primary from %s (score %.2f) to %s (score %.2f), avg score = %.2f",
+                pc.app_type.c_str(), pc.gpid.app_id, pc.gpid.pidx,
+                hn.first.to_string(), hot.primary_score,
+                target.to_string(), target_load->primary_score,
+                avg
+                );
+
+            _migration_report_counts[hn.first] = hot.report_count;
+            _migration_report_counts[target] = target_load->report_count;
+            hot.primary_score -= c.first;
+            target_load->primary_score += c.first;
+
+            plan_primary_switch(pc, target, now);
+
+            if (++migrations >= _opts.lb_max_migrations_per_round)
+                return;
+
+            // at most one migration from the node before it reports again
+            break;
+        }
+    }
+}
+
+void load_balancer::plan_primary_switch(partition_configuration& pc, ::dsn::rpc_address target, uint64_t now)
+{
+    primary_plan plan;
+    plan.source = pc.primary;
+    plan.target = target;
+    plan.ballot = pc.ballot;
+    plan.ts_ms = now;
+    _primary_plans[pc.gpid] = plan;
+    _last_migration_ms[pc.gpid] = now;
+
+    // the new primary is assigned by run_lb after the downgrade is done
+    configuration_update_request proposal;
+    proposal.config = pc;
+    proposal.type = CT_DOWNGRADE_TO_SECONDARY;
+    proposal.node = pc.primary;
+    send_proposal(pc.primary, proposal);
+}
+
+bool load_balancer::is_switch_pending(const global_partition_id& gpid, const primary_plan& plan, uint64_t now) const
+{
+    const partition_configuration& pc = _state->_apps[gpid.app_id - 1].partitions[gpid.pidx];
+
+    // waiting for the downgrade, which may be lost
+    if (pc.ballot == plan.ballot && pc.primary == plan.source)
+        return now < plan.ts_ms + _opts.lb_primary_switch_timeout_ms;
+
+    // waiting for the upgrade
+    return pc.ballot == plan.ballot + 1 && pc.primary.is_invalid();
+}
+
+void load_balancer::balance_primaries()
+{
+    zauto_read_lock l(_state->_lock);
+    zauto_lock l2(_balance_lock);
+
+    if (_state->freezed() || _opts.lb_primary_balance_max_concurrent_switches <= 0)
+        return;
+
+    compute_node_loads();
+
+    // throttle with the switches on the way, and count them as done
+    uint64_t now = dsn_now_ms();
+    std::unordered_map<::dsn::rpc_address, int> counts;
+    int total = 0;
+    for (auto& kv : _node_loads)
+    {
+        int c = static_cast<int>(_state->_nodes[kv.first].primaries.size());
+        counts[kv.first] = c;
+        total += c;
+    }
+
+    if (counts.size() < 2)
+        return;
+
+    int budget = _opts.lb_primary_balance_max_concurrent_switches;
+    for (auto it = _primary_plans.begin(); it != _primary_plans.end();)
+    {
+        if (!is_switch_pending(it->first, it->second, now))
+        {
+            it = _primary_plans.erase(it);
+            continue;
+        }
+
+        budget--;
+        auto src = counts.find(it->second.source);
+        auto dst = counts.find(it->second.target);
+        if (src != counts.end() && src->second > 0)
+            src->second--;
+        if (dst != counts.end())
+            dst->second++;
+        it++;
+    }
+
+    // every node should end with lower or upper primaries
+    int n = static_cast<int>(counts.size());
+    int lower = total / n;
+    int upper = (total + n - 1) / n;
+
+    while (budget > 0)
+    {
+        std::vector<std::pair<::dsn::rpc_address, int>> sources(counts.begin(), counts.end());
+        std::sort(sources.begin(), sources.end(), [](const std::pair<::dsn::rpc_address, int>& l, const std::pair<::dsn::rpc_address, int>& r)
+        {
+            return l.second > r.second;
+        });
+
+        bool moved = false;
+        for (auto& src : sources)
+        {
+            if (src.second <= lower)
+                break;
+
+            // the coldest primary whose secondary is on the node with the least primaries,
+            // so that load-aware migrations are less disturbed
+            partition_configuration* best = nullptr;
+            ::dsn::rpc_address best_target;
+            int best_count = 0;
+            double best_score = 0;
+
+            for (auto& gpid : _state->_nodes[src.first].primaries)
+            {
+                partition_configuration& pc = _state->_apps[gpid.app_id - 1].partitions[gpid.pidx];
+                if (pc.primary != src.first
+                    || static_cast<int>(pc.secondaries.size()) + 1 < pc.max_replica_count
+                    || _primary_plans.find(gpid) != _primary_plans.end())
+                    continue;
+
+                auto it = _last_migration_ms.find(gpid);
+                if (it != _last_migration_ms.end() && now < it->second + _opts.lb_migration_cooldown_ms)
+                    continue;
+
+                double score = replica_score(get_primary_load(pc), true);
+                for (auto& s : pc.secondaries)
+                {
+                    auto cit = counts.find(s);
+                    if (cit == counts.end() || cit->second + 1 >= src.second)
+                        continue;
+
+                    // either the source is above upper, or the target is below lower
+                    if (src.second <= upper && cit->second >= lower)
+                        continue;
+
+                    if (best == nullptr || cit->second < best_count 
+                        || (cit->second == best_count && score < best_score))
+                    {
+                        best = &pc;
+                        best_target = s;
+                        best_count = cit->second;
+                        best_score = score;
+                    }
+                }
+            }
+
+            if (best != nullptr)
+            {
+                ddebug("%s.%d.%d: switch primary from %s (%d primaries) to %s (%d primaries) for primary balance, target = [%d, %d]",
+                    best->app_type.c_str(), best->gpid.app_id, best->gpid.pidx,
+                    src.first.to_string(), src.second,
+                    best_target.to_string(), best_count,
+                    lower, upper
+                    );
+
+                counts[src.first]--;
+                counts[best_target]++;
+                plan_primary_switch(*best, best_target, now);
+                budget--;
+                moved = true;
+                break;
+            }
+        }
+
+        if (!moved)
+            break;
+    }
 }
 
 void load_balancer::run_lb(partition_configuration& pc)
@@ -122,7 +555,7 @@ void load_balancer::run_lb(partition_configuration& pc)
     {
         if (pc.secondaries.size() > 0)
         {
-            proposal.node = pc.secondaries[dsn_random32(0, static_cast<int>(pc.secondaries.size()) - 1)];
+            proposal.node = find_primary_candidate(pc);
             proposal.type = CT_UPGRADE_TO_PRIMARY;
         }
 
@@ -155,10 +588,8 @@ void load_balancer::run_lb(partition_configuration& pc)
     else if (static_cast<int>(pc.secondaries.size()) + 1 < pc.max_replica_count)
     {
         proposal.type = CT_ADD_SECONDARY;
-        proposal.node = find_minimal_load_machine(false);
-        if (proposal.node.is_invalid() == false && 
-            proposal.node != pc.primary &&
-            std::find(pc.secondaries.begin(), pc.secondaries.end(), proposal.node) == pc.secondaries.end())
+        proposal.node = find_minimal_load_machine(false, &pc);
+        if (proposal.node.is_invalid() == false)
         {
             send_proposal(pc.primary, proposal);
         }
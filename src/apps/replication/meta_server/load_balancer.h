@@ -44,22 +44,87 @@ using namespace dsn::replication;
 class load_balancer : public serverlet<load_balancer>
 {
 public:
-    load_balancer(server_state* state);
-    ~load_balancer();
+    load_balancer(server_state* state, const replication_options& opts);
+    virtual ~load_balancer();
 
     void run();
     void run(global_partition_id gpid);
 
-private:
+    // move primaries from the nodes with more than the average primary count to 
+    // their secondaries on the nodes with less, with at most
+    // lb_primary_balance_max_concurrent_switches switches on the way
+    void balance_primaries();
+
+protected:
     // meta server => partition server
-    void send_proposal(::dsn::rpc_address node, const configuration_update_request& proposal);
+    virtual void send_proposal(::dsn::rpc_address node, const configuration_update_request& proposal);
+
+private:
     void query_decree(std::shared_ptr<query_replica_decree_request> query);
     void on_query_decree_ack(error_code err, std::shared_ptr<query_replica_decree_request>& query, std::shared_ptr<query_replica_decree_response>& resp);
     
     void run_lb(partition_configuration& pc);
-    ::dsn::rpc_address find_minimal_load_machine(bool primaryOnly);
+
+    //
+    // load-aware balancing
+    //
+    // the score of a node is sum(weight * metric / cluster average of the metric),
+    // where the metrics are qps, written bytes, log backlog and p99 latency 
+    // reported by the replicas on config sync, together with the replica count;
+    // it degrades to counting replicas when no load is reported or
+    // lb_load_aware is false
+    //
+    struct node_metrics
+    {
+        double qps;
+        double write_bytes;
+        double log_backlog;
+        double latency;   // max p99 of the replicas
+        double count;
+
+        node_metrics() : qps(0), write_bytes(0), log_backlog(0), latency(0), count(0) {}
+    };
+
+    struct node_load
+    {
+        double   score;          // with all replicas
+        double   primary_score;  // with primary replicas only
+        uint64_t report_count;   // how many load reports are received from the node
+    };
+
+    //
+    // a planned primary switch is a CT_DOWNGRADE_TO_SECONDARY proposal to the 
+    // source, whose 2pc is drained before the downgrade, followed by a 
+    // CT_UPGRADE_TO_PRIMARY proposal to the target in run_lb
+    //
+    struct primary_plan
+    {
+        ::dsn::rpc_address source;
+        ::dsn::rpc_address target;
+        int64_t            ballot;  // ballot when the downgrade is proposed
+        uint64_t           ts_ms;
+    };
+
+    // called with _state->_lock held
+    void compute_node_loads();
+    double score(const node_metrics& m, const node_metrics& avg) const;
+    double replica_score(const partition_load* load, bool primary) const;
+    ::dsn::rpc_address find_minimal_load_machine(bool primaryOnly, const partition_configuration* exclude = nullptr);
+    ::dsn::rpc_address find_primary_candidate(const partition_configuration& pc);
+    const partition_load* get_primary_load(const partition_configuration& pc) const;
+    void migrate_primaries();
+    void plan_primary_switch(partition_configuration& pc, ::dsn::rpc_address target, uint64_t now);
+    bool is_switch_pending(const global_partition_id& gpid, const primary_plan& plan, uint64_t now) const;
 
 private:
-    server_state *_state;
-};
+    server_state                *_state;
+    replication_options          _opts;
 
+    zlock                                                         _balance_lock;
+    std::unordered_map<::dsn::rpc_address, node_load>             _node_loads;
+    node_metrics                                                  _avg;
+    node_metrics                                                  _avg_primary;
+    std::unordered_map<global_partition_id, primary_plan>         _primary_plans;
+    std::unordered_map<global_partition_id, uint64_t>             _last_migration_ms;
+    std::unordered_map<::dsn::rpc_address, uint64_t>              _migration_report_counts; // report count of the node at its last migration
+};
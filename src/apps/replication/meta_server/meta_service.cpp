@@ -113,7 +113,7 @@ void meta_service::start(const char* data_dir, bool clean_state)
 
     _log = dsn_file_open((_data_dir + "/oplog").c_str(), O_RDWR | O_CREAT, 0666);
 
-    _balancer = new load_balancer(_state);            
+    _balancer = new load_balancer(_state, _opts);
     _failure_detector = new meta_server_failure_detector(_state, this);
     
     // TODO: use zookeeper for leader election
@@ -461,6 +461,11 @@ void meta_service::on_load_balance_timer()
     if (_failure_detector->is_primary())
     {
         _balancer->run();
+
+        if (!_opts.lb_primary_balance_disabled)
+        {
+            _balancer->balance_primaries();
+        }
     }
 }
 
@@ -262,7 +262,7 @@ void server_state::unfree_if_possible_on_start()
 // partition server & client => meta server
 void server_state::query_configuration_by_node(const configuration_query_by_node_request& request, /*out*/ configuration_query_by_node_response& response)
 {
-    zauto_read_lock l(_lock);
+    zauto_write_lock l(_lock);
     auto it = _nodes.find(request.node);
     if (it == _nodes.end())
     {
@@ -272,6 +272,13 @@ void server_state::query_configuration_by_node(const configuration_query_by_node
     {
         response.err = ERR_OK;
 
+        it->second.loads.clear();
+        for (auto& ld : request.loads)
+        {
+            it->second.loads[ld.gpid] = ld;
+        }
+        it->second.load_report_count++;
+
         for (auto& p : it->second.partitions)
         {
             response.partitions.push_back(_apps[p.app_id - 1].partitions[p.pidx]);
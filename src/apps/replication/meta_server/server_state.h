@@ -87,7 +87,8 @@ public:
 
     // partition server & client => meta server
 
-    // query all partition configurations of a replica server
+    // query all partition configurations of a replica server,
+    // and the replica loads piggybacked in the request are recorded for load balancing
     void query_configuration_by_node(const configuration_query_by_node_request& request, /*out*/ configuration_query_by_node_response& response);
 
     // query specified partition configurations by app_name and partition indexes
@@ -121,6 +122,12 @@ private:
         ::dsn::rpc_address            address;
         std::set<global_partition_id> primaries;
         std::set<global_partition_id> partitions;
+
+        // latest loads reported by the node
+        std::unordered_map<global_partition_id, partition_load> loads;
+        uint64_t                      load_report_count;
+
+        node_state() : is_alive(false), load_report_count(0) {}
     };
 
     friend class load_balancer;
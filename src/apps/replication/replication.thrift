@@ -64,7 +64,8 @@ enum read_semantic_t
 {
     ReadLastUpdate,
     ReadOutdated,
-    ReadSnapshot
+    ReadSnapshot,
+    ReadBoundedStaleness
 }
 
 struct read_request_header
@@ -132,6 +133,26 @@ struct learn_response
     6:string                base_local_dir;
 }
 
+struct learn_chunk_request
+{
+    1:global_partition_id   gpid;
+    2:dsn.address           learner;
+    3:i64                   signature;
+    4:string                base_local_dir;
+    5:string                file;
+    6:i64                   offset;
+    7:i32                   size;
+}
+
+struct learn_chunk_response
+{
+    1:dsn.error_code        err;
+    2:i64                   file_size;
+    3:dsn.blob              data;
+    4:i64                   file_mtime;  // with file_size, identifies the file content for resumption
+    5:bool                  append_only; // e.g., log files, which are only appended
+}
+
 struct group_check_request
 {
     1:string                app_type;
@@ -203,10 +224,23 @@ struct configuration_proposal_request
     5:bool                     is_upgrade = false;
 }
 
+// load of one replica, collected since the last report
+struct partition_load
+{
+    1:global_partition_id    gpid;
+    2:partition_status       status;
+    3:double                 qps;
+    4:double                 write_bytes_per_second;
+    5:i64                    log_backlog;
+    6:i64                    p99_latency_us;
+}
+
 // client => meta server
+// loads is optional so that nodes and meta servers without it still talk to each other
 struct configuration_query_by_node_request
 {
-    1:dsn.address    node;
+    1:dsn.address                   node;
+    2:optional list<partition_load> loads;
 }
 
 // meta server => client
@@ -249,6 +283,7 @@ service replica_s
     prepare_ack prepare(1:prepare_msg request);
     void config_proposal(1:configuration_update_request proposal);
     learn_response learn(1:learn_request request);
+    learn_chunk_response learn_chunk(1:learn_chunk_request request);
     void learn_completion_notification(1:group_check_response report);
     void add_learner(1:group_check_request request);
     void remove(1:replica_configuration request);
@@ -0,0 +1,245 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     crc32c (castagnoli) with sse4.2/pclmul kernels selected by cpuid at startup
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "crc32c.h"
+# include <cstdio>
+# include "crc.h"
+# include <cstring>
+
+# if defined(__x86_64__) || defined(_M_X64)
+#     define DSN_CRC32C_HW 1
+#     ifdef _MSC_VER
+#         include <intrin.h>
+#         define DSN_CRC32C_TARGET
+#     else
+#         include <cpuid.h>
+#         define DSN_CRC32C_TARGET __attribute__((target("sse4.2,pclmul")))
+#     endif
+#     include <nmmintrin.h>
+#     include <wmmintrin.h>
+# else
+#     define DSN_CRC32C_HW 0
+# endif
+
+namespace dsn {
+    namespace utils {
+
+        uint32_t crc32c_software(const void* ptr, size_t size, uint32_t init_crc)
+        {
+            return crc32::compute(ptr, size, init_crc);
+        }
+
+        uint32_t crc32c_concatenate(
+            uint32_t xy_init,
+            uint32_t x_init, uint32_t x_final, size_t x_size,
+            uint32_t y_init, uint32_t y_final, size_t y_size
+            )
+        {
+            return crc32::concatenate(
+                xy_init,
+                x_init, x_final, (uint64_t)x_size,
+                y_init, y_final, (uint64_t)y_size
+                );
+        }
+
+# if DSN_CRC32C_HW
+
+        //
+        // the buffer is cut into blocks of 3 * block_size bytes, and the three
+        // parts of each block are fed to three independent crc32 instruction 
+        // streams to hide the 3-cycle latency of the instruction; the lane
+        // results are then merged as
+        //
+        //    crc = shift(lane0, 2 * block_size) ^ shift(lane1, block_size) ^ lane2
+        //
+        // where shift(c, n) multiplies c by x^(8n) mod P with a single pclmul
+        // against the precomputed constant x^(8n-33) mod P followed by a crc32 
+        // reduction (which contributes the remaining x^32 and x^1 is due to
+        // the reflected bit order)
+        //
+        static const size_t crc32c_long_block = 8192;
+        static const size_t crc32c_short_block = 256;
+
+        static uint32_t s_crc32c_long_shifts[2];   // for 2 * long, long
+        static uint32_t s_crc32c_short_shifts[2];  // for 2 * short, short
+
+        static uint32_t crc32c_shift_constant(size_t bytes)
+        {
+            // x^(8 * bytes - 33) = x^(8 * (bytes - 5)) * x^7
+            return crc32::MulPoly(crc32::ComputeX_N((uint64_t)(bytes - 5)), crc32::MSB >> 7);
+        }
+
+        DSN_CRC32C_TARGET
+        static inline uint64_t crc32c_load64(const uint8_t* p)
+        {
+            uint64_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        DSN_CRC32C_TARGET
+        static inline uint32_t crc32c_shift(uint64_t crc, uint32_t k)
+        {
+            __m128i r = _mm_clmulepi64_si128(
+                _mm_cvtsi32_si128((int)(uint32_t)crc),
+                _mm_cvtsi32_si128((int)k),
+                0
+                );
+            return (uint32_t)_mm_crc32_u64(0, (uint64_t)_mm_cvtsi128_si64(r));
+        }
+
+        DSN_CRC32C_TARGET
+        static inline const uint8_t* crc32c_lanes(
+            const uint8_t* p, 
+            size_t& size, 
+            uint64_t& crc, 
+            size_t block_size,
+            const uint32_t* shifts
+            )
+        {
+            while (size >= 3 * block_size)
+            {
+                uint64_t c0 = crc, c1 = 0, c2 = 0;
+                const uint8_t* end = p + block_size;
+                do
+                {
+                    c0 = _mm_crc32_u64(c0, crc32c_load64(p));
+                    c1 = _mm_crc32_u64(c1, crc32c_load64(p + block_size));
+                    c2 = _mm_crc32_u64(c2, crc32c_load64(p + 2 * block_size));
+                    p += 8;
+                } while (p < end);
+
+                crc = crc32c_shift(c0, shifts[0]) ^ crc32c_shift(c1, shifts[1]) ^ c2;
+                p += 2 * block_size;
+                size -= 3 * block_size;
+            }
+            return p;
+        }
+
+        DSN_CRC32C_TARGET
+        uint32_t crc32c_hardware(const void* ptr, size_t size, uint32_t init_crc)
+        {
+            const uint8_t* p = (const uint8_t*)ptr;
+            uint64_t crc = (uint32_t)~init_crc;
+
+            // align to 8 bytes
+            while (size > 0 && ((size_t)p & 7) != 0)
+            {
+                crc = _mm_crc32_u8((uint32_t)crc, *p++);
+                size--;
+            }
+
+            p = crc32c_lanes(p, size, crc, crc32c_long_block, s_crc32c_long_shifts);
+            p = crc32c_lanes(p, size, crc, crc32c_short_block, s_crc32c_short_shifts);
+
+            while (size >= 8)
+            {
+                crc = _mm_crc32_u64(crc, crc32c_load64(p));
+                p += 8;
+                size -= 8;
+            }
+
+            while (size > 0)
+            {
+                crc = _mm_crc32_u8((uint32_t)crc, *p++);
+                size--;
+            }
+
+            return ~(uint32_t)crc;
+        }
+
+        static bool crc32c_cpu_check()
+        {
+            unsigned int regs[4] = { 0 }; // eax, ebx, ecx, edx
+# ifdef _MSC_VER
+            __cpuid((int*)regs, 1);
+# else
+            if (!__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]))
+                return false;
+# endif
+            const unsigned int sse42 = 1u << 20;
+            const unsigned int pclmul = 1u << 1;
+            return (regs[2] & sse42) != 0 && (regs[2] & pclmul) != 0;
+        }
+
+# else
+
+        uint32_t crc32c_hardware(const void* ptr, size_t size, uint32_t init_crc)
+        {
+            return crc32c_software(ptr, size, init_crc);
+        }
+
+        static bool crc32c_cpu_check()
+        {
+            return false;
+        }
+
+# endif
+
+        typedef uint32_t (*crc32c_kernel)(const void*, size_t, uint32_t);
+
+        // software until the static initializer below runs
+        static crc32c_kernel s_crc32c_kernel = crc32c_software;
+        static bool s_crc32c_hw = false;
+
+        static struct crc32c_selector
+        {
+            crc32c_selector()
+            {
+                s_crc32c_hw = crc32c_cpu_check();
+                if (s_crc32c_hw)
+                {
+# if DSN_CRC32C_HW
+                    s_crc32c_long_shifts[0] = crc32c_shift_constant(2 * crc32c_long_block);
+                    s_crc32c_long_shifts[1] = crc32c_shift_constant(crc32c_long_block);
+                    s_crc32c_short_shifts[0] = crc32c_shift_constant(2 * crc32c_short_block);
+                    s_crc32c_short_shifts[1] = crc32c_shift_constant(crc32c_short_block);
+# endif
+                    s_crc32c_kernel = crc32c_hardware;
+                }
+            }
+        } s_crc32c_selector;
+
+        bool crc32c_hardware_supported()
+        {
+            return s_crc32c_hw;
+        }
+
+        uint32_t crc32c_compute(const void* ptr, size_t size, uint32_t init_crc)
+        {
+            return s_crc32c_kernel(ptr, size, init_crc);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     crc32c (castagnoli) with sse4.2/pclmul kernels selected by cpuid at startup
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <cstdint>
+# include <cstddef>
+
+namespace dsn {
+    namespace utils {
+
+        //
+        // the polynomial is the same as crc32 in crc.h (reflected 0x82f63b78),
+        // so all the kernels below produce exactly the same values and can
+        // be mixed freely, e.g., checksums written by the software version
+        // are verified by the hardware version
+        //
+
+        // table driven, portable
+        extern uint32_t crc32c_software(const void* ptr, size_t size, uint32_t init_crc);
+
+        // sse4.2 crc32 over three interleaved lanes, merged with pclmul;
+        // must only be called when crc32c_hardware_supported() is true
+        extern uint32_t crc32c_hardware(const void* ptr, size_t size, uint32_t init_crc);
+
+        // whether the cpu supports both sse4.2 and pclmul
+        extern bool crc32c_hardware_supported();
+
+        // the fastest kernel on this machine, used by dsn_crc32_compute
+        extern uint32_t crc32c_compute(const void* ptr, size_t size, uint32_t init_crc);
+
+        // see dsn_crc32_concatenate
+        extern uint32_t crc32c_concatenate(
+            uint32_t xy_init, 
+            uint32_t x_init, uint32_t x_final, size_t x_size, 
+            uint32_t y_init, uint32_t y_final, size_t y_size
+            );
+    }
+}
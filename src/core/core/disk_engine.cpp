@@ -251,10 +251,9 @@ void disk_engine::read(aio_task* aio)
 class batch_write_io_task : public aio_task
 {
 public:
-    batch_write_io_task(aio_task* tasks, blob& buffer)
+    batch_write_io_task(aio_task* tasks)
         : aio_task(LPC_AIO_BATCH_WRITE, nullptr, tasks)
     {
-        _buffer = buffer;
     }
     
     virtual void exec() override
@@ -314,39 +313,42 @@ void disk_engine::process_write(aio_task* aio, uint32_t sz)
     // batching
     else
     {
+        // setup io task
+        auto new_task = new batch_write_io_task(aio);
+        auto dio = new_task->aio();
+        dio->buffer_size = sz;
+        dio->file_offset = aio->aio()->file_offset;
+
+        dio->file = aio->aio()->file;
+        dio->file_object = aio->aio()->file_object;
+        dio->engine = aio->aio()->engine;
+        dio->type = AIO_Write;
+
         // merge the buffers
-        auto bb = tls_trans_mem_alloc_blob((size_t)sz);
-        char* ptr = (char*)bb.data();
+        char* buffer = _provider->prepare_write_buffer(dio, sz);
+        if (nullptr == buffer)
+        {
+            new_task->_buffer = tls_trans_mem_alloc_blob((size_t)sz);
+            buffer = (char*)new_task->_buffer.data();
+        }
+        dio->buffer = (void*)buffer;
+
+        char* ptr = buffer;
         auto current_wk = aio;
         do
         {
-            auto dio = current_wk->aio();
+            auto cio = current_wk->aio();
             memcpy(
                 (void*)ptr,
-                (const void*)(dio->buffer),
-                (size_t)(dio->buffer_size)
+                (const void*)(cio->buffer),
+                (size_t)(cio->buffer_size)
                 );
 
-            ptr += dio->buffer_size;
+            ptr += cio->buffer_size;
             current_wk = (aio_task*)current_wk->next;
         } while (current_wk);
 
-        dassert(ptr == (char*)bb.data() + bb.length(), "");
-
-        // setup io task
-        auto new_task = new batch_write_io_task(
-            aio,
-            bb
-            );
-        auto dio = new_task->aio();
-        dio->buffer = (void*)bb.data();
-        dio->buffer_size = sz;
-        dio->file_offset = aio->aio()->file_offset;
-
-        dio->file = aio->aio()->file;
-        dio->file_object = aio->aio()->file_object;
-        dio->engine = aio->aio()->engine;
-        dio->type = AIO_Write;
+        dassert(ptr == buffer + sz, "");
 
         new_task->add_ref(); // released in complete_io
         return _provider->aio(new_task);
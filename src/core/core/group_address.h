@@ -36,10 +36,50 @@
 # pragma once
 
 # include <dsn/cpp/address.h>
+# include <dsn/cpp/autoref_ptr.h>
+# include <dsn/internal/synchronize.h>
 # include <algorithm> // for std::find()
+# include <atomic>
 
 namespace dsn
 {
+    //
+    // latency and load of a group member, which is shared with the in-flight 
+    // calls to the member so that it may outlive the member in the group
+    //
+    class rpc_group_member_stat : public ref_counter
+    {
+    public:
+        rpc_group_member_stat();
+
+        // maintained by rpc_client_matcher, where timeouts count as responses
+        // so that members which do not respond are penalized as well
+        void on_call() { ++_outstanding; }
+        void on_response(uint64_t rtt_us);
+        void on_cancelled() { --_outstanding; }
+
+        int      outstanding() const { return _outstanding.load(); }
+        uint64_t rtt_us() const { return _rtt_us.load(); } // EWMA, 0 before any response
+
+        // the given percentile of the recent rtts, 0 when there are not enough samples
+        uint64_t rtt_percentile_us(int percentile);
+
+        // expected latency with the outstanding requests, for member selection
+        uint64_t cost() const { return rtt_us() * (uint64_t)(outstanding() + 1); }
+
+    private:
+        enum { RTT_SAMPLE_COUNT = 64, RTT_SAMPLE_MIN_COUNT = 8 };
+
+        std::atomic<int>              _outstanding;
+        std::atomic<uint64_t>         _rtt_us;
+        ::dsn::utils::ex_lock_nr_spin _lock;
+        uint64_t                      _samples[RTT_SAMPLE_COUNT];
+        int                           _sample_count;
+        int                           _next_sample;
+    };
+
+    typedef ref_ptr<rpc_group_member_stat> rpc_group_member_stat_ptr;
+
     class rpc_group_address
     {
     public:
@@ -59,9 +99,18 @@ namespace dsn
         const char* name() const { return _name.c_str(); }
         rpc_address address() const { return _group_address; }
 
+        // power-of-two-choices on the members (other than the excluded one)
+        // with their rtts and outstanding requests
+        rpc_address select_member(/*out*/ rpc_group_member_stat_ptr& stat, rpc_address excluded = _invalid) const;
+        rpc_group_member_stat_ptr member_stat(rpc_address addr) const;
+
+    private:
+        int random_index(int excluded) const;
+
     private:
         typedef std::vector<rpc_address> members_t;
         members_t   _members;
+        std::vector<rpc_group_member_stat_ptr> _stats; // same order as _members
         int         _leader_index;
         std::string _name;
         rpc_address _group_address;
@@ -70,6 +119,46 @@ namespace dsn
 
     // ------------------ inline implementation --------------------
 
+    inline rpc_group_member_stat::rpc_group_member_stat()
+        : _outstanding(0), _rtt_us(0)
+    {
+        _sample_count = 0;
+        _next_sample = 0;
+    }
+
+    inline void rpc_group_member_stat::on_response(uint64_t rtt_us)
+    {
+        --_outstanding;
+
+        // EWMA with weight 1/8 for the new sample, as TCP's smoothed rtt
+        uint64_t old = _rtt_us.load();
+        _rtt_us.store(old == 0 ? rtt_us : (uint64_t)((int64_t)old + ((int64_t)rtt_us - (int64_t)old) / 8));
+
+        utils::auto_lock< ::dsn::utils::ex_lock_nr_spin> l(_lock);
+        _samples[_next_sample] = rtt_us;
+        _next_sample = (_next_sample + 1) % RTT_SAMPLE_COUNT;
+        if (_sample_count < RTT_SAMPLE_COUNT)
+            _sample_count++;
+    }
+
+    inline uint64_t rpc_group_member_stat::rtt_percentile_us(int percentile)
+    {
+        uint64_t samples[RTT_SAMPLE_COUNT];
+        int count;
+        {
+            utils::auto_lock< ::dsn::utils::ex_lock_nr_spin> l(_lock);
+            count = _sample_count;
+            memcpy(samples, _samples, sizeof(uint64_t) * count);
+        }
+
+        if (count < RTT_SAMPLE_MIN_COUNT)
+            return 0;
+
+        int index = std::min(count - 1, count * percentile / 100);
+        std::nth_element(samples, samples + index, samples + count);
+        return samples[index];
+    }
+
     inline rpc_group_address::rpc_group_address(const char* name)
     {
         _name = name;
@@ -82,6 +171,7 @@ namespace dsn
         if (_members.end() == std::find(_members.begin(), _members.end(), addr))
         {
             _members.push_back(addr);
+            _stats.push_back(new rpc_group_member_stat());
             return true;
         }
         else
@@ -111,6 +201,7 @@ namespace dsn
             }
 
             _members.push_back(addr);
+            _stats.push_back(new rpc_group_member_stat());
             _leader_index = (int)(_members.size() - 1);
         }
     }
@@ -118,7 +209,10 @@ namespace dsn
     inline rpc_address rpc_group_address::possible_leader()
     {
         if (_leader_index == -1)
-            return random_member();
+        {
+            rpc_group_member_stat_ptr stat;
+            return select_member(stat);
+        }
         else
             return _members[_leader_index];
     }
@@ -132,6 +226,7 @@ namespace dsn
             if (-1 != _leader_index && addr == _members[_leader_index])
                 _leader_index = -1;
 
+            _stats.erase(_stats.begin() + (it - _members.begin()));
             _members.erase(it);
         }
         return r;
@@ -158,4 +253,57 @@ namespace dsn
             }
         }
     }
+    inline int rpc_group_address::random_index(int excluded) const
+    {
+        int count = (int)_members.size() - (excluded >= 0 ? 1 : 0);
+        int index = (int)dsn_random32(0, (uint32_t)count - 1);
+        if (excluded >= 0 && index >= excluded)
+            index++;
+        return index;
+    }
+
+    inline rpc_address rpc_group_address::select_member(/*out*/ rpc_group_member_stat_ptr& stat, rpc_address excluded) const
+    {
+        int ex = -1;
+        if (!excluded.is_invalid())
+        {
+            auto it = std::find(_members.begin(), _members.end(), excluded);
+            if (it != _members.end())
+                ex = (int)(it - _members.begin());
+        }
+
+        int count = (int)_members.size() - (ex >= 0 ? 1 : 0);
+        if (count <= 0)
+        {
+            stat = nullptr;
+            return _invalid;
+        }
+
+        int i = random_index(ex);
+        if (count > 1)
+        {
+            int j;
+            do
+            {
+                j = random_index(ex);
+            } while (j == i);
+
+            // members without responses yet have zero cost so that they are explored soon
+            uint64_t ci = _stats[i]->cost(), cj = _stats[j]->cost();
+            if (cj < ci || (cj == ci && _stats[j]->outstanding() < _stats[i]->outstanding()))
+                i = j;
+        }
+
+        stat = _stats[i];
+        return _members[i];
+    }
+
+    inline rpc_group_member_stat_ptr rpc_group_address::member_stat(rpc_address addr) const
+    {
+        auto it = std::find(_members.begin(), _members.end(), addr);
+        if (it == _members.end())
+            return nullptr;
+        else
+            return _stats[it - _members.begin()];
+    }
 }
@@ -35,6 +35,7 @@
 
 # include <dsn/internal/message_parser.h>
 # include <dsn/service_api_c.h>
+# include "recv_buffer_pool.h"
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -46,25 +47,68 @@ namespace dsn {
     message_parser::message_parser(int buffer_block_size)
         : _buffer_block_size(buffer_block_size)
     {
+        static int scatter_threshold = (int)dsn_config_get_value_uint64("network", "recv_scatter_threshold", 4096,
+            "messages larger than this (in bytes) are received into their own buffers when they cannot fit in the current block, 0 for disabled");
+
+        _scatter_threshold = scatter_threshold;
+        _scatter_buffer_occupied = 0;
         create_new_buffer(buffer_block_size);
     }
 
     void message_parser::create_new_buffer(int sz)
     {
-        std::shared_ptr<char> buffer(new char[sz]);
-        _read_buffer.assign(buffer, 0, sz);
+        int capacity;
+        std::shared_ptr<char> buffer = recv_buffer_alloc(sz, capacity);
+        _read_buffer.assign(buffer, 0, capacity);
         _read_buffer_occupied = 0;
     }
 
     void message_parser::mark_read(int read_length)
     {
-        dassert(read_length + _read_buffer_occupied <= _read_buffer.length(), "");
-        _read_buffer_occupied += read_length;
+        if (is_scattering())
+        {
+            dassert(read_length + _scatter_buffer_occupied <= _scatter_buffer.length(), "");
+            _scatter_buffer_occupied += read_length;
+        }
+        else
+        {
+            dassert(read_length + _read_buffer_occupied <= _read_buffer.length(), "");
+            _read_buffer_occupied += read_length;
+        }
+    }
+
+    void message_parser::begin_scatter(int msg_size)
+    {
+        int capacity;
+        std::shared_ptr<char> buffer = recv_buffer_alloc(msg_size, capacity);
+        _scatter_buffer.assign(buffer, 0, msg_size);
+
+        memcpy((void*)_scatter_buffer.data(), (const void*)_read_buffer.data(), _read_buffer_occupied);
+        recv_buffer_mark_copied(_read_buffer_occupied);
+        _scatter_buffer_occupied = _read_buffer_occupied;
+
+        // continue with the remaining of the current block after the message
+        _read_buffer = _read_buffer.range(_read_buffer_occupied);
+        _read_buffer_occupied = 0;
+    }
+
+    void message_parser::end_scatter()
+    {
+        _scatter_buffer = blob();
+        _scatter_buffer_occupied = 0;
     }
 
     // before read
     void* message_parser::read_buffer_ptr(int read_next)
     {
+        // read_next may be a stale hint, e.g., the default one of a new read event,
+        // while the scatter buffer always holds exactly the rest of the message,
+        // and read_buffer_capacity() makes sure no more is read into it
+        if (is_scattering())
+        {
+            return (void*)(_scatter_buffer.data() + _scatter_buffer_occupied);
+        }
+
         if (read_next + _read_buffer_occupied >  _read_buffer.length())
         {
             // remember currently read content
@@ -80,6 +124,7 @@ namespace dsn {
             if (rb.length() > 0)
             {
                 memcpy((void*)_read_buffer.data(), (const void*)rb.data(), rb.length());
+                recv_buffer_mark_copied(rb.length());
                 _read_buffer_occupied = rb.length();
             }            
             
@@ -91,7 +136,27 @@ namespace dsn {
 
     int message_parser::read_buffer_capacity() const
     {
-        return _read_buffer.length() - _read_buffer_occupied;
+        if (is_scattering())
+            return _scatter_buffer.length() - _scatter_buffer_occupied;
+
+        int capacity = _read_buffer.length() - _read_buffer_occupied;
+
+        // when the partially received header already tells that the message is
+        // a large one which cannot fit in the block, read the header only so
+        // that its body is received into its own buffer without copy
+        if (_scatter_threshold > 0 && _read_buffer_occupied > 0)
+        {
+            int header_size;
+            int msg_sz = peek_message_size(_read_buffer.data(), _read_buffer_occupied, header_size);
+            if (msg_sz >= _scatter_threshold
+                && msg_sz > _read_buffer.length()
+                && header_size > _read_buffer_occupied
+                && capacity > header_size - _read_buffer_occupied)
+            {
+                capacity = header_size - _read_buffer_occupied;
+            }
+        }
+        return capacity;
     }
 
     //-------------------- dsn message --------------------
@@ -101,10 +166,35 @@ namespace dsn {
     {
     }
 
+    int dsn_message_parser::peek_message_size(const char* data, int size, /*out*/ int& header_size) const
+    {
+        header_size = (int)sizeof(message_header);
+        if (size < (int)(offsetof(message_header, body_length) + sizeof(int32_t)))
+            return -1;
+
+        return header_size + message_ex::get_body_length((char*)data);
+    }
+
     message_ex* dsn_message_parser::get_message_on_receive(int read_length, /*out*/ int& read_next)
     {
         mark_read(read_length);
 
+        if (is_scattering())
+        {
+            if (_scatter_buffer_occupied < _scatter_buffer.length())
+            {
+                read_next = _scatter_buffer.length() - _scatter_buffer_occupied;
+                return nullptr;
+            }
+
+            message_ex* msg = message_ex::create_receive_message(_scatter_buffer);
+            dassert(msg->is_right_header() && msg->is_right_body(false), "");
+
+            end_scatter();
+            read_next = sizeof(message_header);
+            return msg;
+        }
+
         if (_read_buffer_occupied >= sizeof(message_header))
         {            
             int msg_sz = sizeof(message_header) +
@@ -123,6 +213,14 @@ namespace dsn {
                 read_next = sizeof(message_header);
                 return msg;
             }
+            else if (_scatter_threshold > 0 
+                && msg_sz >= _scatter_threshold 
+                && msg_sz > _read_buffer.length())
+            {
+                begin_scatter(msg_sz);
+                read_next = msg_sz - _scatter_buffer_occupied;
+                return nullptr;
+            }
             else
             {
                 read_next = msg_sz - _read_buffer_occupied;
@@ -162,5 +260,458 @@ namespace dsn {
         *total_length = (int)msg->body_size() + sizeof(message_header);
         return (int)msg->buffers.size();
     }
+    //-------------------- dsn compact message --------------------
+
+    //
+    // compact header layout, varints are LEB128 and the others are little endian:
+    //   uint8    flags
+    //   uint8    header length
+    //   varint   body length
+    //   varint   rpc code of the sender, 0 when the name is not cachable
+    //   [varint  name length, name]            when COMPACT_HDR_HAS_NAME
+    //   varint   id
+    //   uint64   rpc id
+    //   request:  varint timeout_ms, varint hash, varint port
+    //   response: varint error
+    //   [varint  context, varint context2]     when COMPACT_HDR_HAS_CONTEXT
+    //   [uint32  body crc, uint32 header crc]  when COMPACT_HDR_HAS_CRC, and the header crc
+    //                                          covers all the header bytes before it
+    //
+# define COMPACT_HDR_IS_RESPONSE 0x1
+# define COMPACT_HDR_HAS_NAME    0x2
+# define COMPACT_HDR_HAS_CONTEXT 0x4
+# define COMPACT_HDR_HAS_CRC     0x8
+
+# define COMPACT_HDR_PREFIX_SIZE 2
+# define COMPACT_HDR_MAX_SIZE    128
+
+# define CRC_INVALID 0xdead0c2c
+
+    static inline char* put_varint(char* ptr, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            *ptr++ = (char)(v | 0x80);
+            v >>= 7;
+        }
+        *ptr++ = (char)v;
+        return ptr;
+    }
+
+    // returns nullptr when the varint is invalid or truncated
+    static inline const char* get_varint(const char* ptr, const char* end, /*out*/ uint64_t& v)
+    {
+        v = 0;
+        if (ptr == nullptr)
+            return nullptr;
+
+        for (int shift = 0; shift < 64 && ptr < end; shift += 7)
+        {
+            uint64_t b = (uint8_t)*ptr++;
+            v |= (b & 0x7f) << shift;
+            if ((b & 0x80) == 0)
+                return ptr;
+        }
+        return nullptr;
+    }
+
+    //
+    // the encoded headers are kept with the message until it is destroyed, one for each
+    // parser (i.e., session) which sends the message, as the message may be resent on
+    // another session while the previous send is not done yet
+    //
+    struct compact_header_buffer
+    {
+        compact_header_buffer* next;
+        const void*            owner;
+        char                   data[COMPACT_HDR_MAX_SIZE];
+    };
+
+    static void delete_compact_header_buffers(void* ptr)
+    {
+        auto buf = (compact_header_buffer*)ptr;
+        while (buf != nullptr)
+        {
+            auto next = buf->next;
+            delete buf;
+            buf = next;
+        }
+    }
+
+    static uint32_t compact_header_extension()
+    {
+        static uint32_t s_ext = message_ex::register_extension(delete_compact_header_buffers);
+        return s_ext;
+    }
+
+    static char* get_compact_header_buffer(message_ex* msg, const void* owner)
+    {
+        uint64_t& head = msg->get_extension(compact_header_extension());
+        for (auto buf = (compact_header_buffer*)head; buf != nullptr; buf = buf->next)
+        {
+            if (buf->owner == owner)
+                return buf->data;
+        }
+
+        auto buf = new compact_header_buffer();
+        buf->next = (compact_header_buffer*)head;
+        buf->owner = owner;
+        head = (uint64_t)buf;
+        return buf->data;
+    }
+
+    dsn_compact_message_parser::dsn_compact_message_parser(int buffer_block_size)
+        : message_parser(buffer_block_size)
+    {
+        compact_header_extension();
+    }
+
+    int dsn_compact_message_parser::encode_header(message_ex* msg, /*out*/ char* buffer, bool commit)
+    {
+        auto& hdr = *msg->header;
+        dsn_task_code_t code = msg->local_rpc_code;
+        bool is_response = (task_spec::get(code)->type == TASK_TYPE_RPC_RESPONSE);
+
+        // the local code stands for the name only when they match, e.g., not for aliases
+        bool cachable = (strcmp(dsn_task_code_to_string(code), hdr.rpc_name) == 0);
+        bool has_name = !cachable || code >= (int)_sent_names.size() || !_sent_names[code];
+
+        uint8_t flags = 0;
+        if (is_response) flags |= COMPACT_HDR_IS_RESPONSE;
+        if (has_name) flags |= COMPACT_HDR_HAS_NAME;
+        if (hdr.context != 0 || hdr.context2 != 0) flags |= COMPACT_HDR_HAS_CONTEXT;
+        if (hdr.hdr_crc32 != CRC_INVALID) flags |= COMPACT_HDR_HAS_CRC;
+
+        char* ptr = buffer + COMPACT_HDR_PREFIX_SIZE;
+        ptr = put_varint(ptr, (uint32_t)hdr.body_length);
+        ptr = put_varint(ptr, cachable ? (uint64_t)code : 0);
+        if (has_name)
+        {
+            size_t len = strnlen(hdr.rpc_name, sizeof(hdr.rpc_name));
+            ptr = put_varint(ptr, len);
+            memcpy(ptr, hdr.rpc_name, len);
+            ptr += len;
+        }
+
+        ptr = put_varint(ptr, hdr.id);
+        memcpy(ptr, &hdr.rpc_id, sizeof(hdr.rpc_id));
+        ptr += sizeof(hdr.rpc_id);
+
+        if (is_response)
+        {
+            ptr = put_varint(ptr, (uint32_t)hdr.server.error);
+        }
+        else
+        {
+            ptr = put_varint(ptr, (uint32_t)hdr.client.timeout_ms);
+            ptr = put_varint(ptr, (uint32_t)hdr.client.hash);
+            ptr = put_varint(ptr, hdr.client.port);
+        }
+
+        if (flags & COMPACT_HDR_HAS_CONTEXT)
+        {
+            ptr = put_varint(ptr, hdr.context);
+            ptr = put_varint(ptr, hdr.context2);
+        }
+
+        int length = (int)(ptr - buffer);
+        if (flags & COMPACT_HDR_HAS_CRC)
+        {
+            length += (int)sizeof(uint32_t) * 2;
+        }
+        dassert(length <= COMPACT_HDR_MAX_SIZE, "compact header is too long (%d)", length);
+
+        buffer[0] = (char)flags;
+        buffer[1] = (char)length;
+
+        if (flags & COMPACT_HDR_HAS_CRC)
+        {
+            memcpy(ptr, &hdr.body_crc32, sizeof(uint32_t));
+            ptr += sizeof(uint32_t);
+
+            uint32_t crc = dsn_crc32_compute(buffer, ptr - buffer, 0);
+            memcpy(ptr, &crc, sizeof(uint32_t));
+        }
+
+        if (commit && has_name && cachable)
+        {
+            if (code >= (int)_sent_names.size())
+                _sent_names.resize(code + 1, false);
+            _sent_names[code] = true;
+        }
+        return length;
+    }
+
+    message_ex* dsn_compact_message_parser::decode_message(const blob& data, int header_length)
+    {
+        const char* begin = data.data();
+        const char* end = begin + header_length;
+        uint8_t flags = (uint8_t)begin[0];
+
+        if (flags & COMPACT_HDR_HAS_CRC)
+        {
+            if (header_length < COMPACT_HDR_PREFIX_SIZE + (int)sizeof(uint32_t) * 2)
+            {
+                derror("compact message header is too short for its crc (%d)", header_length);
+                return nullptr;
+            }
+            end -= sizeof(uint32_t) * 2;
+
+            uint32_t crc;
+            memcpy(&crc, end + sizeof(uint32_t), sizeof(uint32_t));
+            if (crc != dsn_crc32_compute(begin, end + sizeof(uint32_t) - begin, 0))
+            {
+                derror("compact message header is corrupted");
+                return nullptr;
+            }
+        }
+
+        std::shared_ptr<char> hdr_buffer(new char[sizeof(message_header)], std::default_delete<char[]>());
+        auto& hdr = *(message_header*)hdr_buffer.get();
+        memset(&hdr, 0, sizeof(hdr));
+
+        uint64_t v;
+        const char* ptr = get_varint(begin + COMPACT_HDR_PREFIX_SIZE, end, v);
+        hdr.body_length = (int32_t)v;
+
+        uint64_t remote = 0;
+        dsn_task_code_t local_code = TASK_CODE_INVALID;
+        ptr = get_varint(ptr, end, remote);
+        if (ptr == nullptr || remote > UINT16_MAX)
+        {
+            derror("invalid rpc code in compact message header");
+            return nullptr;
+        }
+
+        if (flags & COMPACT_HDR_HAS_NAME)
+        {
+            ptr = get_varint(ptr, end, v);
+            if (ptr == nullptr || v >= sizeof(hdr.rpc_name) || v > (uint64_t)(end - ptr))
+            {
+                derror("invalid rpc name in compact message header");
+                return nullptr;
+            }
+            memcpy(hdr.rpc_name, ptr, (size_t)v);
+            ptr += v;
+
+            local_code = dsn_task_code_from_string(hdr.rpc_name, TASK_CODE_INVALID);
+            if (remote != 0)
+            {
+                if (remote >= _remote_codes.size())
+                    _remote_codes.resize((size_t)remote + 1);
+                _remote_codes[remote].local_code = local_code;
+                _remote_codes[remote].name = hdr.rpc_name;
+            }
+        }
+        else
+        {
+            if (remote >= _remote_codes.size() || _remote_codes[remote].name.length() == 0)
+            {
+                derror("rpc code %d is received before its name", (int)remote);
+                return nullptr;
+            }
+
+            auto& rc = _remote_codes[remote];
+            local_code = rc.local_code;
+            memcpy(hdr.rpc_name, rc.name.c_str(), rc.name.length());
+        }
+
+        ptr = get_varint(ptr, end, hdr.id);
+        if (ptr == nullptr || (size_t)(end - ptr) < sizeof(hdr.rpc_id))
+        {
+            derror("compact message header is truncated");
+            return nullptr;
+        }
+        memcpy(&hdr.rpc_id, ptr, sizeof(hdr.rpc_id));
+        ptr += sizeof(hdr.rpc_id);
+
+        if (flags & COMPACT_HDR_IS_RESPONSE)
+        {
+            ptr = get_varint(ptr, end, v);
+            hdr.server.error = (int32_t)(uint32_t)v;
+        }
+        else
+        {
+            ptr = get_varint(ptr, end, v);
+            hdr.client.timeout_ms = (int32_t)(uint32_t)v;
+            ptr = get_varint(ptr, end, v);
+            hdr.client.hash = (int32_t)(uint32_t)v;
+            ptr = get_varint(ptr, end, v);
+            hdr.client.port = (uint16_t)v;
+        }
+
+        if (flags & COMPACT_HDR_HAS_CONTEXT)
+        {
+            ptr = get_varint(ptr, end, hdr.context);
+            ptr = get_varint(ptr, end, hdr.context2);
+        }
+
+        if (ptr != end)
+        {
+            derror("compact message header length mismatch");
+            return nullptr;
+        }
+
+        // the header is verified above, while the body is verified with is_right_body
+        hdr.hdr_crc32 = CRC_INVALID;
+        if (flags & COMPACT_HDR_HAS_CRC)
+        {
+            memcpy(&hdr.body_crc32, end, sizeof(uint32_t));
+        }
+        else
+        {
+            hdr.body_crc32 = CRC_INVALID;
+        }
+
+        message_ex* msg = message_ex::create_receive_message(
+            blob(hdr_buffer, 0, (int)sizeof(message_header)),
+            data.range(header_length, hdr.body_length)
+            );
+        msg->local_rpc_code = (uint16_t)local_code;
+
+        if (!msg->is_right_body(false))
+        {
+            derror("compact message body is corrupted, rpc_name = %s", hdr.rpc_name);
+            delete msg;
+            return nullptr;
+        }
+        return msg;
+    }
 
-}
\ No newline at end of file
+    message_ex* dsn_compact_message_parser::get_message_on_receive(int read_length, /*out*/ int& read_next)
+    {
+        mark_read(read_length);
+
+        if (is_scattering())
+        {
+            if (_scatter_buffer_occupied < _scatter_buffer.length())
+            {
+                read_next = _scatter_buffer.length() - _scatter_buffer_occupied;
+                return nullptr;
+            }
+
+            message_ex* msg = decode_message(_scatter_buffer, (uint8_t)_scatter_buffer.data()[1]);
+            end_scatter();
+            read_next = (msg != nullptr ? COMPACT_HDR_PREFIX_SIZE : -1);
+            return msg;
+        }
+
+        if (_read_buffer_occupied < COMPACT_HDR_PREFIX_SIZE)
+        {
+            read_next = COMPACT_HDR_PREFIX_SIZE - _read_buffer_occupied;
+            return nullptr;
+        }
+
+        int hdr_sz = (uint8_t)_read_buffer.data()[1];
+        if (hdr_sz <= COMPACT_HDR_PREFIX_SIZE || hdr_sz > COMPACT_HDR_MAX_SIZE)
+        {
+            derror("invalid compact message header length %d", hdr_sz);
+            read_next = -1;
+            return nullptr;
+        }
+
+        if (_read_buffer_occupied < hdr_sz)
+        {
+            read_next = hdr_sz - _read_buffer_occupied;
+            return nullptr;
+        }
+
+        uint64_t body_sz;
+        if (nullptr == get_varint(_read_buffer.data() + COMPACT_HDR_PREFIX_SIZE, _read_buffer.data() + hdr_sz, body_sz)
+            || body_sz > (uint64_t)(INT32_MAX - hdr_sz))
+        {
+            derror("invalid body length in compact message header");
+            read_next = -1;
+            return nullptr;
+        }
+        int msg_sz = hdr_sz + (int)body_sz;
+
+        // msg done
+        if (_read_buffer_occupied >= msg_sz)
+        {
+            message_ex* msg = decode_message(_read_buffer.range(0, msg_sz), hdr_sz);
+            if (msg == nullptr)
+            {
+                read_next = -1;
+                return nullptr;
+            }
+
+            _read_buffer = _read_buffer.range(msg_sz);
+            _read_buffer_occupied -= msg_sz;
+            read_next = COMPACT_HDR_PREFIX_SIZE;
+            return msg;
+        }
+        else if (_scatter_threshold > 0
+            && msg_sz >= _scatter_threshold
+            && msg_sz > _read_buffer.length())
+        {
+            begin_scatter(msg_sz);
+            read_next = msg_sz - _scatter_buffer_occupied;
+            return nullptr;
+        }
+        else
+        {
+            read_next = msg_sz - _read_buffer_occupied;
+            return nullptr;
+        }
+    }
+
+    int dsn_compact_message_parser::prepare_buffers_on_send(message_ex* msg, int offset, /*out*/ send_buf* buffers)
+    {
+        // the name is regarded as sent from now on
+        char* hdr = get_compact_header_buffer(msg, this);
+        int hdr_sz = encode_header(msg, hdr, true);
+
+        int i = 0;
+        if (offset < hdr_sz)
+        {
+            buffers[i].buf = (void*)(hdr + offset);
+            buffers[i].sz = (uint32_t)(hdr_sz - offset);
+            offset = 0;
+            ++i;
+        }
+        else
+        {
+            offset -= hdr_sz;
+        }
+
+        // the fixed message_header at the beginning of the first buffer is skipped
+        offset += (int)sizeof(message_header);
+        for (auto& buf : msg->buffers)
+        {
+            if (offset >= buf.length())
+            {
+                offset -= buf.length();
+                continue;
+            }
+
+            buffers[i].buf = (void*)(buf.data() + offset);
+            buffers[i].sz = (uint32_t)(buf.length() - offset);
+            offset = 0;
+            ++i;
+        }
+
+        return i;
+    }
+
+    int dsn_compact_message_parser::get_send_buffers_count_and_total_length(message_ex* msg, int* total_length)
+    {
+        char hdr[COMPACT_HDR_MAX_SIZE];
+        *total_length = encode_header(msg, hdr, false) + (int)msg->body_size();
+
+        // the compact header, and the buffers without the fixed message_header
+        int count = 1;
+        int offset = (int)sizeof(message_header);
+        for (auto& buf : msg->buffers)
+        {
+            if (offset >= buf.length())
+            {
+                offset -= buf.length();
+                continue;
+            }
+            offset = 0;
+            ++count;
+        }
+        return count;
+    }
+}
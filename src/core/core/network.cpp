@@ -121,16 +121,18 @@ namespace dsn
             // added in rpc_engine::reply (for server) or rpc_session::send_message (for client)
             rmsg->release_ref();
         }
+
+        _pending_message_count = 0;
     }
 
-    inline bool rpc_session::unlink_message_for_send()
+    inline bool rpc_session::unlink_message_for_send(bool gathering)
     {
         auto n = _messages.next();
-        int bcount = 0;
+        int bcount = (int)_sending_buffers.size(); // non-zero when gathering more
         int tlen = 0;
 
-        dbg_dassert(0 == _sending_buffers.size(), "");
-        dbg_dassert(0 == _sending_msgs.size(), "");
+        dbg_dassert(gathering || 0 == _sending_buffers.size(), "");
+        dbg_dassert(gathering || 0 == _sending_msgs.size(), "");
 
         while (n != &_messages)
         {
@@ -153,6 +155,17 @@ namespace dsn
         return _sending_msgs.size() > 0;
     }
     
+    bool rpc_session::gather_messages_for_send()
+    {
+        utils::auto_lock<utils::ex_lock_nr> l(_lock);
+        if (!_is_sending_next)
+            return false;
+
+        auto count = _sending_msgs.size();
+        unlink_message_for_send(true);
+        return _sending_msgs.size() > count;
+    }
+
     void rpc_session::send_message(message_ex* msg)
     {
         dinfo("%s: rpc_id = %llx, code = %s", __FUNCTION__, msg->header->rpc_id, msg->header->rpc_name);
@@ -162,6 +175,7 @@ namespace dsn
         {
             utils::auto_lock<utils::ex_lock_nr> l(_lock);
             msg->dl.insert_before(&_messages);
+            ++_pending_message_count;
             if (SS_CONNECTED == _connect_state && !_is_sending_next)
             {
                 _is_sending_next = true;
@@ -188,6 +202,7 @@ namespace dsn
                 return false;
 
             request->dl.remove();  
+            --_pending_message_count;
         }
 
         // added in rpc_engine::reply (for server) or rpc_session::send_message (for client)
@@ -216,6 +231,7 @@ namespace dsn
                     msg->release_ref();
                     _message_sent++;
                 }
+                _pending_message_count -= (int)_sending_msgs.size();
                 _sending_msgs.clear();
                 _sending_buffers.clear();
             }
@@ -253,6 +269,7 @@ namespace dsn
         _is_sending_next = false;
         _connect_state = is_client ? SS_DISCONNECTED : SS_CONNECTED;
         _reconnect_count_after_last_success = 0;
+        _pending_message_count = 0;
         _message_sent = 0;
         _max_buffer_block_count_per_send = net.max_buffer_block_count_per_send();
         _matcher = is_client ? _net.engine()->matcher() : nullptr;
@@ -363,6 +380,38 @@ namespace dsn
     connection_oriented_network::connection_oriented_network(rpc_engine* srv, network* inner_provider)
         : network(srv, inner_provider)
     {
+        _client_session_count = (int)dsn_config_get_value_uint64("network", "client_sessions_per_server", 1,
+            "how many client sessions (connections) are used for the requests to the same server, "
+            "where requests with the same (non-zero) hash always go through the same session to keep their order, "
+            "and the others go through the session with the least pending messages"
+            );
+        dassert(_client_session_count >= 1, "client_sessions_per_server must be positive");
+    }
+
+    int connection_oriented_network::select_client_session(const std::vector<rpc_session_ptr>& sessions, int hash) const
+    {
+        if (sessions.size() == 1)
+            return 0;
+
+        if (hash != 0)
+            return (int)((uint32_t)hash % (uint32_t)sessions.size());
+
+        // an empty slot means a new session to be created
+        int index = 0;
+        int min_count = 0;
+        for (int i = 0; i < (int)sessions.size(); i++)
+        {
+            if (sessions[i] == nullptr)
+                return i;
+
+            int count = sessions[i]->pending_message_count();
+            if (i == 0 || count < min_count)
+            {
+                index = i;
+                min_count = count;
+            }
+        }
+        return index;
     }
 
     void connection_oriented_network::send_message(message_ex* request)
@@ -370,6 +419,7 @@ namespace dsn
         rpc_session_ptr client = nullptr;
         bool new_client = false;
         auto& to = request->to_address;
+        int hash = request->header->client.hash;
 
         // TODO: thread-local client ptr cache
         {
@@ -377,22 +427,28 @@ namespace dsn
             auto it = _clients.find(to);
             if (it != _clients.end())
             {
-                client = it->second;
+                client = it->second[select_client_session(it->second, hash)];
             }
         }
 
         if (nullptr == client.get())
         {
             utils::auto_write_lock l(_clients_lock);
-            auto it = _clients.find(to);
-            if (it != _clients.end())
+            auto& sessions = _clients[to];
+            if (sessions.empty())
+            {
+                sessions.resize(_client_session_count);
+            }
+
+            auto& slot = sessions[select_client_session(sessions, hash)];
+            if (slot != nullptr)
             {
-                client = it->second;
+                client = slot;
             }
             else
             {
                 client = create_client_session(to);
-                _clients.insert(client_sessions::value_type(to, client));
+                slot = client;
                 new_client = true;
             }
         }
@@ -463,22 +519,54 @@ namespace dsn
     {
         utils::auto_read_lock l(_clients_lock);
         auto it = _clients.find(ep);
-        return it != _clients.end() ? it->second : nullptr;
+        if (it != _clients.end())
+        {
+            for (auto& c : it->second)
+            {
+                if (c != nullptr)
+                    return c;
+            }
+        }
+        return nullptr;
     }
 
     void connection_oriented_network::on_client_session_disconnected(rpc_session_ptr& s)
     {
-        int scount;
+        int scount = 0;
         bool r = false;
         {
             utils::auto_write_lock l(_clients_lock);
             auto it = _clients.find(s->remote_address());
-            if (it != _clients.end() && it->second.get() == s.get())
+            if (it != _clients.end())
             {
-                _clients.erase(it);
-                r = true;
+                bool empty = true;
+                for (auto& c : it->second)
+                {
+                    if (c.get() == s.get())
+                    {
+                        c = nullptr;
+                        r = true;
+                    }
+                    else if (c != nullptr)
+                    {
+                        empty = false;
+                    }
+                }
+
+                if (empty)
+                {
+                    _clients.erase(it);
+                }
+            }
+
+            for (auto& kv : _clients)
+            {
+                for (auto& c : kv.second)
+                {
+                    if (c != nullptr)
+                        scount++;
+                }
             }
-            scount = (int)_clients.size();
         }
 
         if (r)
@@ -0,0 +1,249 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "recv_buffer_pool.h"
+# include <dsn/internal/perf_counters.h>
+# include <dsn/internal/synchronize.h>
+# include <atomic>
+# include <vector>
+# include <type_traits>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "recv.buffer.pool"
+
+namespace dsn 
+{
+    class recv_buffer_pool;
+
+    //
+    // each pooled chunk reserves its head for the shared_ptr control block of
+    // the buffer following it, so that the control block is pooled together
+    // with the buffer; the chunk goes back to the pool when the control block
+    // is released, which is after the (no-op) deleter of the buffer is called
+    //
+    template <typename T>
+    class recv_chunk_allocator
+    {
+    public:
+        typedef T value_type;
+
+        recv_chunk_allocator(recv_buffer_pool* pool, int cls, char* chunk)
+            : _pool(pool), _cls(cls), _chunk(chunk)
+        {
+        }
+
+        template <typename U>
+        recv_chunk_allocator(const recv_chunk_allocator<U>& other)
+            : _pool(other._pool), _cls(other._cls), _chunk(other._chunk)
+        {
+        }
+
+        T* allocate(size_t n);
+        void deallocate(T* p, size_t n);
+
+        template <typename U> bool operator == (const recv_chunk_allocator<U>& other) const { return _chunk == other._chunk; }
+        template <typename U> bool operator != (const recv_chunk_allocator<U>& other) const { return _chunk != other._chunk; }
+
+    private:
+        template <typename U> friend class recv_chunk_allocator;
+
+        recv_buffer_pool* _pool;
+        int               _cls;
+        char*             _chunk;
+    };
+
+    class recv_buffer_pool
+    {
+    public:
+        enum 
+        {
+            MIN_CLASS_BITS = 12, // 4KB
+            CLASS_COUNT = 9,     // up to 1MB
+            CONTROL_BLOCK_RESERVED = 64 // ahead of each pooled buffer
+        };
+
+        recv_buffer_pool()
+        {
+            static uint64_t max_bytes = dsn_config_get_value_uint64("network", "recv_buffer_pool_max_bytes", 16 * 1024 * 1024,
+                "max bytes cached in the receive buffer pool of each network thread");
+
+            for (int i = 0; i < CLASS_COUNT; i++)
+            {
+                size_t count = (size_t)(max_bytes / CLASS_COUNT / class_size(i));
+                _classes[i].max_count = count > 0 ? count : 1;
+            }
+        }
+
+        static int class_size(int cls) { return 1 << (MIN_CLASS_BITS + cls); }
+
+        static int size_class(int sz)
+        {
+            int cls = 0;
+            while (cls < CLASS_COUNT && class_size(cls) < sz)
+                cls++;
+            return cls;
+        }
+
+        // return true when it is reused from the pool
+        bool alloc(int sz, /*out*/ std::shared_ptr<char>& buffer, /*out*/ int& capacity)
+        {
+            int cls = size_class(sz);
+            if (cls == CLASS_COUNT)
+            {
+                buffer.reset(new char[sz], std::default_delete<char[]>());
+                capacity = sz;
+                return false;
+            }
+
+            char* chunk = nullptr;
+            auto& c = _classes[cls];
+            {
+                utils::auto_lock<utils::ex_lock_nr_spin> l(c.lock);
+                if (!c.free_list.empty())
+                {
+                    chunk = c.free_list.back();
+                    c.free_list.pop_back();
+                }
+            }
+
+            bool hit = (chunk != nullptr);
+            if (!hit)
+                chunk = new char[CONTROL_BLOCK_RESERVED + class_size(cls)];
+
+            buffer.reset(chunk + CONTROL_BLOCK_RESERVED, [](char*) {}, recv_chunk_allocator<char>(this, cls, chunk));
+            capacity = class_size(cls);
+            return hit;
+        }
+
+        void free(int cls, char* chunk)
+        {
+            auto& c = _classes[cls];
+            {
+                utils::auto_lock<utils::ex_lock_nr_spin> l(c.lock);
+                if (c.free_list.size() < c.max_count)
+                {
+                    c.free_list.push_back(chunk);
+                    return;
+                }
+            }
+            delete[] chunk;
+        }
+
+    private:
+        struct size_class_list
+        {
+            utils::ex_lock_nr_spin lock;
+            std::vector<char*>     free_list;
+            size_t                 max_count;
+        };
+        size_class_list _classes[CLASS_COUNT];
+    };
+
+    template <typename T>
+    T* recv_chunk_allocator<T>::allocate(size_t n)
+    {
+        static_assert(std::alignment_of<T>::value <= 16, "control block must fit the chunk head alignment");
+        dassert(n * sizeof(T) <= recv_buffer_pool::CONTROL_BLOCK_RESERVED,
+            "control block of %d bytes cannot fit in the chunk head", (int)(n * sizeof(T)));
+        return (T*)_chunk;
+    }
+
+    template <typename T>
+    void recv_chunk_allocator<T>::deallocate(T* p, size_t n)
+    {
+        _pool->free(_cls, _chunk);
+    }
+
+    // pools are never destroyed as buffers may still be referenced after
+    // the owner thread exits, while network threads live with the process
+    static __thread recv_buffer_pool* tls_recv_buffer_pool = nullptr;
+
+    static std::atomic<uint64_t> s_alloc_count(0);
+    static std::atomic<uint64_t> s_hit_count(0);
+    static std::atomic<uint64_t> s_copied_bytes(0);
+
+    struct recv_buffer_counters
+    {
+        perf_counter_ptr alloc_count;
+        perf_counter_ptr hit_count;
+        perf_counter_ptr copied_bytes;
+
+        recv_buffer_counters()
+        {
+            alloc_count = utils::perf_counters::instance().get_counter("network", "recv.buffer.alloc#", COUNTER_TYPE_NUMBER, true);
+            hit_count = utils::perf_counters::instance().get_counter("network", "recv.buffer.hit#", COUNTER_TYPE_NUMBER, true);
+            copied_bytes = utils::perf_counters::instance().get_counter("network", "recv.buffer.copied(bytes)", COUNTER_TYPE_NUMBER, true);
+        }
+    };
+
+    static recv_buffer_counters& counters()
+    {
+        static recv_buffer_counters s_counters;
+        return s_counters;
+    }
+
+    std::shared_ptr<char> recv_buffer_alloc(int sz, /*out*/ int& capacity)
+    {
+        if (tls_recv_buffer_pool == nullptr)
+            tls_recv_buffer_pool = new recv_buffer_pool();
+
+        std::shared_ptr<char> buffer;
+        bool hit = tls_recv_buffer_pool->alloc(sz, buffer, capacity);
+
+        s_alloc_count.fetch_add(1, std::memory_order_relaxed);
+        counters().alloc_count->increment();
+        if (hit)
+        {
+            s_hit_count.fetch_add(1, std::memory_order_relaxed);
+            counters().hit_count->increment();
+        }
+        return buffer;
+    }
+
+    void recv_buffer_mark_copied(int sz)
+    {
+        s_copied_bytes.fetch_add((uint64_t)sz, std::memory_order_relaxed);
+        counters().copied_bytes->add((uint64_t)sz);
+    }
+
+    void recv_buffer_get_stats(/*out*/ recv_buffer_pool_stats& stats)
+    {
+        stats.alloc_count = s_alloc_count.load(std::memory_order_relaxed);
+        stats.hit_count = s_hit_count.load(std::memory_order_relaxed);
+        stats.copied_bytes = s_copied_bytes.load(std::memory_order_relaxed);
+    }
+}
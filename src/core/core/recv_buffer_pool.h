@@ -0,0 +1,65 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     per-thread size-classed buffer pool for the receive path of message parsers
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <dsn/ports.h>
+# include <dsn/service_api_c.h>
+
+namespace dsn 
+{
+    //
+    // buffers are allocated from the pool of the calling thread (i.e., the
+    // network/io looper thread), and are returned to the same pool when the
+    // last reference (e.g., from the received messages) is gone, no matter
+    // which thread releases it
+    //
+    // sizes are rounded up to 4KB << n (n < 9), larger ones are not pooled
+    //
+    struct recv_buffer_pool_stats
+    {
+        uint64_t alloc_count;
+        uint64_t hit_count;
+        uint64_t copied_bytes;
+    };
+
+    // allocate a buffer with at least sz bytes, and the real capacity is returned
+    extern std::shared_ptr<char> recv_buffer_alloc(int sz, /*out*/ int& capacity);
+
+    // record the bytes moved by memcpy on the receive path
+    extern void recv_buffer_mark_copied(int sz);
+
+    // accumulated stats of all threads
+    extern void recv_buffer_get_stats(/*out*/ recv_buffer_pool_stats& stats);
+}
@@ -81,6 +81,234 @@ namespace dsn {
         uint64_t            _id;
     };
 
+    //
+    // response task for each member of a group call, which feeds its result 
+    // into the group call directly instead of being executed on any thread pool
+    //
+    class rpc_group_member_task : public rpc_response_task
+    {
+    public:
+        rpc_group_member_task(message_ex* request, rpc_group_call* group, int index, service_node* node)
+            : rpc_response_task(request, nullptr, nullptr, 0, node)
+        {
+            _group = group;
+            _index = index;
+            _group->add_ref(); // released in dctor
+        }
+
+        ~rpc_group_member_task()
+        {
+            // the result is reported to the group call instead, or dropped on cancellation
+            _error.end_tracking();
+            _group->release_ref(); // added in ctor
+        }
+
+        using rpc_response_task::enqueue;
+        virtual void enqueue(error_code err, message_ex* reply) override
+        {
+            // delayed ones (e.g., the timeout of a dropped request) go through
+            // the thread pool as usual, and are reported in exec
+            if (delay_milliseconds() > 0)
+            {
+                rpc_response_task::enqueue(err, reply);
+                return;
+            }
+
+            _group->on_member_response(_index, err, reply);
+
+            // as ref_count may be zero, e.g., when the request is dropped in call_ip
+            this->add_ref();
+            this->release_ref();
+        }
+
+        virtual void exec() override
+        {
+            _group->on_member_response(_index, error(), get_response());
+        }
+
+    private:
+        rpc_group_call* _group;
+        int             _index;
+    };
+
+    rpc_group_call::rpc_group_call(rpc_response_task* call, const std::vector<rpc_address>& members, int quorum, 
+        rpc_client_matcher* matcher)
+    {
+        _call = call;
+        _call->add_ref(); // released once completed
+        _matcher = matcher;
+
+        _quorum = (quorum <= 0 || quorum > (int)members.size()) ? (int)members.size() : quorum;
+        _succeeded = 0;
+        _failed = 0;
+        _first_error = ERR_OK;
+
+        _responses.resize(members.size());
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            _responses[i].member = members[i];
+            _responses[i].err = ERR_IO_PENDING;
+            _responses[i].response = nullptr;
+            _responses[i].request_id = 0;
+        }
+    }
+
+    rpc_group_call::~rpc_group_call()
+    {
+        for (auto& r : _responses)
+        {
+            // per-member results are not necessarily inquired by the upper apps
+            r.err.end_tracking();
+
+            if (r.response != nullptr)
+                r.response->release_ref(); // added in on_member_response
+        }
+
+        if (_call != nullptr)
+            _call->release_ref(); // added in ctor
+    }
+
+    void rpc_group_call::on_member_response(int index, error_code err, message_ex* reply)
+    {
+        if (reply != nullptr && err != ERR_OK)
+        {
+            // as ref_count for reply may be zero
+            reply->add_ref();
+            reply->release_ref();
+            reply = nullptr;
+        }
+
+        rpc_response_task* call = nullptr;
+        error_code call_err = ERR_OK;
+        message_ex* response = nullptr;
+        std::vector<uint64_t> losers;
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_lock);
+            auto& r = _responses[index];
+            dassert(r.err == ERR_IO_PENDING, "group member %s responds more than once",
+                r.member.to_string());
+
+            r.err = err;
+            if (reply != nullptr)
+            {
+                // the member may have forwarded the request to others
+                r.member = reply->from_address;
+                r.response = reply;
+                reply->add_ref(); // released in dctor
+            }
+
+            if (_call == nullptr)
+                return;
+
+            if (err == ERR_OK)
+            {
+                if (++_succeeded == _quorum)
+                {
+                    call = _call;
+                    response = reply;
+                }
+            }
+            else
+            {
+                if (_first_error == ERR_OK)
+                    _first_error = err;
+
+                if (++_failed > (int)_responses.size() - _quorum)
+                {
+                    call = _call;
+                    call_err = _first_error;
+                }
+            }
+
+            if (call != nullptr)
+            {
+                _call = nullptr;
+
+                if (_matcher != nullptr)
+                {
+                    for (auto& p : _responses)
+                    {
+                        if (p.err == ERR_IO_PENDING && p.request_id != 0)
+                            losers.push_back(p.request_id);
+                    }
+                }
+            }
+        }
+
+        if (call != nullptr)
+        {
+            for (auto& id : losers)
+            {
+                _matcher->cancel(id);
+            }
+
+            call->enqueue(call_err, response);
+            call->release_ref(); // added in ctor
+        }
+    }
+
+    bool rpc_group_call::set_member_request_id(int index, uint64_t id)
+    {
+        utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_lock);
+        if (_call == nullptr)
+            return false;
+
+        _responses[index].request_id = id;
+        return true;
+    }
+
+    error_code rpc_group_call::get_member_response(int index, /*out*/ rpc_address& member, /*out*/ message_ex*& response)
+    {
+        utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_lock);
+        auto& r = _responses[index];
+        member = r.member;
+        response = r.response;
+        if (response != nullptr)
+            response->add_ref(); // released by callers
+        return r.err;
+    }
+
+    DEFINE_TASK_CODE(LPC_RPC_HEDGE, TASK_PRIORITY_COMMON, THREAD_POOL_DEFAULT)
+
+    //
+    // resend a GRPC_TO_ANY request to another member when there is no reply in time
+    //
+    class rpc_hedge_task : public task
+    {
+    public:
+        rpc_hedge_task(rpc_engine* engine, rpc_group_call* group, message_ex* request,
+            rpc_address member, rpc_group_member_stat* stat, service_node* node)
+            : task(LPC_RPC_HEDGE, 0, node)
+        {
+            _engine = engine;
+            _group = group;
+            _request = request;
+            _member = member;
+            _stat = stat;
+
+            _group->add_ref(); // released in dctor
+            _request->add_ref(); // released in dctor
+        }
+
+        ~rpc_hedge_task()
+        {
+            _group->release_ref(); // added in ctor
+            _request->release_ref(); // added in ctor
+        }
+
+        virtual void exec()
+        {
+            _engine->call_hedge(_group, _request, _member, _stat.get());
+        }
+
+    private:
+        rpc_engine*               _engine;
+        rpc_group_call*           _group;
+        message_ex*               _request;
+        rpc_address               _member;
+        rpc_group_member_stat_ptr _stat;
+    };
+
     rpc_client_matcher::~rpc_client_matcher()
     {
         for (int i = 0; i < MATCHER_BUCKET_NR; i++)
@@ -95,6 +323,8 @@ namespace dsn {
         
         rpc_response_task* call;
         task* timeout_task;
+        rpc_group_member_stat* stat;
+        uint64_t start_ns;
         int bucket_index = key % MATCHER_BUCKET_NR;
 
         {
@@ -105,6 +335,8 @@ namespace dsn {
                 call = it->second.resp_task;
                 timeout_task = it->second.timeout_task;
                 timeout_task->add_ref(); // released below in the same function
+                stat = it->second.stat;
+                start_ns = it->second.start_ns;
                 _requests[bucket_index].erase(it);
             }
             else
@@ -122,6 +354,12 @@ namespace dsn {
             timeout_task->cancel(false); // no need to wait
         }
         timeout_task->release_ref(); // added above in the same function
+
+        if (stat != nullptr)
+        {
+            stat->on_response((dsn_now_ns() - start_ns) / 1000);
+            stat->release_ref(); // added in on_call
+        }
         
         if (reply->error() == ERR_FORWARD_TO_OTHERS)
         {
@@ -143,6 +381,8 @@ namespace dsn {
     void rpc_client_matcher::on_rpc_timeout(uint64_t key)
     {
         rpc_response_task* call;
+        rpc_group_member_stat* stat;
+        uint64_t start_ns;
         int bucket_index = key % MATCHER_BUCKET_NR;
 
         {
@@ -151,6 +391,8 @@ namespace dsn {
             if (it != _requests[bucket_index].end())
             {
                 call = it->second.resp_task;
+                stat = it->second.stat;
+                start_ns = it->second.start_ns;
                 _requests[bucket_index].erase(it);
             }
             else
@@ -159,13 +401,59 @@ namespace dsn {
             }
         }
 
+        if (stat != nullptr)
+        {
+            stat->on_response((dsn_now_ns() - start_ns) / 1000);
+            stat->release_ref(); // added in on_call
+        }
+
         dbg_dassert(call != nullptr, "rpc response task cannot be empty");
         call->enqueue(ERR_TIMEOUT, nullptr);
 
         call->release_ref(); // added in on_call
     }
+
+    bool rpc_client_matcher::cancel(uint64_t key)
+    {
+        rpc_response_task* call;
+        task* timeout_task;
+        rpc_group_member_stat* stat;
+        int bucket_index = key % MATCHER_BUCKET_NR;
+
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_requests_lock[bucket_index]);
+            auto it = _requests[bucket_index].find(key);
+            if (it != _requests[bucket_index].end())
+            {
+                call = it->second.resp_task;
+                timeout_task = it->second.timeout_task;
+                timeout_task->add_ref(); // released below in the same function
+                stat = it->second.stat;
+                _requests[bucket_index].erase(it);
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (timeout_task != task::get_current_task())
+        {
+            timeout_task->cancel(false); // no need to wait
+        }
+        timeout_task->release_ref(); // added above in the same function
+
+        if (stat != nullptr)
+        {
+            stat->on_cancelled();
+            stat->release_ref(); // added in on_call
+        }
+
+        call->release_ref(); // added in on_call
+        return true;
+    }
     
-    void rpc_client_matcher::on_call(message_ex* request, rpc_response_task* call)
+    void rpc_client_matcher::on_call(message_ex* request, rpc_response_task* call, rpc_group_member_stat* stat)
     {
         task* timeout_task;
         message_header& hdr = *request->header;
@@ -180,6 +468,14 @@ namespace dsn {
             dassert (pr.second, "the message is already on the fly!!!");
             pr.first->second.resp_task = call;
             pr.first->second.timeout_task = timeout_task;
+            pr.first->second.stat = stat;
+            pr.first->second.start_ns = stat ? dsn_now_ns() : 0;
+        }
+
+        if (stat != nullptr)
+        {
+            stat->add_ref(); // released in on_rpc_timeout, on_recv_reply, or cancel
+            stat->on_call();
         }
 
         timeout_task->set_delay(hdr.client.timeout_ms);
@@ -253,10 +549,23 @@ namespace dsn {
         // start client networks
         _client_nets.resize(network_header_format::max_value() + 1);
 
+        // only the formats used by rpc calls, besides the default one
+        std::vector<bool> used_formats(network_header_format::max_value() + 1, false);
+        used_formats[NET_HDR_DSN] = true;
+        for (int i = 0; i <= dsn_task_code_max(); i++)
+        {
+            auto sp = task_spec::get(i);
+            if (sp != nullptr && sp->type == TASK_TYPE_RPC_REQUEST)
+                used_formats[sp->rpc_call_header_format] = true;
+        }
+
         // for each format
         for (int i = 0; i <= network_header_format::max_value(); i++)
         {
             std::vector<network*>& pnet = _client_nets[i];
+            if (!used_formats[i])
+                continue;
+
             pnet.resize(rpc_channel::max_value() + 1);
 
             // for each channel
@@ -380,6 +689,10 @@ namespace dsn {
         {
             _handlers[name] = handler;
             _handlers[handler->name] = handler;
+
+            if (handler->code >= (int)_handlers_by_code.size())
+                _handlers_by_code.resize(handler->code + 1);
+            _handlers_by_code[handler->code] = handler;
             return true;
         }
         else
@@ -400,6 +713,7 @@ namespace dsn {
         std::string name = it->second->name;
         _handlers.erase(it);
         _handlers.erase(name);
+        _handlers_by_code[ret->code] = nullptr;
 
         return ret;
     }
@@ -409,11 +723,22 @@ namespace dsn {
         rpc_request_task* tsk = nullptr;
         {
             utils::auto_read_lock l(_handlers_lock);
-            auto it = _handlers.find(msg->header->rpc_name);
-            if (it != _handlers.end())
+
+            // resolved by the message parser already, e.g., NET_HDR_DSN_COMPACT
+            if (msg->local_rpc_code != TASK_CODE_INVALID
+                && msg->local_rpc_code < _handlers_by_code.size()
+                && _handlers_by_code[msg->local_rpc_code] != nullptr)
             {
-                msg->local_rpc_code = (uint16_t)it->second->code;
-                tsk = new rpc_request_task(msg, it->second, _node);                
+                tsk = new rpc_request_task(msg, _handlers_by_code[msg->local_rpc_code], _node);
+            }
+            else
+            {
+                auto it = _handlers.find(msg->header->rpc_name);
+                if (it != _handlers.end())
+                {
+                    msg->local_rpc_code = (uint16_t)it->second->code;
+                    tsk = new rpc_request_task(msg, it->second, _node);
+                }
             }
         }
 
@@ -435,14 +760,19 @@ namespace dsn {
         }
     }
 
-    void rpc_engine::call(message_ex* request, rpc_response_task* call)
+    void rpc_engine::prepare_call(message_ex* request)
     {
-        auto sp = task_spec::get(request->local_rpc_code);
         auto& hdr = *request->header;
 
         hdr.client.port = primary_address().port();
         hdr.rpc_id = utils::get_random64();        
         request->seal(_message_crc_required);
+    }
+
+    void rpc_engine::call(message_ex* request, rpc_response_task* call)
+    {
+        auto sp = task_spec::get(request->local_rpc_code);
+        prepare_call(request);
         
         switch (request->server_address.type())
         {
@@ -456,15 +786,18 @@ namespace dsn {
             switch (sp->grpc_mode)
             {
             case GRPC_TO_LEADER:
-                // TODO: auto-changed leader
-                call_ip(request->server_address.group_address()->possible_leader(), request, call);
+                {
+                    // TODO: auto-changed leader
+                    auto group = request->server_address.group_address();
+                    auto leader = group->possible_leader();
+                    call_ip(leader, request, call, false, group->member_stat(leader).get());
+                }
                 break;
             case GRPC_TO_ANY:
-                // TODO: performance optimization
-                call_ip(request->server_address.group_address()->random_member(), request, call);
+                call_any(request->server_address, request, call);
                 break;
             case GRPC_TO_ALL:
-                dassert(false, "to be implemented");
+                call_all(request->server_address, request, call, 0);
                 break;
             default:
                 dassert(false, "invalid group rpc mode %d", (int)(sp->grpc_mode));
@@ -477,7 +810,126 @@ namespace dsn {
         return;
     }
 
-    void rpc_engine::call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id)
+    void rpc_engine::call_group(message_ex* request, rpc_response_task* call, int quorum)
+    {
+        dassert(request->server_address.type() == HOST_TYPE_GROUP, 
+            "group call is sent to %s which is not a group address",
+            request->server_address.to_string()
+            );
+
+        prepare_call(request);
+        call_all(request->server_address, request, call, quorum);
+    }
+
+    void rpc_engine::call_all(rpc_address group, message_ex* request, rpc_response_task* call, int quorum)
+    {
+        // members may be changed later by the upper apps
+        std::vector<rpc_address> members = group.group_address()->members();
+        if (members.empty())
+        {
+            if (call != nullptr)
+            {
+                call->enqueue(ERR_NOT_ENOUGH_MEMBER, nullptr);
+            }
+            else
+            {
+                // as ref_count for request may be zero
+                request->add_ref();
+                request->release_ref();
+            }
+            return;
+        }
+
+        // the request is serialized and sealed only once, and the other members get
+        // copies sharing its body buffers; all copies are made before any is sent 
+        // as the request may be released right after it is sent
+        std::vector<message_ex*> requests(members.size());
+        requests[0] = request;
+        for (size_t i = 1; i < members.size(); i++)
+        {
+            requests[i] = request->copy_for_send(_message_crc_required);
+        }
+
+        rpc_group_call* gcall = nullptr;
+        if (call != nullptr)
+        {
+            gcall = new rpc_group_call(call, members, quorum);
+            gcall->add_ref(); // released in call's dctor
+            call->_group_call = gcall;
+        }
+
+        for (size_t i = 0; i < members.size(); i++)
+        {
+            rpc_response_task* member_call = nullptr;
+            if (gcall != nullptr)
+            {
+                member_call = new rpc_group_member_task(requests[i], gcall, (int)i, call->node());
+            }
+            call_ip(members[i], requests[i], member_call, false, 
+                group.group_address()->member_stat(members[i]).get());
+        }
+    }
+
+    void rpc_engine::call_any(rpc_address group, message_ex* request, rpc_response_task* call)
+    {
+        auto sp = task_spec::get(request->local_rpc_code);
+        auto g = group.group_address();
+        rpc_group_member_stat_ptr stat;
+        rpc_address addr = g->select_member(stat);
+
+        // hedged requests: the request is sent to another member as well when there 
+        // is no reply after the given percentile of the rtts of the first member
+        rpc_group_member_stat_ptr hedge_stat;
+        rpc_address hedge_addr;
+        int hedge_delay_ms = 0;
+        if (call != nullptr && sp->rpc_call_hedge_percentile > 0 && stat != nullptr)
+        {
+            uint64_t delay_us = stat->rtt_percentile_us(sp->rpc_call_hedge_percentile);
+            hedge_delay_ms = (int)((delay_us + 999) / 1000);
+            if (delay_us > 0 && hedge_delay_ms < request->header->client.timeout_ms)
+            {
+                hedge_addr = g->select_member(hedge_stat, addr);
+            }
+        }
+
+        if (hedge_addr.is_invalid())
+        {
+            call_ip(addr, request, call, false, stat.get());
+            return;
+        }
+
+        // the first reply wins, and the other is cancelled
+        std::vector<rpc_address> members;
+        members.push_back(addr);
+        members.push_back(hedge_addr);
+        auto gcall = new rpc_group_call(call, members, 1, &_rpc_matcher);
+        gcall->add_ref(); // released in call's dctor
+        call->_group_call = gcall;
+
+        auto hedge = new rpc_hedge_task(this, gcall, request, hedge_addr, hedge_stat.get(), call->node());
+        hedge->set_delay(hedge_delay_ms);
+        hedge->enqueue();
+
+        gcall->set_member_request_id(0, request->header->id);
+        call_ip(addr, request, new rpc_group_member_task(request, gcall, 0, call->node()), false, stat.get());
+    }
+
+    void rpc_engine::call_hedge(rpc_group_call* gcall, message_ex* request, rpc_address member, rpc_group_member_stat* stat)
+    {
+        message_ex* hedge = request->copy_for_send(_message_crc_required);
+        if (!gcall->set_member_request_id(1, hedge->header->id))
+        {
+            // completed already, and as ref_count for hedge is zero
+            hedge->add_ref();
+            hedge->release_ref();
+            return;
+        }
+
+        call_ip(member, hedge, new rpc_group_member_task(hedge, gcall, 1, _node), false, stat);
+    }
+
+    void rpc_engine::call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id,
+        rpc_group_member_stat* stat)
     {
         dbg_dassert(addr.type() == HOST_TYPE_IPV4, "only IPV4 is now supported");
         dbg_dassert(addr.port() >= 1024, "only server address can be called");
@@ -535,7 +987,7 @@ namespace dsn {
             
         if (call != nullptr)
         {
-            _rpc_matcher.on_call(request, call);
+            _rpc_matcher.on_call(request, call, stat);
         }
 
         net->send_message(request);
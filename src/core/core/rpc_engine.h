@@ -44,6 +44,7 @@ namespace dsn {
 
 class service_node;
 class rpc_engine;
+class rpc_group_member_stat;
 
 //
 // client matcher for matching RPC request and RPC response, and handling timeout
@@ -71,7 +72,7 @@ public:
     // when a two-way RPC call is made, register the requst id and the callback
     // which also registers a timer for timeout tracking
     //
-    void on_call(message_ex* request, rpc_response_task* call);
+    void on_call(message_ex* request, rpc_response_task* call, rpc_group_member_stat* stat = nullptr);
 
     //
     // when a RPC response is received, call this function to trigger calback
@@ -81,6 +82,11 @@ public:
     //
     bool on_recv_reply(uint64_t key, message_ex* reply, int delay_ms);
 
+    //
+    // drop the call without any callback, e.g., the losers of hedged requests
+    //
+    bool cancel(uint64_t key);
+
 private:
     friend class rpc_timeout_task;
     void on_rpc_timeout(uint64_t key);
@@ -91,12 +97,60 @@ private:
     {
         rpc_response_task*    resp_task;
         task*                 timeout_task;
+        rpc_group_member_stat* stat; // for calls to group members
+        uint64_t              start_ns;
     };
     typedef std::unordered_map<uint64_t, match_entry> rpc_requests;
     rpc_requests                  _requests[MATCHER_BUCKET_NR];
     ::dsn::utils::ex_lock_nr_spin _requests_lock[MATCHER_BUCKET_NR];
 };
 
+//
+// state of a group rpc call (GRPC_TO_ALL, or dsn_rpc_call_group), which
+// collects the results from all members, and completes the caller's response
+// task once when quorum members succeed, or when the quorum cannot be reached
+// any more (with the first member error)
+//
+class rpc_group_call : public ref_counter
+{
+public:
+    // the pending members are cancelled in matcher once completed if it is given
+    rpc_group_call(rpc_response_task* call, const std::vector<rpc_address>& members, int quorum, 
+        rpc_client_matcher* matcher = nullptr);
+    ~rpc_group_call();
+
+    // invoked once for each member, with its reply, error, or timeout
+    void on_member_response(int index, error_code err, message_ex* reply);
+
+    int member_count() const { return (int)_responses.size(); }
+
+    // record the request id sent to the member for cancellation,
+    // return false when the call is already completed
+    bool set_member_request_id(int index, uint64_t id);
+
+    // the result known so far for the given member, ERR_IO_PENDING when it is still
+    // on the fly, and the returned response must be released by the caller
+    error_code get_member_response(int index, /*out*/ rpc_address& member, /*out*/ message_ex*& response);
+
+private:
+    struct member_response
+    {
+        rpc_address  member;
+        error_code   err;
+        message_ex*  response;
+        uint64_t     request_id;
+    };
+
+    ::dsn::utils::ex_lock_nr_spin _lock;
+    std::vector<member_response>  _responses;
+    rpc_response_task*            _call; // nullptr once completed
+    rpc_client_matcher*           _matcher;
+    int                           _quorum;
+    int                           _succeeded;
+    int                           _failed;
+    error_code                    _first_error;
+};
+
 class rpc_engine
 {
 public:
@@ -120,6 +174,9 @@ public:
     // rpc routines
     //
     void call(message_ex* request, rpc_response_task* call);    
+    // send to all members of the group, and complete the call when quorum members 
+    // reply successfully (all members when quorum <= 0)
+    void call_group(message_ex* request, rpc_response_task* call, int quorum);
     void on_recv_request(message_ex* msg, int delay_ms);
     static void reply(message_ex* response, error_code err = ERR_OK);
 
@@ -131,9 +188,16 @@ public:
     rpc_client_matcher* matcher() { return &_rpc_matcher; }
 
     // call with ip address only
-    void call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id = false);
+    void call_ip(rpc_address addr, message_ex* request, rpc_response_task* call, bool reset_request_id = false,
+        rpc_group_member_stat* stat = nullptr);
 
 private:
+    void prepare_call(message_ex* request);
+    void call_all(rpc_address group, message_ex* request, rpc_response_task* call, int quorum);
+    void call_any(rpc_address group, message_ex* request, rpc_response_task* call);
+    void call_hedge(rpc_group_call* gcall, message_ex* request, rpc_address member, rpc_group_member_stat* stat);
+    friend class rpc_hedge_task;
+
     network* create_network(
         const network_server_config& netcs, 
         bool client_only,
@@ -150,6 +214,7 @@ private:
 
     typedef std::unordered_map<std::string, rpc_handler_ptr> rpc_handlers;
     rpc_handlers                  _handlers;
+    std::vector<rpc_handler_ptr>  _handlers_by_code; // code => handler, for requests with resolved codes
     utils::rw_lock_nr             _handlers_lock;
     
     volatile bool                 _is_running;
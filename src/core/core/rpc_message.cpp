@@ -160,6 +160,7 @@ message_ex::message_ex()
     _rw_index = -1;
     _rw_offset = 0;
     header = nullptr;
+    local_rpc_code = 0;
     _is_read = false;
 }
 
@@ -186,7 +187,6 @@ void message_ex::seal(bool fill_crc)
             size_t len = 0;
             for (int i = 0; i <= i_max; i++)
             {
-                uint32_t lcrc;
                 const void* ptr;
                 size_t sz;
 
@@ -201,12 +201,8 @@ void message_ex::seal(bool fill_crc)
                     sz = (size_t)buffers[i].length();
                 }
 
-                lcrc = dsn_crc32_compute(ptr, sz, crc32);
-                crc32 = dsn_crc32_concatenate(
-                    0,
-                    0, crc32, len, 
-                    crc32, lcrc, sz
-                    );
+                // chained, so it is already the crc of all bytes so far
+                crc32 = dsn_crc32_compute(ptr, sz, crc32);
 
                 len += sz;
             }
@@ -275,7 +271,6 @@ bool message_ex::is_right_body(bool is_write_msg) const
         size_t len = 0;
         for (int i = 0; i <= i_max; i++)
         {
-            uint32_t lcrc;
             const void* ptr;
             size_t sz;
 
@@ -290,12 +285,8 @@ bool message_ex::is_right_body(bool is_write_msg) const
                 sz = (size_t)buffers[i].length();
             }
 
-            lcrc = dsn_crc32_compute(ptr, sz, crc32);
-            crc32 = dsn_crc32_concatenate(
-                0,
-                0, crc32, len,
-                crc32, lcrc, sz
-                );
+            // chained, so it is already the crc of all bytes so far
+            crc32 = dsn_crc32_compute(ptr, sz, crc32);
 
             len += sz;
         }
@@ -323,6 +314,20 @@ message_ex* message_ex::create_receive_message(const blob& data)
     return msg;
 }
 
+message_ex* message_ex::create_receive_message(const blob& header, const blob& body)
+{
+    dassert(header.length() >= (int)sizeof(message_header), "header buffer is too small");
+
+    message_ex* msg = new message_ex();
+    msg->_header_buffer = header;
+    msg->header = (message_header*)header.data();
+    msg->_is_read = true;
+    msg->buffers.push_back(body);
+
+    dbg_dassert(msg->header->body_length > 0, "message %s is empty!", msg->header->rpc_name);
+    return msg;
+}
+
 message_ex* message_ex::copy()
 {
     message_ex* msg = new message_ex();
@@ -330,6 +335,7 @@ message_ex* message_ex::copy()
     msg->to_address = to_address;
     msg->local_rpc_code = local_rpc_code;
     msg->buffers = buffers;
+    msg->_header_buffer = _header_buffer;
     msg->_is_read = _is_read;
 
     // received message
@@ -351,6 +357,32 @@ message_ex* message_ex::copy()
     return msg;
 }
 
+message_ex* message_ex::copy_for_send(bool crc_required)
+{
+    dassert(!_is_read && _rw_committed, "only committed write mode messages can be copied for send");
+
+    message_ex* msg = new message_ex();
+    msg->_is_read = false;
+    msg->prepare_buffer_header();
+    memcpy((void*)msg->header, (const void*)header, sizeof(message_header));
+    msg->header->id = new_id();
+
+    // only the header is copied, the body buffers are shared
+    if (buffers[0].length() > (int)sizeof(message_header))
+    {
+        msg->buffers.push_back(buffers[0].range((int)sizeof(message_header)));
+    }
+    for (size_t i = 1; i < buffers.size(); i++)
+    {
+        msg->buffers.push_back(buffers[i]);
+    }
+
+    msg->local_rpc_code = local_rpc_code;
+    msg->server_address = server_address;
+    msg->seal(crc_required);
+    return msg;
+}
+
 message_ex* message_ex::create_request(dsn_task_code_t rpc_code, int timeout_milliseconds, int hash)
 {
     message_ex* msg = new message_ex();
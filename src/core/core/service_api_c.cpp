@@ -46,13 +46,15 @@
 # include <dsn/internal/task.h>
 # include <dsn/internal/singleton_store.h>
 # include <dsn/internal/configuration.h>
+# include <dsn/internal/callocator.h>
+# include <dsn/internal/perf_counters.h>
 
 # include "command_manager.h"
 # include "service_engine.h"
 # include "rpc_engine.h"
 # include "disk_engine.h"
 # include "coredump.h"
-# include "crc.h"
+# include "crc32c.h"
 # include <fstream>
 
 # ifndef _WIN32
@@ -83,6 +85,39 @@ static struct _all_info_
 
 } dsn_all;
 
+namespace dsn
+{
+    // every object records the provider it is allocated from, so that the
+    // objects created before the provider is ready (e.g., during the tool
+    // installation) go back to malloc instead of the provider
+    struct tools_memory_header
+    {
+        memory_provider* provider;
+        uint64_t         padding; // keeps the objects 16-byte aligned
+    };
+
+    void* tools_memory_allocate(size_t sz)
+    {
+        auto mp = dsn_all.memory;
+        size_t total = sz + sizeof(tools_memory_header);
+        auto hdr = (tools_memory_header*)(mp ? mp->allocate(total) : ::malloc(total));
+        hdr->provider = mp;
+        return hdr + 1;
+    }
+
+    void tools_memory_deallocate(void* ptr)
+    {
+        if (ptr == nullptr)
+            return;
+
+        auto hdr = (tools_memory_header*)ptr - 1;
+        if (hdr->provider)
+            hdr->provider->deallocate(hdr);
+        else
+            ::free(hdr);
+    }
+}
+
 //------------------------------------------------------------------------------
 //
 // common types
@@ -249,18 +284,46 @@ DSN_API void dsn_coredump()
 
 DSN_API uint32_t dsn_crc32_compute(const void* ptr, size_t size, uint32_t init_crc)
 {
-    return ::dsn::utils::crc32::compute(ptr, size, init_crc);
+    return ::dsn::utils::crc32c_compute(ptr, size, init_crc);
 }
 
 DSN_API uint32_t dsn_crc32_concatenate(uint32_t xy_init, uint32_t x_init, uint32_t x_final, size_t x_size, uint32_t y_init, uint32_t y_final, size_t y_size)
 {
-    return ::dsn::utils::crc32::concatenate(
+    return ::dsn::utils::crc32c_concatenate(
         0,
-        x_init, x_final, (uint64_t)x_size,
-        y_init, y_final, (uint64_t)y_size
+        x_init, x_final, x_size,
+        y_init, y_final, y_size
         );
 }
 
+DSN_API dsn_handle_t dsn_perf_counter_create(const char* section, const char* name, dsn_perf_counter_type_t type)
+{
+    static_assert((int)PERF_COUNTER_TYPE_NUMBER == (int)::dsn::COUNTER_TYPE_NUMBER
+        && (int)PERF_COUNTER_TYPE_RATE == (int)::dsn::COUNTER_TYPE_RATE
+        && (int)PERF_COUNTER_TYPE_NUMBER_PERCENTILES == (int)::dsn::COUNTER_TYPE_NUMBER_PERCENTILES,
+        "perf counter types in c api and tool api must match");
+
+    // the registry holds the counter till process exits, so the raw pointer is safe to return
+    auto c = ::dsn::utils::perf_counters::instance().get_counter(
+        section, name, (::dsn::perf_counter_type)type, true);
+    return c.get();
+}
+
+DSN_API void dsn_perf_counter_increment(dsn_handle_t counter)
+{
+    ((::dsn::perf_counter*)counter)->increment();
+}
+
+DSN_API void dsn_perf_counter_add(dsn_handle_t counter, uint64_t val)
+{
+    ((::dsn::perf_counter*)counter)->add(val);
+}
+
+DSN_API void dsn_perf_counter_set(dsn_handle_t counter, uint64_t val)
+{
+    ((::dsn::perf_counter*)counter)->set(val);
+}
+
 //------------------------------------------------------------------------------
 //
 // tasking - asynchronous tasks and timers tasks executed in target thread pools
@@ -537,6 +600,17 @@ DSN_API void dsn_rpc_call(dsn_address_t server, dsn_task_t rpc_call, dsn_task_tr
     ::dsn::task::get_current_rpc()->call(msg, task);
 }
 
+DSN_API void dsn_rpc_call_group(dsn_address_t group, dsn_task_t rpc_call, int quorum, dsn_task_tracker_t tracker)
+{
+    ::dsn::rpc_response_task* task = (::dsn::rpc_response_task*)rpc_call;
+    dassert(task->spec().type == TASK_TYPE_RPC_RESPONSE, "");
+    task->set_tracker((dsn::task_tracker*)tracker);
+
+    auto msg = task->get_request();
+    msg->server_address = group;
+    ::dsn::task::get_current_rpc()->call_group(msg, task, quorum);
+}
+
 DSN_API dsn_message_t dsn_rpc_call_wait(dsn_address_t server, dsn_message_t request)
 {
     auto msg = ((::dsn::message_ex*)request);
@@ -597,6 +671,30 @@ DSN_API dsn_message_t dsn_rpc_get_response(dsn_task_t rpc_call)
         return nullptr;
 }
 
+DSN_API int dsn_rpc_get_group_response_count(dsn_task_t rpc_call)
+{
+    ::dsn::rpc_response_task* task = (::dsn::rpc_response_task*)rpc_call;
+    dassert(task->spec().type == TASK_TYPE_RPC_RESPONSE, "");
+    auto gcall = task->get_group_call();
+    return gcall ? gcall->member_count() : 0;
+}
+
+DSN_API dsn_error_t dsn_rpc_get_group_response(dsn_task_t rpc_call, int index, dsn_address_t* member, dsn_message_t* response)
+{
+    ::dsn::rpc_response_task* task = (::dsn::rpc_response_task*)rpc_call;
+    dassert(task->spec().type == TASK_TYPE_RPC_RESPONSE, "");
+    auto gcall = task->get_group_call();
+    dassert(gcall != nullptr && index >= 0 && index < gcall->member_count(), 
+        "invalid group member index %d", index);
+
+    ::dsn::rpc_address addr;
+    ::dsn::message_ex* msg;
+    auto err = gcall->get_member_response(index, addr, msg);
+    *member = addr.c_addr();
+    *response = msg;
+    return err.get();
+}
+
 DSN_API void dsn_rpc_enqueue_response(dsn_task_t rpc_call, dsn_error_t err, dsn_message_t response)
 {
     ::dsn::rpc_response_task* task = (::dsn::rpc_response_task*)rpc_call;
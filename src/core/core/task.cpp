@@ -470,6 +470,7 @@ rpc_response_task::rpc_response_task(message_ex* request, dsn_rpc_response_handl
 
     _request = request;
     _response = nullptr;
+    _group_call = nullptr;
 
     _caller_pool = task::get_current_worker() ? 
         task::get_current_worker()->pool() : nullptr;
@@ -483,6 +484,9 @@ rpc_response_task::~rpc_response_task()
 
     if (_response != nullptr)
         _response->release_ref(); // added in enqueue
+
+    if (_group_call != nullptr)
+        _group_call->release_ref(); // added in rpc_engine::call_all
 }
 
 void rpc_response_task::enqueue(error_code err, message_ex* reply)
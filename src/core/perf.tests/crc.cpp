@@ -0,0 +1,94 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     throughput of the crc32c kernels across buffer sizes
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <gtest/gtest.h>
+# include <dsn/service_api_c.h>
+# include <iostream>
+# include <iomanip>
+# include <memory>
+
+# include "crc32c.h"
+
+using namespace ::dsn::utils;
+
+typedef uint32_t (*crc32c_kernel)(const void*, size_t, uint32_t);
+
+// returns MB/s
+static double crc32c_throughput(crc32c_kernel kernel, const char* buffer, size_t size)
+{
+    // about 256MB per case, at least 16 rounds
+    size_t rounds = (256 * 1024 * 1024) / size;
+    if (rounds < 16)
+        rounds = 16;
+
+    volatile uint32_t crc = 0;
+    uint64_t start = dsn_now_ns();
+    for (size_t i = 0; i < rounds; i++)
+    {
+        crc = kernel(buffer, size, crc);
+    }
+    uint64_t d = dsn_now_ns() - start;
+
+    return (double)size * (double)rounds / 1024.0 / 1024.0 / ((double)d / 1000000000.0);
+}
+
+TEST(core, crc32c_perf)
+{
+    const size_t max_size = 1024 * 1024;
+    std::unique_ptr<char[]> buffer(new char[max_size]);
+    for (size_t i = 0; i < max_size; i++)
+    {
+        buffer[i] = (char)dsn_random32(0, 255);
+    }
+
+    bool hw = crc32c_hardware_supported();
+
+    std::cout << "size(bytes)\t software(MB/s)\t hardware(MB/s)" << std::endl;
+    for (size_t sz = 64; sz <= max_size; sz *= 4)
+    {
+        double sw_thp = crc32c_throughput(crc32c_software, buffer.get(), sz);
+        double hw_thp = hw ? crc32c_throughput(crc32c_hardware, buffer.get(), sz) : 0.0;
+
+        std::cout << sz << "\t\t " 
+            << std::fixed << std::setprecision(1) << sw_thp << "\t\t "
+            << (hw ? hw_thp : 0.0) << (hw ? "" : " (unsupported)")
+            << std::endl;
+
+        if (hw && sz >= 4096)
+        {
+            EXPECT_GT(hw_thp, sw_thp);
+        }
+    }
+}
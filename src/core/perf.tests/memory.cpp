@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     allocation count benchmark for the echo rpc with the slab memory provider
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <gtest/gtest.h>
+# include <dsn/service_api_cpp.h>
+# include <dsn/service_api_c.h>
+
+# include "slab_memory_provider.h"
+# include "test_utils.h"
+
+using namespace ::dsn;
+using namespace ::dsn::tools;
+
+// replies may be dropped by the fault injector, so failures are tolerated
+static void echo_rpcs(int count)
+{
+    ::dsn::rpc_address server("localhost", 20101);
+    for (int i = 0; i < count; i++)
+    {
+        dsn_message_t msg = dsn_msg_create_request(RPC_TEST_STRING_COMMAND, 100, 0);
+        ::marshall(msg, std::string("echo hello"));
+
+        dsn_message_t resp = dsn_rpc_call_wait(server.c_addr(), msg);
+        if (resp != nullptr)
+        {
+            std::string result;
+            ::unmarshall(resp, result);
+            EXPECT_EQ(std::string("hello"), result);
+            dsn_msg_release_ref(resp);
+        }
+    }
+}
+
+TEST(core, rpc_allocation_count)
+{
+    // the slab memory provider is the default one of the fastrun tool
+    std::string provider = dsn_config_get_value_string("core", "tools_memory_factory_name", 
+        "", "memory management provider for tools");
+    if (provider != "" && provider != "dsn::tools::slab_memory_provider")
+        return;
+
+    const int rpc_count = 5000;
+
+    // warm up the thread caches
+    echo_rpcs(500);
+
+    slab_memory_provider::stats s1, s2;
+    slab_memory_provider::get_stats(s1);
+    echo_rpcs(rpc_count);
+    slab_memory_provider::get_stats(s2);
+
+    // tasks and messages are allocated with malloc one by one by the default
+    // memory provider, so alloc# per rpc is also the malloc# per rpc before
+    double allocs = (double)(s2.alloc_count - s1.alloc_count) / rpc_count;
+    double mallocs = (double)(s2.malloc_count - s1.malloc_count) / rpc_count;
+
+    std::cout << "provider\t\t\t mallocs/rpc (tasks and messages)" << std::endl;
+    std::cout << "dsn::default_memory_provider\t " << allocs << std::endl;
+    std::cout << "dsn::tools::slab_memory_provider " << mallocs << std::endl;
+
+    EXPECT_GT(allocs, 1.0);
+    EXPECT_LT(mallocs, 0.01);
+}
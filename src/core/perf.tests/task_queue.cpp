@@ -0,0 +1,216 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     tail latency of partitioned thread pools under skewed hash distributions,
+ *     with and without work stealing
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+
+# include <gtest/gtest.h>
+# include <dsn/service_api_cpp.h>
+# include <dsn/service_api_c.h>
+# include <dsn/tool_api.h>
+# include <random>
+# include <algorithm>
+
+# include "service_engine.h"
+# include "task_engine.h"
+# include "test_utils.h"
+
+using namespace ::dsn;
+
+DEFINE_THREAD_POOL_CODE(THREAD_POOL_PERF_STEALING)
+DEFINE_TASK_CODE(LPC_PERF_AFFINE, TASK_PRIORITY_COMMON, THREAD_POOL_PERF_STEALING)
+DEFINE_TASK_CODE(LPC_PERF_STEALABLE, TASK_PRIORITY_COMMON, THREAD_POOL_PERF_STEALING)
+
+struct queue_perf_stats
+{
+    std::vector<uint64_t>          latency_ns;
+    std::vector<std::atomic<int>*> last_seq; // per hash, for ordered tasks
+    std::atomic<int>               done;
+    std::atomic<bool>              ordered;
+};
+
+class queue_perf_task : public task
+{
+public:
+    queue_perf_task(dsn_task_code_t code, int hash, int seq, uint64_t work_ns, queue_perf_stats* stats)
+        : task(code, hash), _seq(seq), _work_ns(work_ns), _stats(stats)
+    {
+    }
+
+    void submit(task_worker_pool* pool)
+    {
+        _enqueue_ts_ns = dsn_now_ns();
+        enqueue(pool);
+    }
+
+    virtual void exec() override
+    {
+        uint64_t start = dsn_now_ns();
+        while (dsn_now_ns() - start < _work_ns)
+        {
+        }
+
+        if (!spec().allow_stealing)
+        {
+            auto& last = *_stats->last_seq[hash()];
+            if (last.load() > _seq)
+                _stats->ordered = false;
+            last.store(_seq);
+        }
+
+        _stats->latency_ns[_seq] = dsn_now_ns() - _enqueue_ts_ns;
+        ++_stats->done;
+    }
+
+private:
+    int               _seq;
+    uint64_t          _work_ns;
+    uint64_t          _enqueue_ts_ns;
+    queue_perf_stats* _stats;
+};
+
+//
+// the pools are created from [threadpool.THREAD_POOL_PERF_STEALING] with the
+// given providers, and are not bound to any app
+//
+static task_worker_pool* create_perf_pool(const char* queue_factory, const char* worker_factory)
+{
+    threadpool_spec spec(service_engine::fast_instance().spec().threadpool_specs[THREAD_POOL_PERF_STEALING]);
+    spec.queue_factory_name = queue_factory;
+    spec.worker_factory_name = worker_factory;
+    spec.queue_aspects.clear();
+    spec.worker_aspects.clear();
+
+    // never destroyed as the workers cannot be stopped
+    auto pool = new task_worker_pool(spec, task::get_current_node2()->computation());
+    pool->create();
+    pool->start();
+    return pool;
+}
+
+//
+// open-loop arrivals at half of the pool capacity, hot_ratio of which go to
+// the same hash (and so the same worker when it is hash-affine)
+//
+static void queue_perf_test(
+    const char* name,
+    task_worker_pool* pool,
+    double hot_ratio,
+    double stealable_ratio
+    )
+{
+    const int task_count = 20000;
+    const int hash_count = 64;
+    const uint64_t work_ns = 20000;
+    const uint64_t interval_ns = work_ns * 2 / pool->workers().size();
+
+    queue_perf_stats stats;
+    stats.latency_ns.resize(task_count, 0);
+    for (int i = 0; i < hash_count; i++)
+        stats.last_seq.push_back(new std::atomic<int>(-1));
+    stats.done = 0;
+    stats.ordered = true;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<double> ratio(0.0, 1.0);
+    std::uniform_int_distribution<int> cold_hash(1, hash_count - 1);
+
+    uint64_t nts_start = dsn_now_ns();
+    for (int i = 0; i < task_count; i++)
+    {
+        while (dsn_now_ns() < nts_start + interval_ns * i)
+        {
+        }
+
+        int hash = ratio(rng) < hot_ratio ? 0 : cold_hash(rng);
+        auto code = ratio(rng) < stealable_ratio ? LPC_PERF_STEALABLE : LPC_PERF_AFFINE;
+        auto t = new queue_perf_task(code, hash, i, work_ns, &stats);
+        t->submit(pool);
+    }
+
+    while (stats.done.load() < task_count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    uint64_t nts = dsn_now_ns();
+
+    EXPECT_TRUE(stats.ordered.load());
+
+    std::sort(stats.latency_ns.begin(), stats.latency_ns.end());
+    auto pct = [&](double p)
+    {
+        return stats.latency_ns[std::min((size_t)(p * task_count), (size_t)(task_count - 1))] / 1000;
+    };
+
+    std::cout
+        << name << "\t "
+        << hot_ratio << "\t\t "
+        << stealable_ratio << "\t\t "
+        << pct(0.5) << "\t "
+        << pct(0.99) << "\t "
+        << pct(0.999) << "\t "
+        << stats.latency_ns[task_count - 1] / 1000 << "\t "
+        << static_cast<double>(task_count) / (nts - nts_start) * 1000000000 << "#/s"
+        << std::endl;
+
+    for (auto& s : stats.last_seq)
+        delete s;
+}
+
+TEST(core, work_stealing_task_queue_test)
+{
+    ASSERT_TRUE(task_spec::get(LPC_PERF_STEALABLE)->allow_stealing);
+    ASSERT_FALSE(task_spec::get(LPC_PERF_AFFINE)->allow_stealing);
+
+    // no per-queue timer services are there for pools not bound to any app
+    if (service_engine::fast_instance().spec().timer_io_mode == IOE_PER_QUEUE)
+    {
+        std::cout << "skipped as timer_io_mode is IOE_PER_QUEUE" << std::endl;
+        return;
+    }
+
+    auto partitioned = create_perf_pool("dsn::tools::hpc_task_queue", "dsn::task_worker");
+    auto stealing = create_perf_pool("dsn::tools::work_stealing_task_queue", "dsn::tools::work_stealing_task_worker");
+
+    std::cout << "queue\t\t hot_ratio\t stealable\t p50(us)\t p99(us)\t p999(us)\t max(us)\t qps" << std::endl;
+
+    auto hot_ratios = { 0.25, 0.5 };
+    for (double hot : hot_ratios)
+    {
+        queue_perf_test("partitioned", partitioned, hot, 0.0);
+        queue_perf_test("stealing", stealing, hot, 0.0);
+        queue_perf_test("stealing", stealing, hot, 0.5);
+        queue_perf_test("stealing", stealing, hot, 1.0);
+    }
+}
@@ -278,3 +278,65 @@ TEST(core, dsn_group)
 
     dsn_group_destroy(g);
 }
+
+TEST(core, rpc_group_address_select_member)
+{
+    rpc_group_address g("test_group");
+    rpc_address fast("127.0.0.1", 8080);
+    rpc_address slow("127.0.0.1", 8081);
+    rpc_address invalid_addr;
+    rpc_group_member_stat_ptr stat;
+
+    ASSERT_EQ(invalid_addr, g.select_member(stat));
+    ASSERT_TRUE(stat == nullptr);
+
+    ASSERT_TRUE(g.add(fast));
+    ASSERT_EQ(fast, g.select_member(stat));
+    ASSERT_TRUE(stat == g.member_stat(fast).get());
+    ASSERT_EQ(invalid_addr, g.select_member(stat, fast));
+
+    ASSERT_TRUE(g.add(slow));
+    ASSERT_EQ(slow, g.select_member(stat, fast));
+    ASSERT_EQ(fast, g.select_member(stat, slow));
+
+    // ewma rtt
+    auto fast_stat = g.member_stat(fast);
+    auto slow_stat = g.member_stat(slow);
+    for (int i = 0; i < 16; i++)
+    {
+        fast_stat->on_call();
+        fast_stat->on_response(100 + i);
+        slow_stat->on_call();
+        slow_stat->on_response(10000);
+    }
+    ASSERT_EQ(0, fast_stat->outstanding());
+    ASSERT_LT(fast_stat->rtt_us(), 120u);
+    ASSERT_EQ(10000u, slow_stat->rtt_us());
+
+    // percentiles of the recent rtts
+    ASSERT_EQ(100u, fast_stat->rtt_percentile_us(0));
+    ASSERT_EQ(108u, fast_stat->rtt_percentile_us(50));
+    ASSERT_EQ(115u, fast_stat->rtt_percentile_us(99));
+    ASSERT_TRUE(g.member_stat(invalid_addr) == nullptr);
+
+    // with two members, both are the choices and the cheaper one wins
+    for (int i = 0; i < 10; i++)
+    {
+        ASSERT_EQ(fast, g.select_member(stat));
+    }
+
+    // until it is loaded with too many outstanding requests
+    for (int i = 0; i < 200; i++)
+    {
+        fast_stat->on_call();
+    }
+    ASSERT_EQ(slow, g.select_member(stat));
+    for (int i = 0; i < 200; i++)
+    {
+        fast_stat->on_cancelled();
+    }
+
+    ASSERT_TRUE(g.remove(fast));
+    ASSERT_TRUE(g.member_stat(fast) == nullptr);
+    ASSERT_EQ(slow, g.select_member(stat));
+}
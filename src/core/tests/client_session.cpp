@@ -0,0 +1,179 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for selecting among multiple client sessions to one server.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/internal/network.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include "service_engine.h"
+
+using namespace ::dsn;
+
+DEFINE_TASK_CODE_RPC(RPC_CLIENT_SESSION_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+// never connected, so that the messages stay pending in the session
+class client_session_test_session : public rpc_session
+{
+public:
+    client_session_test_session(connection_oriented_network& net, ::dsn::rpc_address server, std::shared_ptr<message_parser>& parser)
+        : rpc_session(net, server, parser, true)
+    {
+    }
+
+    virtual void connect() override {}
+    virtual void send(uint64_t signature) override {}
+};
+
+class client_session_test_network : public connection_oriented_network
+{
+public:
+    client_session_test_network(rpc_engine* srv, int sessions_per_server)
+        : connection_oriented_network(srv, nullptr)
+    {
+        _client_session_count = sessions_per_server;
+    }
+
+    virtual error_code start(rpc_channel channel, int port, bool client_only, io_modifer& ctx) override { return ERR_OK; }
+    virtual ::dsn::rpc_address address() override { return ::dsn::rpc_address("localhost", 1); }
+
+    virtual rpc_session_ptr create_client_session(::dsn::rpc_address server_addr) override
+    {
+        std::shared_ptr<message_parser> parser;
+        rpc_session_ptr s = new client_session_test_session(*this, server_addr, parser);
+        created.push_back(s);
+        return s;
+    }
+
+    void send(::dsn::rpc_address server, int hash)
+    {
+        message_ex* msg = message_ex::create_request(RPC_CLIENT_SESSION_TEST, 0, hash);
+        msg->to_address = server;
+        send_message(msg);
+    }
+
+    std::vector<int> pending_counts()
+    {
+        std::vector<int> counts;
+        for (auto& s : created)
+            counts.push_back(s->pending_message_count());
+        return counts;
+    }
+
+public:
+    std::vector<rpc_session_ptr> created;
+};
+
+static rpc_engine* get_test_rpc_engine()
+{
+    auto& nodes = service_engine::fast_instance().get_all_nodes();
+    return nodes.empty() ? nullptr : nodes.begin()->second->node_rpc();
+}
+
+TEST(core, client_session_least_pending)
+{
+    auto rpc = get_test_rpc_engine();
+    ASSERT_TRUE(rpc != nullptr);
+
+    client_session_test_network net(rpc, 3);
+    ::dsn::rpc_address server("localhost", 20101);
+
+    // empty slots are filled first, one session per request
+    for (int i = 0; i < 3; i++)
+        net.send(server, 0);
+    ASSERT_EQ(3u, net.created.size());
+    EXPECT_EQ(std::vector<int>({ 1, 1, 1 }), net.pending_counts());
+
+    // then the session with the least pending messages, the first one on ties
+    net.send(server, 0);
+    EXPECT_EQ(std::vector<int>({ 2, 1, 1 }), net.pending_counts());
+    net.send(server, 0);
+    EXPECT_EQ(std::vector<int>({ 2, 2, 1 }), net.pending_counts());
+    net.send(server, 0);
+    EXPECT_EQ(std::vector<int>({ 2, 2, 2 }), net.pending_counts());
+
+    // pinned requests load a single session, which the others then avoid
+    net.send(server, 3);
+    net.send(server, 3);
+    EXPECT_EQ(std::vector<int>({ 4, 2, 2 }), net.pending_counts());
+    net.send(server, 0);
+    net.send(server, 0);
+    EXPECT_EQ(std::vector<int>({ 4, 3, 3 }), net.pending_counts());
+
+    // sessions to another server are separate
+    net.send(::dsn::rpc_address("localhost", 20102), 0);
+    ASSERT_EQ(4u, net.created.size());
+    EXPECT_EQ(1, net.created[3]->pending_message_count());
+}
+
+TEST(core, client_session_hash_pinned)
+{
+    auto rpc = get_test_rpc_engine();
+    ASSERT_TRUE(rpc != nullptr);
+
+    client_session_test_network net(rpc, 3);
+    ::dsn::rpc_address server("localhost", 20101);
+
+    // the session is created on demand at slot hash % 3
+    net.send(server, 5);
+    ASSERT_EQ(1u, net.created.size());
+    auto pinned = net.created[0];
+    EXPECT_TRUE(net.get_client_session(server) == pinned);
+
+    // requests with the same hash always go to the same session, whatever
+    // the load is
+    for (int i = 0; i < 5; i++)
+        net.send(server, 5);
+    net.send(server, 8);
+    EXPECT_EQ(1u, net.created.size());
+    EXPECT_EQ(7, pinned->pending_message_count());
+
+    // other hashes go to their own slots
+    net.send(server, 4);
+    net.send(server, 6);
+    ASSERT_EQ(3u, net.created.size());
+    EXPECT_EQ(1, net.created[1]->pending_message_count());
+    EXPECT_EQ(1, net.created[2]->pending_message_count());
+    net.send(server, 7);
+    net.send(server, 9);
+    EXPECT_EQ(std::vector<int>({ 7, 2, 2 }), net.pending_counts());
+
+    // a disconnected session only clears its own slot, and the pinned
+    // requests get a new session there
+    rpc_session_ptr s = pinned;
+    net.on_client_session_disconnected(s);
+    net.send(server, 5);
+    ASSERT_EQ(4u, net.created.size());
+    EXPECT_EQ(1, net.created[3]->pending_message_count());
+    EXPECT_EQ(std::vector<int>({ 7, 2, 2, 1 }), net.pending_counts());
+}
@@ -0,0 +1,262 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the send path of the hpc network provider on linux.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# ifdef __linux__
+
+# include "hpc_network_provider.h"
+# include "service_engine.h"
+# include <dsn/internal/message_parser.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <netinet/in.h>
+# include <unistd.h>
+# include <thread>
+
+using namespace ::dsn;
+using namespace ::dsn::tools;
+
+DEFINE_TASK_CODE_RPC(RPC_HPC_SEND_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+// a server session on one end of a loopback tcp connection, see
+// send_pack_max_bytes and send_zerocopy_min_bytes in config-test.ini
+class hpc_send_test_session : public hpc_rpc_session
+{
+public:
+    hpc_send_test_session(socket_t sock, std::shared_ptr<message_parser>& parser, connection_oriented_network& net)
+        : hpc_rpc_session(sock, parser, net, ::dsn::rpc_address("localhost", 1), false)
+    {
+    }
+
+    // prepare the buffers as the start of a new sending batch
+    std::vector<message_parser::send_buf>& prepare(const std::vector<message_parser::send_buf>& buffers)
+    {
+        _sending_buffers = buffers;
+        prepare_sending_buffers();
+        return _sending_buffers;
+    }
+
+    bool is_arena(const void* ptr) const
+    {
+        return (const char*)ptr >= _send_arena.get() && (const char*)ptr < _send_arena.get() + _send_arena_size;
+    }
+
+    bool zerocopy_enabled() const { return _zerocopy_enabled; }
+    bool sending_zerocopy() const { return _sending_zerocopy; }
+
+    int zerocopy_pending_batches()
+    {
+        utils::auto_lock<utils::ex_lock_nr> l(_send_lock);
+        return (int)_zerocopy_msgs.size();
+    }
+
+    bool zerocopy_completed() { return on_zerocopy_completed(); }
+};
+
+class hpc_send_test
+{
+public:
+    hpc_send_test()
+        : net(service_engine::fast_instance().get_all_nodes().begin()->second->node_rpc(), nullptr),
+        server_fd(-1), client_fd(-1)
+    {
+        // a connected tcp pair on loopback
+        int listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        memset((void*)&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t addr_len = (socklen_t)sizeof(addr);
+        EXPECT_EQ(0, ::bind(listen_fd, (struct sockaddr*)&addr, addr_len));
+        EXPECT_EQ(0, ::listen(listen_fd, 1));
+        EXPECT_EQ(0, ::getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len));
+
+        client_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        EXPECT_EQ(0, ::connect(client_fd, (struct sockaddr*)&addr, addr_len));
+        server_fd = ::accept(listen_fd, nullptr, nullptr);
+        EXPECT_NE(-1, server_fd);
+        ::close(listen_fd);
+
+        std::shared_ptr<message_parser> parser(new dsn_message_parser(4096));
+        session = new hpc_send_test_session(server_fd, parser, net);
+    }
+
+    ~hpc_send_test()
+    {
+        session = nullptr;
+        ::close(server_fd);
+        ::close(client_fd);
+    }
+
+    std::string receive(size_t size)
+    {
+        std::string data(size, '\0');
+        size_t pos = 0;
+        while (pos < size)
+        {
+            auto sz = ::recv(client_fd, &data[pos], size - pos, 0);
+            if (sz <= 0)
+                break;
+            pos += (size_t)sz;
+        }
+        data.resize(pos);
+        return data;
+    }
+
+public:
+    hpc_network_provider   net;
+    int                    server_fd;
+    int                    client_fd;
+    ::dsn::ref_ptr<hpc_send_test_session> session;
+};
+
+static std::string concat(const std::vector<message_parser::send_buf>& buffers)
+{
+    std::string s;
+    for (auto& buf : buffers)
+        s.append((const char*)buf.buf, buf.sz);
+    return s;
+}
+
+// message with the given body, and its bytes on wire
+static message_ex* create_send_test_message(int body_size, char c, /*out*/ std::string& wire)
+{
+    message_ex* msg = message_ex::create_request(RPC_HPC_SEND_TEST, 100, 1);
+    void* ptr;
+    size_t sz;
+    msg->write_next(&ptr, &sz, body_size);
+    memset(ptr, c, body_size);
+    msg->write_commit(body_size);
+    msg->seal(true);
+
+    dsn_message_parser parser(4096);
+    int total_length;
+    int count = parser.get_send_buffers_count_and_total_length(msg, &total_length);
+    std::vector<message_parser::send_buf> buffers(count);
+    parser.prepare_buffers_on_send(msg, 0, &buffers[0]);
+    wire = concat(buffers);
+    return msg;
+}
+
+TEST(core, hpc_send_pack_buffers)
+{
+    hpc_send_test t;
+    ASSERT_EQ(64u, t.net.send_opts().pack_max_bytes);
+
+    std::string a(10, 'a'), b(20, 'b'), c(100, 'c'), d(30, 'd'), e(40, 'e');
+    std::vector<message_parser::send_buf> buffers;
+    for (auto s : { &a, &b, &c, &d, &e })
+    {
+        message_parser::send_buf buf;
+        buf.buf = (void*)s->data();
+        buf.sz = s->size();
+        buffers.push_back(buf);
+    }
+
+    // the small neighbours are copied into the arena and merged, while the
+    // large one is sent in place, and the bytes on wire are kept
+    auto& packed = t.session->prepare(buffers);
+    ASSERT_EQ(3u, packed.size());
+    EXPECT_TRUE(t.session->is_arena(packed[0].buf));
+    EXPECT_EQ(30u, packed[0].sz);
+    EXPECT_EQ((void*)c.data(), packed[1].buf);
+    EXPECT_EQ(100u, packed[1].sz);
+    EXPECT_TRUE(t.session->is_arena(packed[2].buf));
+    EXPECT_EQ(70u, packed[2].sz);
+    EXPECT_EQ(a + b + c + d + e, concat(packed));
+    EXPECT_FALSE(t.session->sending_zerocopy());
+
+    // batches with a zerocopy buffer are not packed, as the arena is reused
+    // before the kernel is done with it
+    std::string large(5000, 'x');
+    buffers.resize(3);
+    buffers[1].buf = (void*)large.data();
+    buffers[1].sz = large.size();
+    auto& zc = t.session->prepare(buffers);
+    ASSERT_EQ(3u, zc.size());
+    EXPECT_EQ(a + large + c, concat(zc));
+    if (t.session->zerocopy_enabled())
+    {
+        EXPECT_TRUE(t.session->sending_zerocopy());
+        EXPECT_EQ((void*)a.data(), zc[0].buf);
+        EXPECT_EQ((void*)c.data(), zc[2].buf);
+    }
+    else
+    {
+        EXPECT_FALSE(t.session->sending_zerocopy());
+        EXPECT_TRUE(t.session->is_arena(zc[0].buf));
+        EXPECT_EQ((void*)c.data(), zc[2].buf);
+    }
+}
+
+TEST(core, hpc_send_zerocopy_release)
+{
+    hpc_send_test t;
+    if (!t.session->zerocopy_enabled())
+    {
+        std::cout << "MSG_ZEROCOPY is not available, skipped" << std::endl;
+        return;
+    }
+
+    // small messages are released once they are sent
+    std::string wire;
+    message_ex* small = create_send_test_message(100, 's', wire);
+    small->add_ref();
+    t.session->send_message(small);
+    EXPECT_EQ(wire, t.receive(wire.size()));
+    EXPECT_EQ(1, small->get_count());
+    EXPECT_EQ(0, t.session->zerocopy_pending_batches());
+    small->release_ref();
+
+    // while the zerocopy ones are kept till the kernel completes them
+    message_ex* large = create_send_test_message(20000, 'z', wire);
+    large->add_ref();
+    t.session->send_message(large);
+    EXPECT_EQ(wire, t.receive(wire.size()));
+    EXPECT_EQ(0, t.session->pending_message_count());
+
+    for (int i = 0; i < 200 && t.session->zerocopy_pending_batches() > 0; i++)
+    {
+        EXPECT_EQ(2, large->get_count());
+        EXPECT_TRUE(t.session->zerocopy_completed());
+        if (t.session->zerocopy_pending_batches() > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(0, t.session->zerocopy_pending_batches());
+    EXPECT_EQ(1, large->get_count());
+    large->release_ref();
+}
+
+# endif
@@ -0,0 +1,352 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for message parser and its receive buffer pool.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include <dsn/internal/message_parser.h>
+# include <../core/recv_buffer_pool.h>
+# include <gtest/gtest.h>
+
+using namespace ::dsn;
+
+DEFINE_TASK_CODE_RPC(RPC_CODE_FOR_PARSER_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+// returns the header length on wire
+static int append_message(std::string& stream, message_parser& parser, int body_size, char c, uint64_t context = 0)
+{
+    message_ex* msg = message_ex::create_request(RPC_CODE_FOR_PARSER_TEST, 100, 1);
+    msg->header->context = context;
+
+    void* ptr;
+    size_t sz;
+    msg->write_next(&ptr, &sz, body_size);
+    memset(ptr, c, body_size);
+    msg->write_commit(body_size);
+    msg->seal(true);
+
+    int total_length;
+    int count = parser.get_send_buffers_count_and_total_length(msg, &total_length);
+    std::vector<message_parser::send_buf> buffers(count);
+    int used = parser.prepare_buffers_on_send(msg, 0, &buffers[0]);
+    EXPECT_EQ(count, used);
+
+    size_t length = stream.size();
+    for (int i = 0; i < used; i++)
+        stream.append((const char*)buffers[i].buf, buffers[i].sz);
+    EXPECT_EQ((size_t)total_length, stream.size() - length);
+
+    msg->add_ref();
+    msg->release_ref();
+    return total_length - body_size;
+}
+
+TEST(core, message_parser)
+{
+    const int sizes[] = { 100, 20000, 50, 70000, 3000, 5000 };
+    const int count = (int)(sizeof(sizes) / sizeof(int));
+    dsn_message_parser parser(4096);
+
+    std::string stream;
+    int large_bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        append_message(stream, parser, sizes[i], (char)('a' + i));
+        if (sizes[i] > 4096)
+            large_bytes += sizes[i];
+    }
+
+    recv_buffer_pool_stats stats1, stats2;
+    recv_buffer_get_stats(stats1);
+
+    // simulate socket reads with different sizes
+    size_t pos = 0;
+    int read_next = (int)sizeof(message_header);
+    int received = 0;
+    int round = 0;
+    while (pos < stream.size())
+    {
+        char* ptr = (char*)parser.read_buffer_ptr(read_next);
+        int capacity = parser.read_buffer_capacity();
+        ASSERT_GE(capacity, 1);
+
+        int sz = std::min(capacity, 1000 + 777 * (round++ % 7));
+        sz = std::min(sz, (int)(stream.size() - pos));
+        memcpy(ptr, stream.data() + pos, sz);
+        pos += sz;
+
+        message_ex* msg = parser.get_message_on_receive(sz, read_next);
+        while (msg != nullptr)
+        {
+            ASSERT_LT(received, count);
+            ASSERT_EQ(sizes[received], (int)msg->body_size());
+            ASSERT_TRUE(msg->is_right_header());
+            ASSERT_TRUE(msg->is_right_body(false));
+
+            void* rptr;
+            size_t rsz;
+            ASSERT_TRUE(msg->read_next(&rptr, &rsz));
+            ASSERT_EQ((size_t)sizes[received], rsz);
+            ASSERT_EQ(std::string(rsz, (char)('a' + received)), std::string((const char*)rptr, rsz));
+            msg->read_commit(rsz);
+
+            msg->add_ref();
+            msg->release_ref();
+
+            received++;
+            msg = parser.get_message_on_receive(0, read_next);
+        }
+    }
+    ASSERT_EQ(count, received);
+
+    // large bodies are received into their own buffers without copy,
+    // only the parts received together with their headers are copied
+    recv_buffer_get_stats(stats2);
+    ASSERT_GT(stats2.alloc_count, stats1.alloc_count);
+    ASSERT_LT(stats2.copied_bytes - stats1.copied_bytes, (uint64_t)large_bytes);
+}
+
+TEST(core, message_parser_header_only_read)
+{
+    const int prefix = 16; // covers body_length
+    dsn_message_parser parser(4096);
+    int hdr_size = (int)sizeof(message_header);
+
+    // a small message fills most of the block
+    std::string stream;
+    append_message(stream, parser, 3000, 'a');
+    int read_next = hdr_size;
+    memcpy(parser.read_buffer_ptr(read_next), stream.data(), stream.size());
+    message_ex* msg = parser.get_message_on_receive((int)stream.size(), read_next);
+    ASSERT_TRUE(msg != nullptr);
+    msg->add_ref();
+    msg->release_ref();
+    ASSERT_TRUE(parser.get_message_on_receive(0, read_next) == nullptr);
+    int block_remaining = parser.read_buffer_capacity();
+    ASSERT_GT(block_remaining, hdr_size);
+
+    // nothing is known of the next message, so the rest of the block is read
+    // as a whole, and so for the small one
+    std::string small;
+    append_message(small, parser, 100, 'b');
+    memcpy(parser.read_buffer_ptr(read_next), small.data(), prefix);
+    ASSERT_TRUE(parser.get_message_on_receive(prefix, read_next) == nullptr);
+    ASSERT_EQ(block_remaining - prefix, parser.read_buffer_capacity());
+
+    memcpy(parser.read_buffer_ptr(read_next), small.data() + prefix, small.size() - prefix);
+    msg = parser.get_message_on_receive((int)small.size() - prefix, read_next);
+    ASSERT_TRUE(msg != nullptr);
+    ASSERT_EQ(100u, msg->body_size());
+    msg->add_ref();
+    msg->release_ref();
+    block_remaining = parser.read_buffer_capacity();
+
+    // only the header when the large message cannot fit in the block
+    std::string large;
+    append_message(large, parser, 20000, 'c');
+    memcpy(parser.read_buffer_ptr(read_next), large.data(), prefix);
+    ASSERT_TRUE(parser.get_message_on_receive(prefix, read_next) == nullptr);
+    ASSERT_EQ(hdr_size - prefix, parser.read_buffer_capacity());
+
+    // then the body is received into its own buffer
+    memcpy(parser.read_buffer_ptr(read_next), large.data() + prefix, hdr_size - prefix);
+    ASSERT_TRUE(parser.get_message_on_receive(hdr_size - prefix, read_next) == nullptr);
+    ASSERT_EQ(20000, parser.read_buffer_capacity());
+
+    memcpy(parser.read_buffer_ptr(read_next), large.data() + hdr_size, 20000);
+    msg = parser.get_message_on_receive(20000, read_next);
+    ASSERT_TRUE(msg != nullptr);
+    ASSERT_EQ(20000u, msg->body_size());
+    ASSERT_TRUE(msg->is_right_body(false));
+    msg->add_ref();
+    msg->release_ref();
+
+    // and the block is still used for the following messages
+    ASSERT_EQ(block_remaining - hdr_size, parser.read_buffer_capacity());
+}
+
+TEST(core, compact_message_parser)
+{
+    const int sizes[] = { 100, 20000, 50, 70000, 3000, 5000 };
+    const int count = (int)(sizeof(sizes) / sizeof(int));
+    dsn_compact_message_parser sender(4096);
+    dsn_compact_message_parser receiver(4096);
+
+    std::string stream;
+    std::vector<int> header_sizes;
+    for (int i = 0; i < count; i++)
+    {
+        header_sizes.push_back(append_message(stream, sender, sizes[i], (char)('a' + i), i == 2 ? 12345 : 0));
+    }
+
+    // the name is only sent with the first message
+    int name_length = (int)strlen(dsn_task_code_to_string(RPC_CODE_FOR_PARSER_TEST));
+    ASSERT_GT(header_sizes[0], name_length);
+    ASSERT_LT(header_sizes[1], header_sizes[0]);
+    ASSERT_LE(header_sizes[1], 32);
+    ASSERT_LT(header_sizes[1], (int)sizeof(message_header));
+
+    // simulate socket reads with different sizes
+    size_t pos = 0;
+    int read_next = 2;
+    int received = 0;
+    int round = 0;
+    while (pos < stream.size())
+    {
+        char* ptr = (char*)receiver.read_buffer_ptr(read_next);
+        int capacity = receiver.read_buffer_capacity();
+        ASSERT_GE(capacity, 1);
+
+        int sz = std::min(capacity, 1 + 777 * (round++ % 7));
+        sz = std::min(sz, (int)(stream.size() - pos));
+        memcpy(ptr, stream.data() + pos, sz);
+        pos += sz;
+
+        message_ex* msg = receiver.get_message_on_receive(sz, read_next);
+        while (msg != nullptr)
+        {
+            ASSERT_LT(received, count);
+            ASSERT_EQ(sizes[received], (int)msg->body_size());
+            ASSERT_TRUE(msg->is_right_header());
+            ASSERT_TRUE(msg->is_right_body(false));
+            ASSERT_EQ((int)RPC_CODE_FOR_PARSER_TEST, (int)msg->local_rpc_code);
+            ASSERT_STREQ(dsn_task_code_to_string(RPC_CODE_FOR_PARSER_TEST), msg->header->rpc_name);
+            ASSERT_EQ(100, msg->header->client.timeout_ms);
+            ASSERT_EQ(1, msg->header->client.hash);
+            ASSERT_EQ(received == 2 ? 12345u : 0u, msg->header->context);
+
+            void* rptr;
+            size_t rsz;
+            ASSERT_TRUE(msg->read_next(&rptr, &rsz));
+            ASSERT_EQ((size_t)sizes[received], rsz);
+            ASSERT_EQ(std::string(rsz, (char)('a' + received)), std::string((const char*)rptr, rsz));
+            msg->read_commit(rsz);
+
+            // replies are encoded with the paired code
+            message_ex* resp = msg->create_response();
+            int total_length;
+            receiver.get_send_buffers_count_and_total_length(resp, &total_length);
+            ASSERT_LT(total_length, (int)sizeof(message_header));
+            resp->add_ref();
+            resp->release_ref();
+
+            msg->add_ref();
+            msg->release_ref();
+
+            received++;
+            msg = receiver.get_message_on_receive(0, read_next);
+        }
+    }
+    ASSERT_EQ(count, received);
+}
+
+// feeds the data at once, and returns whether it is rejected as malformed
+static bool is_malformed(const std::string& data)
+{
+    dsn_compact_message_parser receiver(4096);
+    int read_next = 2;
+    memcpy(receiver.read_buffer_ptr(read_next), data.data(), data.size());
+    message_ex* msg = receiver.get_message_on_receive((int)data.size(), read_next);
+    while (msg != nullptr)
+    {
+        msg->add_ref();
+        msg->release_ref();
+        msg = receiver.get_message_on_receive(0, read_next);
+    }
+    return read_next < 0;
+}
+
+TEST(core, compact_message_parser_malformed)
+{
+    dsn_compact_message_parser sender(4096);
+    std::string first, second;
+    int hdr_sz = append_message(first, sender, 100, 'a');
+    append_message(second, sender, 100, 'b');
+    ASSERT_FALSE(is_malformed(first));
+    ASSERT_FALSE(is_malformed(first + second));
+
+    // header length too short or too long
+    std::string data = first;
+    data[1] = (char)2;
+    EXPECT_TRUE(is_malformed(data));
+    data[1] = (char)200;
+    EXPECT_TRUE(is_malformed(data));
+
+    // the header crc mismatches
+    data = first;
+    data[hdr_sz - 9] ^= 0x1;
+    EXPECT_TRUE(is_malformed(data));
+
+    // the body crc mismatches
+    data = first;
+    data[hdr_sz + 10] ^= 0x1;
+    EXPECT_TRUE(is_malformed(data));
+
+    // the code is received before its name on a new session
+    EXPECT_TRUE(is_malformed(second));
+
+    // an invalid varint where the body length is
+    data = first;
+    for (int i = 2; i < hdr_sz; i++)
+        data[i] = (char)0xff;
+    EXPECT_TRUE(is_malformed(data));
+}
+
+TEST(core, recv_buffer_pool)
+{
+    recv_buffer_pool_stats stats1, stats2;
+    int capacity;
+
+    // warm up
+    {
+        auto buffer = recv_buffer_alloc(5000, capacity);
+        ASSERT_EQ(8192, capacity);
+    }
+
+    recv_buffer_get_stats(stats1);
+    for (int i = 0; i < 10; i++)
+    {
+        auto buffer = recv_buffer_alloc(8000, capacity);
+        ASSERT_EQ(8192, capacity);
+    }
+    recv_buffer_get_stats(stats2);
+    ASSERT_EQ(10u, stats2.alloc_count - stats1.alloc_count);
+    ASSERT_EQ(10u, stats2.hit_count - stats1.hit_count);
+
+    // not pooled
+    {
+        auto buffer = recv_buffer_alloc(2 * 1024 * 1024, capacity);
+        ASSERT_EQ(2 * 1024 * 1024, capacity);
+    }
+    recv_buffer_get_stats(stats1);
+    ASSERT_EQ(stats2.hit_count, stats1.hit_count);
+}
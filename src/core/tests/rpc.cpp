@@ -36,6 +36,7 @@
 #include <vector>
 #include <string>
 #include <queue>
+#include <set>
 
 #include <dsn/internal/aio_provider.h>
 #include <gtest/gtest.h>
@@ -214,3 +215,106 @@ TEST(core, send_to_invalid_address)
     send_message(group, std::string("echo hehehe"), 10, action_on_succeed, action_on_failure);
     destroy_group(group);
 }
+
+TEST(core, group_address_call_all)
+{
+    ::dsn::rpc_address group = build_group();
+
+    // all members must reply
+    dsn_message_t request = dsn_msg_create_request(RPC_TEST_STRING_COMMAND);
+    ::marshall(request, std::string("echo hehehe"));
+    ::dsn::task_ptr resp_task = ::dsn::rpc::call_group(group, request, nullptr,
+        [](error_code err, dsn_message_t, dsn_message_t resp) {
+            EXPECT_TRUE(err == ERR_OK);
+            EXPECT_TRUE(resp != nullptr);
+        });
+    resp_task->wait();
+    EXPECT_TRUE(resp_task->error() == ERR_OK);
+
+    int count = dsn_rpc_get_group_response_count(resp_task->native_handle());
+    EXPECT_EQ(TEST_PORT_END - TEST_PORT_BEGIN + 1, count);
+
+    std::set<uint16_t> ports;
+    for (int i = 0; i < count; i++)
+    {
+        dsn_address_t member;
+        dsn_message_t resp;
+        error_code err = dsn_rpc_get_group_response(resp_task->native_handle(), i, &member, &resp);
+        EXPECT_TRUE(err == ERR_OK);
+        ASSERT_TRUE(resp != nullptr);
+
+        std::string hehe_str;
+        ::unmarshall(resp, hehe_str);
+        EXPECT_TRUE(hehe_str == "hehehe");
+        dsn_msg_release_ref(resp);
+
+        ports.insert(::dsn::rpc_address(member).port());
+    }
+    EXPECT_EQ(count, (int)ports.size());
+
+    // only the last member replies, which makes a quorum of 1
+    request = dsn_msg_create_request(RPC_TEST_STRING_COMMAND, 1000);
+    ::marshall(request, std::string("expect_no_reply"));
+    resp_task = ::dsn::rpc::call_group(group, request, nullptr,
+        [](error_code err, dsn_message_t, dsn_message_t resp) {
+            EXPECT_TRUE(err == ERR_OK);
+            std::string result;
+            ::unmarshall(resp, result);
+            EXPECT_TRUE(dsn_address_from_string(result).port() == TEST_PORT_END);
+        }, 1);
+    resp_task->wait();
+    EXPECT_TRUE(resp_task->error() == ERR_OK);
+
+    // but not a quorum of all
+    request = dsn_msg_create_request(RPC_TEST_STRING_COMMAND, 1000);
+    ::marshall(request, std::string("expect_no_reply"));
+    resp_task = ::dsn::rpc::call_group(group, request, nullptr,
+        [](error_code err, dsn_message_t, dsn_message_t resp) {
+            EXPECT_TRUE(err == ERR_TIMEOUT);
+            EXPECT_TRUE(resp == nullptr);
+        });
+    resp_task->wait();
+    EXPECT_TRUE(resp_task->error() == ERR_TIMEOUT);
+
+    destroy_group(group);
+}
+
+TEST(core, group_address_hedged_call)
+{
+    ::dsn::rpc_address group;
+    group.assign_group(dsn_group_build("server_group.hedge"));
+    dsn_group_add(group.group_handle(), ::dsn::rpc_address("localhost", TEST_PORT_BEGIN).c_addr());
+    dsn_group_add(group.group_handle(), ::dsn::rpc_address("localhost", TEST_PORT_END).c_addr());
+
+    // warm up the rtts of the members
+    for (int i = 0; i < 40; i++)
+    {
+        dsn_message_t request = dsn_msg_create_request(RPC_TEST_STRING_COMMAND_HEDGE);
+        ::marshall(request, std::string("echo hehehe"));
+        ::dsn::task_ptr resp_task = ::dsn::rpc::call(group, request, nullptr, nullptr);
+        resp_task->wait();
+        EXPECT_TRUE(resp_task->error() == ERR_OK);
+    }
+
+    // only the last member replies, and the requests sent to the other
+    // one are resent to the last one well before they time out
+    for (int i = 0; i < 10; i++)
+    {
+        uint64_t start_ms = dsn_now_ms();
+        dsn_message_t request = dsn_msg_create_request(RPC_TEST_STRING_COMMAND_HEDGE);
+        ::marshall(request, std::string("expect_no_reply"));
+        ::dsn::task_ptr resp_task = ::dsn::rpc::call(group, request, nullptr, nullptr);
+        resp_task->wait();
+        EXPECT_TRUE(resp_task->error() == ERR_OK);
+        EXPECT_LT(dsn_now_ms() - start_ms, 1000u);
+
+        if (resp_task->error() == ERR_OK)
+        {
+            std::string result;
+            ::unmarshall(resp_task->response(), result);
+            EXPECT_TRUE(dsn_address_from_string(result).port() == TEST_PORT_END);
+        }
+    }
+
+    destroy_group(group);
+}
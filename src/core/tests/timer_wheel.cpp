@@ -0,0 +1,204 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the hierarchical timer wheel.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "timer_wheel.h"
+# include "service_engine.h"
+# include <gtest/gtest.h>
+# include <map>
+
+using namespace ::dsn;
+using namespace ::dsn::tools;
+
+DEFINE_TASK_CODE(LPC_TIMER_WHEEL_TEST, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+class timer_wheel_test_task : public task
+{
+public:
+    timer_wheel_test_task(uint64_t expire_ms)
+        : task(LPC_TIMER_WHEEL_TEST, 0, service_engine::fast_instance().get_all_nodes().begin()->second),
+        expire_ms(expire_ms)
+    {
+        add_ref(); // released at the end of the test
+    }
+
+    virtual void exec() override {}
+
+    uint64_t expire_ms;
+};
+
+// keep advancing to the next check point until all timers fire, and return
+// the time when each is fired
+static std::map<task*, uint64_t> run_wheel(timer_wheel& wheel, uint64_t until_ms = 0)
+{
+    std::map<task*, uint64_t> fired;
+    uint64_t now;
+    while ((now = wheel.next_check_ms()) != 0 && (until_ms == 0 || now <= until_ms))
+    {
+        slist<task> expired;
+        wheel.advance(now, expired);
+        for (task* t = expired.pop_all(), *next; t; t = next)
+        {
+            next = t->next;
+            t->next = nullptr;
+            EXPECT_TRUE(fired.find(t) == fired.end());
+            fired[t] = now;
+        }
+    }
+    return fired;
+}
+
+TEST(core, timer_wheel_levels)
+{
+    timer_wheel wheel;
+    const uint64_t now = 1000;
+
+    // the first level, each of the three higher levels, and beyond the horizon
+    const uint64_t delays[] = {
+        1, 255,
+        256, 300, (1ULL << 14) - 1,
+        1ULL << 14, 20000, (1ULL << 20) - 1,
+        1ULL << 20, (1ULL << 22) + 7, (1ULL << 26) - 2,
+        (1ULL << 26) + 100
+    };
+
+    std::vector<timer_wheel_test_task*> timers;
+    for (auto d : delays)
+    {
+        auto t = new timer_wheel_test_task(now + d);
+        wheel.add(t, t->expire_ms, now);
+        timers.push_back(t);
+    }
+    ASSERT_EQ((int)timers.size(), wheel.count());
+    EXPECT_EQ(now + 1, wheel.next_check_ms());
+
+    // every timer fires exactly at its deadline, no matter which level it starts from
+    auto fired = run_wheel(wheel);
+    ASSERT_EQ(timers.size(), fired.size());
+    for (auto t : timers)
+    {
+        EXPECT_EQ(t->expire_ms, fired[t]);
+    }
+    EXPECT_EQ(0, wheel.count());
+    EXPECT_EQ(0u, wheel.next_check_ms());
+
+    for (auto t : timers)
+        t->release_ref();
+}
+
+TEST(core, timer_wheel_cancel)
+{
+    timer_wheel wheel;
+    const uint64_t now = 5000;
+
+    auto t0 = new timer_wheel_test_task(now + 10);
+    auto t1 = new timer_wheel_test_task(now + 100);
+    auto t2 = new timer_wheel_test_task(now + 30000);
+    auto t3 = new timer_wheel_test_task(now + 40000);
+    for (auto t : { t0, t1, t2, t3 })
+        wheel.add(t, t->expire_ms, now);
+
+    // cancelled timers in the first level are returned at their deadlines,
+    // while those in the higher levels are returned once they are cascaded
+    ASSERT_TRUE(t1->cancel(false));
+    ASSERT_TRUE(t2->cancel(false));
+
+    auto fired = run_wheel(wheel);
+    ASSERT_EQ(4u, fired.size());
+    EXPECT_EQ(t0->expire_ms, fired[t0]);
+    EXPECT_EQ(t1->expire_ms, fired[t1]);
+    EXPECT_EQ(t3->expire_ms, fired[t3]);
+    EXPECT_LT(fired[t2], t2->expire_ms);
+    EXPECT_EQ(TASK_STATE_CANCELLED, t2->state());
+    EXPECT_EQ(TASK_STATE_READY, t3->state());
+    EXPECT_EQ(0, wheel.count());
+
+    for (auto t : { t0, t1, t2, t3 })
+        t->release_ref();
+}
+
+TEST(core, timer_wheel_current_slot)
+{
+    timer_wheel wheel;
+    uint64_t now = 2000;
+
+    auto t0 = new timer_wheel_test_task(now + 5);
+    wheel.add(t0, t0->expire_ms, now);
+
+    slist<task> expired;
+    now += 2;
+    wheel.advance(now, expired);
+    EXPECT_TRUE(expired.pop_all() == nullptr);
+
+    // timers at the slot to be processed next, or already past, fire on the
+    // next advance
+    now++;
+    auto t1 = new timer_wheel_test_task(now);
+    auto t2 = new timer_wheel_test_task(now - 100);
+    auto t3 = new timer_wheel_test_task(now + 1);
+    for (auto t : { t1, t2, t3 })
+        wheel.add(t, t->expire_ms, now);
+    EXPECT_EQ(4, wheel.count());
+    EXPECT_EQ(now, wheel.next_check_ms());
+
+    wheel.advance(now, expired);
+    int count = 0;
+    for (task* t = expired.pop_all(), *next; t; t = next, count++)
+    {
+        next = t->next;
+        t->next = nullptr;
+        EXPECT_TRUE(t == t1 || t == t2);
+    }
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(2, wheel.count());
+
+    // the remaining ones still fire at their deadlines
+    auto fired = run_wheel(wheel);
+    ASSERT_EQ(2u, fired.size());
+    EXPECT_EQ(t3->expire_ms, fired[t3]);
+    EXPECT_EQ(t0->expire_ms, fired[t0]);
+
+    // an empty wheel catches up with the clock, and a timer added later lands
+    // in the current slot
+    now += 100000;
+    auto t4 = new timer_wheel_test_task(now);
+    wheel.add(t4, t4->expire_ms, now);
+    EXPECT_EQ(now, wheel.next_check_ms());
+    fired = run_wheel(wheel);
+    ASSERT_EQ(1u, fired.size());
+    EXPECT_EQ(now, fired[t4]);
+
+    for (auto t : { t0, t1, t2, t3, t4 })
+        t->release_ref();
+}
@@ -105,8 +105,16 @@ namespace dsn {
                         this->on_message_read(msg);
                         msg = _parser->get_message_on_receive(0, read_next);
                     }
-                     
-                    do_read(read_next);
+
+                    if (read_next < 0)
+                    {
+                        derror("malformed message received from %s", _remote_addr.to_string());
+                        on_failure();
+                    }
+                    else
+                    {
+                        do_read(read_next);
+                    }
                 }
 
                 release_ref();
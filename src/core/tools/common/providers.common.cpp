@@ -70,6 +70,7 @@ namespace dsn {
             register_component_provider<simple_timer_service>("dsn::tools::simple_timer_service");
             
             register_message_header_parser<dsn_message_parser>("NET_HDR_DSN");
+            register_message_header_parser<dsn_compact_message_parser>("NET_HDR_DSN_COMPACT");
 #if defined(_WIN32)
             register_component_provider<native_win_aio_provider>("dsn::tools::native_aio_provider");
 #elif defined(__linux__)
@@ -85,7 +85,7 @@ namespace dsn
                 spec.memory_factory_name = "dsn::default_memory_provider";
 
             if (spec.tools_memory_factory_name == "")
-                spec.tools_memory_factory_name = "dsn::default_memory_provider";
+                spec.tools_memory_factory_name = "dsn::tools::slab_memory_provider";
 
             if (spec.lock_factory_name == "")
                 spec.lock_factory_name = ("dsn::tools::std_lock_provider");
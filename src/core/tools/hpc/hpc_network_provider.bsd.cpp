@@ -249,6 +249,13 @@ namespace dsn
                         this->on_read_completed(msg);
                         msg = _parser->get_message_on_receive(0, read_next);
                     }
+
+                    if (read_next < 0)
+                    {
+                        derror("(s = %d) malformed message received from %s", _socket, _remote_addr.to_string());
+                        on_failure();
+                        break;
+                    }
                 }
                 else
                 {
@@ -51,7 +51,9 @@
 
 
 # include <dsn/tool_api.h>
+# include <dsn/internal/perf_counters.h>
 # include "io_looper.h"
+# include <deque>
 
 
 namespace dsn {
@@ -66,11 +68,30 @@ namespace dsn {
             virtual error_code start(rpc_channel channel, int port, bool client_only, io_modifer& ctx);
             virtual ::dsn::rpc_address address() { return _address;  }
             virtual rpc_session_ptr create_client_session(::dsn::rpc_address server_addr);
+
+# ifdef __linux__
+        public:
+            // shared by all sessions of this provider, see [network] in config
+            struct send_options
+            {
+                bool             coalescing;         // flush sends at the end of the io loop iteration
+                uint32_t         pack_max_bytes;     // buffers no larger than this are packed together
+                uint32_t         zerocopy_min_bytes; // MSG_ZEROCOPY for buffers no smaller than this, 0 for off
+                perf_counter_ptr syscall_qps;
+                perf_counter_ptr bytes_per_syscall;
+                perf_counter_ptr buffers_per_syscall;
+            };
+
+            const send_options& send_opts() const { return _send_opts; }
+# endif
             
         private:
             socket_t      _listen_fd;
             ::dsn::rpc_address _address;
             io_looper     *_looper;
+# ifdef __linux__
+            send_options  _send_opts;
+# endif
             
         private:
             void do_accept();
@@ -110,11 +131,26 @@ namespace dsn {
                 ::dsn::rpc_address remote_addr,
                 bool is_client
                 );
+# ifdef __linux__
+            virtual ~hpc_rpc_session();
+# endif
 
             virtual void send(uint64_t signature) override
             {
 # ifdef _WIN32
                 do_write(signature);
+# elif defined(__linux__)
+                // sends from other threads are not deferred, as the hop
+                // to the looper costs more than the saved syscalls
+                if (_send_opts.coalescing
+                    && io_looper::defer_to_iteration_end(&_deferred_write_event, this))
+                {
+                    _deferred_signature = signature;
+                }
+                else
+                {
+                    do_safe_write(signature);
+                }
 # else
                 do_safe_write(signature);
 # endif
@@ -157,6 +193,30 @@ namespace dsn {
             void on_connect_events_ready(uintptr_t lolp_or_events);
             void on_send_recv_events_ready(uintptr_t lolp_or_events);
             void do_safe_write(uint64_t signature);
+
+# ifdef __linux__
+            void do_deferred_write();
+            void prepare_sending_buffers();
+            bool on_zerocopy_completed();
+
+            const hpc_network_provider::send_options& _send_opts;
+
+            // see hpc_network_provider::send_options::coalescing
+            io_loop_callback                       _deferred_write_event;
+            uint64_t                               _deferred_signature;
+
+            // small buffers of the sending batch are copied here, locked by _send_lock
+            std::unique_ptr<char[]>                _send_arena;
+            int                                    _send_arena_size;
+
+            // messages sent with MSG_ZEROCOPY are referenced till the kernel
+            // notifies the completion of their last zerocopy send, locked by _send_lock
+            bool                                   _zerocopy_enabled;
+            bool                                   _sending_zerocopy;
+            bool                                   _sending_zerocopy_used;
+            uint32_t                               _zerocopy_next_id;
+            std::deque<std::pair<uint32_t, std::vector<message_ex*> > > _zerocopy_msgs;
+# endif
 # endif
         };
     }
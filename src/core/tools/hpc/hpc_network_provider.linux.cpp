@@ -39,6 +39,11 @@
 # include "hpc_network_provider.h"
 # include "mix_all_io_looper.h"
 # include <netinet/tcp.h>
+# include <linux/errqueue.h>
+
+# if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+# define HPC_ZEROCOPY_SUPPORTED
+# endif
 
 # ifdef __TITLE__
 # undef __TITLE__
@@ -50,7 +55,7 @@ namespace dsn
 {
     namespace tools
     {
-        static socket_t create_tcp_socket(sockaddr_in* addr)
+        socket_t create_tcp_socket(sockaddr_in* addr)
         {
             socket_t s = -1;
             if ((s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP)) == -1)
@@ -108,6 +113,30 @@ namespace dsn
             _listen_fd = -1;
             _looper = nullptr;
             _max_buffer_block_count_per_send = 128;             
+
+            _send_opts.coalescing = dsn_config_get_value_bool("network", "send_coalescing", false,
+                "whether the sends issued in the same io loop iteration are flushed together, "
+                "i.e., with one sendmsg per session");
+            _send_opts.pack_max_bytes = (uint32_t)dsn_config_get_value_uint64("network", "send_pack_max_bytes", 0,
+                "buffers of a sending batch no larger than this are copied into a contiguous "
+                "per-session arena so that sendmsg gets fewer iovecs, 0 for no packing");
+            _send_opts.zerocopy_min_bytes = (uint32_t)dsn_config_get_value_uint64("network", "send_zerocopy_min_bytes", 0,
+                "sending batches with buffers no smaller than this are sent with MSG_ZEROCOPY, 0 for off");
+
+# ifndef HPC_ZEROCOPY_SUPPORTED
+            if (_send_opts.zerocopy_min_bytes > 0)
+            {
+                dwarn("MSG_ZEROCOPY is not supported on this platform, send_zerocopy_min_bytes is ignored");
+                _send_opts.zerocopy_min_bytes = 0;
+            }
+# endif
+
+            _send_opts.syscall_qps = utils::perf_counters::instance().get_counter(
+                "network", "hpc.send.syscall.qps", COUNTER_TYPE_RATE, true);
+            _send_opts.bytes_per_syscall = utils::perf_counters::instance().get_counter(
+                "network", "hpc.send.bytes.per.syscall", COUNTER_TYPE_NUMBER_PERCENTILES, true);
+            _send_opts.buffers_per_syscall = utils::perf_counters::instance().get_counter(
+                "network", "hpc.send.buffers.per.syscall", COUNTER_TYPE_NUMBER_PERCENTILES, true);
         }
 
         error_code hpc_network_provider::start(rpc_channel channel, int port, bool client_only, io_modifer& ctx)
@@ -249,6 +278,13 @@ namespace dsn
                         this->on_read_completed(msg);
                         msg = _parser->get_message_on_receive(0, read_next);
                     }
+
+                    if (read_next < 0)
+                    {
+                        derror("(s = %d) malformed message received from %s", _socket, _remote_addr.to_string());
+                        on_failure();
+                        break;
+                    }
                 }
                 else
                 {
@@ -297,6 +333,7 @@ namespace dsn
             {
                 _sending_signature = sig;
                 _sending_buffer_start_index = 0;
+                prepare_sending_buffers();
             }
 
             // continue old msg
@@ -316,7 +353,13 @@ namespace dsn
                 hdr.msg_iov = (struct iovec*)&_sending_buffers[_sending_buffer_start_index];
                 hdr.msg_iovlen = (size_t)buffer_count;
 
-                int sz = sendmsg(_socket, &hdr, MSG_NOSIGNAL);
+                int flags = MSG_NOSIGNAL;
+# ifdef HPC_ZEROCOPY_SUPPORTED
+                if (_sending_zerocopy)
+                    flags |= MSG_ZEROCOPY;
+# endif
+
+                int sz = sendmsg(_socket, &hdr, flags);
                 int err = errno;
                 dinfo("(s = %d) call sendmsg on %s, return %d, err = %s",
                     _socket,
@@ -327,6 +370,13 @@ namespace dsn
 
                 if (sz < 0)
                 {
+                    // too many zerocopy sends are not completed yet, so copy instead
+                    if (err == ENOBUFS && _sending_zerocopy)
+                    {
+                        _sending_zerocopy = false;
+                        continue;
+                    }
+
                     if (err != EAGAIN && err != EWOULDBLOCK)
                     {
                         derror("(s = %d) sendmsg failed, err = %s", _socket, strerror(err));
@@ -340,6 +390,17 @@ namespace dsn
                 }
                 else
                 {
+                    _send_opts.syscall_qps->increment();
+                    _send_opts.bytes_per_syscall->set((uint64_t)sz);
+                    _send_opts.buffers_per_syscall->set((uint64_t)buffer_count);
+
+                    // the kernel numbers each zerocopy sendmsg which sends something
+                    if (_sending_zerocopy && sz > 0)
+                    {
+                        _zerocopy_next_id++;
+                        _sending_zerocopy_used = true;
+                    }
+
                     int len = (int)sz;
                     int buf_i = _sending_buffer_start_index;
                     while (len > 0)
@@ -367,6 +428,15 @@ namespace dsn
                         auto csig = _sending_signature;
                         _sending_signature = 0;
 
+                        // the buffers are still in use by the kernel, so the messages
+                        // are referenced till on_zerocopy_completed
+                        if (_sending_zerocopy_used)
+                        {
+                            for (auto& msg : _sending_msgs)
+                                msg->add_ref();
+                            _zerocopy_msgs.push_back(std::make_pair(_zerocopy_next_id - 1, _sending_msgs));
+                        }
+
                         _send_lock.unlock(); // avoid recursion
                         // try next msg recursively                        
                         on_send_completed(csig);
@@ -382,6 +452,135 @@ namespace dsn
             }
         }
 
+        void hpc_rpc_session::prepare_sending_buffers()
+        {
+            _sending_zerocopy = false;
+            _sending_zerocopy_used = false;
+            if (_zerocopy_enabled)
+            {
+                for (auto& buf : _sending_buffers)
+                {
+                    if (buf.sz >= _send_opts.zerocopy_min_bytes)
+                    {
+                        _sending_zerocopy = true;
+                        break;
+                    }
+                }
+
+                // the arena is reused by the next batch before the kernel
+                // is done with it, so no packing for zerocopy batches
+                if (_sending_zerocopy)
+                    return;
+            }
+
+            if (_send_opts.pack_max_bytes == 0 || _sending_buffers.size() < 2)
+                return;
+
+            if (nullptr == _send_arena)
+            {
+                _send_arena_size = _max_buffer_block_count_per_send * (int)_send_opts.pack_max_bytes;
+                _send_arena.reset(new char[_send_arena_size]);
+            }
+
+            // copy the small buffers into the arena, and merge the contiguous ones
+            char* arena = _send_arena.get();
+            int used = 0;
+            int count = 0;
+            bool last_packed = false;
+            for (auto& buf : _sending_buffers)
+            {
+                if (buf.sz <= _send_opts.pack_max_bytes && used + (int)buf.sz <= _send_arena_size)
+                {
+                    memcpy(arena + used, buf.buf, buf.sz);
+                    if (last_packed)
+                    {
+                        _sending_buffers[count - 1].sz += buf.sz;
+                    }
+                    else
+                    {
+                        _sending_buffers[count].buf = arena + used;
+                        _sending_buffers[count].sz = buf.sz;
+                        count++;
+                    }
+                    used += (int)buf.sz;
+                    last_packed = true;
+                }
+                else
+                {
+                    _sending_buffers[count++] = buf;
+                    last_packed = false;
+                }
+            }
+            _sending_buffers.resize(count);
+        }
+
+        void hpc_rpc_session::do_deferred_write()
+        {
+            uint64_t sig = _deferred_signature;
+            _deferred_signature = 0;
+
+            // failed meanwhile
+            if (-1 == _socket)
+                return;
+
+            // sends issued later in the same loop iteration join this batch
+            gather_messages_for_send();
+            do_safe_write(sig);
+        }
+
+        bool hpc_rpc_session::on_zerocopy_completed()
+        {
+# ifdef HPC_ZEROCOPY_SUPPORTED
+            utils::auto_lock<utils::ex_lock_nr> l(_send_lock);
+
+            while (true)
+            {
+                char control[128];
+                struct msghdr hdr;
+                memset((void*)&hdr, 0, sizeof(hdr));
+                hdr.msg_control = control;
+                hdr.msg_controllen = sizeof(control);
+
+                if (recvmsg(_socket, &hdr, MSG_ERRQUEUE) < 0)
+                {
+                    if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    {
+                        derror("(s = %d) recvmsg on error queue failed, err = %s", _socket, strerror(errno));
+                        return false;
+                    }
+                    return true;
+                }
+
+                for (auto cm = CMSG_FIRSTHDR(&hdr); cm != nullptr; cm = CMSG_NXTHDR(&hdr, cm))
+                {
+                    if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                        && !(cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))
+                        continue;
+
+                    auto ee = (struct sock_extended_err*)CMSG_DATA(cm);
+                    if (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+                    {
+                        derror("(s = %d) unexpected error on error queue, err = %s", _socket, strerror(ee->ee_errno));
+                        return false;
+                    }
+
+                    // sends [ee_info, ee_data] are completed, and they are always
+                    // notified in order for tcp
+                    uint32_t last_id = ee->ee_data;
+                    while (!_zerocopy_msgs.empty()
+                        && (int32_t)(last_id - _zerocopy_msgs.front().first) >= 0)
+                    {
+                        for (auto& msg : _zerocopy_msgs.front().second)
+                            msg->release_ref(); // added in do_write
+                        _zerocopy_msgs.pop_front();
+                    }
+                }
+            }
+# else
+            return false;
+# endif
+        }
+
         void hpc_rpc_session::close()
         {
             if (-1 != _socket)
@@ -395,6 +594,18 @@ namespace dsn
         void hpc_rpc_session::on_send_recv_events_ready(uintptr_t lolp_or_events)
         {
             uint32_t events = (uint32_t)lolp_or_events;
+
+            // zerocopy completions are notified via the error queue
+            if ((events & EPOLLERR) && _zerocopy_enabled && on_zerocopy_completed())
+            {
+                int err = 0;
+                socklen_t err_len = (socklen_t)sizeof(err);
+                if (getsockopt(_socket, SOL_SOCKET, SO_ERROR, (void*)&err, &err_len) == 0 && err == 0)
+                {
+                    events &= ~EPOLLERR;
+                }
+            }
+
             // shutdown or send/recv error
             if ((events & EPOLLHUP) || (events & EPOLLRDHUP) || (events & EPOLLERR))
             {
@@ -441,12 +652,39 @@ namespace dsn
             bool is_client
             )
             : rpc_session(net, remote_addr, parser, is_client),
-             _socket(sock)
+             _socket(sock),
+             _send_opts(static_cast<hpc_network_provider&>(net).send_opts())
         {
             dassert(sock != -1, "invalid given socket handle");
             _sending_signature = 0;
             _sending_buffer_start_index = 0;
             _looper = nullptr;
+            _deferred_signature = 0;
+            _send_arena_size = 0;
+            _sending_zerocopy = false;
+            _sending_zerocopy_used = false;
+            _zerocopy_next_id = 0;
+            _zerocopy_enabled = false;
+
+            _deferred_write_event = [this](int err, uint32_t length, uintptr_t lolp_or_events)
+            {
+                this->do_deferred_write();
+            };
+
+# ifdef HPC_ZEROCOPY_SUPPORTED
+            if (_send_opts.zerocopy_min_bytes > 0)
+            {
+                int zerocopy = 1;
+                if (setsockopt(_socket, SOL_SOCKET, SO_ZEROCOPY, (char*)&zerocopy, sizeof(zerocopy)) != 0)
+                {
+                    dwarn("(s = %d) setsockopt SO_ZEROCOPY failed, err = %s", _socket, strerror(errno));
+                }
+                else
+                {
+                    _zerocopy_enabled = true;
+                }
+            }
+# endif
 
             memset((void*)&_peer_addr, 0, sizeof(_peer_addr));
             _peer_addr.sin_family = AF_INET;
@@ -485,6 +723,16 @@ namespace dsn
             
         }
 
+        hpc_rpc_session::~hpc_rpc_session()
+        {
+            for (auto& msgs : _zerocopy_msgs)
+            {
+                for (auto& msg : msgs.second)
+                    msg->release_ref(); // added in do_write
+            }
+            _zerocopy_msgs.clear();
+        }
+
         void hpc_rpc_session::on_connect_events_ready(uintptr_t lolp_or_events)
         {
             dassert(is_connecting(), "session must be connecting at this time");
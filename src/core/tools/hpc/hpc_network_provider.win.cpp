@@ -363,7 +363,15 @@ namespace dsn
                         msg = _parser->get_message_on_receive(0, read_next);
                     }
 
-                    do_read(read_next);
+                    if (read_next < 0)
+                    {
+                        derror("malformed message received from %s", _remote_addr.to_string());
+                        on_failure();
+                    }
+                    else
+                    {
+                        do_read(read_next);
+                    }
                 }
 
                 release_ref();
@@ -48,6 +48,8 @@ namespace dsn
         {
             _io_queue = -1;
             _local_notification_fd = IO_LOOPER_USER_NOTIFICATION_FD;
+            _remote_timer_tasks_count = 0;
+            _timer_armed_ms = 0;
             _filters.insert(EVFILT_READ);
             _filters.insert(EVFILT_WRITE);
             //EVFILT_AIO is automatically registered.
@@ -227,6 +229,11 @@ namespace dsn
             dinfo("notify local");
         }
 
+        void io_looper::arm_timer(uint64_t ts_ms)
+        {
+            // timers are still checked by the 1ms polling in loop_worker
+        }
+
         void io_looper::create_completion_queue()
         {
             _io_queue = ::kqueue();
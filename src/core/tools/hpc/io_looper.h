@@ -40,6 +40,7 @@
 
 # include <dsn/ports.h>
 # include <dsn/tool_api.h>
+# include "timer_wheel.h"
 
 # ifndef _WIN32
 
@@ -116,12 +117,32 @@ namespace dsn
 
             virtual void handle_local_queues() { exec_timer_tasks(false); }
 
-            void add_timer(task* timer); // return next firing delay ms
+            void add_timer(task* timer);
+
+# ifdef __linux__
+            //
+            // execute cb at the end of the current loop iteration, i.e., after all
+            // the ready events and local tasks of this iteration are handled, so that
+            // e.g., the sends issued by these handlers are flushed together;
+            // ctx is referenced till cb is executed;
+            // return false when the current thread is not a loop worker
+            //
+            static bool defer_to_iteration_end(io_loop_callback* cb, ref_counter* ctx);
+# endif
 
         protected:
             virtual bool is_shared_timer_queue() { return true; }
+            virtual bool has_local_work() { return false; }
             void exec_timer_tasks(bool local_exec);
 
+        private:
+            // make sure the looper is woken up no later than ts_ms
+            void arm_timer(uint64_t ts_ms);
+
+# ifdef __linux__
+            static void exec_deferred_callbacks();
+# endif
+
         private:
             std::vector<std::thread*> _workers;
 # ifdef _WIN32
@@ -141,6 +162,13 @@ namespace dsn
             int                       _local_notification_fd;
             io_loop_callback          _local_notification_callback;
 
+# ifdef __linux__
+            // timers are driven by timerfd instead of polling
+            int                       _timer_fd;
+            io_loop_callback          _timer_callback;
+            std::atomic<bool>         _exiting;
+# endif
+
             //
             // epoll notifications are not per-op, so we have to
             // use a look-up layer to ensure the callback context
@@ -153,8 +181,11 @@ namespace dsn
             // timers
             std::atomic<uint64_t>           _remote_timer_tasks_count;
             ::dsn::utils::ex_lock_nr_spin   _remote_timer_tasks_lock;
-            std::map<uint64_t, slist<task>> _remote_timer_tasks; // ts (ms) => task
-            std::map<uint64_t, slist<task>> _local_timer_tasks;
+            timer_wheel                     _remote_timer_tasks;
+            timer_wheel                     _local_timer_tasks;
+
+            ::dsn::utils::ex_lock_nr_spin   _timer_armed_lock;
+            std::atomic<uint64_t>           _timer_armed_ms; // 0 for not armed
         };
 
         // --------------- inline implementation -------------------------
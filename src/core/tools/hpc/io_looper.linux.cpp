@@ -38,21 +38,33 @@
 
 # include "io_looper.h"
 # include <sys/eventfd.h>
+# include <sys/timerfd.h>
 
 namespace dsn
 {
     namespace tools
     {
+        typedef std::vector<std::pair<io_loop_callback*, ref_counter*> > deferred_callbacks;
+
+        // set only within loop_worker
+        static __thread deferred_callbacks* s_deferred_callbacks = nullptr;
+
         io_looper::io_looper()
         {
             _io_queue = 0;
             _local_notification_fd = eventfd(0, EFD_NONBLOCK);
+            _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+            dassert(_timer_fd != -1, "timerfd_create failed, err = %s", strerror(errno));
+            _exiting = false;
+            _remote_timer_tasks_count = 0;
+            _timer_armed_ms = 0;
         }
 
         io_looper::~io_looper(void)
         {
             stop();
             close(_local_notification_fd);
+            close(_timer_fd);
         }
 
         error_code io_looper::bind_io_handle(
@@ -144,6 +156,37 @@ namespace dsn
             dinfo("notify local");
         }
 
+        void io_looper::arm_timer(uint64_t ts_ms)
+        {
+            uint64_t armed = _timer_armed_ms.load(std::memory_order_acquire);
+            if (armed != 0 && armed <= ts_ms)
+                return;
+
+            utils::auto_lock<utils::ex_lock_nr_spin> l(_timer_armed_lock);
+            armed = _timer_armed_ms.load(std::memory_order_relaxed);
+            if (armed != 0 && armed <= ts_ms)
+                return;
+
+            _timer_armed_ms.store(ts_ms, std::memory_order_release);
+
+            // relative time as dsn_now_ms is not necessarily CLOCK_MONOTONIC,
+            // and zero disarms the timer so at least 1ns is required
+            uint64_t nts = dsn_now_ms();
+            uint64_t delay_ms = ts_ms > nts ? ts_ms - nts : 0;
+
+            struct itimerspec its;
+            memset(&its, 0, sizeof(its));
+            its.it_value.tv_sec = delay_ms / 1000;
+            its.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
+            if (delay_ms == 0)
+                its.it_value.tv_nsec = 1;
+
+            if (timerfd_settime(_timer_fd, 0, &its, nullptr) < 0)
+            {
+                dassert(false, "arm timer via timerfd failed, err = %s", strerror(errno));
+            }
+        }
+
         void io_looper::create_completion_queue()
         {
             const int max_event_count = sizeof(_events) / sizeof(struct epoll_event);
@@ -172,6 +215,25 @@ namespace dsn
 
             bind_io_handle((dsn_handle_t)(intptr_t)_local_notification_fd, &_local_notification_callback, 
                 EPOLLIN | EPOLLET);
+
+            _timer_callback = [this](
+                int native_error,
+                uint32_t io_size,
+                uintptr_t lolp_or_events
+                )
+            {
+                uint64_t expirations = 0;
+                if (read(_timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                {
+                    // consumed by other loop workers already
+                    return;
+                }
+
+                this->handle_local_queues();
+            };
+
+            bind_io_handle((dsn_handle_t)(intptr_t)_timer_fd, &_timer_callback,
+                EPOLLIN | EPOLLET);
         }
 
         void io_looper::close_completion_queue()
@@ -206,7 +268,11 @@ namespace dsn
 
         void io_looper::stop()
         {
-            close_completion_queue();
+            // loop workers block in epoll_wait without timeout now, so they
+            // must be woken up before the completion queue is closed
+            _exiting = true;
+            if (_io_queue != 0)
+                notify_local_execution();
 
             if (_workers.size() > 0)
             {
@@ -217,15 +283,56 @@ namespace dsn
                 }
                 _workers.clear();
             }
+
+            close_completion_queue();
+        }
+
+        bool io_looper::defer_to_iteration_end(io_loop_callback* cb, ref_counter* ctx)
+        {
+            auto cbs = s_deferred_callbacks;
+            if (cbs == nullptr)
+                return false;
+
+            ctx->add_ref(); // released in exec_deferred_callbacks
+            cbs->push_back(std::make_pair(cb, ctx));
+            return true;
+        }
+
+        void io_looper::exec_deferred_callbacks()
+        {
+            auto cbs = s_deferred_callbacks;
+
+            // callbacks may defer more, which are executed in this round as well
+            for (size_t i = 0; i < cbs->size(); i++)
+            {
+                auto cb = (*cbs)[i];
+                (*cb.first)(0, 0, 0);
+                cb.second->release_ref();
+            }
+            cbs->clear();
         }
 
         void io_looper::loop_worker()
         {
             const int max_event_count = sizeof(_events) / sizeof(struct epoll_event);
 
+            deferred_callbacks cbs;
+            s_deferred_callbacks = &cbs;
+
             while (true)
             {
-                int nfds = epoll_wait(_io_queue, _events, max_event_count, 1); // 1ms for timers
+                exec_deferred_callbacks();
+
+                if (_exiting)
+                {
+                    // wake up the next loop worker
+                    notify_local_execution();
+                    break;
+                }
+
+                // timers are fired via _timer_fd, so only pending local tasks
+                // prevent the looper from blocking
+                int nfds = epoll_wait(_io_queue, _events, max_event_count, has_local_work() ? 0 : -1);
                 if (nfds == 0) // timeout
                 {
                     handle_local_queues();
@@ -239,6 +346,7 @@ namespace dsn
                     else
                     {
                         derror("epoll_wait loop exits, err = %s", strerror(errno));
+                        exec_deferred_callbacks();
                         break;
                     }
                 }
@@ -291,7 +399,15 @@ namespace dsn
                         (*cb)(0, 0, (uintptr_t)_events[i].events);
                     }
                 }
+
+                // local tasks must not be starved by continuous io events
+                if (nfds > 0 && has_local_work())
+                {
+                    handle_local_queues();
+                }
             }
+
+            s_deferred_callbacks = nullptr;
         }
     }
 }
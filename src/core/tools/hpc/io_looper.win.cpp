@@ -47,6 +47,8 @@ namespace dsn
         io_looper::io_looper()
         {
             _io_queue = 0;
+            _remote_timer_tasks_count = 0;
+            _timer_armed_ms = 0;
         }
 
         io_looper::~io_looper(void)
@@ -86,6 +88,11 @@ namespace dsn
             }
         }
 
+        void io_looper::arm_timer(uint64_t ts_ms)
+        {
+            // timers are still checked by the 1ms polling in loop_worker
+        }
+
         void io_looper::create_completion_queue()
         {
             _io_queue = ::CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);
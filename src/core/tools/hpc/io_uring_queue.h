@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     a thin wrapper over the linux io_uring syscalls (no liburing), whose
+ *     completions are reaped in bulk by the io looper threads
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <dsn/ports.h>
+# include <dsn/tool_api.h>
+# include "io_looper.h"
+
+# ifdef __linux__
+
+# include <linux/io_uring.h>
+# include <sys/uio.h>
+
+namespace dsn
+{
+    namespace tools
+    {
+        //
+        // one in-flight operation on the ring, used as the sqe's user_data
+        //
+        // callback(res, cqe_flags) is executed in the io looper threads,
+        // and context (when not null) is pinned by the queue until the
+        // (last) completion of the operation is handled
+        //
+        struct io_uring_op
+        {
+            std::function<void(int, uint32_t)> callback;
+            ref_counter*                       context;
+
+            io_uring_op() : context(nullptr) {}
+        };
+
+        class io_uring_queue
+        {
+        public:
+            io_uring_queue();
+            ~io_uring_queue();
+
+            // create the rings, and bind the completion notification to the looper
+            error_code start(io_looper* looper, unsigned int entries);
+
+            void stop();
+
+            bool is_started() const { return _ring_fd != -1; }
+
+            //
+            // prepare one sqe for op via prep(struct io_uring_sqe*)
+            //
+            // sqes prepared inside the completion callbacks of this queue are
+            // submitted together with one io_uring_enter after the current
+            // completion batch, others are submitted immediately
+            //
+            template<typename TPrepare>
+            void submit(io_uring_op* op, TPrepare prep);
+
+            // submit all prepared sqes
+            void flush();
+
+            //
+            // provided buffer ring (kernel 5.19+), recv with IOSQE_BUFFER_SELECT
+            // picks one buffer from it, and the buffer must be recycled after
+            // it is consumed (in completion callbacks only)
+            //
+            bool provide_buffers(int count, int size);
+            bool has_provided_buffers() const { return _buf_ring != nullptr; }
+            uint16_t buffer_group() const { return 0; }
+            int buffer_size() const { return _buf_size; }
+            char* buffer_data(int bid) const { return _buf_data + (size_t)bid * (size_t)_buf_size; }
+            void recycle_buffer(int bid);
+
+            //
+            // registered files (kernel 5.5+), a sparse table of count slots,
+            // sqes with IOSQE_FIXED_FILE use the slot index as the fd, which
+            // saves the fget/fput on each io
+            //
+            bool register_files(int count);
+            int  register_file(int fd); // return the slot, or -1 if not available
+            void unregister_file(int slot);
+
+            //
+            // registered (fixed) buffers for IORING_OP_READ/WRITE_FIXED, which
+            // are pinned once instead of being mapped on each io
+            //
+            bool register_buffers(const struct iovec* iovs, int count);
+
+        private:
+            struct io_uring_sqe* get_sqe();
+            void publish_sqe();
+            void reap();
+            int  enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+            bool is_reaping() const { return _reaping_queue == this; }
+
+            static __thread io_uring_queue* _reaping_queue;
+
+        private:
+            int                        _ring_fd;
+            io_looper*                 _looper;
+
+            // submission queue, locked by _sq_lock
+            ::dsn::utils::ex_lock_nr_spin _sq_lock;
+            unsigned int               *_sq_head;
+            unsigned int               *_sq_tail;
+            unsigned int               *_sq_mask;
+            unsigned int               *_sq_flags;
+            unsigned int               *_sq_array;
+            struct io_uring_sqe        *_sqes;
+            unsigned int               _sq_entries;
+            unsigned int               _sq_local_tail;
+            unsigned int               _sq_pending;
+
+            // completion queue, consumed by one looper thread at a time
+            ::dsn::utils::ex_lock_nr_spin _cq_lock;
+            unsigned int               *_cq_head;
+            unsigned int               *_cq_tail;
+            unsigned int               *_cq_mask;
+            struct io_uring_cqe        *_cqes;
+
+            void                       *_sq_ring_ptr;
+            size_t                     _sq_ring_size;
+            void                       *_cq_ring_ptr;
+            size_t                     _cq_ring_size;
+            size_t                     _sqes_size;
+
+            // completion notification for the looper
+            int                        _event_fd;
+            io_loop_callback           _event_callback;
+
+            // provided buffers
+            struct io_uring_buf_ring   *_buf_ring;
+            char                       *_buf_data;
+            int                        _buf_count;
+            int                        _buf_size;
+            uint16_t                   _buf_tail;
+
+            // registered files
+            ::dsn::utils::ex_lock_nr_spin _files_lock;
+            std::vector<int>           _free_file_slots;
+        };
+
+        // --------------- inline implementation -------------------------
+        template<typename TPrepare>
+        inline void io_uring_queue::submit(io_uring_op* op, TPrepare prep)
+        {
+            if (op->context)
+                op->context->add_ref(); // released after the completion is handled
+
+            {
+                utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_sq_lock);
+                struct io_uring_sqe* sqe = get_sqe();
+                prep(sqe);
+                sqe->user_data = (uint64_t)(uintptr_t)op;
+                publish_sqe();
+            }
+
+            if (!is_reaping())
+                flush();
+        }
+    }
+}
+
+# endif
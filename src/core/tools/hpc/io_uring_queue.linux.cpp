@@ -0,0 +1,471 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# if defined(__linux__)
+
+# include "io_uring_queue.h"
+# include <sys/eventfd.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "io_uring.queue"
+
+namespace dsn
+{
+    namespace tools
+    {
+        __thread io_uring_queue* io_uring_queue::_reaping_queue = nullptr;
+
+        io_uring_queue::io_uring_queue()
+        {
+            _ring_fd = -1;
+            _looper = nullptr;
+            _sq_ring_ptr = nullptr;
+            _cq_ring_ptr = nullptr;
+            _sqes = nullptr;
+            _sq_local_tail = 0;
+            _sq_pending = 0;
+            _event_fd = -1;
+            _buf_ring = nullptr;
+            _buf_data = nullptr;
+            _buf_count = 0;
+            _buf_size = 0;
+            _buf_tail = 0;
+        }
+
+        io_uring_queue::~io_uring_queue()
+        {
+            stop();
+        }
+
+        error_code io_uring_queue::start(io_looper* looper, unsigned int entries)
+        {
+            if (_ring_fd != -1)
+                return ERR_SERVICE_ALREADY_RUNNING;
+
+            struct io_uring_params p;
+            memset(&p, 0, sizeof(p));
+
+            int fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+            if (fd < 0)
+            {
+                derror("io_uring_setup failed, err = %s", strerror(errno));
+                return ERR_NOT_IMPLEMENTED;
+            }
+
+            _sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+            _cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                if (_cq_ring_size > _sq_ring_size)
+                    _sq_ring_size = _cq_ring_size;
+                _cq_ring_size = _sq_ring_size;
+            }
+
+            _sq_ring_ptr = mmap(0, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQ_RING);
+            dassert(_sq_ring_ptr != MAP_FAILED, "mmap io_uring sq ring failed, err = %s", strerror(errno));
+
+            if (p.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                _cq_ring_ptr = _sq_ring_ptr;
+            }
+            else
+            {
+                _cq_ring_ptr = mmap(0, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_CQ_RING);
+                dassert(_cq_ring_ptr != MAP_FAILED, "mmap io_uring cq ring failed, err = %s", strerror(errno));
+            }
+
+            _sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+            _sqes = (struct io_uring_sqe*)mmap(0, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                fd, IORING_OFF_SQES);
+            dassert(_sqes != MAP_FAILED, "mmap io_uring sqes failed, err = %s", strerror(errno));
+
+            char* sq = (char*)_sq_ring_ptr;
+            _sq_head = (unsigned int*)(sq + p.sq_off.head);
+            _sq_tail = (unsigned int*)(sq + p.sq_off.tail);
+            _sq_mask = (unsigned int*)(sq + p.sq_off.ring_mask);
+            _sq_flags = (unsigned int*)(sq + p.sq_off.flags);
+            _sq_array = (unsigned int*)(sq + p.sq_off.array);
+            _sq_entries = p.sq_entries;
+            _sq_local_tail = *_sq_tail;
+
+            char* cq = (char*)_cq_ring_ptr;
+            _cq_head = (unsigned int*)(cq + p.cq_off.head);
+            _cq_tail = (unsigned int*)(cq + p.cq_off.tail);
+            _cq_mask = (unsigned int*)(cq + p.cq_off.ring_mask);
+            _cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+            _ring_fd = fd;
+
+            // completions are notified through an eventfd bound to the looper,
+            // so that the ring works together with the other epoll based io
+            _event_fd = eventfd(0, EFD_NONBLOCK);
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_EVENTFD, &_event_fd, 1) < 0)
+            {
+                derror("io_uring register eventfd failed, err = %s", strerror(errno));
+                stop();
+                return ERR_NOT_IMPLEMENTED;
+            }
+
+            _event_callback = [this](
+                int native_error,
+                uint32_t io_size,
+                uintptr_t lolp_or_events
+                )
+            {
+                int64_t notify_count = 0;
+
+                // possibly consumed already by others, and the completions
+                // are then reaped by them or by ourselves below
+                if (read(_event_fd, &notify_count, sizeof(notify_count)) < 0)
+                {
+                    dassert(errno == EAGAIN || errno == EWOULDBLOCK,
+                        "read io_uring completion notification failed, err = %s", strerror(errno));
+                }
+
+                this->reap();
+            };
+
+            _looper = looper;
+            return _looper->bind_io_handle((dsn_handle_t)(intptr_t)_event_fd, &_event_callback, EPOLLIN | EPOLLET);
+        }
+
+        void io_uring_queue::stop()
+        {
+            if (_event_fd != -1)
+            {
+                if (_looper)
+                {
+                    _looper->unbind_io_handle((dsn_handle_t)(intptr_t)_event_fd, nullptr);
+                    _looper = nullptr;
+                }
+                ::close(_event_fd);
+                _event_fd = -1;
+            }
+
+            if (_sqes)
+            {
+                munmap(_sqes, _sqes_size);
+                _sqes = nullptr;
+            }
+
+            if (_cq_ring_ptr && _cq_ring_ptr != _sq_ring_ptr)
+            {
+                munmap(_cq_ring_ptr, _cq_ring_size);
+            }
+            _cq_ring_ptr = nullptr;
+
+            if (_sq_ring_ptr)
+            {
+                munmap(_sq_ring_ptr, _sq_ring_size);
+                _sq_ring_ptr = nullptr;
+            }
+
+            if (_ring_fd != -1)
+            {
+                ::close(_ring_fd);
+                _ring_fd = -1;
+            }
+
+            if (_buf_ring)
+            {
+                free(_buf_ring);
+                _buf_ring = nullptr;
+            }
+
+            if (_buf_data)
+            {
+                free(_buf_data);
+                _buf_data = nullptr;
+            }
+
+            _free_file_slots.clear();
+        }
+
+        int io_uring_queue::enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+        {
+            int r = (int)syscall(__NR_io_uring_enter, _ring_fd, to_submit, min_complete, flags, nullptr, 0);
+            return r < 0 ? -errno : r;
+        }
+
+        struct io_uring_sqe* io_uring_queue::get_sqe()
+        {
+            // sq is full, push the prepared ones to the kernel first
+            while (_sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE) >= _sq_entries)
+            {
+                int r = enter(_sq_pending, 0, 0);
+                if (r > 0)
+                {
+                    _sq_pending -= r;
+                }
+                else if (r < 0 && r != -EINTR && r != -EAGAIN && r != -EBUSY)
+                {
+                    dassert(false, "io_uring_enter failed, err = %s", strerror(-r));
+                }
+            }
+
+            auto sqe = &_sqes[_sq_local_tail & *_sq_mask];
+            memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+
+        void io_uring_queue::publish_sqe()
+        {
+            unsigned int index = _sq_local_tail & *_sq_mask;
+            _sq_array[index] = index;
+            ++_sq_local_tail;
+            ++_sq_pending;
+            __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+        }
+
+        void io_uring_queue::flush()
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_sq_lock);
+            while (_sq_pending > 0)
+            {
+                int r = enter(_sq_pending, 0, 0);
+                if (r > 0)
+                {
+                    _sq_pending -= r;
+                }
+                else if (r == -EINTR)
+                {
+                    continue;
+                }
+                else if (r == 0 || r == -EAGAIN || r == -EBUSY)
+                {
+                    // cq is overflowed, the left ones are submitted after next reap
+                    dwarn("io_uring_enter cannot submit now, %u sqes are pending, err = %s",
+                        _sq_pending, strerror(-r));
+                    break;
+                }
+                else
+                {
+                    dassert(false, "io_uring_enter failed, err = %s", strerror(-r));
+                }
+            }
+        }
+
+        void io_uring_queue::reap()
+        {
+            auto last = _reaping_queue;
+            _reaping_queue = this;
+
+            while (_cq_lock.try_lock())
+            {
+                while (true)
+                {
+                    unsigned int head = *_cq_head;
+                    unsigned int tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+                    if (head == tail)
+                    {
+                        // completions overflowed are flushed into the cq by io_uring_enter
+                        if (__atomic_load_n(_sq_flags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW)
+                        {
+                            enter(0, 0, IORING_ENTER_GETEVENTS);
+                            continue;
+                        }
+                        break;
+                    }
+
+                    for (; head != tail; ++head)
+                    {
+                        auto cqe = &_cqes[head & *_cq_mask];
+                        auto op = (io_uring_op*)(uintptr_t)cqe->user_data;
+                        int res = cqe->res;
+                        uint32_t flags = cqe->flags;
+
+                        // release the slot before callback as new sqes may be submitted there
+                        __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+
+                        if (op == nullptr)
+                            continue;
+
+                        // op may be gone together with the context after the callback
+                        auto ctx = op->context;
+                        op->callback(res, flags);
+                        if (ctx && !(flags & IORING_CQE_F_MORE))
+                            ctx->release_ref(); // added in submit
+                    }
+                }
+
+                _cq_lock.unlock();
+
+                // submit the sqes prepared in the above callbacks with one syscall
+                flush();
+
+                // completions arrived right before unlock are possibly skipped
+                // by other loopers failing try_lock
+                if (*_cq_head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+                    break;
+            }
+
+            _reaping_queue = last;
+        }
+
+        bool io_uring_queue::provide_buffers(int count, int size)
+        {
+            dassert(_buf_ring == nullptr, "buffers are already provided");
+            dassert(count > 0 && count <= 32768 && (count & (count - 1)) == 0,
+                "provided buffer count must be power of 2 and no more than 32768, now %d", count);
+
+            void* ring = nullptr;
+            if (posix_memalign(&ring, 4096, count * sizeof(struct io_uring_buf)) != 0)
+                return false;
+            memset(ring, 0, count * sizeof(struct io_uring_buf));
+
+            struct io_uring_buf_reg reg;
+            memset(&reg, 0, sizeof(reg));
+            reg.ring_addr = (uint64_t)(uintptr_t)ring;
+            reg.ring_entries = (uint32_t)count;
+            reg.bgid = buffer_group();
+
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+            {
+                dwarn("io_uring register provided buffer ring failed, err = %s", strerror(errno));
+                free(ring);
+                return false;
+            }
+
+            _buf_ring = (struct io_uring_buf_ring*)ring;
+            _buf_data = (char*)malloc((size_t)count * (size_t)size);
+            _buf_count = count;
+            _buf_size = size;
+            _buf_tail = 0;
+
+            for (int i = 0; i < count; i++)
+            {
+                recycle_buffer(i);
+            }
+            return true;
+        }
+
+        void io_uring_queue::recycle_buffer(int bid)
+        {
+            auto buf = &_buf_ring->bufs[_buf_tail & (_buf_count - 1)];
+            buf->addr = (uint64_t)(uintptr_t)buffer_data(bid);
+            buf->len = (uint32_t)_buf_size;
+            buf->bid = (uint16_t)bid;
+
+            ++_buf_tail;
+            __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+        }
+
+        bool io_uring_queue::register_files(int count)
+        {
+            dassert(_free_file_slots.empty(), "files are already registered");
+            dassert(count > 0, "registered file count must be positive, now %d", count);
+
+            std::vector<int> fds(count, -1);
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_FILES, &fds[0], count) < 0)
+            {
+                dwarn("io_uring register files failed, err = %s", strerror(errno));
+                return false;
+            }
+
+            // slots are taken from the back
+            for (int i = count - 1; i >= 0; i--)
+            {
+                _free_file_slots.push_back(i);
+            }
+            return true;
+        }
+
+        int io_uring_queue::register_file(int fd)
+        {
+            int slot;
+            {
+                utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+                if (_free_file_slots.empty())
+                    return -1;
+
+                slot = _free_file_slots.back();
+                _free_file_slots.pop_back();
+            }
+
+            struct io_uring_files_update up;
+            memset(&up, 0, sizeof(up));
+            up.offset = (uint32_t)slot;
+            up.fds = (uint64_t)(uintptr_t)&fd;
+
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_FILES_UPDATE, &up, 1) != 1)
+            {
+                dwarn("io_uring update registered file failed, err = %s", strerror(errno));
+
+                utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+                _free_file_slots.push_back(slot);
+                return -1;
+            }
+            return slot;
+        }
+
+        void io_uring_queue::unregister_file(int slot)
+        {
+            int fd = -1;
+
+            struct io_uring_files_update up;
+            memset(&up, 0, sizeof(up));
+            up.offset = (uint32_t)slot;
+            up.fds = (uint64_t)(uintptr_t)&fd;
+
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_FILES_UPDATE, &up, 1) != 1)
+            {
+                // the slot is leaked rather than reused with a stale file
+                derror("io_uring clear registered file failed, slot = %d, err = %s", slot, strerror(errno));
+                return;
+            }
+
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+            _free_file_slots.push_back(slot);
+        }
+
+        bool io_uring_queue::register_buffers(const struct iovec* iovs, int count)
+        {
+            if (syscall(__NR_io_uring_register, _ring_fd, IORING_REGISTER_BUFFERS, iovs, count) < 0)
+            {
+                dwarn("io_uring register buffers failed, err = %s", strerror(errno));
+                return false;
+            }
+            return true;
+        }
+    }
+}
+
+# endif
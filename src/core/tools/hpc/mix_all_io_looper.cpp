@@ -120,11 +120,15 @@ namespace dsn
                 t = next;
             }
 
-            // execute shared queue
+            // execute shared queue, and reset the counter first so that
+            // later remote enqueues notify this looper again
+            if (_remote_count.exchange(0, std::memory_order_acquire) > 0)
             {
                 utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_lock);
                 t = _remote_tasks.pop_all();
             }
+            else
+                t = nullptr;
             
             while (t)
             {
@@ -136,75 +140,54 @@ namespace dsn
 
         void io_looper::exec_timer_tasks(bool local_exec)
         {
-            // execute local timers
             uint64_t nts = ::dsn::task::get_current_env()->now_ns() / 1000000;
-            while (_local_timer_tasks.size() > 0)
-            {
-                auto it = _local_timer_tasks.begin();
-                if (it->first <= nts)
-                {
-                    task* t = it->second.pop_all(), *next;
-                    _local_timer_tasks.erase(it);
+            uint64_t next_ts;
+            slist<task> timers;
 
-                    while (t)
-                    {
-                        next = t->next;
-                        if (local_exec)
-                            t->exec_internal();
-                        else
-                        {
-                            t->enqueue();
-                            t->release_ref(); // added by first t->enqueue()
-                        }
+            // disarm first so that timers added from now on re-arm the timer
+            _timer_armed_ms.store(0, std::memory_order_release);
 
-                        t = next;
-                    }
-                }
-                else
-                    break;
-            }
+            // collect local timers
+            _local_timer_tasks.advance(nts, timers);
+            next_ts = _local_timer_tasks.next_check_ms();
 
-            // execute shared timers
-            while (_remote_timer_tasks_count.load(std::memory_order_relaxed) > 0)
+            // collect shared timers
+            if (_remote_timer_tasks_count.load(std::memory_order_relaxed) > 0)
             {
-                task* t = nullptr, *next;
-                {
-                    utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_remote_timer_tasks_lock);
-                    if (_remote_timer_tasks.size() == 0)
-                        break;
-
-                    auto it = _remote_timer_tasks.begin();
-                    if (it->first <= nts)
-                    {
-                        t = it->second.pop_all();
-                        _remote_timer_tasks.erase(it);
-                    }
-                    else
-                        break;
-                }
+                utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_remote_timer_tasks_lock);
+                int old_count = _remote_timer_tasks.count();
+                _remote_timer_tasks.advance(nts, timers);
+                _remote_timer_tasks_count -= (old_count - _remote_timer_tasks.count());
 
-                while (t)
-                {
-                    _remote_timer_tasks_count--;
-                    
-                    next = t->next;
+                uint64_t ts = _remote_timer_tasks.next_check_ms();
+                if (ts != 0 && (next_ts == 0 || ts < next_ts))
+                    next_ts = ts;
+            }
 
-                    if (local_exec)
-                        t->exec_internal();
-                    else
-                    {
-                        t->enqueue();
-                        t->release_ref(); // added by first t->enqueue()
-                    }
+            if (next_ts != 0)
+                arm_timer(next_ts);
 
-                    t = next;
+            // execute timers, including the cancelled ones for releasing
+            task* t = timers.pop_all(), *next;
+            while (t)
+            {
+                next = t->next;
+                if (local_exec)
+                    t->exec_internal();
+                else
+                {
+                    t->enqueue();
+                    t->release_ref(); // added by first t->enqueue()
                 }
+
+                t = next;
             }
         }
 
         void io_looper::add_timer(task* timer)
         {
-            uint64_t ts_ms = dsn_now_ms() + timer->delay_milliseconds();
+            uint64_t nts = dsn_now_ms();
+            uint64_t ts_ms = nts + timer->delay_milliseconds();
             timer->set_delay(0);
 
             // put into locked queue when it is shared or from remote threads
@@ -212,9 +195,7 @@ namespace dsn
             {
                 {
                     utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_remote_timer_tasks_lock);
-                    auto pr = _remote_timer_tasks.insert(
-                        std::map<uint64_t, slist<task>>::value_type(ts_ms, slist<task>()));
-                    pr.first->second.add(timer);
+                    _remote_timer_tasks.add(timer, ts_ms, nts);
                 }
 
                 _remote_timer_tasks_count++;
@@ -223,10 +204,10 @@ namespace dsn
             // put into local queue
             else
             {
-                auto pr = _local_timer_tasks.insert(
-                    std::map<uint64_t, slist<task>>::value_type(ts_ms, slist<task>()));
-                pr.first->second.add(timer);
+                _local_timer_tasks.add(timer, ts_ms, nts);
             }
+
+            arm_timer(ts_ms);
         }
 
         void io_looper_task_queue::enqueue(task* task)
@@ -64,6 +64,11 @@ namespace dsn
                 return is_shared() || task::get_current_worker() != owner_worker();
             }
 
+            virtual bool has_local_work() override
+            {
+                return !_local_tasks.is_empty();
+            }
+
         private:
             std::atomic<int>              _remote_count;
 
@@ -36,11 +36,15 @@
 
 # include <dsn/tool/providers.hpc.h>
 # include "hpc_task_queue.h"
+# include "work_stealing_task_queue.h"
 # include "hpc_tail_logger.h"
 # include "hpc_logger.h"
 # include "hpc_aio_provider.h"
+# include "uring_aio_provider.h"
 # include "hpc_network_provider.h"
+# include "uring_network_provider.h"
 # include "hpc_env_provider.h"
+# include "slab_memory_provider.h"
 # include "mix_all_io_looper.h"
 
 namespace dsn {
@@ -50,10 +54,17 @@ namespace dsn {
             register_component_provider<hpc_tail_logger>("dsn::tools::hpc_tail_logger");
             register_component_provider<hpc_logger>("dsn::tools::hpc_logger");
             register_component_provider<hpc_task_queue>("dsn::tools::hpc_task_queue");
+            register_component_provider<work_stealing_task_queue>("dsn::tools::work_stealing_task_queue");
+            register_component_provider<work_stealing_task_worker>("dsn::tools::work_stealing_task_worker");
             register_component_provider<hpc_env_provider>("dsn::tools::hpc_env_provider");
+            register_component_provider<slab_memory_provider>("dsn::tools::slab_memory_provider");
             
             register_component_provider<hpc_aio_provider>("dsn::tools::hpc_aio_provider");
             register_component_provider<hpc_network_provider>("dsn::tools::hpc_network_provider");
+# ifdef __linux__
+            register_component_provider<uring_aio_provider>("dsn::tools::uring_aio_provider");
+            register_component_provider<uring_network_provider>("dsn::tools::uring_network_provider");
+# endif
             register_component_provider<io_looper_task_queue>("dsn::tools::io_looper_task_queue");
             register_component_provider<io_looper_task_worker>("dsn::tools::io_looper_task_worker");
             register_component_provider<io_looper_timer_service>("dsn::tools::io_looper_timer_service");
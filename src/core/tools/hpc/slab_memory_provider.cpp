@@ -0,0 +1,322 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "slab_memory_provider.h"
+# include <dsn/internal/perf_counters.h>
+# include <atomic>
+# include <vector>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "slab.memory"
+
+namespace dsn
+{
+    namespace tools
+    {
+        enum
+        {
+            SLAB_HEADER_SIZE = 16,   // keep 16-byte alignment for the objects
+            SLAB_GRANULARITY = 16,
+            SLAB_CLASS_COUNT = 64,   // up to 1KB
+            SLAB_CHUNK_SIZE = 64 * 1024,
+            SLAB_BATCH_COUNT = 32,   // objects moved between thread and central lists
+            SLAB_LARGE_CLASS = 0xffff
+        };
+
+        static const uint32_t SLAB_MAGIC = 0xdeadbeef;
+
+        struct slab_header
+        {
+            uint32_t magic;
+            uint32_t size_class;
+        };
+
+        // free objects are linked via their first word, headers included
+        struct slab_free_list
+        {
+            void* head;
+            int   count;
+
+            void push(void* obj)
+            {
+                *(void**)obj = head;
+                head = obj;
+                count++;
+            }
+
+            void* pop()
+            {
+                void* obj = head;
+                head = *(void**)obj;
+                count--;
+                return obj;
+            }
+        };
+
+        struct slab_central_list
+        {
+            utils::ex_lock_nr_spin lock;
+            slab_free_list         objects;
+        };
+
+        // only written by the owner thread, so that relaxed load + store is enough
+        struct slab_thread_cache
+        {
+            slab_free_list        lists[SLAB_CLASS_COUNT];
+            std::atomic<uint64_t> alloc_count;
+            std::atomic<uint64_t> free_count;
+            std::atomic<uint64_t> malloc_count;
+
+            slab_thread_cache()
+            {
+                memset(lists, 0, sizeof(lists));
+                alloc_count.store(0);
+                free_count.store(0);
+                malloc_count.store(0);
+            }
+        };
+
+        static inline void inc(std::atomic<uint64_t>& v)
+        {
+            v.store(v.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        static inline size_t class_bytes(int cls)
+        {
+            return SLAB_HEADER_SIZE + (size_t)(cls + 1) * SLAB_GRANULARITY;
+        }
+
+        static slab_central_list s_central[SLAB_CLASS_COUNT];
+
+        // caches are never destroyed so that the stats are kept after threads exit
+        static ::dsn::utils::ex_lock_nr_spin    s_caches_lock;
+        static std::vector<slab_thread_cache*>  s_caches;
+        static __thread slab_thread_cache*      tls_cache = nullptr;
+
+        struct slab_counters
+        {
+            perf_counter_ptr alloc_count;
+            perf_counter_ptr free_count;
+            perf_counter_ptr malloc_count;
+
+            slab_counters()
+            {
+                alloc_count = utils::perf_counters::instance().get_counter("memory", "slab.alloc#", COUNTER_TYPE_NUMBER, true);
+                free_count = utils::perf_counters::instance().get_counter("memory", "slab.free#", COUNTER_TYPE_NUMBER, true);
+                malloc_count = utils::perf_counters::instance().get_counter("memory", "slab.malloc#", COUNTER_TYPE_NUMBER, true);
+            }
+        };
+
+        // counters are refreshed in the slow path (i.e., batch moves) only,
+        // with the deltas since last refresh as number counters cannot be set
+        static void update_counters()
+        {
+            static slab_counters s_counters;
+            static ::dsn::utils::ex_lock_nr_spin s_lock;
+            static slab_memory_provider::stats s_last = { 0, 0, 0 };
+
+            slab_memory_provider::stats s;
+            slab_memory_provider::get_stats(s);
+
+            utils::auto_lock<utils::ex_lock_nr_spin> l(s_lock);
+            if (s.alloc_count > s_last.alloc_count)
+                s_counters.alloc_count->add(s.alloc_count - s_last.alloc_count);
+            if (s.free_count > s_last.free_count)
+                s_counters.free_count->add(s.free_count - s_last.free_count);
+            if (s.malloc_count > s_last.malloc_count)
+                s_counters.malloc_count->add(s.malloc_count - s_last.malloc_count);
+
+            if (s.alloc_count > s_last.alloc_count)
+                s_last.alloc_count = s.alloc_count;
+            if (s.free_count > s_last.free_count)
+                s_last.free_count = s.free_count;
+            if (s.malloc_count > s_last.malloc_count)
+                s_last.malloc_count = s.malloc_count;
+        }
+
+        static slab_thread_cache* get_thread_cache()
+        {
+            if (tls_cache == nullptr)
+            {
+                tls_cache = new slab_thread_cache();
+
+                utils::auto_lock<utils::ex_lock_nr_spin> l(s_caches_lock);
+                s_caches.push_back(tls_cache);
+            }
+            return tls_cache;
+        }
+
+        static void refill(slab_thread_cache* cache, int cls)
+        {
+            auto& list = cache->lists[cls];
+            auto& central = s_central[cls];
+            {
+                utils::auto_lock<utils::ex_lock_nr_spin> l(central.lock);
+                while (central.objects.count > 0 && list.count < SLAB_BATCH_COUNT)
+                {
+                    list.push(central.objects.pop());
+                }
+            }
+
+            if (list.count == 0)
+            {
+                size_t bytes = class_bytes(cls);
+                char* chunk = (char*)::malloc(SLAB_CHUNK_SIZE);
+                dassert(chunk, "malloc %d bytes failed", (int)SLAB_CHUNK_SIZE);
+                inc(cache->malloc_count);
+
+                for (size_t offset = 0; offset + bytes <= SLAB_CHUNK_SIZE; offset += bytes)
+                {
+                    list.push(chunk + offset);
+                }
+            }
+
+            update_counters();
+        }
+
+        static void overflow(slab_thread_cache* cache, int cls)
+        {
+            auto& list = cache->lists[cls];
+            auto& central = s_central[cls];
+            {
+                utils::auto_lock<utils::ex_lock_nr_spin> l(central.lock);
+                for (int i = 0; i < SLAB_BATCH_COUNT; i++)
+                {
+                    central.objects.push(list.pop());
+                }
+            }
+
+            update_counters();
+        }
+
+        slab_memory_provider::slab_memory_provider()
+        {
+        }
+
+        void* slab_memory_provider::allocate(size_t sz)
+        {
+            slab_thread_cache* cache = get_thread_cache();
+            inc(cache->alloc_count);
+
+            slab_header* hdr;
+            if (sz > SLAB_CLASS_COUNT * SLAB_GRANULARITY)
+            {
+                hdr = (slab_header*)::malloc(SLAB_HEADER_SIZE + sz);
+                dassert(hdr, "malloc %d bytes failed", (int)(SLAB_HEADER_SIZE + sz));
+                inc(cache->malloc_count);
+                hdr->size_class = SLAB_LARGE_CLASS;
+            }
+            else
+            {
+                int cls = sz > 0 ? (int)((sz - 1) / SLAB_GRANULARITY) : 0;
+                auto& list = cache->lists[cls];
+                if (list.count == 0)
+                    refill(cache, cls);
+
+                hdr = (slab_header*)list.pop();
+                hdr->size_class = (uint32_t)cls;
+            }
+
+            hdr->magic = SLAB_MAGIC;
+            return (char*)hdr + SLAB_HEADER_SIZE;
+        }
+
+        void* slab_memory_provider::reallocate(void* ptr, size_t sz)
+        {
+            if (ptr == nullptr)
+                return allocate(sz);
+
+            slab_header* hdr = (slab_header*)((char*)ptr - SLAB_HEADER_SIZE);
+            dassert(hdr->magic == SLAB_MAGIC, "invalid object %p for slab memory provider", ptr);
+
+            // size of large objects is not recorded, so leave it to realloc
+            if (hdr->size_class == SLAB_LARGE_CLASS)
+            {
+                hdr = (slab_header*)::realloc(hdr, SLAB_HEADER_SIZE + sz);
+                dassert(hdr, "realloc %d bytes failed", (int)(SLAB_HEADER_SIZE + sz));
+                return (char*)hdr + SLAB_HEADER_SIZE;
+            }
+
+            size_t old_sz = class_bytes(hdr->size_class) - SLAB_HEADER_SIZE;
+            if (sz <= old_sz)
+                return ptr;
+
+            void* nptr = allocate(sz);
+            memcpy(nptr, ptr, old_sz);
+            deallocate(ptr);
+            return nptr;
+        }
+
+        void slab_memory_provider::deallocate(void* ptr)
+        {
+            if (ptr == nullptr)
+                return;
+
+            slab_header* hdr = (slab_header*)((char*)ptr - SLAB_HEADER_SIZE);
+            dassert(hdr->magic == SLAB_MAGIC, "invalid object %p for slab memory provider", ptr);
+            hdr->magic = 0;
+
+            slab_thread_cache* cache = get_thread_cache();
+            inc(cache->free_count);
+
+            if (hdr->size_class == SLAB_LARGE_CLASS)
+            {
+                ::free(hdr);
+                return;
+            }
+
+            int cls = (int)hdr->size_class;
+            auto& list = cache->lists[cls];
+            list.push(hdr);
+            if (list.count >= 2 * SLAB_BATCH_COUNT)
+                overflow(cache, cls);
+        }
+
+        void slab_memory_provider::get_stats(/*out*/ stats& s)
+        {
+            memset(&s, 0, sizeof(s));
+
+            utils::auto_lock<utils::ex_lock_nr_spin> l(s_caches_lock);
+            for (auto& c : s_caches)
+            {
+                s.alloc_count += c->alloc_count.load(std::memory_order_relaxed);
+                s.free_count += c->free_count.load(std::memory_order_relaxed);
+                s.malloc_count += c->malloc_count.load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
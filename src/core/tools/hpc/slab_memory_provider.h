@@ -0,0 +1,76 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     slab based memory provider with per-thread caches for the small and
+ *     hot objects (e.g., tasks and messages)
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# pragma once
+
+# include <dsn/tool_api.h>
+
+namespace dsn
+{
+    namespace tools
+    {
+        //
+        // objects no larger than 1KB are served from per-thread free lists of
+        // 16-byte size classes, which are refilled from (and overflowed to) the
+        // per-class central lists in batches, and the central lists carve new
+        // 64KB slabs from malloc when they are empty; larger objects go to
+        // malloc directly
+        //
+        // objects may be freed on any thread, and slabs are never returned
+        // to the system
+        //
+        class slab_memory_provider : public memory_provider
+        {
+        public:
+            struct stats
+            {
+                uint64_t alloc_count;  // allocate calls
+                uint64_t free_count;   // deallocate calls
+                uint64_t malloc_count; // system mallocs for slabs and large objects
+            };
+
+        public:
+            slab_memory_provider();
+
+            virtual void* allocate(size_t sz) override;
+            virtual void* reallocate(void* ptr, size_t sz) override;
+            virtual void  deallocate(void* ptr) override;
+
+            // accumulated stats of all threads
+            static void get_stats(/*out*/ stats& s);
+        };
+    }
+}
@@ -0,0 +1,176 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "timer_wheel.h"
+
+namespace dsn
+{
+    namespace tools
+    {
+        uint32_t timer_wheel::s_expire_ext = task::register_extension();
+
+        timer_wheel::timer_wheel()
+        {
+            _current_ms = 0;
+            _count = 0;
+        }
+
+        void timer_wheel::append(slist<task>& to, slist<task>& from)
+        {
+            if (from._first == nullptr)
+                return;
+
+            if (to._last)
+                to._last->next = from._first;
+            else
+                to._first = from._first;
+            to._last = from._last;
+
+            from._first = from._last = nullptr;
+        }
+
+        void timer_wheel::add(task* timer, uint64_t expire_ms, uint64_t now_ms)
+        {
+            if (_count == 0 && _current_ms < now_ms)
+                _current_ms = now_ms;
+
+            timer->next = nullptr;
+            timer->set_extension(s_expire_ext, expire_ms);
+            add_internal(timer, expire_ms);
+            _count++;
+        }
+
+        void timer_wheel::add_internal(task* timer, uint64_t expire_ms)
+        {
+            // already expired timers go to the slot processed by next advance
+            if (expire_ms < _current_ms)
+                expire_ms = _current_ms;
+
+            uint64_t delta = expire_ms - _current_ms;
+            if (delta < L0_SIZE)
+            {
+                _l0[expire_ms & (L0_SIZE - 1)].add(timer);
+                return;
+            }
+
+            // beyond the horizon, park it in the last level and re-schedule
+            // it with its real expiration time when it is cascaded
+            const int max_bits = L0_BITS + LN_BITS * (LEVEL_COUNT - 1);
+            if (delta >= (1ULL << max_bits))
+                expire_ms = _current_ms + (1ULL << max_bits) - 1;
+
+            for (int i = 0; i < LEVEL_COUNT - 1; i++)
+            {
+                int shift = L0_BITS + LN_BITS * i;
+                if (delta < (1ULL << (shift + LN_BITS)) || i == LEVEL_COUNT - 2)
+                {
+                    _ln[i][(expire_ms >> shift) & (LN_SIZE - 1)].add(timer);
+                    return;
+                }
+            }
+        }
+
+        void timer_wheel::cascade(int level, /*out*/ slist<task>& expired)
+        {
+            int shift = L0_BITS + LN_BITS * level;
+            auto& slot = _ln[level][(_current_ms >> shift) & (LN_SIZE - 1)];
+            task* t = slot.pop_all(), *next;
+            while (t)
+            {
+                next = t->next;
+                t->next = nullptr;
+
+                // cancelled timers are released as early as possible
+                if (t->state() == TASK_STATE_CANCELLED)
+                {
+                    expired.add(t);
+                    _count--;
+                }
+                else
+                {
+                    add_internal(t, t->get_extension(s_expire_ext));
+                }
+                t = next;
+            }
+        }
+
+        void timer_wheel::advance(uint64_t now_ms, /*out*/ slist<task>& expired)
+        {
+            while (_count > 0 && _current_ms <= now_ms)
+            {
+                uint32_t index = (uint32_t)(_current_ms & (L0_SIZE - 1));
+
+                // cascade the higher levels when the lower one wraps around
+                for (int i = 0; index == 0 && i < LEVEL_COUNT - 1; i++)
+                {
+                    cascade(i, expired);
+                    if (((_current_ms >> (L0_BITS + LN_BITS * i)) & (LN_SIZE - 1)) != 0)
+                        break;
+                }
+
+                auto& slot = _l0[index];
+                for (task* t = slot._first; t; t = t->next)
+                {
+                    _count--;
+                }
+                append(expired, slot);
+
+                _current_ms++;
+            }
+
+            // nothing left, simply catch up with the clock
+            if (_count == 0 && _current_ms <= now_ms)
+                _current_ms = now_ms + 1;
+        }
+
+        uint64_t timer_wheel::next_check_ms() const
+        {
+            if (_count == 0)
+                return 0;
+
+            for (uint64_t ts = _current_ms; ts < _current_ms + L0_SIZE; ts++)
+            {
+                // higher levels must be cascaded at the round boundary
+                if ((ts & (L0_SIZE - 1)) == 0)
+                    return ts;
+
+                if (_l0[ts & (L0_SIZE - 1)]._first)
+                    return ts;
+            }
+
+            return _current_ms + L0_SIZE;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     hierarchical timing wheel for the timer tasks in io looper, with
+ *     O(1) insertion and lazy (state based) cancellation
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <dsn/tool_api.h>
+
+namespace dsn
+{
+    namespace tools
+    {
+        //
+        // 1ms per tick, 256 slots in the first level and 64 slots in each of
+        // the other three levels, i.e., 2^26 ms (~18.6 hours) in total, and
+        // timers beyond that are re-scheduled when they are cascaded down
+        //
+        // the expiration time of each timer is kept in a task extension slot,
+        // cancelled timers are not unlinked but returned as soon as they are
+        // met during cascading, and task::exec_internal simply releases them
+        //
+        // not thread safe
+        //
+        class timer_wheel
+        {
+        public:
+            timer_wheel();
+
+            void add(task* timer, uint64_t expire_ms, uint64_t now_ms);
+
+            // append expired (or cancelled) timers to the list
+            void advance(uint64_t now_ms, /*out*/ slist<task>& expired);
+
+            // earliest time (ms) when advance should be called again, 0 for no timers;
+            // it is exact for timers in the first level, while for the others it is
+            // the next first level round (<= 256ms) when they are cascaded
+            uint64_t next_check_ms() const;
+
+            int count() const { return _count; }
+
+        private:
+            void add_internal(task* timer, uint64_t expire_ms);
+            void cascade(int level, /*out*/ slist<task>& expired);
+            static void append(slist<task>& to, slist<task>& from);
+
+        private:
+            enum
+            {
+                L0_BITS = 8,
+                LN_BITS = 6,
+                L0_SIZE = 1 << L0_BITS,
+                LN_SIZE = 1 << LN_BITS,
+                LEVEL_COUNT = 4
+            };
+
+            uint64_t    _current_ms; // next tick to be processed
+            int         _count;
+            slist<task> _l0[L0_SIZE];
+            slist<task> _ln[LEVEL_COUNT - 1][LN_SIZE];
+
+            static uint32_t s_expire_ext;
+        };
+    }
+}
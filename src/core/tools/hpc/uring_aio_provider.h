@@ -0,0 +1,90 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     disk aio provider using io_uring, where the reads/writes are submitted
+ *     in batches and reaped in bulk from the completion ring in io looper
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <dsn/tool_api.h>
+# include <dsn/internal/synchronize.h>
+# include "io_uring_queue.h"
+
+# ifdef __linux__
+
+# include <unordered_map>
+
+namespace dsn {
+    namespace tools {
+
+        struct uring_disk_aio_context;
+
+        class uring_aio_provider : public aio_provider
+        {
+        public:
+            uring_aio_provider(disk_engine* disk, aio_provider* inner_provider);
+            ~uring_aio_provider();
+
+            virtual dsn_handle_t open(const char* file_name, int flag, int pmode) override;
+            virtual error_code   close(dsn_handle_t fh) override;
+            virtual void         aio(aio_task* aio) override;
+            virtual disk_aio*    prepare_aio_context(aio_task* tsk) override;
+            virtual char*        prepare_write_buffer(disk_aio* aio, uint32_t size) override;
+
+            virtual void start(io_modifer& ctx) override;
+
+        protected:
+            error_code aio_internal(aio_task* aio, bool async, /*out*/ uint32_t* pbytes = nullptr);
+
+        private:
+            friend struct uring_disk_aio_context;
+            void complete_aio(uring_disk_aio_context* aio, int res);
+            int  get_file_slot(int fd);
+
+        private:
+            io_looper      *_looper;
+            io_uring_queue _ring;
+
+            // fd -> slot in the registered file table
+            ::dsn::utils::ex_lock_nr_spin _files_lock;
+            std::unordered_map<int, int>  _file_slots;
+
+            // registered buffers for the merged batch writes (e.g., mutation log appends)
+            ::dsn::utils::ex_lock_nr_spin _buffers_lock;
+            char                          *_fixed_buffers;
+            uint32_t                      _fixed_buffer_size;
+            std::vector<int>              _free_fixed_buffers;
+        };
+    }
+}
+
+# endif
@@ -0,0 +1,329 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+
+# ifdef __linux__
+
+# include "uring_aio_provider.h"
+# include "mix_all_io_looper.h"
+# include <fcntl.h>
+# include <sys/types.h>
+# include <sys/stat.h>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "aio.provider.uring"
+
+namespace dsn { namespace tools {
+
+struct uring_disk_aio_context : public disk_aio
+{
+    io_uring_op op;
+    aio_task* tsk;
+    uring_aio_provider* this_;
+    utils::notify_event* evt;
+    error_code err;
+    uint32_t bytes;
+    int fixed_buffer; // index of the registered buffer, or -1
+};
+
+uring_aio_provider::uring_aio_provider(disk_engine* disk, aio_provider* inner_provider)
+    : aio_provider(disk, inner_provider)
+{
+    _looper = nullptr;
+    _fixed_buffers = nullptr;
+    _fixed_buffer_size = 0;
+}
+
+uring_aio_provider::~uring_aio_provider()
+{
+    _ring.stop();
+
+    if (_fixed_buffers)
+    {
+        free(_fixed_buffers);
+        _fixed_buffers = nullptr;
+    }
+}
+
+void uring_aio_provider::start(io_modifer& ctx)
+{
+    static int entries = (int)dsn_config_get_value_uint64("core", "io_uring_aio_entries", 1024,
+        "sqe count for each io_uring aio provider");
+    static int file_count = (int)dsn_config_get_value_uint64("core", "io_uring_aio_registered_files", 256,
+        "size of the registered file table of each io_uring aio provider, 0 for disabling it");
+    static int buffer_count = (int)dsn_config_get_value_uint64("core", "io_uring_aio_fixed_buffer_count", 16,
+        "count of the registered buffers for the batched writes of each io_uring aio provider, "
+        "0 for using the transient memory instead");
+    static int buffer_size = (int)dsn_config_get_value_uint64("core", "io_uring_aio_fixed_buffer_size", 1024 * 1024,
+        "byte size of each registered buffer for the batched writes, "
+        "batches larger than this use the transient memory instead");
+
+    _looper = get_io_looper(node(), ctx.queue, ctx.mode);
+
+    auto err = _ring.start(_looper, (unsigned int)entries);
+    dassert(err == ERR_OK, "io_uring is not supported on this kernel, "
+        "please use dsn::tools::hpc_aio_provider instead");
+
+    if (file_count > 0 && !_ring.register_files(file_count))
+    {
+        dwarn("registered files are not supported, use the plain fds instead");
+    }
+
+    if (buffer_count > 0)
+    {
+        void* ptr = nullptr;
+        dassert(posix_memalign(&ptr, 4096, (size_t)buffer_count * (size_t)buffer_size) == 0,
+            "allocate %d fixed buffers with %d bytes each failed", buffer_count, buffer_size);
+
+        std::vector<struct iovec> iovs(buffer_count);
+        for (int i = 0; i < buffer_count; i++)
+        {
+            iovs[i].iov_base = (char*)ptr + (size_t)i * (size_t)buffer_size;
+            iovs[i].iov_len = (size_t)buffer_size;
+        }
+
+        if (_ring.register_buffers(&iovs[0], buffer_count))
+        {
+            _fixed_buffers = (char*)ptr;
+            _fixed_buffer_size = (uint32_t)buffer_size;
+            for (int i = buffer_count - 1; i >= 0; i--)
+            {
+                _free_fixed_buffers.push_back(i);
+            }
+        }
+        else
+        {
+            dwarn("fixed buffers are not supported (possibly limited by RLIMIT_MEMLOCK), "
+                "use the transient memory for batched writes instead");
+            free(ptr);
+        }
+    }
+}
+
+dsn_handle_t uring_aio_provider::open(const char* file_name, int oflag, int pmode)
+{
+    int fd = ::open(file_name, oflag, pmode);
+    if (fd >= 0)
+    {
+        int slot = _ring.register_file(fd);
+        if (slot >= 0)
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+            _file_slots[fd] = slot;
+        }
+    }
+    return (dsn_handle_t)(uintptr_t)fd;
+}
+
+error_code uring_aio_provider::close(dsn_handle_t fh)
+{
+    int fd = (int)(uintptr_t)(fh);
+    int slot = -1;
+    {
+        utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+        auto it = _file_slots.find(fd);
+        if (it != _file_slots.end())
+        {
+            slot = it->second;
+            _file_slots.erase(it);
+        }
+    }
+
+    if (slot >= 0)
+    {
+        _ring.unregister_file(slot);
+    }
+
+    if (::close(fd) == 0)
+    {
+        return ERR_OK;
+    }
+    else
+    {
+        derror("close file failed, err = %s\n", strerror(errno));
+        return ERR_FILE_OPERATION_FAILED;
+    }
+}
+
+int uring_aio_provider::get_file_slot(int fd)
+{
+    utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_files_lock);
+    auto it = _file_slots.find(fd);
+    return it != _file_slots.end() ? it->second : -1;
+}
+
+disk_aio* uring_aio_provider::prepare_aio_context(aio_task* tsk)
+{
+    auto r = new uring_disk_aio_context;
+    r->tsk = tsk;
+    r->this_ = this;
+    r->evt = nullptr;
+    r->bytes = 0;
+    r->fixed_buffer = -1;
+    r->op.callback = [r](int res, uint32_t flags)
+    {
+        r->this_->complete_aio(r, res);
+    };
+    r->op.context = nullptr; // tsk is pinned by disk engine until completion
+    return r;
+}
+
+char* uring_aio_provider::prepare_write_buffer(disk_aio* aio, uint32_t size)
+{
+    if (size > _fixed_buffer_size)
+        return nullptr;
+
+    int index;
+    {
+        utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_buffers_lock);
+        if (_free_fixed_buffers.empty())
+            return nullptr;
+
+        index = _free_fixed_buffers.back();
+        _free_fixed_buffers.pop_back();
+    }
+
+    auto ctx = (uring_disk_aio_context*)aio;
+    ctx->fixed_buffer = index;
+    return _fixed_buffers + (size_t)index * (size_t)_fixed_buffer_size;
+}
+
+void uring_aio_provider::aio(aio_task* aio_tsk)
+{
+    auto err = aio_internal(aio_tsk, true);
+    err.end_tracking();
+}
+
+error_code uring_aio_provider::aio_internal(aio_task* aio_tsk, bool async, /*out*/ uint32_t* pbytes /*= nullptr*/)
+{
+    auto aio = (uring_disk_aio_context*)aio_tsk->aio();
+    int fd = static_cast<int>((ssize_t)aio->file);
+    int slot = get_file_slot(fd);
+
+    uint8_t opcode;
+    switch (aio->type)
+    {
+    case AIO_Read:
+        opcode = IORING_OP_READ;
+        break;
+    case AIO_Write:
+        opcode = aio->fixed_buffer >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        break;
+    default:
+        derror("unknown aio type %u", static_cast<int>(aio->type));
+        if (async)
+        {
+            complete_io(aio_tsk, ERR_FILE_OPERATION_FAILED, 0);
+        }
+        return ERR_FILE_OPERATION_FAILED;
+    }
+
+    if (!async)
+    {
+        aio->evt = new utils::notify_event();
+        aio->err = ERR_OK;
+        aio->bytes = 0;
+    }
+
+    // submitted together with the others when we are in the completion
+    // callbacks (e.g., the next batched write issued by disk engine), or
+    // immediately otherwise
+    _ring.submit(&aio->op, [=](struct io_uring_sqe* sqe)
+    {
+        sqe->opcode = opcode;
+        sqe->fd = slot >= 0 ? slot : fd;
+        sqe->flags = slot >= 0 ? IOSQE_FIXED_FILE : 0;
+        sqe->addr = (uint64_t)(uintptr_t)aio->buffer;
+        sqe->len = aio->buffer_size;
+        sqe->off = aio->file_offset;
+        if (opcode == IORING_OP_WRITE_FIXED)
+            sqe->buf_index = (uint16_t)aio->fixed_buffer;
+    });
+
+    if (async)
+    {
+        return ERR_IO_PENDING;
+    }
+    else
+    {
+        aio->evt->wait();
+        delete aio->evt;
+        aio->evt = nullptr;
+        if (pbytes != nullptr)
+        {
+            *pbytes = aio->bytes;
+        }
+        return aio->err;
+    }
+}
+
+void uring_aio_provider::complete_aio(uring_disk_aio_context* aio, int res)
+{
+    if (aio->fixed_buffer >= 0)
+    {
+        utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_buffers_lock);
+        _free_fixed_buffers.push_back(aio->fixed_buffer);
+        aio->fixed_buffer = -1;
+    }
+
+    error_code ec;
+    uint32_t bytes = 0;
+    if (res < 0)
+    {
+        derror("aio error, err = %s", strerror(-res));
+        ec = ERR_FILE_OPERATION_FAILED;
+    }
+    else
+    {
+        bytes = (uint32_t)res;
+        ec = bytes > 0 ? ERR_OK : ERR_HANDLE_EOF;
+    }
+
+    if (!aio->evt)
+    {
+        complete_io(aio->tsk, ec, bytes);
+    }
+    else
+    {
+        aio->err = ec;
+        aio->bytes = bytes;
+        aio->evt->notify();
+    }
+}
+
+}} // end namespace dsn::tools
+#endif
@@ -0,0 +1,132 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     network provider using io_uring, where accept/recv/sendmsg are
+ *     submitted as batched sqes instead of one syscall per ready event
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include "hpc_network_provider.h"
+# include "io_uring_queue.h"
+
+# ifdef __linux__
+
+namespace dsn {
+    namespace tools {
+
+        extern socket_t create_tcp_socket(sockaddr_in* addr);
+
+        class uring_network_provider : public connection_oriented_network
+        {
+        public:
+            uring_network_provider(rpc_engine* srv, network* inner_provider);
+
+            virtual error_code start(rpc_channel channel, int port, bool client_only, io_modifer& ctx) override;
+            virtual ::dsn::rpc_address address() override { return _address; }
+            virtual rpc_session_ptr create_client_session(::dsn::rpc_address server_addr) override;
+
+            io_uring_queue* ring() { return &_ring; }
+
+        private:
+            void do_accept();
+            void on_accept_completed(int res);
+
+        private:
+            socket_t           _listen_fd;
+            ::dsn::rpc_address _address;
+            io_looper          *_looper;
+            io_uring_queue     _ring;
+
+            io_uring_op        _accept_op;
+            struct sockaddr_in _accept_addr;
+            socklen_t          _accept_addr_len;
+        };
+
+        class uring_rpc_session : public rpc_session
+        {
+        public:
+            uring_rpc_session(
+                socket_t sock,
+                std::shared_ptr<dsn::message_parser>& parser,
+                uring_network_provider& net,
+                ::dsn::rpc_address remote_addr,
+                bool is_client
+                );
+            virtual ~uring_rpc_session();
+
+            virtual void connect() override;
+            virtual void send(uint64_t signature) override;
+
+            void start_read();
+
+        private:
+            void do_read(bool use_provided_buffers);
+            void do_write();
+            void on_read_completed(int res, uint32_t flags);
+            bool on_read_parsed(int read_length); // false when the data is malformed
+            void on_write_completed(int res);
+            void on_connect_completed(int res);
+            void on_failure();
+            void close();
+
+            void on_message_read(message_ex* msg)
+            {
+                if (is_client())
+                    on_recv_reply(msg->header->id, msg, 0);
+                else
+                    on_recv_request(msg, 0);
+            }
+
+        private:
+            socket_t                _socket;
+            io_uring_queue          *_ring;
+            std::atomic<bool>       _is_failed;
+
+            // recv, at most one in flight
+            io_uring_op             _read_op;
+            int                     _read_next;
+            bool                    _use_provided_buffers;
+
+            // send, at most one in flight as guaranteed by rpc_session
+            io_uring_op             _write_op;
+            struct msghdr           _write_hdr;
+            uint64_t                _sending_signature;
+            int                     _sending_buffer_start_index;
+
+            // connect, client only
+            io_uring_op             _connect_op;
+            struct sockaddr_in      _connect_addr;
+        };
+    }
+}
+
+# endif
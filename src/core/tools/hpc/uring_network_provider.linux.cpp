@@ -0,0 +1,495 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+
+# ifdef __linux__
+
+# include "uring_network_provider.h"
+# include "mix_all_io_looper.h"
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "network.provider.uring"
+
+
+namespace dsn
+{
+    namespace tools
+    {
+        // io_uring never blocks the submitter, and it works better with
+        // blocking sockets as it then arms the internal poll directly
+        static void set_blocking(socket_t s)
+        {
+            int flags = fcntl(s, F_GETFL, 0);
+            dassert(flags != -1, "fcntl failed, err = %s, fd = %d", strerror(errno), s);
+
+            if (flags & O_NONBLOCK)
+            {
+                flags &= ~O_NONBLOCK;
+                flags = fcntl(s, F_SETFL, flags);
+                dassert(flags != -1, "fcntl failed, err = %s, fd = %d", strerror(errno), s);
+            }
+        }
+
+        uring_network_provider::uring_network_provider(rpc_engine* srv, network* inner_provider)
+            : connection_oriented_network(srv, inner_provider)
+        {
+            _listen_fd = -1;
+            _looper = nullptr;
+            _max_buffer_block_count_per_send = 128;
+            _accept_addr_len = 0;
+        }
+
+        error_code uring_network_provider::start(rpc_channel channel, int port, bool client_only, io_modifer& ctx)
+        {
+            if (_listen_fd != -1)
+                return ERR_SERVICE_ALREADY_RUNNING;
+
+            _looper = get_io_looper(node(), ctx.queue, ctx.mode);
+
+            dassert(channel == RPC_CHANNEL_TCP || channel == RPC_CHANNEL_UDP,
+                "invalid given channel %s", channel.to_string());
+
+            static int entries = (int)dsn_config_get_value_uint64("network", "io_uring_entries", 4096,
+                "sqe count for each io_uring network provider");
+            static int buffer_count = (int)dsn_config_get_value_uint64("network", "io_uring_provided_buffer_count", 1024,
+                "count of the buffers provided to each io_uring network provider for recv, "
+                "must be power of 2, and 0 for recving into the message parser directly");
+            static int buffer_size = (int)dsn_config_get_value_uint64("network", "io_uring_provided_buffer_size", 16384,
+                "byte size of each buffer provided to the io_uring network provider for recv");
+
+            auto err = _ring.start(_looper, (unsigned int)entries);
+            dassert(err == ERR_OK, "io_uring is not supported on this kernel, "
+                "please use dsn::tools::hpc_network_provider instead");
+
+            if (buffer_count > 0 && !_ring.provide_buffers(buffer_count, buffer_size))
+            {
+                dwarn("provided buffer ring is not supported, recv into message parser directly instead");
+            }
+
+            _address.assign_ipv4(get_local_ipv4(), port);
+
+            if (!client_only)
+            {
+                struct sockaddr_in addr;
+                addr.sin_family = AF_INET;
+                addr.sin_addr.s_addr = INADDR_ANY;
+                addr.sin_port = htons(port);
+
+                _listen_fd = create_tcp_socket(&addr);
+                if (_listen_fd == -1)
+                {
+                    dassert(false, "cannot create listen socket");
+                }
+
+                int forcereuse = 1;
+                if (setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR,
+                    (char*)&forcereuse, sizeof(forcereuse)) != 0)
+                {
+                    dwarn("setsockopt SO_REUSEDADDR failed, err = %s", strerror(errno));
+                }
+
+                if (listen(_listen_fd, SOMAXCONN) != 0)
+                {
+                    dwarn("listen failed, err = %s", strerror(errno));
+                    return ERR_NETWORK_START_FAILED;
+                }
+
+                set_blocking(_listen_fd);
+
+                _accept_op.callback = [this](int res, uint32_t flags)
+                {
+                    this->on_accept_completed(res);
+                };
+                _accept_op.context = nullptr; // network_provider is a global object
+
+                do_accept();
+            }
+
+            return ERR_OK;
+        }
+
+        rpc_session_ptr uring_network_provider::create_client_session(::dsn::rpc_address server_addr)
+        {
+            auto parser = new_message_parser();
+
+            struct sockaddr_in addr;
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = INADDR_ANY;
+            addr.sin_port = 0;
+
+            auto sock = create_tcp_socket(&addr);
+            dassert(sock != -1, "create client tcp socket failed!");
+            set_blocking(sock);
+
+            auto client = new uring_rpc_session(sock, parser, *this, server_addr, true);
+            rpc_session_ptr c(client);
+            return c;
+        }
+
+        void uring_network_provider::do_accept()
+        {
+            _accept_addr_len = (socklen_t)sizeof(_accept_addr);
+            _ring.submit(&_accept_op, [this](struct io_uring_sqe* sqe)
+            {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->fd = _listen_fd;
+                sqe->addr = (uint64_t)(uintptr_t)&_accept_addr;
+                sqe->addr2 = (uint64_t)(uintptr_t)&_accept_addr_len;
+            });
+        }
+
+        void uring_network_provider::on_accept_completed(int res)
+        {
+            if (res >= 0)
+            {
+                socket_t s = res;
+                ::dsn::rpc_address client_addr(ntohl(_accept_addr.sin_addr.s_addr), ntohs(_accept_addr.sin_port));
+
+                auto parser = new_message_parser();
+                auto rs = new uring_rpc_session(s, parser, *this, client_addr, false);
+                rpc_session_ptr s1(rs);
+
+                this->on_server_session_accepted(s1);
+                rs->start_read();
+            }
+            else if (res != -EINTR && res != -EAGAIN)
+            {
+                derror("accept failed, err = %s", strerror(-res));
+            }
+
+            do_accept();
+        }
+
+        uring_rpc_session::uring_rpc_session(
+            socket_t sock,
+            std::shared_ptr<dsn::message_parser>& parser,
+            uring_network_provider& net,
+            ::dsn::rpc_address remote_addr,
+            bool is_client
+            )
+            : rpc_session(net, remote_addr, parser, is_client),
+            _socket(sock), _ring(net.ring()), _is_failed(false)
+        {
+            dassert(sock != -1, "invalid given socket handle");
+
+            _read_next = 256;
+            _use_provided_buffers = _ring->has_provided_buffers();
+            _sending_signature = 0;
+            _sending_buffer_start_index = 0;
+            memset((void*)&_write_hdr, 0, sizeof(_write_hdr));
+            memset((void*)&_connect_addr, 0, sizeof(_connect_addr));
+
+            _read_op.callback = [this](int res, uint32_t flags)
+            {
+                this->on_read_completed(res, flags);
+            };
+            _read_op.context = this;
+
+            _write_op.callback = [this](int res, uint32_t flags)
+            {
+                this->on_write_completed(res);
+            };
+            _write_op.context = this;
+
+            _connect_op.callback = [this](int res, uint32_t flags)
+            {
+                this->on_connect_completed(res);
+            };
+            _connect_op.context = this;
+        }
+
+        uring_rpc_session::~uring_rpc_session()
+        {
+            close();
+        }
+
+        void uring_rpc_session::start_read()
+        {
+            do_read(_use_provided_buffers);
+        }
+
+        void uring_rpc_session::do_read(bool use_provided_buffers)
+        {
+            if (use_provided_buffers)
+            {
+                _ring->submit(&_read_op, [this](struct io_uring_sqe* sqe)
+                {
+                    sqe->opcode = IORING_OP_RECV;
+                    sqe->fd = _socket;
+                    sqe->flags = IOSQE_BUFFER_SELECT;
+                    sqe->buf_group = _ring->buffer_group();
+                    sqe->len = (uint32_t)_ring->buffer_size();
+                });
+            }
+            else
+            {
+                char* ptr = (char*)_parser->read_buffer_ptr(_read_next);
+                int remaining = _parser->read_buffer_capacity();
+
+                _ring->submit(&_read_op, [this, ptr, remaining](struct io_uring_sqe* sqe)
+                {
+                    sqe->opcode = IORING_OP_RECV;
+                    sqe->fd = _socket;
+                    sqe->addr = (uint64_t)(uintptr_t)ptr;
+                    sqe->len = (uint32_t)remaining;
+                });
+            }
+        }
+
+        bool uring_rpc_session::on_read_parsed(int read_length)
+        {
+            message_ex* msg = _parser->get_message_on_receive(read_length, _read_next);
+            while (msg != nullptr)
+            {
+                this->on_message_read(msg);
+                msg = _parser->get_message_on_receive(0, _read_next);
+            }
+
+            if (_read_next < 0)
+            {
+                derror("(s = %d) malformed message received from %s", _socket, _remote_addr.to_string());
+                return false;
+            }
+            return true;
+        }
+
+        void uring_rpc_session::on_read_completed(int res, uint32_t flags)
+        {
+            dinfo("(s = %d) recv on %s completed, return %d", _socket, _remote_addr.to_string(), res);
+
+            if (res > 0)
+            {
+                // feed the provided buffer into the message parser, piece by piece
+                // as the parser may only accept the remaining of the current message
+                bool parsed = true;
+                if (flags & IORING_CQE_F_BUFFER)
+                {
+                    int bid = (int)(flags >> IORING_CQE_BUFFER_SHIFT);
+                    const char* data = _ring->buffer_data(bid);
+                    int left = res;
+                    while (left > 0 && parsed)
+                    {
+                        char* ptr = (char*)_parser->read_buffer_ptr(_read_next);
+                        int sz = std::min(left, _parser->read_buffer_capacity());
+                        memcpy(ptr, data, sz);
+                        data += sz;
+                        left -= sz;
+                        parsed = on_read_parsed(sz);
+                    }
+                    _ring->recycle_buffer(bid);
+                }
+                else
+                {
+                    parsed = on_read_parsed(res);
+                }
+
+                if (parsed)
+                    do_read(_use_provided_buffers);
+                else
+                    on_failure();
+            }
+            else if (res == -ENOBUFS)
+            {
+                // provided buffers are used up, recv into the parser for this round
+                do_read(false);
+            }
+            else if (res == -EINTR || res == -EAGAIN)
+            {
+                do_read(_use_provided_buffers);
+            }
+            else
+            {
+                if (res < 0)
+                {
+                    derror("(s = %d) recv failed, err = %s", _socket, strerror(-res));
+                }
+                on_failure();
+            }
+        }
+
+        void uring_rpc_session::send(uint64_t sig)
+        {
+            dbg_dassert(sig != 0, "cannot send empty msg");
+            dassert(_sending_signature == 0, "only one sending msg is possible");
+
+            _sending_signature = sig;
+            _sending_buffer_start_index = 0;
+            do_write();
+        }
+
+        void uring_rpc_session::do_write()
+        {
+            static_assert (sizeof(dsn_message_parser::send_buf) == sizeof(struct iovec),
+                "make sure they are compatible");
+
+            memset((void*)&_write_hdr, 0, sizeof(_write_hdr));
+            _write_hdr.msg_iov = (struct iovec*)&_sending_buffers[_sending_buffer_start_index];
+            _write_hdr.msg_iovlen = (size_t)((int)_sending_buffers.size() - _sending_buffer_start_index);
+
+            _ring->submit(&_write_op, [this](struct io_uring_sqe* sqe)
+            {
+                sqe->opcode = IORING_OP_SENDMSG;
+                sqe->fd = _socket;
+                sqe->addr = (uint64_t)(uintptr_t)&_write_hdr;
+                sqe->len = 1;
+                sqe->msg_flags = MSG_NOSIGNAL;
+            });
+        }
+
+        void uring_rpc_session::on_write_completed(int res)
+        {
+            dinfo("(s = %d) sendmsg on %s completed, return %d", _socket, _remote_addr.to_string(), res);
+
+            if (res < 0)
+            {
+                if (res == -EINTR || res == -EAGAIN)
+                {
+                    do_write();
+                }
+                else
+                {
+                    derror("(s = %d) sendmsg failed, err = %s", _socket, strerror(-res));
+                    on_failure();
+                }
+                return;
+            }
+
+            int len = res;
+            int buf_i = _sending_buffer_start_index;
+            while (len > 0)
+            {
+                auto& buf = _sending_buffers[buf_i];
+                if (len >= (int)buf.sz)
+                {
+                    buf_i++;
+                    len -= (int)buf.sz;
+                }
+                else
+                {
+                    buf.buf = (char*)buf.buf + len;
+                    buf.sz -= len;
+                    break;
+                }
+            }
+            _sending_buffer_start_index = buf_i;
+
+            // message completed, continue next message
+            if (_sending_buffer_start_index == (int)_sending_buffers.size())
+            {
+                dassert(len == 0, "buffer must be sent completely");
+
+                auto csig = _sending_signature;
+                _sending_signature = 0;
+                on_send_completed(csig);
+            }
+
+            // continue sending current msg
+            else
+            {
+                do_write();
+            }
+        }
+
+        void uring_rpc_session::connect()
+        {
+            if (!try_connecting())
+                return;
+
+            dassert(_socket != -1, "invalid given socket handle");
+            _is_failed = false;
+
+            _connect_addr.sin_family = AF_INET;
+            _connect_addr.sin_addr.s_addr = htonl(_remote_addr.ip());
+            _connect_addr.sin_port = htons(_remote_addr.port());
+
+            _ring->submit(&_connect_op, [this](struct io_uring_sqe* sqe)
+            {
+                sqe->opcode = IORING_OP_CONNECT;
+                sqe->fd = _socket;
+                sqe->addr = (uint64_t)(uintptr_t)&_connect_addr;
+                sqe->off = sizeof(_connect_addr);
+            });
+        }
+
+        void uring_rpc_session::on_connect_completed(int res)
+        {
+            dassert(is_connecting(), "session must be connecting at this time");
+
+            if (res == 0)
+            {
+                dinfo("(s = %d) client session %s connected",
+                    _socket,
+                    _remote_addr.to_string()
+                    );
+
+                set_connected();
+                start_read();
+
+                // start first round send
+                on_send_completed();
+            }
+            else
+            {
+                derror("(s = %d) connect failed, err = %s", _socket, strerror(-res));
+                on_failure();
+            }
+        }
+
+        void uring_rpc_session::on_failure()
+        {
+            // pending recv/send ops all fail after the socket is shutdown
+            if (_is_failed.exchange(true))
+                return;
+
+            if (on_disconnected())
+                close();
+        }
+
+        void uring_rpc_session::close()
+        {
+            if (-1 != _socket)
+            {
+                ::shutdown(_socket, SHUT_RDWR);
+                ::close(_socket);
+                dinfo("(s = %d) close socket %p", _socket, this);
+                _socket = -1;
+            }
+        }
+    }
+}
+
+# endif
@@ -0,0 +1,400 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     What is this file about?
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "work_stealing_task_queue.h"
+# include <map>
+# include <algorithm>
+
+# ifdef __TITLE__
+# undef __TITLE__
+# endif
+# define __TITLE__ "task.queue.stealing"
+
+namespace dsn 
+{
+    namespace tools 
+    {
+        // max stealable tasks run by the owner before it checks the ordered ones again
+        static const int stealable_batch_size = 16;
+
+        //------------------- work_stealing_deque -------------------------
+        work_stealing_deque::work_stealing_deque(int capacity)
+        {
+            dassert(capacity > 0 && (capacity & (capacity - 1)) == 0,
+                "deque capacity must be power of 2, now %d", capacity);
+
+            auto r = new ring;
+            r->mask = capacity - 1;
+            r->slots = new std::atomic<task*>[capacity];
+
+            _top.store(0);
+            _bottom.store(0);
+            _ring.store(r);
+        }
+
+        work_stealing_deque::~work_stealing_deque()
+        {
+            _retired.push_back(_ring.load());
+            for (auto& r : _retired)
+            {
+                delete[] r->slots;
+                delete r;
+            }
+            _retired.clear();
+        }
+
+        void work_stealing_deque::push(task* t)
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_push_lock);
+
+            int64_t b = _bottom.load(std::memory_order_relaxed);
+            int64_t top = _top.load(std::memory_order_acquire);
+            ring* r = _ring.load(std::memory_order_relaxed);
+            if (b - top > r->mask)
+            {
+                r = grow(r, top, b);
+            }
+
+            r->slots[b & r->mask].store(t, std::memory_order_relaxed);
+            _bottom.store(b + 1, std::memory_order_release);
+        }
+
+        task* work_stealing_deque::take()
+        {
+            while (true)
+            {
+                int64_t top = _top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                int64_t b = _bottom.load(std::memory_order_acquire);
+                if (top >= b)
+                    return nullptr;
+
+                ring* r = _ring.load(std::memory_order_acquire);
+                task* t = r->slots[top & r->mask].load(std::memory_order_relaxed);
+                if (_top.compare_exchange_weak(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    return t;
+                }
+            }
+        }
+
+        int work_stealing_deque::approx_size() const
+        {
+            int64_t b = _bottom.load(std::memory_order_acquire);
+            int64_t top = _top.load(std::memory_order_acquire);
+            return b > top ? static_cast<int>(b - top) : 0;
+        }
+
+        // push lock is hold
+        work_stealing_deque::ring* work_stealing_deque::grow(ring* r, int64_t top, int64_t bottom)
+        {
+            auto nr = new ring;
+            nr->mask = (r->mask + 1) * 2 - 1;
+            nr->slots = new std::atomic<task*>[nr->mask + 1];
+
+            for (int64_t i = top; i < bottom; i++)
+            {
+                nr->slots[i & nr->mask].store(
+                    r->slots[i & r->mask].load(std::memory_order_relaxed),
+                    std::memory_order_relaxed
+                    );
+            }
+
+            _retired.push_back(r);
+            _ring.store(nr, std::memory_order_release);
+            return nr;
+        }
+
+        //------------------- work_stealing_task_queue -------------------------
+        // queues of the same pool, as task_worker_pool is not exposed to tools;
+        // a pool is registered here only until all its queues know their siblings
+        struct pool_queues
+        {
+            std::vector<work_stealing_task_queue*> queues;
+            size_t                                 init_count;
+
+            pool_queues() : init_count(0) {}
+        };
+        static ::dsn::utils::ex_lock_nr_spin s_pool_queues_lock;
+        static std::map<task_worker_pool*, pool_queues> s_pool_queues;
+
+        work_stealing_task_queue::work_stealing_task_queue(task_worker_pool* pool, int index, task_queue* inner_provider)
+            : task_queue(pool, index, inner_provider)
+        {
+            _affine_count.store(0);
+            _sleeper_count.store(0);
+            _next_wakeup.store(0);
+            _siblings_ready = false;
+
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(s_pool_queues_lock);
+            s_pool_queues[pool].queues.push_back(this);
+        }
+
+        work_stealing_task_queue::~work_stealing_task_queue()
+        {
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(s_pool_queues_lock);
+            auto it = s_pool_queues.find(pool());
+            if (it != s_pool_queues.end())
+            {
+                auto& qs = it->second.queues;
+                qs.erase(std::remove(qs.begin(), qs.end(), this), qs.end());
+                if (qs.empty())
+                    s_pool_queues.erase(it);
+            }
+        }
+
+        void work_stealing_task_queue::enqueue(task* task)
+        {
+            dassert(task->next == nullptr, "task is not alone");
+
+            if (task->spec().allow_stealing)
+            {
+                _stealable.push(task);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                // wake up the owner, or an idle sibling to steal it when the owner is busy
+                if (!notify_if_sleeping() && !_siblings.empty())
+                {
+                    unsigned int n = static_cast<unsigned int>(_siblings.size());
+                    unsigned int start = _next_wakeup++;
+                    for (unsigned int i = 0; i < n; i++)
+                    {
+                        if (_siblings[(start + i) % n]->notify_if_sleeping())
+                            break;
+                    }
+                }
+            }
+            else
+            {
+                {
+                    utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_affine_lock);
+                    _affine_tasks.add(task);
+                    ++_affine_count;
+                }
+                notify_if_sleeping();
+            }
+        }
+
+        void work_stealing_task_queue::init_siblings()
+        {
+            // all queues of the pool are created before the workers, and the
+            // queue shared by several workers is initialized only once
+            if (_siblings_ready)
+                return;
+
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(s_pool_queues_lock);
+            auto it = s_pool_queues.find(pool());
+            dassert(it != s_pool_queues.end(), "queues of pool %p are not registered", pool());
+
+            _siblings.clear();
+            for (auto& q : it->second.queues)
+            {
+                if (q != this)
+                    _siblings.push_back(q);
+            }
+            _siblings_ready = true;
+
+            if (++it->second.init_count == it->second.queues.size())
+                s_pool_queues.erase(it);
+        }
+
+        task* work_stealing_task_queue::dequeue()
+        {
+            while (true)
+            {
+                task* first = dequeue_affine(), *last = first;
+                while (last && last->next)
+                {
+                    last = last->next;
+                }
+
+                for (int i = 0; i < stealable_batch_size; i++)
+                {
+                    task* t = _stealable.take();
+                    if (t == nullptr)
+                        break;
+
+                    if (last)
+                        last->next = t;
+                    else
+                        first = t;
+                    last = t;
+                }
+
+                if (first)
+                    return first;
+
+                wait_for_work(false);
+            }
+        }
+
+        task* work_stealing_task_queue::dequeue_affine()
+        {
+            if (_affine_count.load() == 0)
+                return nullptr;
+
+            utils::auto_lock<::dsn::utils::ex_lock_nr_spin> l(_affine_lock);
+            _affine_count.store(0);
+            return _affine_tasks.pop_all();
+        }
+
+        task* work_stealing_task_queue::steal(/*out*/ work_stealing_task_queue** victim)
+        {
+            // from the most loaded sibling
+            work_stealing_task_queue* target = nullptr;
+            int max_size = 0;
+            for (auto& q : _siblings)
+            {
+                int sz = q->_stealable.approx_size();
+                if (sz > max_size)
+                {
+                    max_size = sz;
+                    target = q;
+                }
+            }
+
+            if (target == nullptr)
+                return nullptr;
+
+            *victim = target;
+            return target->_stealable.take();
+        }
+
+        bool work_stealing_task_queue::has_work()
+        {
+            return _affine_count.load() > 0 || _stealable.approx_size() > 0;
+        }
+
+        void work_stealing_task_queue::wait_for_work(bool check_siblings)
+        {
+            std::unique_lock<std::mutex> l(_sleep_lock);
+            ++_sleeper_count;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            bool ready = has_work();
+            if (!ready && check_siblings)
+            {
+                for (auto& q : _siblings)
+                {
+                    if (q->_stealable.approx_size() > 0)
+                    {
+                        ready = true;
+                        break;
+                    }
+                }
+            }
+
+            // enqueuers seeing the sleeper notify under the lock, so no wakeup is lost
+            if (!ready)
+            {
+                _sleep_cond.wait(l);
+            }
+            --_sleeper_count;
+        }
+
+        bool work_stealing_task_queue::notify_if_sleeping()
+        {
+            if (_sleeper_count.load() == 0)
+                return false;
+
+            std::lock_guard<std::mutex> l(_sleep_lock);
+            _sleep_cond.notify_one();
+            return true;
+        }
+
+        //------------------- work_stealing_task_worker -------------------------
+        work_stealing_task_worker::work_stealing_task_worker(task_worker_pool* pool, task_queue* q, int index, task_worker* inner_provider)
+            : task_worker(pool, q, index, inner_provider)
+        {
+            _queue = dynamic_cast<work_stealing_task_queue*>(q);
+            dassert(_queue != nullptr, "work stealing task worker must be used together with work stealing task queue");
+            _queue->init_siblings();
+        }
+
+        void work_stealing_task_worker::run(task* t, task_queue* q)
+        {
+            if (q->decrease_count() < 0)
+            {
+                // fix count approximation
+                q->reset_count();
+            }
+            t->exec_internal();
+        }
+
+        void work_stealing_task_worker::loop()
+        {
+            while (is_running())
+            {
+                bool busy = false;
+
+                // ordered tasks first, in one batch
+                task* t = _queue->dequeue_affine(), *next;
+                while (t != nullptr)
+                {
+                    next = t->next;
+                    t->next = nullptr;
+                    run(t, _queue);
+                    t = next;
+                    busy = true;
+                }
+
+                // bounded so that the ordered tasks are not starved
+                for (int i = 0; i < stealable_batch_size; i++)
+                {
+                    t = _queue->take();
+                    if (t == nullptr)
+                        break;
+
+                    run(t, _queue);
+                    busy = true;
+                }
+
+                if (busy)
+                    continue;
+
+                work_stealing_task_queue* victim;
+                t = _queue->steal(&victim);
+                if (t != nullptr)
+                {
+                    run(t, victim);
+                    continue;
+                }
+
+                _queue->wait_for_work(true);
+            }
+        }
+    }
+}
@@ -0,0 +1,133 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     task queue and worker with per-worker deques and work stealing, for
+ *     partitioned thread pools where some hash buckets are much hotter
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+#pragma once
+
+# include <dsn/tool_api.h>
+# include <atomic>
+# include <mutex>
+# include <condition_variable>
+
+namespace dsn 
+{
+    namespace tools
+    {
+        //
+        // unbounded chase-lev style deque, where pushes from multiple threads are
+        // serialized by a spin lock, and takes from the top are lock-free so that
+        // both the owner and the thieves get tasks in fifo order
+        //
+        class work_stealing_deque
+        {
+        public:
+            work_stealing_deque(int capacity = 1024);
+            ~work_stealing_deque();
+
+            void  push(task* t);
+            task* take(); // nullptr if empty
+            int   approx_size() const;
+
+        private:
+            struct ring
+            {
+                int64_t            mask;
+                std::atomic<task*> *slots;
+            };
+
+            ring* grow(ring* r, int64_t top, int64_t bottom);
+
+        private:
+            std::atomic<int64_t>          _top;
+            std::atomic<int64_t>          _bottom;
+            std::atomic<ring*>            _ring;
+
+            ::dsn::utils::ex_lock_nr_spin _push_lock;
+            std::vector<ring*>            _retired; // released in dtor as thieves may still read them
+        };
+
+        //
+        // tasks whose spec disallows stealing stay in the ordered list and are only
+        // executed by the owner worker(s) of this queue, others go to the deque
+        // from where idle workers of the same pool may steal them
+        //
+        class work_stealing_task_queue : public task_queue
+        {
+        public:
+            work_stealing_task_queue(task_worker_pool* pool, int index, task_queue* inner_provider);
+            ~work_stealing_task_queue();
+
+            virtual void     enqueue(task* task) override;
+            virtual task*    dequeue() override; // own tasks only, blocking
+
+            void  init_siblings();
+            task* dequeue_affine();         // all ordered tasks, or nullptr
+            task* take() { return _stealable.take(); }
+            task* steal(/*out*/ work_stealing_task_queue** victim);
+            bool  has_work();
+            void  wait_for_work(bool check_siblings);
+
+        private:
+            bool  notify_if_sleeping();
+
+        private:
+            ::dsn::utils::ex_lock_nr_spin _affine_lock;
+            slist<task>                   _affine_tasks;
+            std::atomic<int>              _affine_count;
+
+            work_stealing_deque           _stealable;
+
+            std::mutex                    _sleep_lock;
+            std::condition_variable       _sleep_cond;
+            std::atomic<int>              _sleeper_count;
+
+            std::vector<work_stealing_task_queue*> _siblings; // excluding this
+            bool                          _siblings_ready;
+            std::atomic<unsigned int>     _next_wakeup;
+        };
+
+        class work_stealing_task_worker : public task_worker
+        {
+        public:
+            work_stealing_task_worker(task_worker_pool* pool, task_queue* q, int index, task_worker* inner_provider);
+            virtual void loop() override;
+
+        private:
+            void run(task* t, task_queue* q);
+
+        private:
+            work_stealing_task_queue *_queue;
+        };
+    }
+}
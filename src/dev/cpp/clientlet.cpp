@@ -161,6 +161,32 @@ namespace dsn
 
             return tsk;
         }
+
+        task_ptr call_group(
+            ::dsn::rpc_address group,
+            dsn_message_t request,
+            clientlet* svc,
+            rpc_reply_handler callback,
+            int quorum,
+            int reply_hash
+            )
+        {
+            task_ptr tsk = new safe_task<rpc_reply_handler >(callback);
+
+            if (callback != nullptr)
+                tsk->add_ref(); // released in exec_rpc_response
+
+            auto t = dsn_rpc_create_response_task(
+                request,
+                callback != nullptr ? safe_task<rpc_reply_handler >::exec_rpc_response : nullptr,
+                (void*)tsk,
+                reply_hash
+                );
+            tsk->set_task_info(t);
+            dsn_rpc_call_group(group.c_addr(), t, quorum, svc ? svc->tracker() : nullptr);
+
+            return tsk;
+        }
     }
     
     namespace file
@@ -258,6 +258,8 @@ namespace dsn {
             auto& cs = suit.cases[_current_case_index];
             cs.timeout_rounds = 0;
             cs.error_rounds = 0;
+            cs.succ_rounds = 0;
+            cs.succ_rounds_sum_ns = 0;
             cs.max_latency_ns = 0;
             cs.min_latency_ns = UINT64_MAX;
 
@@ -406,6 +406,16 @@ bool failure_detector::is_master_connected( ::dsn::rpc_address node) const
         return false;
 }
 
+uint64_t failure_detector::get_master_lease_expire_ms( ::dsn::rpc_address node) const
+{
+    zauto_lock l(_lock);
+    auto it = _masters.find(node);
+    if (it != _masters.end() && it->second.is_alive)
+        return it->second.last_send_time_for_beacon_with_ack + _lease_milliseconds;
+    else
+        return 0;
+}
+
 void failure_detector::register_worker( ::dsn::rpc_address target, bool is_connected)
 {
     uint64_t now = now_ms();
@@ -0,0 +1,408 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ * 
+ * -=- Robust Distributed System Nucleus (rDSN) -=- 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     load balancer against a hotspot on simulated replica servers
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+# include "load_balancer.h"
+# include <gtest/gtest.h>
+# include <iostream>
+# include <iomanip>
+# include <queue>
+# include <climits>
+
+using namespace ::dsn;
+using namespace ::dsn::replication;
+
+//
+// replica servers are simulated in memory: proposals are accepted at once,
+// and the balancer is rerun on the changed partitions as meta_service does
+//
+class simulated_balancer : public load_balancer
+{
+public:
+    simulated_balancer(server_state* state, const replication_options& opts)
+        : load_balancer(state, opts), _sim_state(state), _downgrade_count(0)
+    {
+    }
+
+    int downgrade_count() const { return _downgrade_count; }
+
+    int apply_proposals()
+    {
+        int count = 0;
+        while (!_proposals.empty())
+        {
+            configuration_update_request proposal = _proposals.front();
+            _proposals.pop();
+
+            configuration_update_request req;
+            req.config = proposal.config;
+            req.config.ballot++;
+            req.node = proposal.node;
+            req.type = proposal.type;
+
+            switch (proposal.type)
+            {
+            case CT_ASSIGN_PRIMARY:
+            case CT_UPGRADE_TO_PRIMARY:
+                req.config.primary = proposal.node;
+                replica_helper::remove_node(proposal.node, req.config.secondaries);
+                break;
+            case CT_ADD_SECONDARY:
+                // learning is done at once
+                req.type = CT_UPGRADE_TO_SECONDARY;
+                req.config.secondaries.push_back(proposal.node);
+                break;
+            case CT_DOWNGRADE_TO_SECONDARY:
+                req.config.primary.set_invalid();
+                req.config.secondaries.push_back(proposal.node);
+                break;
+            default:
+                continue;
+            }
+
+            configuration_update_response resp;
+            _sim_state->update_configuration(req, resp);
+            if (resp.err == ERR_OK)
+            {
+                count++;
+                run(req.config.gpid);
+            }
+        }
+        return count;
+    }
+
+protected:
+    virtual void send_proposal(::dsn::rpc_address node, const configuration_update_request& proposal) override
+    {
+        if (proposal.type == CT_DOWNGRADE_TO_SECONDARY)
+            _downgrade_count++;
+        _proposals.push(proposal);
+    }
+
+private:
+    server_state                             *_sim_state;
+    int                                      _downgrade_count;
+    std::queue<configuration_update_request> _proposals;
+};
+
+// every node reports the loads of its replicas, and returns max/avg of the primary qps over nodes
+static double report_loads(server_state& state, const std::vector<::dsn::rpc_address>& nodes, const std::vector<double>& qps)
+{
+    double max_qps = 0, sum_qps = 0;
+    for (auto& node : nodes)
+    {
+        configuration_query_by_node_request req;
+        configuration_query_by_node_response resp;
+        req.node = node;
+        state.query_configuration_by_node(req, resp);
+
+        // half of the requests are 1KB writes, applied on all replicas;
+        // latency grows with the primary qps on the node
+        double node_qps = 0;
+        for (auto& pc : resp.partitions)
+        {
+            if (pc.primary == node)
+                node_qps += qps[pc.gpid.pidx];
+        }
+        
+        for (auto& pc : resp.partitions)
+        {
+            double q = qps[pc.gpid.pidx];
+            partition_load ld;
+            ld.gpid = pc.gpid;
+            ld.status = (pc.primary == node ? PS_PRIMARY : PS_SECONDARY);
+            ld.qps = (pc.primary == node ? q : 0);
+            ld.write_bytes_per_second = q * 0.5 * 1024;
+            ld.log_backlog = static_cast<int64_t>(q / 10);
+            ld.p99_latency_us = static_cast<int64_t>(1000 + node_qps);
+            req.loads.push_back(ld);
+        }
+        state.query_configuration_by_node(req, resp);
+
+        max_qps = std::max(max_qps, node_qps);
+        sum_qps += node_qps;
+    }
+    return max_qps / (sum_qps / nodes.size());
+}
+
+static std::vector<double> run_hotspot(bool load_aware, int rounds)
+{
+    const int node_count = 8;
+    const int hot_count = 4;
+
+    server_state state;
+    state.init_app();
+
+    std::vector<::dsn::rpc_address> nodes;
+    node_states ns;
+    for (int i = 0; i < node_count; i++)
+    {
+        nodes.push_back(::dsn::rpc_address("localhost", static_cast<uint16_t>(34801 + i)));
+        ns.push_back(std::make_pair(nodes.back(), true));
+    }
+    state.set_node_state(ns, nullptr);
+
+    replication_options opts;
+    opts.lb_load_aware = load_aware;
+    opts.lb_migration_cooldown_ms = 0;
+    simulated_balancer lb(&state, opts);
+
+    // initial placement
+    for (int i = 0; i < 10; i++)
+    {
+        lb.run();
+        if (lb.apply_proposals() == 0)
+            break;
+    }
+
+    // the hot partitions are all served by the node with the most primaries
+    ::dsn::rpc_address hot_node;
+    size_t max_primaries = 0;
+    std::vector<partition_configuration> configs;
+    for (auto& node : nodes)
+    {
+        configuration_query_by_node_request req;
+        configuration_query_by_node_response resp;
+        req.node = node;
+        state.query_configuration_by_node(req, resp);
+
+        size_t primaries = 0;
+        for (auto& pc : resp.partitions)
+        {
+            EXPECT_EQ(pc.max_replica_count, static_cast<int>(pc.secondaries.size()) + 1);
+            if (pc.primary == node)
+                primaries++;
+        }
+
+        if (primaries > max_primaries)
+        {
+            max_primaries = primaries;
+            hot_node = node;
+            configs = resp.partitions;
+        }
+    }
+
+    std::vector<double> qps(32, 100.0);
+    int hot = 0;
+    for (auto& pc : configs)
+    {
+        if (pc.primary == hot_node && hot < hot_count)
+        {
+            qps[pc.gpid.pidx] = 2000.0;
+            hot++;
+        }
+    }
+    EXPECT_EQ(hot_count, hot);
+
+    std::vector<double> imbalances;
+    for (int r = 0; r < rounds; r++)
+    {
+        imbalances.push_back(report_loads(state, nodes, qps));
+        lb.run();
+        lb.apply_proposals();
+    }
+    return imbalances;
+}
+
+TEST(replication, load_balancer_hotspot)
+{
+    const int rounds = 10;
+    auto count_only = run_hotspot(false, rounds);
+    auto load_aware = run_hotspot(true, rounds);
+
+    std::cout << "round\t max/avg primary qps per node (count-only vs load-aware)" << std::endl;
+    for (int r = 0; r < rounds; r++)
+    {
+        std::cout << r << "\t " << std::fixed << std::setprecision(2) 
+            << count_only[r] << "\t " << load_aware[r] << std::endl;
+    }
+
+    EXPECT_LT(load_aware.back(), load_aware.front() / 2);
+    EXPECT_LT(load_aware.back(), count_only.back());
+}
+
+// returns max - min of the primary count over nodes
+static int primary_count_skew(server_state& state, const std::vector<::dsn::rpc_address>& nodes)
+{
+    int max_count = 0, min_count = INT_MAX;
+    for (auto& node : nodes)
+    {
+        configuration_query_by_node_request req;
+        configuration_query_by_node_response resp;
+        req.node = node;
+        state.query_configuration_by_node(req, resp);
+
+        int count = 0;
+        for (auto& pc : resp.partitions)
+        {
+            if (pc.primary == node)
+                count++;
+        }
+        max_count = std::max(max_count, count);
+        min_count = std::min(min_count, count);
+    }
+    return max_count - min_count;
+}
+
+TEST(replication, load_balancer_primary_balance)
+{
+    const int node_count = 8;
+
+    server_state state;
+    state.init_app();
+
+    std::vector<::dsn::rpc_address> nodes;
+    node_states ns;
+    for (int i = 0; i < node_count; i++)
+    {
+        nodes.push_back(::dsn::rpc_address("localhost", static_cast<uint16_t>(34901 + i)));
+        ns.push_back(std::make_pair(nodes.back(), true));
+    }
+    state.set_node_state(ns, nullptr);
+
+    replication_options opts;
+    opts.lb_load_aware = false;
+    opts.lb_migration_cooldown_ms = 0;
+    simulated_balancer lb(&state, opts);
+
+    for (int i = 0; i < 10; i++)
+    {
+        lb.run();
+        if (lb.apply_proposals() == 0)
+            break;
+    }
+
+    // skew: move every primary to nodes[0] where it has a replica, e.g., after a failover
+    configuration_query_by_node_request req;
+    configuration_query_by_node_response resp;
+    req.node = nodes[0];
+    state.query_configuration_by_node(req, resp);
+    for (auto& pc : resp.partitions)
+    {
+        if (pc.primary == nodes[0])
+            continue;
+
+        configuration_update_request down;
+        configuration_update_response down_resp;
+        down.config = pc;
+        down.config.ballot++;
+        down.config.secondaries.push_back(pc.primary);
+        down.config.primary.set_invalid();
+        down.node = pc.primary;
+        down.type = CT_DOWNGRADE_TO_SECONDARY;
+        state.update_configuration(down, down_resp);
+        ASSERT_EQ(ERR_OK, down_resp.err);
+
+        configuration_update_request up;
+        configuration_update_response up_resp;
+        up.config = down.config;
+        up.config.ballot++;
+        up.config.primary = nodes[0];
+        replica_helper::remove_node(nodes[0], up.config.secondaries);
+        up.node = nodes[0];
+        up.type = CT_UPGRADE_TO_PRIMARY;
+        state.update_configuration(up, up_resp);
+        ASSERT_EQ(ERR_OK, up_resp.err);
+    }
+
+    int skew = primary_count_skew(state, nodes);
+    std::cout << "primary count skew " << skew << " after the failover" << std::endl;
+    EXPECT_GT(skew, 1);
+
+    int rounds = 0;
+    for (; rounds < 100 && skew > 1; rounds++)
+    {
+        int before = lb.downgrade_count();
+        lb.balance_primaries();
+        EXPECT_LE(lb.downgrade_count() - before, opts.lb_primary_balance_max_concurrent_switches);
+        EXPECT_GT(lb.downgrade_count() - before, 0);
+
+        lb.apply_proposals();
+        skew = primary_count_skew(state, nodes);
+    }
+
+    std::cout << "primary count skew " << skew << " after " << rounds << " rounds, "
+        << lb.downgrade_count() << " switches" << std::endl;
+    EXPECT_LE(skew, 1);
+}
+
+TEST(replication, load_balancer_query_format)
+{
+    // a request without loads is the same as the one before loads are added
+    configuration_query_by_node_request req;
+    req.node = ::dsn::rpc_address("localhost", 34801);
+
+    binary_writer old_writer;
+    marshall(old_writer, req.node);
+    binary_writer writer;
+    marshall(writer, req);
+    ASSERT_EQ(old_writer.total_size(), writer.total_size());
+
+    blob bb = old_writer.get_buffer();
+    binary_reader old_reader(bb);
+    configuration_query_by_node_request old_req;
+    old_req.loads.resize(1);
+    unmarshall(old_reader, old_req);
+    EXPECT_EQ(req.node, old_req.node);
+    EXPECT_TRUE(old_req.loads.empty());
+
+    // and the loads are appended, which are skipped by the readers without loads
+    partition_load load;
+    load.gpid.app_id = 1;
+    load.gpid.pidx = 2;
+    load.status = PS_PRIMARY;
+    load.qps = 100;
+    load.write_bytes_per_second = 1000;
+    load.log_backlog = 3;
+    load.p99_latency_us = 4000;
+    req.loads.push_back(load);
+
+    binary_writer new_writer;
+    marshall(new_writer, req);
+    bb = new_writer.get_buffer();
+
+    binary_reader node_reader(bb);
+    ::dsn::rpc_address node;
+    unmarshall(node_reader, node);
+    EXPECT_EQ(req.node, node);
+
+    binary_reader new_reader(bb);
+    configuration_query_by_node_request new_req;
+    unmarshall(new_reader, new_req);
+    EXPECT_TRUE(new_reader.is_eof());
+    EXPECT_EQ(req.node, new_req.node);
+    ASSERT_EQ(1u, new_req.loads.size());
+    EXPECT_EQ(load.gpid, new_req.loads[0].gpid);
+    EXPECT_EQ(load.qps, new_req.loads[0].qps);
+    EXPECT_EQ(load.p99_latency_us, new_req.loads[0].p99_latency_us);
+}
@@ -221,3 +221,266 @@ TEST(replication, mutation_log)
     // clear all
     utils::filesystem::remove_path(logp);
 }
+
+TEST(replication, mutation_log_group_commit)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string str = "hello, world!";
+    std::string logp = "./test-log-group-commit";
+    std::vector<mutation_ptr> mutations;
+    std::atomic<int> completed(0);
+    std::atomic<int> failed(0);
+    const int count = 1000;
+
+    // prepare
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // writing logs with adaptive group commit and 2 in-flight writes
+    mutation_log_ptr mlog = new mutation_log(
+        logp,
+        true,
+        1,
+        4,
+        true,
+        10,
+        2
+        );
+
+    auto err = mlog->open(gpid, nullptr);
+    EXPECT_TRUE(err == ERR_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = 2 + i;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        for (int j = 0; j < 100; j++)
+        {
+            writer.write(str);
+        }
+        mu->data.updates.push_back(writer.get_buffer());
+
+        mutations.push_back(mu);
+
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr,
+            [&completed, &failed](error_code err, size_t size)
+            {
+                if (err != ERR_OK)
+                    failed++;
+                completed++;
+            },
+            0);
+    }
+
+    mlog->close();
+
+    // the log callbacks are enqueued before close returns
+    for (int i = 0; i < 1000 && completed.load() < count; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_EQ(count, completed.load());
+    EXPECT_EQ(0, failed.load());
+
+    // reading logs
+    mlog = new mutation_log(
+        logp,
+        true,
+        1,
+        4
+        );
+
+    int mutation_index = -1;
+    mlog->open(
+        gpid,
+        [&mutations, &mutation_index](mutation_ptr mu)
+        {
+            mutation_ptr wmu = mutations[++mutation_index];
+            EXPECT_TRUE(memcmp((const void*)&wmu->data.header,
+                (const void*)&mu->data.header,
+                sizeof(mu->data.header)) == 0
+                );
+            EXPECT_TRUE(wmu->data.updates[0].length() == mu->data.updates[0].length());
+            return true;
+        }
+        );
+    EXPECT_TRUE(mutation_index + 1 == (int)mutations.size());
+    mlog->close();
+
+    // clear all
+    utils::filesystem::remove_path(logp);
+}
+
+// restart benchmark: replay the same multi-file private log sequentially 
+// and with parallel prefetching, the replayed mutations must be identical
+TEST(replication, mutation_log_replay_perf)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string str = "hello, world!";
+    std::string logp = "./test-log-replay";
+    const int count = 20000;
+
+    // prepare
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // writing logs, in about 30 files of 1 MB
+    mutation_log_ptr mlog = new mutation_log(logp, true, 1, 1, true, 10, 4);
+    auto err = mlog->open(gpid, nullptr);
+    EXPECT_TRUE(err == ERR_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = 2 + i;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        for (int j = 0; j < 100; j++)
+        {
+            writer.write(str);
+        }
+        mu->data.updates.push_back(writer.get_buffer());
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0);
+    }
+    mlog->close();
+
+    const int prefetches[] = { 0, 1, 2, 4 };
+    for (auto prefetch : prefetches)
+    {
+        int replayed = 0;
+        bool in_order = true;
+
+        mlog = new mutation_log(logp, true, 1, 1);
+        mlog->set_replay_prefetch_files_before_open(prefetch);
+
+        uint64_t start = dsn_now_ns();
+        err = mlog->open(
+            gpid,
+            [&replayed, &in_order](mutation_ptr mu)
+            {
+                if (mu->data.header.decree != 2 + replayed)
+                    in_order = false;
+                replayed++;
+                return true;
+            }
+            );
+        uint64_t elapsed_ns = dsn_now_ns() - start;
+        EXPECT_TRUE(err == ERR_OK);
+        EXPECT_EQ(count, replayed);
+        EXPECT_TRUE(in_order);
+        EXPECT_EQ(count + 1, (int)mlog->max_decree(gpid));
+
+        std::cout << "replay " << replayed << " mutations with prefetch_files = " << prefetch
+            << ": " << elapsed_ns / 1000000 << " ms" << std::endl;
+
+        mlog->close();
+    }
+
+    // clear all
+    utils::filesystem::remove_path(logp);
+}
+
+TEST(replication, mutation_log_partition_index)
+{
+    global_partition_id gpid = { 1, 0 };
+    std::string str = "hello, world!";
+    std::string logp = "./test-log-index";
+    const int count = 5000;
+
+    // prepare
+    utils::filesystem::remove_path(logp);
+    utils::filesystem::create_directory(logp);
+
+    // writing logs in several files, which are all indexed on close
+    mutation_log_ptr mlog = new mutation_log(logp, true, 1, 1);
+    auto err = mlog->open(gpid, nullptr);
+    EXPECT_TRUE(err == ERR_OK);
+
+    for (int i = 0; i < count; i++)
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.ballot = 1;
+        mu->data.header.decree = 2 + i;
+        mu->data.header.gpid = gpid;
+        mu->data.header.last_committed_decree = i;
+        mu->data.header.log_offset = 0;
+
+        binary_writer writer;
+        for (int j = 0; j < 100; j++)
+        {
+            writer.write(str);
+        }
+        mu->data.updates.push_back(writer.get_buffer());
+        mlog->append(mu, LPC_AIO_IMMEDIATE_CALLBACK, nullptr, nullptr, 0);
+    }
+
+    std::vector<std::pair<std::string, int64_t>> written_blocks;
+    EXPECT_TRUE(mlog->get_partition_blocks(gpid, 2 + count / 2, written_blocks));
+    EXPECT_TRUE(written_blocks.size() > 0);
+    mlog->close();
+
+    for (auto& b : written_blocks)
+    {
+        EXPECT_TRUE(utils::filesystem::file_exists(b.first + ".index"));
+    }
+
+    // reopen with the persisted indexes, and then with the rebuilt ones
+    for (int round = 0; round < 2; round++)
+    {
+        if (round == 1)
+        {
+            for (auto& b : written_blocks)
+            {
+                utils::filesystem::remove_path(b.first + ".index");
+            }
+        }
+
+        mlog = new mutation_log(logp, true, 1, 1);
+        int replayed = 0;
+        err = mlog->open(gpid, [&replayed](mutation_ptr mu) { replayed++; return true; });
+        EXPECT_TRUE(err == ERR_OK);
+        EXPECT_EQ(count, replayed);
+
+        std::vector<std::pair<std::string, int64_t>> blocks;
+        EXPECT_TRUE(mlog->get_partition_blocks(gpid, 2 + count / 2, blocks));
+        EXPECT_EQ(written_blocks.size(), blocks.size());
+        for (size_t i = 0; i < blocks.size() && i < written_blocks.size(); i++)
+        {
+            EXPECT_EQ(written_blocks[i].first, blocks[i].first);
+            EXPECT_EQ(written_blocks[i].second, blocks[i].second);
+        }
+
+        // learning starts from the first indexed file with the wanted decrees
+        learn_state state;
+        mlog->get_learn_state(gpid, 2 + count / 2, state);
+        ASSERT_EQ(blocks.size(), state.files.size());
+        for (size_t i = 0; i < blocks.size(); i++)
+        {
+            EXPECT_EQ(blocks[i].first, state.files[i]);
+        }
+
+        blocks.clear();
+        EXPECT_TRUE(mlog->get_partition_blocks(gpid, count + 2, blocks));
+        EXPECT_EQ(0u, blocks.size());
+
+        mlog->close();
+    }
+
+    for (auto& b : written_blocks)
+    {
+        EXPECT_TRUE(utils::filesystem::file_exists(b.first + ".index"));
+    }
+
+    // clear all
+    utils::filesystem::remove_path(logp);
+}
@@ -0,0 +1,217 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for applying the committed mutations out of the replica thread.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include <dsn/internal/task.h>
+# include <gtest/gtest.h>
+# include <atomic>
+# include <thread>
+
+DEFINE_TASK_CODE_RPC(RPC_TEST_APPLY_WRITE, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+namespace dsn { namespace replication {
+
+class apply_async_test_app : public replication_app_base
+{
+public:
+    apply_async_test_app(replica* r)
+        : replication_app_base(r), slow_value(0), fail_value(0)
+    {
+        register_async_rpc_handler(RPC_TEST_APPLY_WRITE, "write", &apply_async_test_app::on_write);
+    }
+
+    void on_write(const int32_t& value, ::dsn::rpc_replier<int32_t>& reply)
+    {
+        if (value == slow_value)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (value == fail_value)
+        {
+            set_physical_error(-1);
+        }
+
+        values.push_back(value);
+        reply(value);
+    }
+
+    virtual int  open(bool create_new) { return 0; }
+    virtual int  close(bool clear_state) { return 0; }
+    virtual int  flush(bool wait) { return 0; }
+    virtual int  get_learn_state(decree start, const blob& learn_req, /*out*/ learn_state& state) { return 0; }
+    virtual int  apply_learn_state(learn_state& state) { return 0; }
+
+public:
+    int32_t slow_value;
+    int32_t fail_value;
+
+    // written by the apply thread, and read after the apply is drained
+    std::vector<int32_t> values;
+};
+
+}}
+
+using namespace ::dsn::replication;
+
+// the failure is handled on the replica thread, which drops the replica
+// through the stub, so the task is only counted and then cancelled here
+static std::atomic<int> s_apply_failed_count(0);
+
+static void on_apply_failed_enqueue(::dsn::task* caller, ::dsn::task* callee)
+{
+    s_apply_failed_count++;
+    callee->cancel(false);
+}
+
+class apply_async_test
+{
+public:
+    apply_async_test(const char* dir)
+        : _dir(dir)
+    {
+        ::dsn::utils::filesystem::remove_path(_dir);
+
+        stub = new replica_stub();
+        stub->options().apply_async_enabled = true;
+
+        rep = replica_tester::create(stub, _dir.c_str());
+        app = new apply_async_test_app(rep.get());
+        replica_tester::set_app(rep.get(), app);
+        replica_tester::config(rep.get()).ballot = 1;
+        replica_tester::config(rep.get()).status = PS_SECONDARY;
+
+        s_apply_failed_count = 0;
+        ::dsn::task_spec::get(LPC_APPLY_MUTATIONS_FAILED)->on_task_enqueue.put_back(on_apply_failed_enqueue, "apply_async_test");
+    }
+
+    ~apply_async_test()
+    {
+        ::dsn::task_spec::get(LPC_APPLY_MUTATIONS_FAILED)->on_task_enqueue.remove("apply_async_test");
+
+        replica_tester::config(rep.get()).status = PS_INACTIVE;
+        rep = nullptr; // the app is closed and deleted with the replica
+        delete stub;
+        ::dsn::utils::filesystem::remove_path(_dir);
+    }
+
+    void commit(int32_t value)
+    {
+        mutation_ptr mu(new mutation());
+        mu->set_id(1, value);
+        mu->data.header.last_committed_decree = value - 1;
+        mu->rpc_code = RPC_TEST_APPLY_WRITE;
+
+        ::dsn::binary_writer writer;
+        marshall(writer, value);
+        mu->data.updates.push_back(writer.get_buffer());
+
+        replica_tester::apply_mutation_async(rep.get(), mu);
+    }
+
+    bool wait_for_failure_count(int count)
+    {
+        for (int i = 0; i < 100 && s_apply_failed_count.load() < count; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return s_apply_failed_count.load() == count;
+    }
+
+public:
+    std::string           _dir;
+    replica_stub*         stub;
+    replica_ptr           rep;
+    apply_async_test_app* app;
+};
+
+TEST(replication, apply_async_drain_on_status_change)
+{
+    apply_async_test t("./test-apply-async-drain");
+
+    // the first one keeps the apply thread busy while the rest are queued
+    t.app->slow_value = 1;
+    for (int32_t v = 1; v <= 4; v++)
+        t.commit(v);
+    EXPECT_EQ(4, replica_tester::last_applying_decree(t.rep.get()));
+
+    // the status changes only after all the queued ones are applied in order
+    EXPECT_TRUE(replica_tester::update_local_configuration_with_no_ballot_change(t.rep.get(), PS_INACTIVE));
+    EXPECT_EQ(PS_INACTIVE, t.rep->status());
+    EXPECT_EQ(4, t.app->last_committed_decree());
+    EXPECT_EQ(std::vector<int32_t>({ 1, 2, 3, 4 }), t.app->values);
+
+    auto& apply = replica_tester::apply_states(t.rep.get());
+    EXPECT_EQ(0, apply.last_queued_decree);
+    EXPECT_TRUE(apply.queue.empty());
+    EXPECT_FALSE(apply.is_running);
+    EXPECT_FALSE(apply.is_failed);
+    EXPECT_EQ(4, replica_tester::last_applying_decree(t.rep.get()));
+    EXPECT_EQ(0, s_apply_failed_count.load());
+}
+
+TEST(replication, apply_async_failure)
+{
+    apply_async_test t("./test-apply-async-failure");
+
+    // the second one fails while the rest are queued behind it
+    t.app->slow_value = 1;
+    t.app->fail_value = 2;
+    for (int32_t v = 1; v <= 4; v++)
+        t.commit(v);
+
+    // the failure is reported once through LPC_APPLY_MUTATIONS_FAILED
+    ASSERT_TRUE(t.wait_for_failure_count(1));
+
+    auto& apply = replica_tester::apply_states(t.rep.get());
+    {
+        ::dsn::service::zauto_lock l(apply.queue_lock);
+        EXPECT_TRUE(apply.is_failed);
+        EXPECT_FALSE(apply.is_running);
+        EXPECT_TRUE(apply.queue.empty());
+    }
+
+    // and the rest are dropped, as well as those committed afterwards
+    t.commit(5);
+    {
+        ::dsn::service::zauto_lock l(apply.queue_lock);
+        EXPECT_TRUE(apply.queue.empty());
+        EXPECT_FALSE(apply.is_running);
+    }
+
+    // nothing more is applied or reported when drained on status change
+    EXPECT_TRUE(replica_tester::update_local_configuration_with_no_ballot_change(t.rep.get(), PS_INACTIVE));
+    EXPECT_EQ(std::vector<int32_t>({ 1, 2 }), t.app->values);
+    EXPECT_EQ(2, t.app->last_committed_decree());
+    EXPECT_EQ(0, apply.last_queued_decree);
+    EXPECT_EQ(1, s_apply_failed_count.load());
+}
@@ -0,0 +1,469 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for streaming the learned files from the learnee in chunks.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include <dsn/internal/task.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <atomic>
+# include <fstream>
+# include <mutex>
+# include <thread>
+
+DEFINE_TASK_CODE(LPC_LEARN_STREAM_TEST, TASK_PRIORITY_COMMON, THREAD_POOL_REPLICATION)
+
+namespace dsn { namespace replication {
+
+class learn_stream_test_app : public replication_app_base
+{
+public:
+    learn_stream_test_app(replica* r) : replication_app_base(r) {}
+
+    virtual int  open(bool create_new) { return 0; }
+    virtual int  close(bool clear_state) { return 0; }
+    virtual int  flush(bool wait) { return 0; }
+    virtual int  get_learn_state(decree start, const blob& learn_req, /*out*/ learn_state& state) { return 0; }
+    virtual int  apply_learn_state(learn_state& state) { return 0; }
+};
+
+}}
+
+using namespace ::dsn::replication;
+
+// the chunk requests are captured and dropped before they go to the network,
+// so that the test replies them as the learnee
+struct sent_chunk
+{
+    ::dsn::message_ex* request;
+    std::string        file;
+    int64_t            offset;
+    int                size;
+    uint64_t           ts_ms;
+};
+
+// the sealed message as the receiver sees it, in one buffer
+static ::dsn::message_ex* receive_message(::dsn::message_ex* msg)
+{
+    msg->seal(false);
+    if (msg->buffers.size() == 1)
+        return ::dsn::message_ex::create_receive_message(msg->buffers[0]);
+
+    int length = 0;
+    for (auto& b : msg->buffers)
+        length += b.length();
+    std::shared_ptr<char> buffer(new char[length], std::default_delete<char[]>());
+    int offset = 0;
+    for (auto& b : msg->buffers)
+    {
+        memcpy(buffer.get() + offset, b.data(), b.length());
+        offset += b.length();
+    }
+    return ::dsn::message_ex::create_receive_message(::dsn::blob(buffer, length));
+}
+
+static std::mutex s_sent_lock;
+static std::vector<sent_chunk> s_sent;
+
+static bool capture_on_rpc_call(::dsn::task* caller, ::dsn::message_ex* request, ::dsn::rpc_response_task* call)
+{
+    dsn_message_t received = (dsn_message_t)receive_message(request);
+    dsn_msg_add_ref(received);
+    learn_chunk_request req;
+    ::unmarshall(received, req);
+    dsn_msg_release_ref(received);
+
+    request->add_ref(); // released in the test dtor
+    std::lock_guard<std::mutex> l(s_sent_lock);
+    s_sent.push_back(sent_chunk{ request, req.file, req.offset, req.size, dsn_now_ms() });
+    return false;
+}
+
+// the stream completion goes to on_copy_remote_state_completed, which is
+// only counted and cancelled here
+static std::atomic<int> s_completed_count(0);
+
+static void on_learn_completed_enqueue(::dsn::task* caller, ::dsn::task* callee)
+{
+    s_completed_count++;
+    callee->cancel(false);
+}
+
+struct remote_file
+{
+    std::string content;
+    int64_t     mtime;
+    bool        append_only;
+};
+
+class learn_stream_test
+{
+public:
+    learn_stream_test(const char* dir)
+        : _dir(dir)
+    {
+        ::dsn::utils::filesystem::remove_path(_dir);
+
+        stub = new replica_stub();
+        stub->options().learn_stream_disabled = false;
+        stub->options().learn_stream_chunk_kb = 1;
+        stub->options().learn_stream_window = 2;
+        stub->options().learn_stream_max_mb_per_second = 0;
+        stub->options().learn_stream_max_retries = 3;
+
+        rep = replica_tester::create(stub, _dir.c_str());
+        replica_tester::set_app(rep.get(), new learn_stream_test_app(rep.get()));
+        replica_tester::config(rep.get()).status = PS_POTENTIAL_SECONDARY;
+
+        // no timeout for the dropped requests, as the test replies them
+        auto spec = ::dsn::task_spec::get(RPC_LEARN_CHUNK);
+        _timeout_ms = spec->rpc_timeout_milliseconds;
+        spec->rpc_timeout_milliseconds = 1000000;
+        spec->on_rpc_call.put_native(capture_on_rpc_call);
+
+        s_completed_count = 0;
+        ::dsn::task_spec::get(LPC_LEARN_REMOTE_DELTA_FILES)->on_task_enqueue.put_back(on_learn_completed_enqueue, "learn_stream_test");
+    }
+
+    ~learn_stream_test()
+    {
+        auto spec = ::dsn::task_spec::get(RPC_LEARN_CHUNK);
+        spec->on_rpc_call.remove("native");
+        spec->rpc_timeout_milliseconds = _timeout_ms;
+        ::dsn::task_spec::get(LPC_LEARN_REMOTE_DELTA_FILES)->on_task_enqueue.remove("learn_stream_test");
+
+        run([this]() { replica_tester::potential_secondary_states(rep.get()).learn_stream = nullptr; });
+        replica_tester::config(rep.get()).status = PS_INACTIVE;
+        rep = nullptr;
+        delete stub;
+
+        {
+            std::lock_guard<std::mutex> l(s_sent_lock);
+            for (auto& s : s_sent)
+                s.request->release_ref();
+            s_sent.clear();
+        }
+        ::dsn::utils::filesystem::remove_path(_dir);
+    }
+
+    // the stream is only touched on the replica thread
+    void run(std::function<void()> callback)
+    {
+        auto t = ::dsn::tasking::enqueue(LPC_LEARN_STREAM_TEST, rep.get(), callback, gpid_to_hash(rep->get_gpid()));
+        t->wait();
+    }
+
+    void start(const std::vector<std::string>& files)
+    {
+        std::shared_ptr<learn_response> resp(new learn_response());
+        resp->err = ::dsn::ERR_OK;
+        resp->config.primary = ::dsn::rpc_address("localhost", 34801);
+        resp->base_local_dir = "/remote/data";
+        resp->state.files = files;
+        run([this, resp]() mutable { replica_tester::start_learn_stream(rep.get(), resp); });
+    }
+
+    std::vector<std::pair<std::string, int64_t>> sent()
+    {
+        std::vector<std::pair<std::string, int64_t>> chunks;
+        std::lock_guard<std::mutex> l(s_sent_lock);
+        for (auto& s : s_sent)
+            chunks.push_back(std::make_pair(s.file, s.offset));
+        return chunks;
+    }
+
+    std::vector<std::pair<std::string, int64_t>> sent_from(size_t index)
+    {
+        auto chunks = sent();
+        return std::vector<std::pair<std::string, int64_t>>(chunks.begin() + std::min(index, chunks.size()), chunks.end());
+    }
+
+    // reply the index-th chunk request as the learnee with the remote files
+    void reply(int index, ::dsn::error_code err = ::dsn::ERR_OK)
+    {
+        sent_chunk s;
+        {
+            std::lock_guard<std::mutex> l(s_sent_lock);
+            ASSERT_LT(index, (int)s_sent.size());
+            s = s_sent[index];
+        }
+
+        dsn_message_t received = nullptr;
+        if (err == ::dsn::ERR_OK)
+        {
+            auto& f = remote[s.file];
+            learn_chunk_response resp;
+            resp.err = ::dsn::ERR_OK;
+            resp.file_size = (int64_t)f.content.length();
+            resp.file_mtime = f.mtime;
+            resp.append_only = f.append_only;
+            if (s.offset < resp.file_size)
+            {
+                std::string data = f.content.substr((size_t)s.offset, (size_t)s.size);
+                std::shared_ptr<char> buffer(new char[data.length()], std::default_delete<char[]>());
+                memcpy(buffer.get(), data.data(), data.length());
+                resp.data = ::dsn::blob(buffer, (int)data.length());
+            }
+
+            dsn_message_t response = dsn_msg_create_response(s.request);
+            ::marshall(response, resp);
+            received = (dsn_message_t)receive_message((::dsn::message_ex*)response);
+            dsn_msg_add_ref(received);
+            dsn_msg_add_ref(response);
+            dsn_msg_release_ref(response);
+        }
+
+        run([this, s, err, received]()
+        {
+            auto stream = replica_tester::potential_secondary_states(rep.get()).learn_stream;
+            ASSERT_TRUE(stream != nullptr);
+            auto& files = stream->resp->state.files;
+            int f = (int)(std::find(files.begin(), files.end(), s.file) - files.begin());
+            replica_tester::on_learn_chunk_reply(rep.get(), stream, f, s.offset, err, (dsn_message_t)s.request, received);
+
+            // before any write completion on this thread sends more
+            sent_on_reply = sent();
+        });
+
+        if (received != nullptr)
+            dsn_msg_release_ref(received);
+    }
+
+    // wait till the received chunks in order are written, the writes are
+    // chained on the replica thread so there is no gap between them
+    void wait_written()
+    {
+        for (int i = 0; i < 200; i++)
+        {
+            bool done = true;
+            run([this, &done]()
+            {
+                auto stream = replica_tester::potential_secondary_states(rep.get()).learn_stream;
+                done = (stream == nullptr || !stream->is_writing);
+            });
+            if (done)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ADD_FAILURE() << "learn stream chunks are not written";
+    }
+
+    bool wait_sent(size_t count, int timeout_ms)
+    {
+        for (int i = 0; i < timeout_ms / 10 && sent().size() < count; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return sent().size() >= count;
+    }
+
+    // reply all the requests one by one till the stream completes
+    void reply_all(size_t from)
+    {
+        for (size_t i = from; i < 100 && s_completed_count.load() == 0; i++)
+        {
+            if (!wait_sent(i + 1, 3000))
+                break;
+            reply((int)i);
+            wait_written();
+        }
+    }
+
+    int inflight_count()
+    {
+        int count = 0;
+        run([this, &count]() { count = replica_tester::potential_secondary_states(rep.get()).learn_stream->inflight_count; });
+        return count;
+    }
+
+    std::string local(const std::string& file)
+    {
+        std::ifstream is((_dir + "/learn/" + file).c_str(), std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    }
+
+public:
+    std::string           _dir;
+    int32_t               _timeout_ms;
+    replica_stub*         stub;
+    replica_ptr           rep;
+    std::map<std::string, remote_file> remote;
+    std::vector<std::pair<std::string, int64_t>> sent_on_reply;
+};
+
+typedef std::vector<std::pair<std::string, int64_t>> chunks;
+
+static std::string make_content(int size, char c)
+{
+    std::string s;
+    for (int i = 0; i < size; i++)
+        s.push_back((char)(c + i % 7));
+    return s;
+}
+
+TEST(replication, learn_stream_window)
+{
+    learn_stream_test t("./test-learn-stream-window");
+    t.remote["a"] = remote_file{ make_content(3000, 'a'), 100, false };
+    t.remote["b"] = remote_file{ make_content(1500, 'b'), 100, false };
+
+    // the file size is not known till the first chunk is replied
+    t.start({ "a", "b" });
+    EXPECT_EQ(chunks({ { "a", 0 } }), t.sent());
+
+    // the received chunk is counted in the window till it is written
+    t.reply(0);
+    EXPECT_EQ(chunks({ { "a", 0 }, { "a", 1024 } }), t.sent_on_reply);
+    t.wait_written();
+    EXPECT_EQ(chunks({ { "a", 0 }, { "a", 1024 }, { "a", 2048 } }), t.sent());
+    EXPECT_EQ(2, t.inflight_count());
+
+    // an out-of-order chunk waits for the previous one, still in the window
+    t.reply(2);
+    t.wait_written();
+    EXPECT_EQ(3u, t.sent().size());
+    EXPECT_EQ(make_content(3000, 'a').substr(0, 1024), t.local("a"));
+
+    // and both are written once the gap is filled, then the next file starts
+    t.reply(1);
+    t.wait_written();
+    EXPECT_EQ(make_content(3000, 'a'), t.local("a"));
+    EXPECT_EQ(chunks({ { "a", 0 }, { "a", 1024 }, { "a", 2048 }, { "b", 0 } }), t.sent());
+
+    t.reply_all(3);
+    EXPECT_EQ(1, s_completed_count.load());
+    EXPECT_EQ(5u, t.sent().size());
+    EXPECT_EQ(make_content(1500, 'b'), t.local("b"));
+}
+
+TEST(replication, learn_stream_retry)
+{
+    learn_stream_test t("./test-learn-stream-retry");
+    t.remote["a"] = remote_file{ make_content(2000, 'a'), 100, false };
+
+    t.start({ "a" });
+    t.reply(0);
+    t.wait_written();
+    EXPECT_EQ(chunks({ { "a", 0 }, { "a", 1024 } }), t.sent());
+
+    // a failed chunk is requested again later, with nothing sent meanwhile
+    t.reply(1, ::dsn::ERR_TIMEOUT);
+    EXPECT_EQ(2u, t.sent().size());
+    EXPECT_EQ(0, t.inflight_count());
+    ASSERT_TRUE(t.wait_sent(3, 3000));
+    EXPECT_EQ(chunks({ { "a", 0 }, { "a", 1024 }, { "a", 1024 } }), t.sent());
+
+    t.reply_all(2);
+    EXPECT_EQ(1, s_completed_count.load());
+    EXPECT_EQ(make_content(2000, 'a'), t.local("a"));
+}
+
+TEST(replication, learn_stream_resume)
+{
+    learn_stream_test t("./test-learn-stream-resume");
+    t.remote["a"] = remote_file{ make_content(3000, 'a'), 100, false };
+
+    // the first round is aborted with a prefix of the file written
+    t.start({ "a" });
+    t.reply(0);
+    t.wait_written();
+    t.reply(1);
+    t.wait_written();
+    EXPECT_EQ(3u, t.sent().size());
+    EXPECT_EQ(make_content(3000, 'a').substr(0, 2048), t.local("a"));
+
+    // the next round from the same source resumes after the prefix
+    t.start({ "a" });
+    EXPECT_EQ(chunks({ { "a", 2048 } }), t.sent_from(3));
+    t.reply_all(3);
+    EXPECT_EQ(1, s_completed_count.load());
+    EXPECT_EQ(4u, t.sent().size());
+    EXPECT_EQ(make_content(3000, 'a'), t.local("a"));
+
+    // the remote file is changed with the same size, so it is learned from scratch
+    s_completed_count = 0;
+    t.remote["a"] = remote_file{ make_content(3000, 'z'), 101, false };
+    t.start({ "a" });
+    t.reply(4);
+    EXPECT_EQ(chunks({ { "a", 3000 }, { "a", 0 }, { "a", 1024 } }), t.sent_from(4));
+    t.reply_all(5);
+    EXPECT_EQ(1, s_completed_count.load());
+    EXPECT_EQ(make_content(3000, 'z'), t.local("a"));
+}
+
+TEST(replication, learn_stream_resume_append_only)
+{
+    learn_stream_test t("./test-learn-stream-resume-append-only");
+    t.remote["log.1.0"] = remote_file{ make_content(1500, 'l'), 100, true };
+
+    t.start({ "log.1.0" });
+    t.reply(0);
+    t.wait_written();
+    EXPECT_EQ(2u, t.sent().size());
+    EXPECT_EQ(1024u, t.local("log.1.0").length());
+
+    // a log file grows by appending only, so the prefix is kept
+    // though the file is changed since
+    std::string content = make_content(2500, 'l');
+    t.remote["log.1.0"] = remote_file{ content, 105, true };
+    EXPECT_EQ(make_content(1500, 'l').substr(0, 1024), content.substr(0, 1024));
+
+    t.start({ "log.1.0" });
+    EXPECT_EQ(chunks({ { "log.1.0", 1024 } }), t.sent_from(2));
+    t.reply_all(2);
+    EXPECT_EQ(1, s_completed_count.load());
+    EXPECT_EQ(4u, t.sent().size());
+    EXPECT_EQ(content, t.local("log.1.0"));
+}
+
+TEST(replication, learn_stream_pace)
+{
+    learn_stream_test t("./test-learn-stream-pace");
+    t.stub->options().learn_stream_chunk_kb = 64;
+    t.stub->options().learn_stream_window = 4;
+    t.stub->options().learn_stream_max_mb_per_second = 1;
+    t.remote["a"] = remote_file{ make_content(256 * 1024, 'a'), 100, false };
+
+    // 64KB for every 62.5 ms at 1MB/s, whatever the window is; the pace
+    // timer is ms granular and may fire a few ms early, so allow some slack
+    t.start({ "a" });
+    t.reply_all(0);
+    EXPECT_EQ(1, s_completed_count.load());
+    ASSERT_EQ(4u, t.sent().size());
+    EXPECT_EQ(make_content(256 * 1024, 'a'), t.local("a"));
+
+    std::lock_guard<std::mutex> l(s_sent_lock);
+    for (int i = 1; i < 4; i++)
+    {
+        EXPECT_GE(s_sent[i].ts_ms - s_sent[0].ts_ms, (uint64_t)(i * 1000 / 16 - 5));
+    }
+}
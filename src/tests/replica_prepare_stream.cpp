@@ -0,0 +1,306 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the windowed prepare stream from primary to secondaries.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include <dsn/internal/task.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+
+using namespace ::dsn::replication;
+
+// the stream messages are captured and dropped before they go to the network,
+// so that the test decides when and how they are acked
+struct sent_stream_message
+{
+    ::dsn::message_ex*           request;
+    ::dsn::rpc_response_task*    call;
+};
+
+static std::vector<sent_stream_message> s_sent;
+
+static bool capture_on_rpc_call(::dsn::task* caller, ::dsn::message_ex* request, ::dsn::rpc_response_task* call)
+{
+    request->add_ref(); // released in release_sent
+    s_sent.push_back(sent_stream_message{ request, call });
+    return false;
+}
+
+static void release_sent()
+{
+    for (auto& s : s_sent)
+        s.request->release_ref();
+    s_sent.clear();
+}
+
+class prepare_stream_test
+{
+public:
+    prepare_stream_test(const char* dir)
+        : _dir(dir), s1("localhost", 34801), s2("localhost", 34802)
+    {
+        ::dsn::utils::filesystem::remove_path(_dir);
+
+        stub = new replica_stub();
+        stub->options().prepare_stream_disabled = false;
+        stub->options().prepare_stream_window = 2;
+        stub->options().prepare_timeout_ms_for_secondaries = 100000; // no retry is close to timeout
+        stub->options().staleness_for_commit = 100;
+        stub->options().mutation_2pc_min_replica_count = 1;
+
+        rep = replica_tester::create(stub, _dir.c_str());
+
+        // a primary with two secondaries, so that acks from s1 only never
+        // make a mutation ready for commit
+        set_ballot(1);
+        replica_tester::config(rep.get()).status = PS_PRIMARY;
+        auto& ps = replica_tester::primary_states(rep.get());
+        ps.membership.primary = ::dsn::rpc_address("localhost", 34800);
+        ps.membership.secondaries.push_back(s1);
+        ps.membership.secondaries.push_back(s2);
+        ps.statuses[s1] = PS_SECONDARY;
+        ps.statuses[s2] = PS_SECONDARY;
+
+        ::dsn::task_spec::get(RPC_PREPARE_STREAM)->on_rpc_call.put_native(capture_on_rpc_call);
+    }
+
+    ~prepare_stream_test()
+    {
+        ::dsn::task_spec::get(RPC_PREPARE_STREAM)->on_rpc_call.remove("native");
+        release_sent();
+
+        replica_tester::config(rep.get()).status = PS_INACTIVE;
+        rep = nullptr;
+        delete stub;
+        ::dsn::utils::filesystem::remove_path(_dir);
+    }
+
+    void set_ballot(ballot b)
+    {
+        replica_tester::config(rep.get()).ballot = b;
+        replica_tester::primary_states(rep.get()).membership.ballot = b;
+    }
+
+    void prepare()
+    {
+        mutation_ptr mu(new mutation());
+        mu->data.header.decree = invalid_decree;
+        mu->set_logged();
+        replica_tester::init_prepare(rep.get(), mu);
+    }
+
+    // the stream messages sent to s1, as [first, last]
+    std::vector<std::pair<decree, decree>> sent_ranges()
+    {
+        std::vector<std::pair<decree, decree>> ranges;
+        for (auto& s : s_sent)
+        {
+            if (s.request->to_address != s1)
+                continue;
+
+            decree first = invalid_decree, last = invalid_decree;
+            for (decree d = 1; d <= rep->max_prepared_decree(); d++)
+            {
+                mutation_ptr mu = replica_tester::get_mutation(rep.get(), d);
+                if (mu == nullptr)
+                    continue;
+
+                auto it = mu->remote_tasks().find(s1);
+                if (it != mu->remote_tasks().end() && it->second->native_handle() == (dsn_task_t)s.call)
+                {
+                    if (first == invalid_decree)
+                        first = d;
+                    last = d;
+                }
+            }
+            ranges.push_back(std::make_pair(first, last));
+        }
+        return ranges;
+    }
+
+    ::dsn::message_ex* sent_to_s1(int index)
+    {
+        int i = 0;
+        for (auto& s : s_sent)
+        {
+            if (s.request->to_address == s1 && i++ == index)
+                return s.request;
+        }
+        return nullptr;
+    }
+
+    // reply from s1 for the index-th stream message sent to it
+    void reply(int index, ballot b, decree first, decree last, ::dsn::error_code err)
+    {
+        ::dsn::message_ex* request = sent_to_s1(index);
+        ASSERT_TRUE(request != nullptr);
+
+        prepare_ack ack;
+        ack.err = err;
+        ack.ballot = b;
+        ack.decree = last;
+        ack.last_committed_decree_in_app = 0;
+        ack.last_committed_decree_in_prepare_list = 0;
+
+        dsn_message_t response = dsn_msg_create_response(request);
+        ::marshall(response, ack);
+        auto msg = (::dsn::message_ex*)response;
+        msg->seal(false);
+        dsn_message_t received = (dsn_message_t)::dsn::message_ex::create_receive_message(msg->buffers[0]);
+        dsn_msg_add_ref(received);
+
+        replica_tester::on_prepare_stream_reply(rep.get(), b, first, last, ::dsn::ERR_OK, request, received);
+
+        dsn_msg_release_ref(received);
+        dsn_msg_add_ref(response);
+        dsn_msg_release_ref(response);
+    }
+
+    int ack_count(decree d)
+    {
+        return (int)replica_tester::get_mutation(rep.get(), d)->left_secondary_ack_count();
+    }
+
+    primary_context::prepare_stream& stream()
+    {
+        return replica_tester::primary_states(rep.get()).prepare_streams[s1];
+    }
+
+public:
+    std::string         _dir;
+    ::dsn::rpc_address  s1, s2;
+    replica_stub*       stub;
+    replica_ptr         rep;
+};
+
+typedef std::vector<std::pair<decree, decree>> ranges;
+
+TEST(replication, prepare_stream_out_of_order_ack)
+{
+    prepare_stream_test t("./test-prepare-stream-ack");
+
+    // one message per mutation until the window is full, and the rest are
+    // sent together when the window opens
+    for (int i = 0; i < 4; i++)
+        t.prepare();
+    EXPECT_EQ(ranges({ { 1, 1 }, { 2, 2 } }), t.sent_ranges());
+    EXPECT_EQ(2, t.stream().inflight_count);
+    EXPECT_EQ(2, t.stream().sent_decree);
+    EXPECT_EQ(4, t.stream().prepared_decree);
+
+    // the later message is acked first, which only acks its own mutations
+    t.reply(1, 1, 2, 2, ::dsn::ERR_OK);
+    EXPECT_EQ(2, t.ack_count(1));
+    EXPECT_EQ(1, t.ack_count(2));
+    EXPECT_EQ(ranges({ { 1, 1 }, { 2, 2 }, { 3, 4 } }), t.sent_ranges());
+    EXPECT_EQ(2, t.stream().inflight_count);
+    EXPECT_EQ(4, t.stream().sent_decree);
+
+    t.reply(0, 1, 1, 1, ::dsn::ERR_OK);
+    EXPECT_EQ(1, t.ack_count(1));
+    EXPECT_EQ(1, t.stream().inflight_count);
+
+    t.reply(2, 1, 3, 4, ::dsn::ERR_OK);
+    EXPECT_EQ(1, t.ack_count(3));
+    EXPECT_EQ(1, t.ack_count(4));
+    EXPECT_EQ(0, t.stream().inflight_count);
+
+    // nothing is committed without s2, and nothing more is sent
+    EXPECT_EQ(0, t.rep->last_committed_decree());
+    EXPECT_EQ(3u, t.sent_ranges().size());
+}
+
+TEST(replication, prepare_stream_busy_resend)
+{
+    prepare_stream_test t("./test-prepare-stream-busy");
+
+    for (int i = 0; i < 4; i++)
+        t.prepare();
+    t.reply(0, 1, 1, 1, ::dsn::ERR_OK);
+    EXPECT_EQ(ranges({ { 1, 1 }, { 2, 2 }, { 3, 4 } }), t.sent_ranges());
+
+    // a busy secondary gets exactly the same range again, in place of the
+    // old message in the window
+    t.reply(2, 1, 3, 4, ::dsn::ERR_BUSY);
+    auto sent = t.sent_ranges();
+    ASSERT_EQ(4u, sent.size());
+    EXPECT_EQ(std::make_pair((decree)3, (decree)4), sent[3]);
+    EXPECT_EQ(2, t.stream().inflight_count);
+    EXPECT_EQ(4, t.stream().sent_decree);
+    EXPECT_EQ(2, t.ack_count(3));
+    EXPECT_EQ(2, t.ack_count(4));
+
+    // and the resent one is acked as usual
+    t.reply(3, 1, 3, 4, ::dsn::ERR_OK);
+    EXPECT_EQ(1, t.ack_count(3));
+    EXPECT_EQ(1, t.ack_count(4));
+    EXPECT_EQ(1, t.stream().inflight_count);
+}
+
+TEST(replication, prepare_stream_ballot_reset)
+{
+    prepare_stream_test t("./test-prepare-stream-ballot");
+
+    for (int i = 0; i < 3; i++)
+        t.prepare();
+    EXPECT_EQ(ranges({ { 1, 1 }, { 2, 2 } }), t.sent_ranges());
+    EXPECT_EQ(2, t.stream().inflight_count);
+
+    // with a new ballot, the stream starts over from the new mutation,
+    // regardless of the full window and the unsent mutation of the old ballot
+    t.set_ballot(2);
+    t.prepare();
+    auto sent = t.sent_ranges();
+    ASSERT_EQ(3u, sent.size());
+    EXPECT_EQ(std::make_pair((decree)4, (decree)4), sent[2]);
+    EXPECT_EQ(2, t.stream().ballot);
+    EXPECT_EQ(1, t.stream().inflight_count);
+    EXPECT_EQ(4, t.stream().sent_decree);
+    EXPECT_EQ(4, t.stream().prepared_decree);
+
+    // late acks of the old ballot are ignored
+    t.reply(0, 1, 1, 1, ::dsn::ERR_OK);
+    EXPECT_EQ(2, t.ack_count(1));
+    EXPECT_EQ(1, t.stream().inflight_count);
+    EXPECT_EQ(3u, t.sent_ranges().size());
+
+    t.reply(2, 2, 4, 4, ::dsn::ERR_OK);
+    EXPECT_EQ(1, t.ack_count(4));
+    EXPECT_EQ(0, t.stream().inflight_count);
+
+    // and the streams are dropped with the preparing mutations on
+    // reconfiguration
+    replica_tester::cleanup_preparing_mutations(t.rep.get(), true);
+    EXPECT_TRUE(replica_tester::primary_states(t.rep.get()).prepare_streams.empty());
+}
@@ -0,0 +1,465 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the lease-protected and the bounded-staleness reads,
+ *     and the replica choice of the client for reads.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include "replication_app_client_tester.h"
+# include "replication_failure_detector.h"
+# include <dsn/internal/task.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <mutex>
+# include <thread>
+
+DEFINE_TASK_CODE_RPC(RPC_TEST_READ, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+namespace dsn { namespace replication {
+
+class read_test_app : public replication_app_base
+{
+public:
+    read_test_app(replica* r, decree d)
+        : replication_app_base(r), read_count(0)
+    {
+        _last_committed_decree = d;
+        register_async_rpc_handler(RPC_TEST_READ, "test.read", &read_test_app::on_read);
+    }
+
+    void on_read(const int32_t& req, rpc_replier<int32_t>& reply)
+    {
+        read_count++;
+        reply(req);
+    }
+
+    virtual int  open(bool create_new) { return 0; }
+    virtual int  close(bool clear_state) { return 0; }
+    virtual int  flush(bool wait) { return 0; }
+    virtual int  get_learn_state(decree start, const blob& learn_req, /*out*/ learn_state& state) { return 0; }
+    virtual int  apply_learn_state(learn_state& state) { return 0; }
+
+public:
+    int read_count;
+};
+
+// the beacons are never sent, and the acks are made up by the test
+class read_test_failure_detector : public replication_failure_detector
+{
+public:
+    read_test_failure_detector(replica_stub* stub, std::vector< ::dsn::rpc_address>& meta_servers)
+        : replication_failure_detector(stub, meta_servers), meta(meta_servers[0])
+    {
+    }
+
+    virtual void on_master_disconnected(const std::vector< ::dsn::rpc_address>& nodes) {}
+    virtual void on_master_connected(::dsn::rpc_address node) {}
+
+    void ack(uint64_t beacon_send_time)
+    {
+        fd::beacon_ack ack;
+        ack.time = beacon_send_time;
+        ack.this_node = meta;
+        ack.primary_node = meta;
+        ack.is_master = true;
+        ack.allowed = true;
+        end_ping(::dsn::ERR_OK, ack, nullptr);
+    }
+
+protected:
+    virtual void send_beacon(::dsn::rpc_address node, uint64_t time) {}
+
+public:
+    ::dsn::rpc_address meta;
+};
+
+}}
+
+using namespace ::dsn::replication;
+
+class read_test
+{
+public:
+    read_test(const char* dir, partition_status status, decree committed)
+        : _dir(dir)
+    {
+        ::dsn::utils::filesystem::remove_path(_dir);
+
+        stub = new replica_stub();
+        stub->options().read_max_staleness_ms = 500;
+        rep = replica_tester::create(stub, _dir.c_str());
+        app = new read_test_app(rep.get(), committed);
+        replica_tester::set_app(rep.get(), app);
+        replica_tester::config(rep.get()).ballot = 1;
+        replica_tester::config(rep.get()).status = status;
+        replica_tester::primary_states(rep.get()).last_prepare_decree_on_new_primary = 0; // set on becoming primary
+    }
+
+    ~read_test()
+    {
+        replica_tester::config(rep.get()).status = PS_INACTIVE;
+        rep = nullptr;
+        delete stub;
+        ::dsn::utils::filesystem::remove_path(_dir);
+    }
+
+    // whether the read is served, as it is dispatched to the app only then
+    bool read(read_semantic_t semantic, decree version = invalid_decree)
+    {
+        dsn_message_t request = dsn_msg_create_request(RPC_TEST_READ, 0, 0);
+        ::marshall(request, (int32_t)1);
+        auto msg = (::dsn::message_ex*)request;
+        msg->seal(false);
+        dsn_message_t received = (dsn_message_t)::dsn::message_ex::create_receive_message(msg->buffers[0]);
+        dsn_msg_add_ref(received);
+        dsn_msg_add_ref(request);
+        dsn_msg_release_ref(request);
+
+        read_request_header meta;
+        meta.gpid = rep->get_gpid();
+        meta.code = "RPC_TEST_READ";
+        meta.semantic = semantic;
+        meta.version_decree = version;
+
+        int count = app->read_count;
+        rep->on_client_read(meta, received);
+        dsn_msg_release_ref(received);
+        return app->read_count > count;
+    }
+
+public:
+    std::string    _dir;
+    replica_stub*  stub;
+    replica_ptr    rep;
+    read_test_app* app;
+};
+
+TEST(replication, read_lease)
+{
+    read_test t("./test-read-lease", PS_PRIMARY, 10);
+    std::vector< ::dsn::rpc_address> metas;
+    metas.push_back(::dsn::rpc_address("localhost", 34601));
+
+    // 1 second lease, with the acks made up below
+    read_test_failure_detector* fd = new read_test_failure_detector(t.stub, metas);
+    ASSERT_EQ(::dsn::ERR_OK, fd->start(1, 1, 1, 2));
+    fd->register_master(fd->meta);
+    replica_tester::set_failure_detector(t.stub, fd);
+    replica_tester::set_connected(t.stub, true);
+
+    // no lease before the first beacon is acked
+    EXPECT_FALSE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // acks must be of beacons sent after the registration
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    fd->ack(dsn_now_ms());
+    EXPECT_TRUE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // the lease expires without any ack, even when the node is still connected
+    std::this_thread::sleep_for(std::chrono::milliseconds(1200));
+    EXPECT_TRUE(t.stub->is_connected());
+    EXPECT_FALSE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // and is renewed by a later ack
+    fd->ack(dsn_now_ms());
+    EXPECT_TRUE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // never served without the connection to meta server
+    replica_tester::set_connected(t.stub, false);
+    EXPECT_FALSE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // or the lease check is turned off
+    t.stub->options().lease_read_disabled = true;
+    EXPECT_TRUE(t.read(read_semantic_t::ReadLastUpdate));
+
+    fd->stop();
+    replica_tester::set_failure_detector(t.stub, nullptr);
+    delete fd;
+}
+
+TEST(replication, read_bounded_staleness)
+{
+    read_test t("./test-read-bounded-staleness", PS_SECONDARY, 10);
+    auto& ss = replica_tester::secondary_states(t.rep.get());
+
+    // never heard from the primary
+    EXPECT_FALSE(t.read(read_semantic_t::ReadBoundedStaleness, 5));
+
+    ss.last_primary_contact_ms = dsn_now_ms();
+    EXPECT_TRUE(t.read(read_semantic_t::ReadBoundedStaleness, 5));
+    EXPECT_TRUE(t.read(read_semantic_t::ReadBoundedStaleness, 10));
+
+    // the required decree is not committed here yet
+    EXPECT_FALSE(t.read(read_semantic_t::ReadBoundedStaleness, 11));
+
+    // beyond the staleness bound
+    ss.last_primary_contact_ms = dsn_now_ms() - 600;
+    EXPECT_FALSE(t.read(read_semantic_t::ReadBoundedStaleness, 5));
+
+    // linearizable reads are only served by primary
+    ss.last_primary_contact_ms = dsn_now_ms();
+    EXPECT_FALSE(t.read(read_semantic_t::ReadLastUpdate));
+
+    // while the primary serves whatever the decree is
+    replica_tester::config(t.rep.get()).status = PS_PRIMARY;
+    EXPECT_TRUE(t.read(read_semantic_t::ReadBoundedStaleness, 11));
+}
+
+// the client requests are captured and dropped before they go to the network,
+// and the timeouts of the dropped calls are suppressed so that the test replies
+// them as the replicas
+struct sent_client_request
+{
+    ::dsn::message_ex*        request;
+    ::dsn::rpc_response_task* call;
+    bool                      replied;
+};
+
+static std::mutex s_client_sent_lock;
+static std::vector<sent_client_request> s_client_sent;
+
+static bool capture_client_request(::dsn::task* caller, ::dsn::message_ex* request, ::dsn::rpc_response_task* call)
+{
+    request->add_ref(); // released in the test dtor
+    call->add_ref();
+    std::lock_guard<std::mutex> l(s_client_sent_lock);
+    s_client_sent.push_back(sent_client_request{ request, call, false });
+    return false;
+}
+
+static bool suppress_client_timeout(::dsn::rpc_response_task* call)
+{
+    std::lock_guard<std::mutex> l(s_client_sent_lock);
+    for (auto& s : s_client_sent)
+    {
+        if (s.call == call)
+            return s.replied;
+    }
+    return true;
+}
+
+class read_test_client : public replication_app_client_base
+{
+public:
+    read_test_client(const std::vector< ::dsn::rpc_address>& meta_servers)
+        : replication_app_client_base(meta_servers, "read_client_test"), err(::dsn::ERR_IO_PENDING), value(0)
+    {
+    }
+
+    ~read_test_client() { err.end_tracking(); }
+
+    void on_read(::dsn::error_code e, std::shared_ptr<int32_t>& req, std::shared_ptr<int32_t>& resp)
+    {
+        err = e;
+        if (e == ::dsn::ERR_OK)
+            value = *resp;
+    }
+
+public:
+    ::dsn::error_code err;
+    int32_t           value;
+};
+
+class read_client_test
+{
+public:
+    read_client_test()
+        : primary("localhost", 34801), secondary("localhost", 34802)
+    {
+        std::vector< ::dsn::rpc_address> metas;
+        metas.push_back(::dsn::rpc_address("localhost", 34601));
+        client = new read_test_client(metas);
+
+        config.gpid.app_id = 1;
+        config.gpid.pidx = 0;
+        config.primary = primary;
+        config.secondaries.push_back(secondary);
+        replication_app_client_tester::set_configs(client, 1, std::vector<partition_configuration>({ config }));
+
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ)->on_rpc_call.put_native(capture_client_request);
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ_ACK)->on_rpc_response_enqueue.put_native(suppress_client_timeout);
+    }
+
+    ~read_client_test()
+    {
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ)->on_rpc_call.remove("native");
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ_ACK)->on_rpc_response_enqueue.remove("native");
+        delete client;
+
+        std::lock_guard<std::mutex> l(s_client_sent_lock);
+        for (auto& s : s_client_sent)
+        {
+            s.call->release_ref();
+            s.request->release_ref();
+        }
+        s_client_sent.clear();
+    }
+
+    ::dsn::task_ptr read(read_semantic_t semantic, decree version)
+    {
+        std::shared_ptr<int32_t> req(new int32_t(1));
+        return client->read(0, RPC_TEST_READ, req, client, &read_test_client::on_read, 100000, 0, semantic, version);
+    }
+
+    bool wait_sent(size_t count)
+    {
+        for (int i = 0; i < 300 && sent_count() < count; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return sent_count() >= count;
+    }
+
+    size_t sent_count()
+    {
+        std::lock_guard<std::mutex> l(s_client_sent_lock);
+        return s_client_sent.size();
+    }
+
+    ::dsn::rpc_address sent_to(int index)
+    {
+        std::lock_guard<std::mutex> l(s_client_sent_lock);
+        return s_client_sent[index].request->to_address;
+    }
+
+    // reply as the replica, with the replication error ahead of the app response
+    void reply(int index, ::dsn::error_code err, int32_t value)
+    {
+        sent_client_request s;
+        {
+            std::lock_guard<std::mutex> l(s_client_sent_lock);
+            s_client_sent[index].replied = true;
+            s = s_client_sent[index];
+        }
+
+        dsn_message_t response = dsn_msg_create_response(s.request);
+        ::marshall(response, err);
+        if (err == ::dsn::ERR_OK)
+            ::marshall(response, value);
+
+        auto msg = (::dsn::message_ex*)response;
+        msg->seal(false);
+        auto received = ::dsn::message_ex::create_receive_message(msg->buffers[0]);
+        dsn_msg_add_ref(response);
+        dsn_msg_release_ref(response);
+
+        s.call->set_delay(0);
+        s.call->enqueue(::dsn::ERR_OK, received);
+    }
+
+public:
+    ::dsn::rpc_address           primary;
+    ::dsn::rpc_address           secondary;
+    partition_configuration      config;
+    read_test_client*            client;
+};
+
+TEST(replication, read_stale_fallback_to_primary)
+{
+    read_client_test t;
+
+    // the secondary is the faster one
+    replication_app_client_tester::update_read_latency_us(t.client, t.primary, 10000);
+    replication_app_client_tester::update_read_latency_us(t.client, t.secondary, 100);
+
+    auto task = t.read(read_semantic_t::ReadBoundedStaleness, 5);
+    ASSERT_TRUE(t.wait_sent(1));
+    EXPECT_EQ(t.secondary, t.sent_to(0));
+
+    // the secondary is too stale, and the config is dropped on the retry,
+    // which is put back here before it is queried again from meta server
+    t.reply(0, ::dsn::ERR_INVALID_STATE, 0);
+    for (int i = 0; i < 100 && replication_app_client_tester::has_config(t.client, 0); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(replication_app_client_tester::has_config(t.client, 0));
+    replication_app_client_tester::set_configs(t.client, 1, std::vector<partition_configuration>({ t.config }));
+
+    // the retry goes to the primary though the secondary is still faster
+    ASSERT_TRUE(t.wait_sent(2));
+    EXPECT_EQ(t.primary, t.sent_to(1));
+    EXPECT_LT(replication_app_client_tester::get_read_latency_us(t.client, t.secondary),
+        replication_app_client_tester::get_read_latency_us(t.client, t.primary));
+
+    t.reply(1, ::dsn::ERR_OK, 42);
+    task->wait();
+    EXPECT_EQ(::dsn::ERR_OK, t.client->err);
+    EXPECT_EQ(42, t.client->value);
+    EXPECT_EQ(2u, t.sent_count());
+}
+
+TEST(replication, read_latency_pick)
+{
+    read_client_test t;
+    ::dsn::rpc_address slow("localhost", 34803);
+    t.config.secondaries.push_back(slow);
+
+    // the linearizable reads always go to the primary
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(t.primary, t.client->get_read_address(read_semantic_t::ReadLastUpdate, t.config));
+    }
+
+    // replicas never tried are preferred, so the slow one is tried sometime
+    replication_app_client_tester::update_read_latency_us(t.client, t.primary, 100);
+    replication_app_client_tester::update_read_latency_us(t.client, t.secondary, 200);
+    int slow_count = 0;
+    for (int i = 0; i < 200; i++)
+    {
+        if (t.client->get_read_address(read_semantic_t::ReadOutdated, t.config) == slow)
+            slow_count++;
+    }
+    EXPECT_GT(slow_count, 0);
+
+    // the faster one of two random replicas, so the slowest one is never
+    // picked, and the fastest one is picked whenever it is one of the two
+    replication_app_client_tester::update_read_latency_us(t.client, slow, 5000);
+    std::map< ::dsn::rpc_address, int> counts;
+    for (int i = 0; i < 300; i++)
+    {
+        counts[t.client->get_read_address(read_semantic_t::ReadBoundedStaleness, t.config)]++;
+    }
+    EXPECT_EQ(0, counts[slow]);
+    EXPECT_GT(counts[t.primary], counts[t.secondary]);
+    EXPECT_EQ(300, counts[t.primary] + counts[t.secondary]);
+
+    // the moving average catches up when the primary becomes slow
+    for (int i = 0; i < 30; i++)
+    {
+        replication_app_client_tester::update_read_latency_us(t.client, t.primary, 10000);
+    }
+    counts.clear();
+    for (int i = 0; i < 300; i++)
+    {
+        counts[t.client->get_read_address(read_semantic_t::ReadOutdated, t.config)]++;
+    }
+    EXPECT_EQ(0, counts[t.primary]);
+    EXPECT_GT(counts[t.secondary], counts[slow]);
+}
@@ -0,0 +1,83 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Access to the replica internals for the unit-tests.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# pragma once
+
+# include "replica.h"
+# include "replica_stub.h"
+# include "mutation.h"
+# include "mutation_log.h"
+
+namespace dsn { namespace replication {
+
+class replica_tester
+{
+public:
+    static replica* create(replica_stub* stub, const char* dir) { return new replica(stub, dir); }
+
+    static replica_configuration& config(replica* r) { return r->_config; }
+    static primary_context& primary_states(replica* r) { return r->_primary_states; }
+    static apply_context& apply_states(replica* r) { return r->_apply; }
+    static secondary_context& secondary_states(replica* r) { return r->_secondary_states; }
+    static potential_secondary_context& potential_secondary_states(replica* r) { return r->_potential_secondary_states; }
+    static mutation_ptr get_mutation(replica* r, decree d) { return r->_prepare_list->get_mutation_by_decree(d); }
+    static decree last_applying_decree(replica* r) { return r->last_applying_decree(); }
+    static void set_app(replica* r, replication_app_base* app) { r->_app = app; } // deleted with the replica
+
+    static void set_connected(replica_stub* stub, bool connected) { stub->_state = connected ? replica_stub::NS_Connected : replica_stub::NS_Disconnected; }
+    static void set_failure_detector(replica_stub* stub, replication_failure_detector* fd) { stub->_failure_detector = fd; } // not owned by the stub
+
+    static void init_prepare(replica* r, mutation_ptr& mu) { r->init_prepare(mu); }
+    static void cleanup_preparing_mutations(replica* r, bool is_primary) { r->cleanup_preparing_mutations(is_primary); }
+    static void apply_mutation_async(replica* r, mutation_ptr& mu) { r->apply_mutation_async(mu); }
+    static bool update_local_configuration_with_no_ballot_change(replica* r, partition_status s)
+    {
+        return r->update_local_configuration_with_no_ballot_change(s);
+    }
+
+    static void start_learn_stream(replica* r, std::shared_ptr<learn_response>& resp) { r->start_learn_stream(resp); }
+    static void on_learn_chunk_reply(replica* r, learn_stream_context_ptr stream, int file_index, int64_t offset,
+        error_code err, dsn_message_t request, dsn_message_t reply)
+    {
+        r->on_learn_chunk_reply(stream, file_index, offset, err, request, reply);
+    }
+
+    static void on_prepare_stream_reply(replica* r, ballot b, decree first, decree last, error_code err, dsn_message_t request, dsn_message_t reply)
+    {
+        r->on_prepare_stream_reply(b, first, last, err, request, reply);
+    }
+};
+
+}}
@@ -0,0 +1,194 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for applying batched mutations in replication_app_base.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+
+DEFINE_TASK_CODE_RPC(RPC_TEST_APP_WRITE, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+namespace dsn { namespace replication {
+
+class replication_app_base_tester : public replication_app_base
+{
+public:
+    struct write_record
+    {
+        int32_t       value;
+        decree        app_decree;  // seen by the handler
+        bool          in_batch;
+        dsn_message_t response;
+    };
+
+    replication_app_base_tester(replica* r)
+        : replication_app_base(r), _in_batch(false)
+    {
+        _handlers[RPC_TEST_APP_WRITE] = [this](binary_reader& reader, dsn_message_t response)
+        {
+            write_record rec;
+            unmarshall(reader, rec.value);
+            rec.app_decree = last_committed_decree();
+            rec.in_batch = _in_batch;
+            rec.response = response;
+            if (response != nullptr)
+            {
+                // kept for checking the reply after it is sent
+                dsn_msg_add_ref(response);
+            }
+            writes.push_back(rec);
+
+            rpc_replier<int32_t> reply(response);
+            reply(rec.value * 10);
+        };
+    }
+
+    virtual int  open(bool create_new) { return 0; }
+    virtual int  close(bool clear_state) { return 0; }
+    virtual int  flush(bool wait) { return 0; }
+    virtual void on_batched_write_begin() { _in_batch = true; }
+    virtual void on_batched_write_end() { _in_batch = false; }
+    virtual int  get_learn_state(decree start, const blob& learn_req, /*out*/ learn_state& state) { return 0; }
+    virtual int  apply_learn_state(learn_state& state) { return 0; }
+
+    error_code write(mutation_ptr& mu) { return write_internal(mu); }
+
+public:
+    std::vector<write_record> writes;
+
+private:
+    bool _in_batch;
+};
+
+}}
+
+using namespace ::dsn::replication;
+
+static dsn_message_t create_received_write(int32_t value)
+{
+    dsn_message_t request = dsn_msg_create_request(RPC_TEST_APP_WRITE, 0, 0);
+    ::marshall(request, value);
+
+    auto msg = (::dsn::message_ex*)request;
+    msg->seal(false);
+    dsn_message_t received = (dsn_message_t)::dsn::message_ex::create_receive_message(msg->buffers[0]);
+
+    dsn_msg_add_ref(request);
+    dsn_msg_release_ref(request);
+    return received;
+}
+
+TEST(replication, app_batched_write)
+{
+    std::string dir = "./test-app-batched-write";
+    ::dsn::utils::filesystem::remove_path(dir);
+
+    replica_stub* stub = new replica_stub();
+    replica_ptr rep = replica_tester::create(stub, dir.c_str());
+    replication_app_base_tester* app = new replication_app_base_tester(rep.get());
+
+    // one mutation with three client writes
+    const int count = 3;
+    std::vector<dsn_message_t> requests;
+    mutation_ptr mu(new mutation());
+    mu->data.header.ballot = 1;
+    mu->data.header.decree = 1;
+    mu->data.header.last_committed_decree = 0;
+    for (int i = 0; i < count; i++)
+    {
+        dsn_message_t request = create_received_write(i + 1);
+        requests.push_back(request);
+        mu->add_client_request(RPC_TEST_APP_WRITE, request);
+    }
+    ASSERT_EQ(count, (int)mu->data.updates.size());
+
+    EXPECT_EQ(::dsn::ERR_OK, app->write(mu));
+    EXPECT_EQ(1, app->last_committed_decree());
+
+    // every write is applied in order within the batch, without seeing
+    // any half-applied decree, and is replied to its own client
+    ASSERT_EQ(count, (int)app->writes.size());
+    for (int i = 0; i < count; i++)
+    {
+        auto& rec = app->writes[i];
+        EXPECT_EQ(i + 1, rec.value);
+        EXPECT_EQ(0, rec.app_decree);
+        EXPECT_TRUE(rec.in_batch);
+        ASSERT_TRUE(rec.response != nullptr);
+
+        auto resp = (::dsn::message_ex*)rec.response;
+        EXPECT_EQ(((::dsn::message_ex*)requests[i])->header->id, resp->header->id);
+
+        resp->seal(false);
+        dsn_message_t received = (dsn_message_t)::dsn::message_ex::create_receive_message(resp->buffers[0]);
+        int err;
+        int32_t value;
+        ::unmarshall(received, err);
+        ::unmarshall(received, value);
+        EXPECT_EQ(0, err);
+        EXPECT_EQ((i + 1) * 10, value);
+
+        dsn_msg_add_ref(received);
+        dsn_msg_release_ref(received);
+        dsn_msg_release_ref(rec.response);
+    }
+    app->writes.clear();
+
+    // updates replayed without client requests (e.g., on secondaries)
+    mutation_ptr mu2(new mutation());
+    mu2->data.header.ballot = 1;
+    mu2->data.header.decree = 2;
+    mu2->data.header.last_committed_decree = 1;
+    mu2->rpc_code = RPC_TEST_APP_WRITE;
+    mu2->data.updates = mu->data.updates;
+
+    EXPECT_EQ(::dsn::ERR_OK, app->write(mu2));
+    EXPECT_EQ(2, app->last_committed_decree());
+    ASSERT_EQ(count, (int)app->writes.size());
+    for (int i = 0; i < count; i++)
+    {
+        EXPECT_EQ(i + 1, app->writes[i].value);
+        EXPECT_EQ(1, app->writes[i].app_decree);
+        EXPECT_TRUE(app->writes[i].response == nullptr);
+    }
+
+    // the requests are released with the mutation
+    mu = nullptr;
+    mu2 = nullptr;
+
+    delete app;
+    rep = nullptr;
+    delete stub;
+    ::dsn::utils::filesystem::remove_path(dir);
+}
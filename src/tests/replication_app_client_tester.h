@@ -0,0 +1,68 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Access to the replication client internals for the unit-tests.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# pragma once
+
+# include <dsn/dist/replication/replication_app_client_base.h>
+
+namespace dsn { namespace replication {
+
+class replication_app_client_tester
+{
+public:
+    // as if the partition configurations are already queried from meta server
+    static void set_configs(replication_app_client_base* c, int app_id, const std::vector<partition_configuration>& configs)
+    {
+        ::dsn::service::zauto_write_lock l(c->_config_lock);
+        c->_app_id = app_id;
+        c->_app_partition_count = static_cast<int>(configs.size());
+        for (auto& pc : configs)
+            c->_config_cache[pc.gpid.pidx] = pc;
+    }
+
+    static bool has_config(replication_app_client_base* c, int pidx)
+    {
+        ::dsn::service::zauto_read_lock l(c->_config_lock);
+        return c->_config_cache.find(pidx) != c->_config_cache.end();
+    }
+
+    static double get_read_latency_us(replication_app_client_base* c, ::dsn::rpc_address addr) { return c->get_read_latency_us(addr); }
+    static void update_read_latency_us(replication_app_client_base* c, ::dsn::rpc_address addr, uint64_t latency_us)
+    {
+        c->update_read_latency_us(addr, latency_us);
+    }
+};
+
+}}
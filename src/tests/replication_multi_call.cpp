@@ -0,0 +1,366 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the multi_read/multi_write batch calls of the
+ *     replication client, which scatter the keys to their partitions.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replication_app_client_tester.h"
+# include <dsn/internal/task.h>
+# include <dsn/internal/rpc_message.h>
+# include <gtest/gtest.h>
+# include <mutex>
+# include <thread>
+
+DEFINE_TASK_CODE_RPC(RPC_TEST_MULTI_READ, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+DEFINE_TASK_CODE_RPC(RPC_TEST_MULTI_WRITE, TASK_PRIORITY_COMMON, ::dsn::THREAD_POOL_DEFAULT)
+
+using namespace ::dsn::replication;
+
+// the client requests are captured and dropped before they go to the network,
+// and the timeouts of the dropped calls are suppressed so that the test replies
+// them as the primaries
+struct sent_group_request
+{
+    ::dsn::message_ex*        request;
+    ::dsn::rpc_response_task* call;
+    ::dsn::rpc_address        to;
+    std::vector<int32_t>      keys;
+    bool                      replied;
+};
+
+static std::mutex s_group_sent_lock;
+static std::vector<sent_group_request> s_group_sent;
+
+// the sealed message as the receiver sees it, in one buffer
+static ::dsn::message_ex* receive_message(::dsn::message_ex* msg)
+{
+    msg->seal(false);
+    if (msg->buffers.size() == 1)
+        return ::dsn::message_ex::create_receive_message(msg->buffers[0]);
+
+    int length = 0;
+    for (auto& b : msg->buffers)
+        length += b.length();
+    std::shared_ptr<char> buffer(new char[length], std::default_delete<char[]>());
+    int offset = 0;
+    for (auto& b : msg->buffers)
+    {
+        memcpy(buffer.get() + offset, b.data(), b.length());
+        offset += b.length();
+    }
+    return ::dsn::message_ex::create_receive_message(::dsn::blob(buffer, length));
+}
+
+static bool capture_group_request(::dsn::task* caller, ::dsn::message_ex* request, ::dsn::rpc_response_task* call)
+{
+    // the replication header goes ahead of the batch of keys
+    dsn_message_t received = (dsn_message_t)receive_message(request);
+    dsn_msg_add_ref(received);
+    std::vector<int32_t> keys;
+    if (request->local_rpc_code == RPC_REPLICATION_CLIENT_READ)
+    {
+        read_request_header header;
+        ::unmarshall(received, header);
+    }
+    else
+    {
+        write_request_header header;
+        ::unmarshall(received, header);
+    }
+    ::unmarshall(received, keys);
+    dsn_msg_release_ref(received);
+
+    request->add_ref(); // released in the test dtor
+    call->add_ref();
+    std::lock_guard<std::mutex> l(s_group_sent_lock);
+    s_group_sent.push_back(sent_group_request{ request, call, request->to_address, keys, false });
+    return false;
+}
+
+static bool suppress_group_timeout(::dsn::rpc_response_task* call)
+{
+    std::lock_guard<std::mutex> l(s_group_sent_lock);
+    for (auto& s : s_group_sent)
+    {
+        if (s.call == call)
+            return s.replied;
+    }
+    return true;
+}
+
+class multi_test_client : public replication_app_client_base
+{
+public:
+    multi_test_client(const std::vector< ::dsn::rpc_address>& meta_servers)
+        : replication_app_client_base(meta_servers, "multi_call_test")
+    {
+    }
+};
+
+class multi_call_test
+{
+public:
+    multi_call_test(int partition_count)
+        : err(::dsn::ERR_IO_PENDING), callback_count(0)
+    {
+        std::vector< ::dsn::rpc_address> metas;
+        metas.push_back(::dsn::rpc_address("localhost", 34601));
+        client = new multi_test_client(metas);
+
+        // one primary for each partition, so the groups are told by the target
+        std::vector<partition_configuration> configs;
+        for (int i = 0; i < partition_count; i++)
+        {
+            partition_configuration config;
+            config.gpid.app_id = 1;
+            config.gpid.pidx = i;
+            config.primary = primary(i);
+            configs.push_back(config);
+        }
+        replication_app_client_tester::set_configs(client, 1, configs);
+
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ)->on_rpc_call.put_native(capture_group_request);
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ_ACK)->on_rpc_response_enqueue.put_native(suppress_group_timeout);
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_WRITE)->on_rpc_call.put_native(capture_group_request);
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_WRITE_ACK)->on_rpc_response_enqueue.put_native(suppress_group_timeout);
+    }
+
+    ~multi_call_test()
+    {
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ)->on_rpc_call.remove("native");
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_READ_ACK)->on_rpc_response_enqueue.remove("native");
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_WRITE)->on_rpc_call.remove("native");
+        ::dsn::task_spec::get(RPC_REPLICATION_CLIENT_WRITE_ACK)->on_rpc_response_enqueue.remove("native");
+        delete client;
+        err.end_tracking();
+        for (auto& e : errors)
+            e.end_tracking();
+
+        std::lock_guard<std::mutex> l(s_group_sent_lock);
+        for (auto& s : s_group_sent)
+        {
+            s.call->release_ref();
+            s.request->release_ref();
+        }
+        s_group_sent.clear();
+    }
+
+    static ::dsn::rpc_address primary(int pidx) { return ::dsn::rpc_address("localhost", 34801 + pidx); }
+
+    std::function<void(::dsn::error_code, const std::vector< ::dsn::error_code>&, std::vector<int32_t>&)> callback()
+    {
+        return [this](::dsn::error_code e, const std::vector< ::dsn::error_code>& errs, std::vector<int32_t>& vs)
+        {
+            err = e;
+            errors = errs;
+            values = vs;
+            callback_count++;
+        };
+    }
+
+    std::function<int(const int32_t&)> partition_of(int partition_count)
+    {
+        return [partition_count](const int32_t& key) { return key % partition_count; };
+    }
+
+    bool wait_sent(size_t count)
+    {
+        for (int i = 0; i < 300 && sent_count() < count; i++)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return sent_count() >= count;
+    }
+
+    size_t sent_count()
+    {
+        std::lock_guard<std::mutex> l(s_group_sent_lock);
+        return s_group_sent.size();
+    }
+
+    sent_group_request sent_to(int pidx)
+    {
+        std::lock_guard<std::mutex> l(s_group_sent_lock);
+        for (auto& s : s_group_sent)
+        {
+            if (s.to == primary(pidx))
+                return s;
+        }
+        return sent_group_request{ nullptr, nullptr, ::dsn::rpc_address(), std::vector<int32_t>(), false };
+    }
+
+    // reply as the primary, with the replication error ahead of the app response
+    void reply(int pidx, ::dsn::error_code e, const std::vector<int32_t>& resp)
+    {
+        sent_group_request s;
+        {
+            std::lock_guard<std::mutex> l(s_group_sent_lock);
+            for (auto& sg : s_group_sent)
+            {
+                if (sg.to == primary(pidx))
+                {
+                    sg.replied = true;
+                    s = sg;
+                    break;
+                }
+            }
+        }
+        ASSERT_TRUE(s.call != nullptr);
+
+        dsn_message_t response = dsn_msg_create_response(s.request);
+        ::marshall(response, e);
+        if (e == ::dsn::ERR_OK)
+            ::marshall(response, resp);
+
+        auto msg = (::dsn::message_ex*)response;
+        auto received = receive_message(msg);
+        dsn_msg_add_ref(response);
+        dsn_msg_release_ref(response);
+
+        s.call->set_delay(0);
+        s.call->enqueue(::dsn::ERR_OK, received);
+    }
+
+    // the value of a key is ten times the key
+    std::vector<int32_t> values_of(const std::vector<int32_t>& keys)
+    {
+        std::vector<int32_t> vs;
+        for (auto& k : keys)
+            vs.push_back(k * 10);
+        return vs;
+    }
+
+public:
+    multi_test_client*              client;
+    ::dsn::error_code               err;
+    std::vector< ::dsn::error_code> errors;
+    std::vector<int32_t>            values;
+    int                             callback_count;
+};
+
+TEST(replication, multi_read_partial_failure)
+{
+    multi_call_test t(3);
+    std::vector<int32_t> keys({ 7, 3, 4, 9, 5, 1, 8, 6 });
+
+    auto tasks = t.client->multi_read<int32_t, int32_t>(
+        RPC_TEST_MULTI_READ, keys, t.partition_of(3), t.callback(),
+        100000, 0, read_semantic_t::ReadLastUpdate);
+    ASSERT_EQ(3u, tasks.size());
+    ASSERT_TRUE(t.wait_sent(3));
+
+    // one request for each partition, with its keys in the batch order
+    EXPECT_EQ(std::vector<int32_t>({ 3, 9, 6 }), t.sent_to(0).keys);
+    EXPECT_EQ(std::vector<int32_t>({ 7, 4, 1 }), t.sent_to(1).keys);
+    EXPECT_EQ(std::vector<int32_t>({ 5, 8 }), t.sent_to(2).keys);
+
+    // the callback is fired only after all groups complete
+    t.reply(2, ::dsn::ERR_OK, t.values_of(t.sent_to(2).keys));
+    tasks[2]->wait();
+    EXPECT_EQ(0, t.callback_count);
+
+    // partition 1 fails without retry, as its app cannot handle the request
+    t.reply(1, ::dsn::ERR_HANDLER_NOT_FOUND, std::vector<int32_t>());
+    t.reply(0, ::dsn::ERR_OK, t.values_of(t.sent_to(0).keys));
+    for (auto& task : tasks)
+        task->wait();
+
+    EXPECT_EQ(1, t.callback_count);
+    EXPECT_EQ(::dsn::ERR_HANDLER_NOT_FOUND, t.err);
+    ASSERT_EQ(keys.size(), t.errors.size());
+    ASSERT_EQ(keys.size(), t.values.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] % 3 == 1)
+        {
+            EXPECT_EQ(::dsn::ERR_HANDLER_NOT_FOUND, t.errors[i]);
+        }
+        else
+        {
+            EXPECT_EQ(::dsn::ERR_OK, t.errors[i]);
+            EXPECT_EQ(keys[i] * 10, t.values[i]);
+        }
+    }
+    EXPECT_EQ(3u, t.sent_count());
+}
+
+TEST(replication, multi_write_partial_failure)
+{
+    multi_call_test t(4);
+    std::vector<int32_t> keys({ 2, 6, 11, 0, 10, 3, 4 });
+
+    // no key goes to partition 1
+    auto tasks = t.client->multi_write<int32_t, int32_t>(
+        RPC_TEST_MULTI_WRITE, keys, t.partition_of(4), t.callback(), 100000);
+    ASSERT_EQ(3u, tasks.size());
+    ASSERT_TRUE(t.wait_sent(3));
+    EXPECT_EQ(std::vector<int32_t>({ 0, 4 }), t.sent_to(0).keys);
+    EXPECT_EQ(nullptr, t.sent_to(1).call);
+    EXPECT_EQ(std::vector<int32_t>({ 2, 6, 10 }), t.sent_to(2).keys);
+    EXPECT_EQ(std::vector<int32_t>({ 11, 3 }), t.sent_to(3).keys);
+
+    // partition 3 replies one value short, which fails its keys only
+    t.reply(0, ::dsn::ERR_OK, t.values_of(t.sent_to(0).keys));
+    t.reply(3, ::dsn::ERR_OK, std::vector<int32_t>({ 110 }));
+    t.reply(2, ::dsn::ERR_OK, t.values_of(t.sent_to(2).keys));
+    for (auto& task : tasks)
+        task->wait();
+
+    EXPECT_EQ(1, t.callback_count);
+    EXPECT_EQ(::dsn::ERR_INVALID_DATA, t.err);
+    ASSERT_EQ(keys.size(), t.errors.size());
+    for (size_t i = 0; i < keys.size(); i++)
+    {
+        if (keys[i] % 4 == 3)
+        {
+            EXPECT_EQ(::dsn::ERR_INVALID_DATA, t.errors[i]);
+        }
+        else
+        {
+            EXPECT_EQ(::dsn::ERR_OK, t.errors[i]);
+            EXPECT_EQ(keys[i] * 10, t.values[i]);
+        }
+    }
+}
+
+TEST(replication, multi_call_empty)
+{
+    multi_call_test t(2);
+    auto tasks = t.client->multi_write<int32_t, int32_t>(
+        RPC_TEST_MULTI_WRITE, std::vector<int32_t>(), t.partition_of(2), t.callback(), 100000);
+
+    // nothing is sent, and the callback is fired in place
+    EXPECT_TRUE(tasks.empty());
+    EXPECT_EQ(1, t.callback_count);
+    EXPECT_EQ(::dsn::ERR_OK, t.err);
+    EXPECT_TRUE(t.errors.empty());
+    EXPECT_EQ(0u, t.sent_count());
+}
@@ -0,0 +1,265 @@
+/*
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2015 Microsoft Corporation
+ *
+ * -=- Robust Distributed System Nucleus (rDSN) -=-
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Description:
+ *     Unit-test for the full and delta checkpoints of simple_kv.
+ *
+ * Revision history:
+ *     xxxx-xx-xx, author, first version
+ *     xxxx-xx-xx, author, fix bug about xxx
+ */
+
+# include "replica_tester.h"
+# include "simple_kv.server.impl.h"
+# include <gtest/gtest.h>
+# include <fstream>
+
+using namespace ::dsn::replication;
+using namespace ::dsn::replication::application;
+
+// the writes are applied as the framework does, with the decree advanced
+// after the handler
+class simple_kv_test_app : public simple_kv_service_impl
+{
+public:
+    simple_kv_test_app(replica* r) : simple_kv_service_impl(r) {}
+
+    void write(const std::string& key, const std::string& value)
+    {
+        kv_pair pr;
+        pr.key = key;
+        pr.value = value;
+        ::dsn::rpc_replier<int32_t> reply(nullptr);
+        on_write(pr, reply);
+        _last_committed_decree++;
+    }
+
+    void append(const std::string& key, const std::string& value)
+    {
+        kv_pair pr;
+        pr.key = key;
+        pr.value = value;
+        ::dsn::rpc_replier<int32_t> reply(nullptr);
+        on_append(pr, reply);
+        _last_committed_decree++;
+    }
+
+    // the whole store, as it is sent to the learners
+    std::map<std::string, std::string> state()
+    {
+        learn_state ls;
+        EXPECT_EQ(0, get_learn_state(0, ::dsn::blob(), ls));
+
+        ::dsn::binary_reader reader(ls.meta[0]);
+        int magic;
+        decree d;
+        uint64_t count;
+        reader.read(magic);
+        reader.read(d);
+        reader.read(count);
+        EXPECT_EQ(last_committed_decree(), d);
+
+        std::map<std::string, std::string> kvs;
+        for (uint64_t i = 0; i < count; i++)
+        {
+            std::string key, value;
+            reader.read(key);
+            reader.read(value);
+            kvs[key] = value;
+        }
+        return kvs;
+    }
+};
+
+class simple_kv_checkpoint_test
+{
+public:
+    simple_kv_checkpoint_test(const char* dir)
+        : _dir(dir), app(nullptr)
+    {
+        ::dsn::utils::filesystem::remove_path(_dir);
+
+        stub = new replica_stub();
+        rep = replica_tester::create(stub, _dir.c_str());
+        reopen(true);
+    }
+
+    ~simple_kv_checkpoint_test()
+    {
+        close();
+        rep = nullptr;
+        delete stub;
+        ::dsn::utils::filesystem::remove_path(_dir);
+    }
+
+    void close()
+    {
+        if (app != nullptr)
+        {
+            EXPECT_EQ(0, app->close(false));
+            delete app;
+            app = nullptr;
+        }
+    }
+
+    void reopen(bool create_new)
+    {
+        close();
+        app = new simple_kv_test_app(rep.get());
+        EXPECT_EQ(0, app->open(create_new));
+    }
+
+    std::vector<std::string> files()
+    {
+        std::vector<std::string> paths, names;
+        ::dsn::utils::filesystem::get_subfiles(app->data_dir(), paths, false);
+        for (auto& p : paths)
+            names.push_back(::dsn::utils::filesystem::get_file_name(p));
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    void add_file(const std::string& name)
+    {
+        std::ofstream os((app->data_dir() + "/" + name).c_str(), std::ios::binary);
+        os << "partially written";
+    }
+
+public:
+    std::string         _dir;
+    replica_stub*       stub;
+    replica_ptr         rep;
+    simple_kv_test_app* app;
+};
+
+typedef std::vector<std::string> names;
+
+TEST(replication, simple_kv_checkpoint_recover)
+{
+    simple_kv_checkpoint_test t("./test-simple-kv-checkpoint-recover");
+
+    // the first checkpoint is compacted into a full one at once, as there
+    // is no full one to be chained on
+    for (int i = 0; i < 20; i++)
+        t.app->write("k" + std::to_string(i), std::string(100, 'a' + i % 26));
+    EXPECT_EQ(0, t.app->flush(true));
+    EXPECT_EQ(names({ "checkpoint.20" }), t.files());
+    EXPECT_EQ(20, t.app->last_durable_decree());
+
+    // only the changed keys are written in the deltas afterwards
+    t.app->write("k1", "overwritten");
+    EXPECT_EQ(0, t.app->flush(true));
+    t.app->append("k2", "appended");
+    EXPECT_EQ(0, t.app->flush(true));
+    t.app->write("k20", "new");
+    EXPECT_EQ(0, t.app->flush(true));
+    EXPECT_EQ(names({ "checkpoint.20", "delta.20.21", "delta.21.22", "delta.22.23" }), t.files());
+    EXPECT_EQ(23, t.app->last_durable_decree());
+
+    // nothing to write when nothing is changed
+    EXPECT_EQ(0, t.app->flush(true));
+    EXPECT_EQ(4u, t.files().size());
+
+    // recovered from the full checkpoint and the delta chain
+    auto state = t.app->state();
+    EXPECT_EQ(21u, state.size());
+    EXPECT_EQ("overwritten", state["k1"]);
+    EXPECT_EQ(std::string(100, 'c') + "appended", state["k2"]);
+
+    t.reopen(false);
+    EXPECT_EQ(23, t.app->last_committed_decree());
+    EXPECT_EQ(23, t.app->last_durable_decree());
+    EXPECT_EQ(state, t.app->state());
+    EXPECT_EQ(4u, t.files().size());
+
+    // the deltas are compacted into a full one when there are too many,
+    // which replaces all the files before
+    for (int i = 0; i < 8; i++)
+    {
+        t.app->write("k" + std::to_string(i), "round" + std::to_string(i));
+        EXPECT_EQ(0, t.app->flush(true));
+    }
+    EXPECT_EQ(names({ "checkpoint.31" }), t.files());
+    EXPECT_EQ(31, t.app->last_durable_decree());
+
+    state = t.app->state();
+    EXPECT_EQ("round1", state["k1"]);
+    EXPECT_EQ("new", state["k20"]);
+    EXPECT_EQ(std::string(100, 'a' + 9), state["k9"]);
+
+    t.reopen(false);
+    EXPECT_EQ(31, t.app->last_committed_decree());
+    EXPECT_EQ(state, t.app->state());
+
+    // deltas are chained on the compacted one again
+    t.app->write("k9", "after compaction");
+    EXPECT_EQ(0, t.app->flush(true));
+    EXPECT_EQ(names({ "checkpoint.31", "delta.31.32" }), t.files());
+    state = t.app->state();
+
+    t.reopen(false);
+    EXPECT_EQ(32, t.app->last_committed_decree());
+    EXPECT_EQ(state, t.app->state());
+}
+
+TEST(replication, simple_kv_checkpoint_cleanup)
+{
+    simple_kv_checkpoint_test t("./test-simple-kv-checkpoint-cleanup");
+
+    for (int i = 0; i < 10; i++)
+        t.app->write("k" + std::to_string(i), std::string(100, 'x'));
+    EXPECT_EQ(0, t.app->flush(true));
+    t.app->write("k0", "changed");
+    EXPECT_EQ(0, t.app->flush(true));
+    EXPECT_EQ(names({ "checkpoint.10", "delta.10.11" }), t.files());
+    auto state = t.app->state();
+    t.close();
+
+    // leftovers of interrupted checkpoint writes, a delta replaced by a
+    // later one on the same base, and a delta off the chain (e.g., based
+    // on a state replaced by learning); none of them is ever read
+    t.app = new simple_kv_test_app(t.rep.get());
+    t.add_file("tmp.checkpoint.12");
+    t.add_file("tmp.delta.11.12");
+    t.add_file("delta.10.10");
+    t.add_file("delta.3.5");
+    EXPECT_EQ(6u, t.files().size());
+
+    EXPECT_EQ(0, t.app->open(false));
+    EXPECT_EQ(names({ "checkpoint.10", "delta.10.11" }), t.files());
+    EXPECT_EQ(11, t.app->last_committed_decree());
+    EXPECT_EQ(11, t.app->last_durable_decree());
+    EXPECT_EQ(state, t.app->state());
+
+    // a full checkpoint removes all the older files
+    for (int i = 0; i < 10; i++)
+    {
+        t.app->write("k1", "round" + std::to_string(i));
+        EXPECT_EQ(0, t.app->flush(true));
+    }
+    EXPECT_EQ(names({ "checkpoint.21" }), t.files());
+}